@@ -37,23 +37,48 @@
 #include <stdlib.h>
 #include <sys/time.h>
 #include <sys/select.h>
+#include <sys/socket.h>
 #include <string.h>
+#include <time.h>
 
 #include "cis_log.h"
 #include "cis_api.h"
 #include "cis_if_api_cmcc.h"
 #include "cis_internals.h"
+#include "iotpf_conn.h"
+#include "iotpf_dtls.h"
+#include "iotpf_stats.h"
+#include "iotpf_dlog.h"
+#include "iotpf_pm.h"
+#include "iotpf_queue.h"
+#if CIS_ENABLE_UPDATE
+#include "iotpf_fw.h"
+#endif
 
 
 #if CIS_ONE_MCU
 #define MAX_PACKET_SIZE        (600)
 
+/* Resources listed by a Discover on one sample object */
+
+#define SAMPLE_RES_MAX         (4)
+
+/* "</65535/65535>," for every possible instance, plus the terminator */
+
+#define SAMPLE_REG_LINKS_MAX   (15 * (SAMPLE_A_INSTANCE_COUNT + SAMPLE_B_INSTANCE_COUNT) + 1)
+
+/* RFC 7252 ACK_TIMEOUT; a pump iteration longer than this costs the peer
+ * a retransmission.
+ */
+
+#define SAMPLE_ACK_TIMEOUT_MS  (2000)
+
 static const uint8_t config_hex[] =
 {
   0x13, 0x00, 0x59,
   0xf1, 0x00, 0x03,
   0xf2, 0x00, 0x4b,
-  0x04, 0x00 /*mtu*/, 0x11 /*Link & bind type*/, 0x80 /*BS DTLS ENABLED*/,
+  0x04, 0x00 /*mtu*/, IOTPF_QUEUE_BINDING /*Link & bind type*/, 0x80 /*BS DTLS ENABLED*/,
   0x00, 0x05 /*apn length*/, 0x43, 0x4d, 0x49, 0x4f, 0x54 /*apn: CMIOT*/,
   0x00, 0x00 /*username length*/, /*username*/
   0x00, 0x00 /*password length*/, /*password*/
@@ -69,34 +94,353 @@ static const uint8_t config_hex[] =
   0x00, 0x00 /*userdata length*//*userdata*/	
 };
 
-static struct st_observe_info *g_observeList = NULL;
+/* The built-in server plus up to three from SERVICES_IOTPF_CMCC_SERVERS */
+
+#define SAMPLE_CONTEXT_MAX     (4)
+
+#ifndef CONFIG_SERVICES_IOTPF_CMCC_SERVERS
+#define CONFIG_SERVICES_IOTPF_CMCC_SERVERS ""
+#endif
+
+/* One LwM2M server: its core context, registration and observations. The
+ * sample objects themselves are shared, every server sees the same data.
+ */
+
+typedef struct st_cmcc_context
+{
+  void *context;
+  iotpf_conn_t conn;
+  struct st_observe_info *observeList;
+  struct st_net_packet *packetTail;
+  cis_time_t notifyLast;
+  bool doUnregister;
+  uint8_t index;
+#ifdef CIS_QUEUE_MODE
+  iotpf_queue_t queue;
+#endif
+#ifdef CIS_DTLS_SESSION
+  iotpf_dtls_t dtls;
+#endif
+} st_cmcc_context;
 
-static void *g_cmcc_context;
+static st_cmcc_context g_cmcc[SAMPLE_CONTEXT_MAX];
+static uint8_t g_cmccCount = 0;
 static bool g_shutdown = false;
-static bool g_doUnregister = false;
-static bool g_doRegister = false;
 
-static cis_time_t g_notifyLast = 0;
+static const uint8_t const_InstBitmap_a[] =
+{
+  SAMPLE_A_INSTANCE_BITMAP,
+};
+
+static const uint8_t const_InstBitmap_b[] =
+{
+  SAMPLE_B_INSTANCE_BITMAP,
+};
+
+static const st_sample_object g_objectList[SAMPLE_OBJECT_MAX] =
+{
+  {
+    SAMPLE_OID_A,
+    SAMPLE_A_INSTANCE_COUNT,
+    const_InstBitmap_a,
+    const_AttrIds_a,
+    sizeof(const_AttrIds_a) / sizeof(cis_rid_t),
+    const_ActIds_a,
+    sizeof(const_ActIds_a) / sizeof(cis_rid_t),
+  },
+  {
+    SAMPLE_OID_B,
+    SAMPLE_B_INSTANCE_COUNT,
+    const_InstBitmap_b,
+    const_AttrIds_b,
+    sizeof(const_AttrIds_b) / sizeof(cis_rid_t),
+    const_ActIds_b,
+    sizeof(const_ActIds_b) / sizeof(cis_rid_t),
+  },
+};
 
-static st_sample_object g_objectList[SAMPLE_OBJECT_MAX];
 static st_instance_a g_instList_a[SAMPLE_A_INSTANCE_COUNT];
 static st_instance_b g_instList_b[SAMPLE_B_INSTANCE_COUNT];
 
+/* Pre-built Discover link lists and registration object links */
+
+typedef struct st_link_cache
+{
+  cis_uri_t uris[SAMPLE_RES_MAX];
+  uint16_t count;
+}st_link_cache;
+
+static st_link_cache g_discoverCache[SAMPLE_OBJECT_MAX];
+static char g_regLinks[SAMPLE_REG_LINKS_MAX];
+static uint16_t g_regLinksLen = 0;
+static bool g_linkCacheValid = false;
+
+/* String values of every instance, carved into SAMPLE_x_STR_MAX slots */
+
+static char g_strArena[SAMPLE_A_INSTANCE_COUNT * SAMPLE_A_STR_MAX +
+                       SAMPLE_B_INSTANCE_COUNT * SAMPLE_B_STR_MAX];
+
 static int g_cisapi_pip_fd[2];
 static pthread_t g_cisapi_onenet_tid = -1;
 
+#ifdef CIS_NET_POOL
+#ifndef CIS_NET_POOL_SIZE
+#define CIS_NET_POOL_SIZE      (4)
+#endif
+
+/* One received datagram: the descriptor handed to the library and the
+ * MTU sized buffer recv() writes into live side by side.
+ */
+
+typedef struct st_net_pool_entry
+{
+  struct st_net_packet packet;
+  uint8_t buffer[MAX_PACKET_SIZE];
+}st_net_pool_entry;
+
+static st_net_pool_entry g_netPool[CIS_NET_POOL_SIZE];
+static struct st_net_packet *g_netPoolFree = NULL;
+#endif
+
+static uint32_t g_netPoolExhausted = 0;
+static uint32_t g_pumpStallMax = 0;
+#ifdef CIS_QUEUE_MODE
+static bool g_queueListening = false;
+#endif
+#if CIS_ENABLE_UPDATE && defined(CIS_HAVE_FW_WRITE)
+static bool g_fwImageOk = false;
+#endif
+#if CIS_ENABLE_UPDATE_MCU
+static volatile int g_sotaEraseResult = CIS_RET_ERROR;
+static st_cmcc_context *g_sotaEraseCtx;
+#endif
+
 void cisapi_cmcc_wakeup_pump(void)
 {
   write(g_cisapi_pip_fd[1], "w", 1);
+  IOTPF_STAT_INC(wakeups);
+}
+
+uint32_t cisapi_cmcc_pump_stall_max(void)
+{
+  return g_pumpStallMax;
+}
+
+#if CIS_ENABLE_UPDATE && defined(CIS_HAVE_FW_WRITE)
+int cisapi_cmcc_fw_write(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+  return iotpf_fw_write(offset, data, len);
+}
+#endif
+
+#if CIS_ENABLE_UPDATE_MCU
+/* Erase worker thread: park the result and let the pump report it */
+
+static void prv_sotaEraseDone(int result, void *arg)
+{
+  g_sotaEraseCtx = (st_cmcc_context *)arg;
+  g_sotaEraseResult = result;
+  write(g_cisapi_pip_fd[1], "e", 1);
 }
+#endif
 
 //////////////////////////////////////////////////////////////////////////
 //private funcation;
-static void prv_observeNotify(void *context, cis_uri_t *uri, cis_mid_t mid)
+static st_cmcc_context *prv_cmccContext(void *context)
+{
+  uint8_t i;
+
+  for (i = 0; i < g_cmccCount; i++)
+    {
+      if (g_cmcc[i].context == context)
+        {
+          return &g_cmcc[i];
+        }
+    }
+
+  return NULL;
+}
+
+#ifdef CIS_QUEUE_MODE
+static void prv_queueRequest(void *context)
+{
+  st_cmcc_context *c = prv_cmccContext(context);
+
+  if (c != NULL)
+    {
+      iotpf_queue_downlink(&c->queue, cissys_gettime());
+    }
+}
+
+/* Holds the SoC up while any server may still be sending what it held
+ * for us, and lowers *timeout (ms) to when the first window closes
+ */
+
+static void prv_queueListen(uint32_t *timeout)
+{
+  uint32_t now = cissys_gettime();
+  bool listening = false;
+  uint32_t left;
+  uint8_t i;
+
+  for (i = 0; i < g_cmccCount; i++)
+    {
+      left = iotpf_queue_poll(&g_cmcc[i].queue, now);
+      if (left > 0)
+        {
+          listening = true;
+          if (left < *timeout)
+            {
+              *timeout = left;
+            }
+        }
+    }
+
+  if (listening && !g_queueListening)
+    {
+      iotpf_pm_stay(IOTPF_PM_LISTEN);
+    }
+  else if (!listening && g_queueListening)
+    {
+      iotpf_pm_relax(IOTPF_PM_LISTEN);
+    }
+  g_queueListening = listening;
+}
+#else
+#  define prv_queueRequest(context)
+#endif
+
+/* The confirmable notification of an observe was answered, or given up
+ * on. One at a time per observe is timed, a newer one sent meanwhile
+ * is left out.
+ */
+
+static void prv_notifyAcked(st_cmcc_context *c, cis_listid_t mid, bool ok)
+{
+  struct st_observe_info *node;
+
+  node = (struct st_observe_info *)CIS_LIST_FIND(c->observeList, mid);
+  if (node != NULL && node->notified != 0)
+    {
+      if (ok)
+        {
+          IOTPF_HIST_ADD(notify_ms, cissys_gettime() - node->notified);
+        }
+      node->notified = 0;
+    }
+}
+
+static void prv_observeClear(st_cmcc_context *c)
+{
+  struct st_observe_info *delnode;
+
+  while (c->observeList != NULL)
+    {
+      c->observeList = (struct st_observe_info *)CIS_LIST_RM((cis_list_t *)c->observeList, c->observeList->mid, (cis_list_t **)&delnode);
+      cis_free(delnode);
+    }
+}
+
+static bool prv_instEnabled(const st_sample_object *obj, cis_instcount_t index)
+{
+  return (obj->instBitmap[index / 8] & (0x01 << (7 - (index % 8)))) != 0;
+}
+
+static void prv_storeString(char *str, uint32_t size, const cis_data_t *value)
+{
+  uint32_t length = value->asBuffer.length;
+
+  if (length >= size)
+    {
+      LOGE("string resource %d truncated from %u to %u bytes", value->id, length, size - 1);
+      length = size - 1;
+    }
+  memcpy(str, value->asBuffer.buffer, length);
+  str[length] = '\0';
+}
+
+static uint32_t prv_elapsedUs(const struct timespec *start)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000000 +
+         (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static void prv_invalidateLinkCache(void)
+{
+  g_linkCacheValid = false;
+}
+
+/* Discover answers and the registration object links only depend on the
+ * object definitions and which instances are enabled, so build them once
+ * and rebuild only after prv_invalidateLinkCache().
+ */
+
+static void prv_buildLinkCache(void)
 {
   uint8_t index;
-  st_sample_object *object = NULL;
+  uint16_t i;
+  cis_instcount_t instIndex;
+
+  if (g_linkCacheValid)
+    {
+      return;
+    }
+
+  g_regLinksLen = 0;
+  for (index = 0; index < SAMPLE_OBJECT_MAX; index++)
+    {
+      const st_sample_object *obj = &g_objectList[index];
+      st_link_cache *cache = &g_discoverCache[index];
+
+      cache->count = 0;
+      for (i = 0; i < obj->attrCount + obj->actCount && i < SAMPLE_RES_MAX; i++)
+        {
+          cis_uri_t *linkUri = &cache->uris[cache->count++];
+          linkUri->objectId = URI_INVALID;
+          linkUri->instanceId = URI_INVALID;
+          if (i < obj->attrCount)
+            {
+              linkUri->resourceId = obj->attrListPtr[i];
+            }
+          else
+            {
+              linkUri->resourceId = obj->actListPtr[i - obj->attrCount];
+            }
+          cis_uri_update(linkUri);
+        }
+
+      for (instIndex = 0; instIndex < obj->instCount; instIndex++)
+        {
+          if (prv_instEnabled(obj, instIndex))
+            {
+              g_regLinksLen += snprintf(g_regLinks + g_regLinksLen,
+                                        sizeof(g_regLinks) - g_regLinksLen,
+                                        "%s</%d/%d>", g_regLinksLen ? "," : "",
+                                        obj->oid, instIndex);
+            }
+        }
+    }
+
+  g_linkCacheValid = true;
+}
+
+const char *cisapi_cmcc_object_links(void)
+{
+  prv_buildLinkCache();
+  return g_regLinksLen > 0 ? g_regLinks : NULL;
+}
+
+static void prv_observeNotify(void *context, cis_uri_t *uri, cis_mid_t mid,
+                              bool needAck)
+{
+  uint8_t index;
+  const st_sample_object *object = NULL;
   cis_data_t value;
+
+  IOTPF_STAT_INC(notifies);
   for (index = 0; index < SAMPLE_OBJECT_MAX; index++)
     {
       if (g_objectList[index].oid == uri->objectId)
@@ -125,20 +469,20 @@ static void prv_observeNotify(void *context, cis_uri_t *uri, cis_mid_t mid)
                       uri->instanceId = index;
                       uri->resourceId = attributeA_intValue;
                       cis_uri_update(uri);
-                      cis_notify(context, uri, &tmpdata[0], mid, CIS_NOTIFY_CONTINUE, false);
+                      cis_notify(context, uri, &tmpdata[0], mid, CIS_NOTIFY_CONTINUE, needAck);
                       tmpdata[1].type = cis_data_type_float;
                       tmpdata[1].value.asFloat = inst->instance.floatValue;
                       uri->instanceId = index;
                       uri->resourceId = attributeA_floatValue;
                       cis_uri_update(uri);
-                      cis_notify(context, uri, &tmpdata[1], mid, CIS_NOTIFY_CONTINUE, false);
+                      cis_notify(context, uri, &tmpdata[1], mid, CIS_NOTIFY_CONTINUE, needAck);
                       tmpdata[2].type = cis_data_type_string;
                       tmpdata[2].asBuffer.length = strlen(inst->instance.strValue);
                       tmpdata[2].asBuffer.buffer = (uint8_t*)(inst->instance.strValue);
                       uri->instanceId = index;
                       uri->resourceId = attributeA_stringValue;
                       cis_uri_update(uri);
-                      cis_notify(context, uri, &tmpdata[2], mid, CIS_NOTIFY_CONTENT, false);
+                      cis_notify(context, uri, &tmpdata[2], mid, CIS_NOTIFY_CONTENT, needAck);
                     }
                 }
             }
@@ -156,20 +500,20 @@ static void prv_observeNotify(void *context, cis_uri_t *uri, cis_mid_t mid)
                       uri->instanceId = index;
                       uri->resourceId = attributeB_intValue;
                       cis_uri_update(uri);
-                      cis_notify(context, uri, &tmpdata[0], mid, CIS_NOTIFY_CONTINUE, false);
+                      cis_notify(context, uri, &tmpdata[0], mid, CIS_NOTIFY_CONTINUE, needAck);
                       tmpdata[1].type = cis_data_type_float;
                       tmpdata[1].value.asFloat = inst->instance.floatValue;
                       uri->instanceId = index;
                       uri->resourceId = attributeB_floatValue;
                       cis_uri_update(uri);
-                      cis_notify(context, uri, &tmpdata[1], mid, CIS_NOTIFY_CONTINUE, false);
+                      cis_notify(context, uri, &tmpdata[1], mid, CIS_NOTIFY_CONTINUE, needAck);
                       tmpdata[2].type = cis_data_type_string;
                       tmpdata[2].asBuffer.length = strlen(inst->instance.strValue);
                       tmpdata[2].asBuffer.buffer = (uint8_t*)(inst->instance.strValue);
                       uri->instanceId = index;
                       uri->resourceId = attributeB_stringValue;
                       cis_uri_update(uri);
-                      cis_notify(context, uri, &tmpdata[2], mid, CIS_NOTIFY_CONTENT, false);
+                      cis_notify(context, uri, &tmpdata[2], mid, CIS_NOTIFY_CONTENT, needAck);
                     }
                 }
             }
@@ -213,7 +557,7 @@ static void prv_observeNotify(void *context, cis_uri_t *uri, cis_mid_t mid)
                     {
                       return;
                     }
-                  cis_notify(context, uri, &value, mid, CIS_NOTIFY_CONTENT, false);
+                  cis_notify(context, uri, &value, mid, CIS_NOTIFY_CONTENT, needAck);
                 }
               else
                 {
@@ -222,18 +566,18 @@ static void prv_observeNotify(void *context, cis_uri_t *uri, cis_mid_t mid)
                   tmpdata[0].value.asInteger = inst->instance.intValue;
                   uri->resourceId = attributeA_intValue;
                   cis_uri_update(uri);
-                  cis_notify(context, uri, &tmpdata[0], mid, CIS_NOTIFY_CONTINUE, false);
+                  cis_notify(context, uri, &tmpdata[0], mid, CIS_NOTIFY_CONTINUE, needAck);
                   tmpdata[1].type = cis_data_type_float;
                   tmpdata[1].value.asFloat = inst->instance.floatValue;
                   uri->resourceId = attributeA_floatValue;
                   cis_uri_update(uri);
-                  cis_notify(context, uri, &tmpdata[1], mid, CIS_NOTIFY_CONTINUE, false);
+                  cis_notify(context, uri, &tmpdata[1], mid, CIS_NOTIFY_CONTINUE, needAck);
                   tmpdata[2].type = cis_data_type_string;
                   tmpdata[2].asBuffer.length = strlen(inst->instance.strValue);
                   tmpdata[2].asBuffer.buffer = (uint8_t*)(inst->instance.strValue);
                   uri->resourceId = attributeA_stringValue;
                   cis_uri_update(uri);
-                  cis_notify(context, uri, &tmpdata[2], mid, CIS_NOTIFY_CONTENT, false);
+                  cis_notify(context, uri, &tmpdata[2], mid, CIS_NOTIFY_CONTENT, needAck);
                 }
             }
             break;
@@ -270,7 +614,7 @@ static void prv_observeNotify(void *context, cis_uri_t *uri, cis_mid_t mid)
                     {
                       return;
                     }
-                  cis_notify(context, uri, &value, mid, CIS_NOTIFY_CONTENT, false);
+                  cis_notify(context, uri, &value, mid, CIS_NOTIFY_CONTENT, needAck);
                 }
               else
                 {
@@ -279,18 +623,18 @@ static void prv_observeNotify(void *context, cis_uri_t *uri, cis_mid_t mid)
                   tmpdata[0].value.asInteger = inst->instance.intValue;
                   uri->resourceId = attributeB_intValue;
                   cis_uri_update(uri);
-                  cis_notify(context, uri, &tmpdata[0], mid, CIS_NOTIFY_CONTINUE, false);
+                  cis_notify(context, uri, &tmpdata[0], mid, CIS_NOTIFY_CONTINUE, needAck);
                   tmpdata[1].type = cis_data_type_float;
                   tmpdata[1].value.asFloat = inst->instance.floatValue;
                   uri->resourceId = attributeB_floatValue;
                   cis_uri_update(uri);
-                  cis_notify(context, uri, &tmpdata[1], mid, CIS_NOTIFY_CONTINUE, false);
+                  cis_notify(context, uri, &tmpdata[1], mid, CIS_NOTIFY_CONTINUE, needAck);
                   tmpdata[2].type = cis_data_type_string;
                   tmpdata[2].asBuffer.length = strlen(inst->instance.strValue);
                   tmpdata[2].asBuffer.buffer = (uint8_t*)(inst->instance.strValue);
                   uri->resourceId = attributeB_stringValue;
                   cis_uri_update(uri);
-                  cis_notify(context, uri, &tmpdata[2], mid, CIS_NOTIFY_CONTENT, false);
+                  cis_notify(context, uri, &tmpdata[2], mid, CIS_NOTIFY_CONTENT, needAck);
                 }
             }
             break;
@@ -302,7 +646,7 @@ static void prv_observeNotify(void *context, cis_uri_t *uri, cis_mid_t mid)
 static cis_coapret_t prv_readResponse(void *context, cis_uri_t *uri, cis_mid_t mid)
 {
   uint8_t index;
-  st_sample_object *object = NULL;
+  const st_sample_object *object = NULL;
   cis_data_t value;
   for (index = 0; index < SAMPLE_OBJECT_MAX; index++)
     {
@@ -513,81 +857,40 @@ static cis_coapret_t prv_readResponse(void *context, cis_uri_t *uri, cis_mid_t m
 static cis_coapret_t prv_discoverResponse(void *context, cis_uri_t *uri, cis_mid_t mid)
 {
   uint8_t index;
-  st_sample_object *object = NULL;
+  uint16_t i;
+  const st_link_cache *cache = NULL;
+  struct timespec start;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  prv_buildLinkCache();
 
   for (index = 0; index < SAMPLE_OBJECT_MAX; index++)
     {
       if (g_objectList[index].oid == uri->objectId)
         {
-          object = &g_objectList[index];
+          cache = &g_discoverCache[index];
         }
     }
 
-  if (object == NULL)
+  if (cache == NULL)
     {
       return CIS_RET_ERROR;
     }
 
-  switch (uri->objectId)
+  for (i = 0; i < cache->count; i++)
     {
-      case SAMPLE_OID_A:
-        {
-          uri->objectId = URI_INVALID;
-          uri->instanceId = URI_INVALID;
-          uri->resourceId = attributeA_intValue;
-          cis_uri_update(uri);
-          cis_response(context, uri, NULL, mid, CIS_RESPONSE_CONTINUE);
-          uri->objectId = URI_INVALID;
-          uri->instanceId = URI_INVALID;
-          uri->resourceId = attributeA_floatValue;
-          cis_uri_update(uri);
-          cis_response(context, uri, NULL, mid, CIS_RESPONSE_CONTINUE);
-          uri->objectId = URI_INVALID;
-          uri->instanceId = URI_INVALID;
-          uri->resourceId = attributeA_stringValue;
-          cis_uri_update(uri);
-          cis_response(context, uri, NULL, mid, CIS_RESPONSE_CONTINUE);
-          uri->objectId = URI_INVALID;
-          uri->instanceId = URI_INVALID;
-          uri->resourceId = actionA_1;
-          cis_uri_update(uri);
-          cis_response(context, uri, NULL, mid, CIS_RESPONSE_CONTINUE);
-        }
-        break;
-      case SAMPLE_OID_B:
-        {
-          uri->objectId = URI_INVALID;
-          uri->instanceId = URI_INVALID;
-          uri->resourceId = attributeB_intValue;
-          cis_uri_update(uri);
-          cis_response(context, uri, NULL, mid, CIS_RESPONSE_CONTINUE);
-          uri->objectId = URI_INVALID;
-          uri->instanceId = URI_INVALID;
-          uri->resourceId = attributeB_floatValue;
-          cis_uri_update(uri);
-          cis_response(context, uri, NULL, mid, CIS_RESPONSE_CONTINUE);
-          uri->objectId = URI_INVALID;
-          uri->instanceId = URI_INVALID;
-          uri->resourceId = attributeB_stringValue;
-          cis_uri_update(uri);
-          cis_response(context, uri, NULL, mid, CIS_RESPONSE_CONTINUE);
-          uri->objectId = URI_INVALID;
-          uri->instanceId = URI_INVALID;
-          uri->resourceId = actionB_1;
-          cis_uri_update(uri);
-          cis_response(context, uri, NULL, mid, CIS_RESPONSE_CONTINUE);
-        }
-        break;
+      cis_response(context, &cache->uris[i], NULL, mid, CIS_RESPONSE_CONTINUE);
     }
   cis_response(context, NULL, NULL, mid, CIS_RESPONSE_DISCOVER);
   cisapi_cmcc_wakeup_pump();
+  LOGD("discover %d: %d links in %u us", uri->objectId, cache->count, prv_elapsedUs(&start));
   return CIS_RET_OK;
 }
 
 static cis_coapret_t prv_writeResponse(void *context, cis_uri_t *uri, const cis_data_t *value, cis_attrcount_t count, cis_mid_t mid)
 {
   uint8_t index;
-  st_sample_object *object = NULL;
+  const st_sample_object *object = NULL;
 
   if (!CIS_URI_IS_SET_INSTANCE(uri))
     {
@@ -636,8 +939,7 @@ static cis_coapret_t prv_writeResponse(void *context, cis_uri_t *uri, const cis_
                     break;
                   case  attributeA_stringValue:
                     {
-                      memset(inst->instance.strValue, 0, sizeof(inst->instance.strValue));
-                      strncpy(inst->instance.strValue, (char*)value[i].asBuffer.buffer, value[i].asBuffer.length);
+                      prv_storeString(inst->instance.strValue, SAMPLE_A_STR_MAX, &value[i]);
                     }
                     break;
                 }
@@ -671,8 +973,7 @@ static cis_coapret_t prv_writeResponse(void *context, cis_uri_t *uri, const cis_
                     break;
                   case attributeB_stringValue:
                     {
-                      memset(inst->instance.strValue, 0, sizeof(inst->instance.strValue));
-                      strncpy(inst->instance.strValue, (char*)value[i].asBuffer.buffer, value[i].asBuffer.length);
+                      prv_storeString(inst->instance.strValue, SAMPLE_B_STR_MAX, &value[i]);
                     }
                     break;
                 }
@@ -688,7 +989,7 @@ static cis_coapret_t prv_writeResponse(void *context, cis_uri_t *uri, const cis_
 static cis_coapret_t prv_execResponse(void *context, cis_uri_t *uri, const uint8_t *value, uint32_t length, cis_mid_t mid)
 {
   uint8_t index;
-  st_sample_object *object = NULL;
+  const st_sample_object *object = NULL;
 
   for (index = 0; index < SAMPLE_OBJECT_MAX; index++)
     {
@@ -754,7 +1055,7 @@ static cis_coapret_t prv_execResponse(void *context, cis_uri_t *uri, const uint8
 static cis_coapret_t prv_paramsResponse(void *context, cis_uri_t *uri, cis_observe_attr_t parameters, cis_mid_t mid)
 {
   uint8_t index;
-  st_sample_object* object = NULL;
+  const st_sample_object *object = NULL;
 
   if (!CIS_URI_IS_SET_INSTANCE(uri))
     {
@@ -785,6 +1086,13 @@ static cis_coapret_t prv_paramsResponse(void *context, cis_uri_t *uri, cis_obser
 
 static cis_coapret_t prv_observeResponse(void *context, cis_uri_t *uri, bool flag, cis_mid_t mid)
 {
+  st_cmcc_context *c = prv_cmccContext(context);
+
+  if (c == NULL)
+    {
+      return CIS_RESPONSE_NOT_FOUND;
+    }
+
   if (flag)
     {
       uint16_t count = 0;
@@ -792,18 +1100,20 @@ static cis_coapret_t prv_observeResponse(void *context, cis_uri_t *uri, bool fla
       observe_new->mid = mid;
       observe_new->uri = *uri;
       observe_new->next = NULL;
-      g_observeList = (struct st_observe_info*)cis_list_add((cis_list_t*)g_observeList, (cis_list_t*)observe_new);
+      observe_new->notified = 0;
+      iotpf_rel_init(&observe_new->rel, IOTPF_REL_TELEMETRY);
+      c->observeList = (struct st_observe_info*)cis_list_add((cis_list_t*)c->observeList, (cis_list_t*)observe_new);
 
       LOGD("cis_on_observe set(%d): %d/%d/%d",
         count,
         observe_new->uri.objectId,
         CIS_URI_IS_SET_INSTANCE(&observe_new->uri) ? observe_new->uri.instanceId : -1,
         CIS_URI_IS_SET_RESOURCE(&observe_new->uri) ? observe_new->uri.resourceId : -1);
-      cis_response(g_cmcc_context, NULL, NULL, mid, CIS_RESPONSE_OBSERVE);
+      cis_response(context, NULL, NULL, mid, CIS_RESPONSE_OBSERVE);
     }
   else
     {
-      struct st_observe_info *delnode = g_observeList;
+      struct st_observe_info *delnode = c->observeList;
       while (delnode)
         {
           if (uri->flag == delnode->uri.flag && uri->objectId == delnode->uri.objectId)
@@ -820,14 +1130,14 @@ static cis_coapret_t prv_observeResponse(void *context, cis_uri_t *uri, bool fla
         }
       if (delnode != NULL)
         {
-          g_observeList = (struct st_observe_info *)cis_list_remove((cis_list_t *)g_observeList, delnode->mid, (cis_list_t **)&delnode);
+          c->observeList = (struct st_observe_info *)cis_list_remove((cis_list_t *)c->observeList, delnode->mid, (cis_list_t **)&delnode);
           LOGD("cis_on_observe cancel: %d/%d/%d",
             delnode->uri.objectId,
             CIS_URI_IS_SET_INSTANCE(&delnode->uri) ? delnode->uri.instanceId : -1,
             CIS_URI_IS_SET_RESOURCE(&delnode->uri) ? delnode->uri.resourceId : -1);
 
           cis_free(delnode);
-          cis_response(g_cmcc_context, NULL, NULL, mid, CIS_RESPONSE_OBSERVE);
+          cis_response(context, NULL, NULL, mid, CIS_RESPONSE_OBSERVE);
         }
       else
         {
@@ -840,34 +1150,70 @@ static cis_coapret_t prv_observeResponse(void *context, cis_uri_t *uri, bool fla
 
 static cis_coapret_t cis_api_onRead(void *context, cis_uri_t *uri, cis_mid_t mid)
 {
-  return prv_readResponse(context, uri, mid);
+  uint32_t start = IOTPF_HIST_NOW_US();
+  cis_coapret_t ret;
+
+  prv_queueRequest(context);
+  ret = prv_readResponse(context, uri, mid);
+  IOTPF_HIST_ADD(request_us, IOTPF_HIST_NOW_US() - start);
+  return ret;
 }
 
 static cis_coapret_t cis_api_onDiscover(void *context, cis_uri_t *uri, cis_mid_t mid)
 {
-  return prv_discoverResponse(context, uri, mid);
+  uint32_t start = IOTPF_HIST_NOW_US();
+  cis_coapret_t ret;
+
+  prv_queueRequest(context);
+  ret = prv_discoverResponse(context, uri, mid);
+  IOTPF_HIST_ADD(request_us, IOTPF_HIST_NOW_US() - start);
+  return ret;
 }
 
 static cis_coapret_t cis_api_onWrite(void *context, cis_uri_t *uri, const cis_data_t *value, cis_attrcount_t attrcount, cis_mid_t mid)
 {
-  return prv_writeResponse(context, uri, value, attrcount, mid);
+  uint32_t start = IOTPF_HIST_NOW_US();
+  cis_coapret_t ret;
+
+  prv_queueRequest(context);
+  ret = prv_writeResponse(context, uri, value, attrcount, mid);
+  IOTPF_HIST_ADD(request_us, IOTPF_HIST_NOW_US() - start);
+  return ret;
 }
 
 
 static cis_coapret_t cis_api_onExec(void *context, cis_uri_t *uri, const uint8_t *value, uint32_t length, cis_mid_t mid)
 {
-  return prv_execResponse(context, uri, value, length, mid);
+  uint32_t start = IOTPF_HIST_NOW_US();
+  cis_coapret_t ret;
+
+  prv_queueRequest(context);
+  ret = prv_execResponse(context, uri, value, length, mid);
+  IOTPF_HIST_ADD(request_us, IOTPF_HIST_NOW_US() - start);
+  return ret;
 }
 
 
 static cis_coapret_t cis_api_onObserve(void *context, cis_uri_t *uri, bool flag, cis_mid_t mid)
 {
-  return prv_observeResponse(context, uri, flag, mid);
+  uint32_t start = IOTPF_HIST_NOW_US();
+  cis_coapret_t ret;
+
+  prv_queueRequest(context);
+  ret = prv_observeResponse(context, uri, flag, mid);
+  IOTPF_HIST_ADD(request_us, IOTPF_HIST_NOW_US() - start);
+  return ret;
 }
 
 static cis_coapret_t cis_api_onParams(void *context, cis_uri_t *uri, cis_observe_attr_t parameters, cis_mid_t mid)
 {
-  return prv_paramsResponse(context, uri, parameters, mid);
+  uint32_t start = IOTPF_HIST_NOW_US();
+  cis_coapret_t ret;
+
+  prv_queueRequest(context);
+  ret = prv_paramsResponse(context, uri, parameters, mid);
+  IOTPF_HIST_ADD(request_us, IOTPF_HIST_NOW_US() - start);
+  return ret;
 }
 
 static void cis_api_onEvent(void *context, cis_evt_t eid, void *param)
@@ -875,46 +1221,92 @@ static void cis_api_onEvent(void *context, cis_evt_t eid, void *param)
 #if CIS_ENABLE_CMIOT_OTA || CIS_ENABLE_UPDATE_MCU
   st_context_t *ctx = (st_context_t*)context;
 #endif
+  st_cmcc_context *c = prv_cmccContext(context);
 #if CIS_ENABLE_CMIOT_OTA
   cissys_assert(context != NULL);
 #endif
-  LOGD("cis_on_event(%d):%s", eid, STR_EVENT_CODE(eid));
+  if (c == NULL)
+    {
+      return;
+    }
+  LOGD("cis_on_event[%u](%d):%s", c->index, eid, STR_EVENT_CODE(eid));
+  iotpf_conn_event(&c->conn, eid);
+#ifdef CIS_QUEUE_MODE
+  /* The server sends what it held, and its observes, right after these */
+
+  if (eid == CIS_EVENT_REG_SUCCESS || eid == CIS_EVENT_UPDATE_SUCCESS)
+    {
+      iotpf_queue_uplink(&c->queue, cissys_gettime());
+    }
+#endif
   switch (eid)
     {
+      case CIS_EVENT_CONNECT_FAILED:
+      case CIS_EVENT_REG_FAILED:
+      case CIS_EVENT_REG_TIMEOUT:
+      case CIS_EVENT_UPDATE_FAILED:
+      case CIS_EVENT_UPDATE_TIMEOUT:
+        LOGD("cis_on_event %s, state:%s", STR_EVENT_CODE(eid), iotpf_conn_state_str(c->conn.state));
+        c->doUnregister = true;
+        break;
       case CIS_EVENT_RESPONSE_FAILED:
-        LOGD("cis_on_event response failed mid:%d", (int32_t)param);
+        LOGD("cis_on_event response failed mid:%d", (int32_t)(intptr_t)param);
+        IOTPF_STAT_INC(response_failed);
         break;
       case CIS_EVENT_NOTIFY_FAILED:
-        LOGD("cis_on_event notify failed mid:%d", (int32_t)param);
+        LOGD("cis_on_event notify failed mid:%d", (int32_t)(intptr_t)param);
+        IOTPF_STAT_INC(notify_failed);
+        prv_notifyAcked(c, (cis_listid_t)(intptr_t)param, false);
+        break;
+      case CIS_EVENT_NOTIFY_SUCCESS:
+        IOTPF_STAT_INC(notify_acked);
+        prv_notifyAcked(c, (cis_listid_t)(intptr_t)param, true);
         break;
       case CIS_EVENT_UPDATE_NEED:
-        LOGD("cis_on_event need to update,reserve time:%ds\n", (int32_t)param);
-        cis_update_reg(g_cmcc_context, LIFETIME_INVALID, false);
+        LOGD("cis_on_event need to update,reserve time:%ds\n",
+             (int32_t)(intptr_t)param);
+        cis_update_reg(context, LIFETIME_INVALID, false);
         break;
       case CIS_EVENT_REG_SUCCESS:
-        {
-          struct st_observe_info* delnode;
-          while (g_observeList != NULL)
-            {
-              g_observeList = (struct st_observe_info *)CIS_LIST_RM((cis_list_t *)g_observeList, g_observeList->mid, (cis_list_t **)&delnode);
-              cis_free(delnode);
-            }
-        }
+        prv_observeClear(c);
+#ifdef CIS_DTLS_SESSION
+        iotpf_dtls_registered(&c->dtls, context);
+#endif
         break;
     #if CIS_ENABLE_UPDATE
       case CIS_EVENT_FIRMWARE_DOWNLOADING:
         LOGD("FIRMWARE_DOWNLOADING");
+#ifdef CIS_HAVE_FW_WRITE
+        g_fwImageOk = false;
+        if (iotpf_fw_begin(true) < 0)
+          {
+            LOGE("FIRMWARE_DOWNLOADING: slot not writable");
+          }
+#endif
         break;
       case CIS_EVENT_FIRMWARE_DOWNLOAD_FAILED:
         LOGD("FIRMWARE_DOWNFAILED");
+#ifdef CIS_HAVE_FW_WRITE
+        iotpf_fw_abort(true);
+#endif
         break;
       case CIS_EVENT_FIRMWARE_DOWNLOADED:
         LOGD("FIRMWARE_DOWNLOADED:");
+#ifdef CIS_HAVE_FW_WRITE
+        g_fwImageOk = iotpf_fw_finish(NULL) == CIS_RET_OK;
+#endif
         break;
       case CIS_EVENT_FIRMWARE_UPDATING:
         LOGD("FIRMWARE_UPDATING:");
         break;
       case CIS_EVENT_FIRMWARE_TRIGGER:
+#ifdef CIS_HAVE_FW_WRITE
+        if (!g_fwImageOk)
+          {
+            LOGE("firmware failed verification, keeping the running image");
+            break;
+          }
+#endif
         LOGD("please update the firmware");
         break;
     #if CIS_ENABLE_UPDATE_MCU
@@ -926,8 +1318,11 @@ static void cis_api_onEvent(void *context, cis_evt_t eid, void *param)
         break;
       case CIS_EVENT_SOTA_FLASHERASE:
         LOGD("SOTA_FLASHERASE:");
-        cissys_sleepms(2000);
-        cis_notify_sota_result(ctx, sota_erase_success);
+        if (iotpf_fw_erase_async(prv_sotaEraseDone, c) != CIS_RET_OK)
+          {
+            LOGE("SOTA_FLASHERASE: erase not started");
+            cis_notify_sota_result(context, sota_erase_fail);
+          }
         break;
       case CIS_EVENT_SOTA_UPDATING:
         cis_set_sota_info( "1801102", 500);
@@ -937,7 +1332,7 @@ static void cis_api_onEvent(void *context, cis_evt_t eid, void *param)
     #endif
     #if CIS_ENABLE_CMIOT_OTA
       case CIS_EVENT_CMIOT_OTA_START:
-        LOGD("cis_on_event CMIOT OTA start:%d", (int32_t)param);
+        LOGD("cis_on_event CMIOT OTA start:%d", (int32_t)(intptr_t)param);
         if (ctx->cmiotOtaState == CMIOT_OTA_STATE_IDIL)
           {
             ctx->cmiotOtaState = CMIOT_OTA_STATE_START;
@@ -949,7 +1344,7 @@ static void cis_api_onEvent(void *context, cis_evt_t eid, void *param)
       case CIS_EVENT_CMIOT_OTA_SUCCESS:
         if (ctx->cmiotOtaState == CMIOT_OTA_STATE_START)
           {
-            LOGD("cis_on_event CMIOT OTA success %d", (int32_t)param);
+            LOGD("cis_on_event CMIOT OTA success %d", (int32_t)(intptr_t)param);
             ctx->cmiotOtaState = CMIOT_OTA_STATE_IDIL;
             cissys_recover_psm();
           }
@@ -958,7 +1353,7 @@ static void cis_api_onEvent(void *context, cis_evt_t eid, void *param)
         if (ctx->cmiotOtaState == CMIOT_OTA_STATE_START)
           {
             ctx->cmiotOtaState = CMIOT_OTA_STATE_IDIL;
-            LOGD("cis_on_event CMIOT OTA fail %d", (int32_t)param);
+            LOGD("cis_on_event CMIOT OTA fail %d", (int32_t)(intptr_t)param);
             cissys_recover_psm();
           }
         break;
@@ -996,95 +1391,243 @@ static void cis_api_onEvent(void *context, cis_evt_t eid, void *param)
 
 static void prv_make_sample_data(void)
 {
-  int i = 0;
   cis_instcount_t instIndex;
-  cis_instcount_t instCount;
-  for (i = 0; i < SAMPLE_OBJECT_MAX; i++)
+  char *str = g_strArena;
+
+  for (instIndex = 0; instIndex < SAMPLE_A_INSTANCE_COUNT; instIndex++)
     {
-      st_sample_object *obj = &g_objectList[i];
-      switch (i)
+      st_instance_a *inst = &g_instList_a[instIndex];
+      inst->instId = instIndex;
+      inst->instance.strValue = str;
+      str += SAMPLE_A_STR_MAX;
+      inst->enabled = prv_instEnabled(&g_objectList[0], instIndex);
+      if (inst->enabled)
         {
-          case 0:
+          inst->instance.floatValue = cissys_rand() * 10.0 / 0xFFFFFFFF;
+          inst->instance.intValue = 666;
+          strncpy(inst->instance.strValue, "hello onenet", SAMPLE_A_STR_MAX - 1);
+        }
+    }
+
+  for (instIndex = 0; instIndex < SAMPLE_B_INSTANCE_COUNT; instIndex++)
+    {
+      st_instance_b *inst = &g_instList_b[instIndex];
+      inst->instId = instIndex;
+      inst->instance.strValue = str;
+      str += SAMPLE_B_STR_MAX;
+      inst->enabled = prv_instEnabled(&g_objectList[1], instIndex);
+      if (inst->enabled)
+        {
+          inst->instance.boolValue = true;
+          inst->instance.floatValue = cissys_rand() * 10.0 / 0xFFFFFFFF;
+          inst->instance.intValue = 555;
+          strncpy(inst->instance.strValue, "test", SAMPLE_B_STR_MAX - 1);
+        }
+    }
+
+  prv_invalidateLinkCache();
+}
+
+#ifdef CIS_NET_POOL
+static void prv_net_pool_init(void)
+{
+  int i;
+
+  g_netPoolFree = NULL;
+  for (i = CIS_NET_POOL_SIZE - 1; i >= 0; i--)
+    {
+      g_netPool[i].packet.buffer = g_netPool[i].buffer;
+      g_netPool[i].packet.next = g_netPoolFree;
+      g_netPoolFree = &g_netPool[i].packet;
+    }
+}
+
+bool cisapi_cmcc_packet_pooled(const void *ptr)
+{
+  const uint8_t *p = (const uint8_t *)ptr;
+
+  return p >= (const uint8_t *)&g_netPool[0] &&
+         p < (const uint8_t *)&g_netPool[CIS_NET_POOL_SIZE];
+}
+
+void cisapi_cmcc_packet_release(const void *ptr)
+{
+  st_net_pool_entry *entry;
+
+  if (!cisapi_cmcc_packet_pooled(ptr))
+    {
+      return;
+    }
+
+  entry = &g_netPool[((const uint8_t *)ptr - (const uint8_t *)g_netPool) /
+                     sizeof(st_net_pool_entry)];
+  entry->packet.next = g_netPoolFree;
+  g_netPoolFree = &entry->packet;
+}
+#endif
+
+uint32_t cisapi_cmcc_netpool_exhausted(void)
+{
+  return g_netPoolExhausted;
+}
+
+static void prv_net_enqueue(st_cmcc_context *c, struct st_net_packet *packet)
+{
+  st_context_t *ctx = (st_context_t *)c->context;
+
+  /* The library only ever pops from the head, so once the list runs
+   * empty our tail pointer is stale and must not be followed.
+   */
+
+  packet->next = NULL;
+  if (ctx->pNetContext->g_packetlist == NULL)
+    {
+      ctx->pNetContext->g_packetlist = packet;
+    }
+  else
+    {
+      c->packetTail->next = packet;
+    }
+  c->packetTail = packet;
+}
+
+static void prv_net_drain(st_cmcc_context *c, int netFd)
+{
+  struct st_net_packet *packet;
+  int numBytes;
+
+  while (1)
+    {
+#ifdef CIS_NET_POOL
+      packet = g_netPoolFree;
+      if (packet == NULL)
+        {
+          uint8_t peek;
+
+          /* Left in the socket, prv_contextWatch() stops watching it */
+
+          if (recv(netFd, (char*)&peek, 1, MSG_PEEK | MSG_DONTWAIT) > 0)
             {
-              obj->oid = SAMPLE_OID_A;
-              obj->instBitmap = SAMPLE_A_INSTANCE_BITMAP;
-              instCount = SAMPLE_A_INSTANCE_COUNT;
-              for (instIndex = 0; instIndex < instCount; instIndex++)
-                {
-                  if (obj->instBitmap[instIndex] != '1')
-                    {
-                      g_instList_a[instIndex].instId = instIndex;
-                      g_instList_a[instIndex].enabled = false;
-                    }
-                  else
-                    {
-                      g_instList_a[instIndex].instId = instIndex;
-                      g_instList_a[instIndex].enabled = true;
-                      g_instList_a[instIndex].instance.floatValue = cissys_rand() * 10.0 / 0xFFFFFFFF;
-                      g_instList_a[instIndex].instance.intValue = 666;
-                      strcpy(g_instList_a[instIndex].instance.strValue, "hello onenet");
-                    }
-                }
-              obj->attrCount = sizeof(const_AttrIds_a) / sizeof(cis_rid_t);
-              obj->attrListPtr = const_AttrIds_a;
-              obj->actCount = sizeof(const_ActIds_a) / sizeof(cis_rid_t);
-              obj->actListPtr = const_ActIds_a;
+              g_netPoolExhausted++;
+              IOTPF_STAT_INC(net_pool_exhausted);
+              DLOGW("net pool exhausted, datagram left in the socket (%u)",
+                    g_netPoolExhausted);
             }
-            break;
-          case 1:
+          break;
+        }
+      numBytes = recv(netFd, (char*)packet->buffer, MAX_PACKET_SIZE, MSG_DONTWAIT);
+#else
+      uint8_t buffer[MAX_PACKET_SIZE];
+      numBytes = recv(netFd, (char*)buffer, MAX_PACKET_SIZE, MSG_DONTWAIT);
+#endif
+      if (numBytes < 0)
+        {
+          if (errno != EAGAIN && errno != EWOULDBLOCK)
             {
-              obj->oid = SAMPLE_OID_B;
-              obj->instBitmap = SAMPLE_B_INSTANCE_BITMAP;
-              instCount = SAMPLE_B_INSTANCE_COUNT;
-              for (instIndex = 0; instIndex < instCount; instIndex++)
-                {
-                  if (obj->instBitmap[instIndex] != '1')
-                    {
-                      g_instList_b[instIndex].instId = instIndex;
-                      g_instList_b[instIndex].enabled = false;
-                    }
-                  else
-                    {
-                      g_instList_b[instIndex].instId = instIndex;
-                      g_instList_b[instIndex].enabled = true;
-                      g_instList_b[instIndex].instance.boolValue = true;
-                      g_instList_b[instIndex].instance.floatValue = cissys_rand() * 10.0 / 0xFFFFFFFF;
-                      g_instList_b[instIndex].instance.intValue = 555;
-                      strcpy(g_instList_b[instIndex].instance.strValue, "test");
-                    }
-                }
-              obj->attrCount = sizeof(const_AttrIds_b) / sizeof(cis_rid_t);
-              obj->attrListPtr = const_AttrIds_b;
-              obj->actCount = sizeof(const_ActIds_b) / sizeof(cis_rid_t);
-              obj->actListPtr = const_ActIds_b;
+              LOGE("Error in recvfrom(): %d %s", errno, strerror(errno));
             }
-            break;
+          break;
         }
+      else if (numBytes == 0)
+        {
+          break;
+        }
+
+      DLOGI("[prv_net_drain]received %d bytes", numBytes);
+      IOTPF_STAT_INC(rx_datagrams);
+      IOTPF_STAT_ADD(rx_bytes, numBytes);
+#ifdef CIS_NET_POOL
+      g_netPoolFree = packet->next;
+#else
+      packet = (struct st_net_packet*)cis_malloc(sizeof(struct st_net_packet));
+      packet->buffer = (uint8_t*)cis_malloc(numBytes);
+      cis_memcpy(packet->buffer, buffer, numBytes);
+#endif
+      packet->length = numBytes;
+      prv_net_enqueue(c, packet);
     }
 }
 
-int cisapi_sample_entry(const uint8_t *config_bin, uint32_t config_size)
+/* Copy of the config blob with its server host replaced. The blob is a 3
+ * byte header (tag, big endian total length) followed by sections with the
+ * same header; the f2 section holds 4 fixed bytes then the length prefixed
+ * apn, username, password, host and userdata strings.
+ */
+
+static uint32_t prv_configWithHost(const uint8_t *config_bin, uint32_t config_size,
+                                   const char *host, uint8_t *out, uint32_t outsize)
 {
-  int index = 0;
-  cis_callback_t callback;
-  callback.onRead = cis_api_onRead;
-  callback.onWrite = cis_api_onWrite;
-  callback.onExec = cis_api_onExec;
-  callback.onObserve = cis_api_onObserve;
-  callback.onSetParams = cis_api_onParams;
-  callback.onEvent = cis_api_onEvent;
-  callback.onDiscover = cis_api_onDiscover;
+  uint32_t hostLen = strlen(host);
+  uint32_t offset = 3;
 
-  cis_time_t g_lifetime = 720;
-  /*init sample data*/
-  prv_make_sample_data();
-  if (cis_init(&g_cmcc_context, (void *)config_bin, config_size) != CIS_RET_OK)
+  while (offset + 3 <= config_size)
     {
-      if (g_cmcc_context != NULL)
+      uint32_t sectLen = (config_bin[offset + 1] << 8) | config_bin[offset + 2];
+      uint32_t field = offset + 3 + 4;
+      uint32_t oldLen;
+      uint32_t size;
+      uint8_t i;
+
+      if (sectLen < 3 || offset + sectLen > config_size)
         {
-          cis_deinit(&g_cmcc_context);
+          return 0;
+        }
+      if (config_bin[offset] != 0xf2)
+        {
+          offset += sectLen;
+          continue;
+        }
+
+      /* Skip apn, username and password */
+
+      for (i = 0; i < 3; i++)
+        {
+          field += 2 + ((config_bin[field] << 8) | config_bin[field + 1]);
+        }
+      oldLen = (config_bin[field] << 8) | config_bin[field + 1];
+      size = config_size - oldLen + hostLen;
+      if (field + 2 + oldLen > offset + sectLen || size > outsize || size > 0xffff)
+        {
+          return 0;
+        }
+
+      memcpy(out, config_bin, field);
+      out[field] = hostLen >> 8;
+      out[field + 1] = hostLen & 0xff;
+      memcpy(out + field + 2, host, hostLen);
+      memcpy(out + field + 2 + hostLen, config_bin + field + 2 + oldLen,
+             config_size - field - 2 - oldLen);
+
+      out[1] = size >> 8;
+      out[2] = size & 0xff;
+      sectLen = sectLen - oldLen + hostLen;
+      out[offset + 1] = sectLen >> 8;
+      out[offset + 2] = sectLen & 0xff;
+      return size;
+    }
+
+  return 0;
+}
+
+static int prv_contextAdd(const uint8_t *config_bin, uint32_t config_size)
+{
+  st_cmcc_context *c;
+  int index;
+
+  if (g_cmccCount >= SAMPLE_CONTEXT_MAX)
+    {
+      return -1;
+    }
+
+  c = &g_cmcc[g_cmccCount];
+  memset(c, 0, sizeof(*c));
+  c->index = g_cmccCount;
+  if (cis_init(&c->context, (void *)config_bin, config_size) != CIS_RET_OK)
+    {
+      if (c->context != NULL)
+        {
+          cis_deinit(&c->context);
         }
-      LOGE("cis entry init failed.");
       return -1;
     }
 
@@ -1092,99 +1635,285 @@ int cisapi_sample_entry(const uint8_t *config_bin, uint32_t config_size)
     {
       cis_inst_bitmap_t bitmap;
       cis_res_count_t rescount;
-      cis_instcount_t instCount, instBytes;
-      const char *instAsciiPtr;
-      uint8_t *instPtr;
-      cis_oid_t oid;
-      int16_t i;
-      st_sample_object* obj = &g_objectList[index];
-
-      oid = obj->oid;
-      instCount = utils_strlen(obj->instBitmap);
-      instBytes = (instCount - 1) / 8 + 1;
-      instAsciiPtr = obj->instBitmap;
-      instPtr = (uint8_t*)cis_malloc(instBytes);
-      cissys_assert(instPtr != NULL);
-      cis_memset(instPtr, 0, instBytes);
-
-      for (i = 0; i < instCount; i++)
+      const st_sample_object *obj = &g_objectList[index];
+
+      bitmap.instanceCount = obj->instCount;
+      bitmap.instanceBitmap = obj->instBitmap;
+      bitmap.instanceBytes = (obj->instCount - 1) / 8 + 1;
+
+      rescount.attrCount = obj->attrCount;
+      rescount.actCount = obj->actCount;
+
+      cis_addobject(c->context, obj->oid, &bitmap, &rescount);
+    }
+
+  //register enabled
+  iotpf_conn_init(&c->conn);
+#ifdef CIS_QUEUE_MODE
+  iotpf_queue_init(&c->queue);
+#endif
+#ifdef CIS_DTLS_SESSION
+  iotpf_dtls_init(&c->dtls, c->index);
+#endif
+  g_cmccCount++;
+  return 0;
+}
+
+static void prv_contextRemove(st_cmcc_context *c)
+{
+  cis_deinit(&c->context);
+  prv_observeClear(c);
+
+  /* Drops the IOTPF_PM_EXCHANGE vote of an operation left in flight */
+
+  iotpf_conn_init(&c->conn);
+}
+
+/* SERVICES_IOTPF_CMCC_SERVERS: "host:port[,host:port...]" added after the
+ * server built into config_bin.
+ */
+
+static void prv_contextAddServers(const uint8_t *config_bin, uint32_t config_size)
+{
+  const char *servers = CONFIG_SERVICES_IOTPF_CMCC_SERVERS;
+
+  while (*servers != '\0' && g_cmccCount < SAMPLE_CONTEXT_MAX)
+    {
+      uint8_t config[256];
+      char host[64];
+      uint32_t len = strcspn(servers, ",");
+      uint32_t size;
+
+      if (len > 0 && len < sizeof(host))
         {
-          cis_instcount_t instBytePos = i / 8;
-          cis_instcount_t instByteOffset = 7 - (i % 8);
-          if (instAsciiPtr[i] == '1')
+          memcpy(host, servers, len);
+          host[len] = '\0';
+          size = prv_configWithHost(config_bin, config_size, host,
+                                    config, sizeof(config));
+          if (size == 0 || prv_contextAdd(config, size) < 0)
             {
-              instPtr[instBytePos] += 0x01 << instByteOffset;
+              LOGE("cis context for %s failed.", host);
+            }
+          else
+            {
+              LOGI("cis context %u: %s", g_cmccCount - 1, host);
             }
         }
-      bitmap.instanceCount = instCount;
-      bitmap.instanceBitmap = instPtr;
-      bitmap.instanceBytes = instBytes;
 
-      rescount.attrCount = obj->attrCount;
-      rescount.actCount = obj->actCount;
+      servers += len;
+      if (*servers == ',')
+        {
+          servers++;
+        }
+    }
+}
+
+/* Everything one context needs done before the loop sleeps. Lowers
+ * *timeout (ms) to when it wants to run next, 0 to not sleep at all.
+ */
+
+static void prv_contextPoll(st_cmcc_context *c, cis_callback_t *callback,
+                                cis_time_t lifetime, uint32_t *timeout)
+{
+  uint32_t connTimeout;
+  time_t pumpSleep = 60;
+  uint32_t result;
+
+  if (iotpf_conn_due(&c->conn))
+    {
+#ifdef CIS_DTLS_SESSION
+      iotpf_dtls_register(&c->dtls, c->context);
+#endif
+      cis_register(c->context, lifetime, callback);
+    }
+  if (c->doUnregister)
+    {
+      c->doUnregister = false;
+      cis_unregister(c->context);
+      prv_observeClear(c);
+      if (c->conn.state != IOTPF_CONN_BACKOFF)
+        {
+          iotpf_conn_backoff(&c->conn);
+        }
+    }
+
+  result = cis_pump(c->context, &pumpSleep);
+  DLOGD("cis_pump[%u] result:%d,%d", c->index, result, (int)pumpSleep);
+  if (result == PUMP_RET_NOSLEEP)
+    {
+      *timeout = 0;
+    }
+  else
+    {
+      if (pumpSleep * 1000 < *timeout)
+        {
+          *timeout = pumpSleep * 1000;
+        }
+      connTimeout = iotpf_conn_timeout(&c->conn);
+      if (connTimeout < *timeout)
+        {
+          *timeout = connTimeout;
+        }
+    }
+}
+
+/* Adds the socket of a context to the select() set. With the packet
+ * pool empty none is: datagrams wait in the socket until the pump has
+ * handed some packets back, instead of being read and dropped.
+ */
+
+static void prv_contextWatch(st_cmcc_context *c, fd_set *readfds, int *maxfd)
+{
+  st_context_t *ctx = (st_context_t *)c->context;
+
+#ifdef CIS_NET_POOL
+  if (g_netPoolFree == NULL)
+    {
+      return;
+    }
+#endif
+  if (ctx->pNetContext && ctx->pNetContext->sock > 0)
+    {
+      DLOGD("cisapi_sample_entry[%u] net sock:%d", c->index, ctx->pNetContext->sock);
+      FD_SET(ctx->pNetContext->sock, readfds);
+      if (ctx->pNetContext->sock > *maxfd)
+        {
+          *maxfd = ctx->pNetContext->sock;
+        }
+    }
+}
+
+static void prv_contextNotify(st_cmcc_context *c, uint32_t nowtime)
+{
+  struct st_observe_info *node;
+#ifdef CIS_QUEUE_MODE
+  bool sent = false;
+#endif
+
+  /*data observe data report*/
+  if (nowtime - c->notifyLast <= 60 * 1000)
+    {
+      return;
+    }
+
+  c->notifyLast = nowtime;
+  for (node = c->observeList; node != NULL; node = node->next)
+    {
+      cis_uri_t uriLocal;
+      bool needAck;
+
+      if (node->mid == 0 || node->uri.flag == 0)
+        {
+          continue;
+        }
+      uriLocal = node->uri;
+      needAck = iotpf_rel_confirm(&node->rel, IOTPF_REL_TELEMETRY);
+      if (needAck && node->notified == 0)
+        {
+          node->notified = nowtime;
+        }
+      prv_observeNotify(c->context, &uriLocal, node->mid, needAck);
+#ifdef CIS_QUEUE_MODE
+      sent = true;
+#endif
+    }
+
+#ifdef CIS_QUEUE_MODE
+  if (sent)
+    {
+      iotpf_queue_uplink(&c->queue, nowtime);
+    }
+#endif
+}
+
+int cisapi_sample_entry(const uint8_t *config_bin, uint32_t config_size)
+{
+  cis_callback_t callback;
+  uint8_t i;
+  callback.onRead = cis_api_onRead;
+  callback.onWrite = cis_api_onWrite;
+  callback.onExec = cis_api_onExec;
+  callback.onObserve = cis_api_onObserve;
+  callback.onSetParams = cis_api_onParams;
+  callback.onEvent = cis_api_onEvent;
+  callback.onDiscover = cis_api_onDiscover;
 
-      cis_addobject(g_cmcc_context, oid, &bitmap, &rescount);
-      cis_free(instPtr);
+  cis_time_t g_lifetime = 720;
+  /*init sample data*/
+  prv_make_sample_data();
+#ifdef CIS_NET_POOL
+  prv_net_pool_init();
+#endif
+  g_cmccCount = 0;
+  if (prv_contextAdd(config_bin, config_size) < 0)
+    {
+      LOGE("cis entry init failed.");
+      return -1;
     }
+  prv_contextAddServers(config_bin, config_size);
 
   g_shutdown = false;
-  g_doUnregister = false;
 
-  //register enabled
-  g_doRegister = true;
+  /* One loop, one select() for every context: each one is polled for due
+   * registrations and pumped, the loop sleeps until the earliest of them
+   * has something to do and hands every readable socket to its owner.
+   */
 
+  iotpf_pm_stay(IOTPF_PM_PUMP);
   while (!g_shutdown)
     {
       struct timeval tv;
       fd_set readfds;
       int result;
-      int netFd = -1;
       int maxfd = 0;
-      st_context_t *ctx = (st_context_t *)g_cmcc_context;
-      tv.tv_sec = 60;
-      tv.tv_usec = 0;
-      {
-        if (g_doRegister)
-          {
-            g_doRegister = false;
-            cis_register(g_cmcc_context, g_lifetime, &callback);
-          }
-        if (g_doUnregister)
-          {
-            g_doUnregister = false;
-            cis_unregister(g_cmcc_context);
-            struct st_observe_info* delnode;
-            while (g_observeList != NULL)
-              {
-                g_observeList = (struct st_observe_info *)CIS_LIST_RM((cis_list_t *)g_observeList, g_observeList->mid, (cis_list_t **)&delnode);
-                cis_free(delnode);
-              }
-            cissys_sleepms(1000);
-            g_doRegister = 1;
-          }
-      }
+      uint32_t timeout = 60 * 1000;
+      uint32_t busyStart = cissys_gettime();
+      uint32_t busyUs = IOTPF_HIST_NOW_US();
+      uint32_t busy;
+      uint32_t pumpUs;
 
+      IOTPF_STAT_INC(pump_loops);
       FD_ZERO(&readfds);
       FD_SET(g_cisapi_pip_fd[0], &readfds);
       maxfd = g_cisapi_pip_fd[0];
-      if (ctx->pNetContext && ctx->pNetContext->sock > 0)
+      for (i = 0; i < g_cmccCount; i++)
         {
-          LOGE("cisapi_sample_entry net sock:%d", ctx->pNetContext->sock);
-          FD_SET(ctx->pNetContext->sock, &readfds);
-          netFd = ctx->pNetContext->sock;
-          if (ctx->pNetContext->sock > maxfd)
-            {
-              maxfd = ctx->pNetContext->sock;
-            }
+          prv_contextPoll(&g_cmcc[i], &callback, g_lifetime, &timeout);
+        }
+      for (i = 0; i < g_cmccCount; i++)
+        {
+          prv_contextWatch(&g_cmcc[i], &readfds, &maxfd);
         }
-      result = cis_pump(g_cmcc_context, &tv.tv_sec);
-      LOGD("cis_pump result:%d,%d", result, tv.tv_sec);
-      if (result == PUMP_RET_NOSLEEP)
+#ifdef CIS_QUEUE_MODE
+      prv_queueListen(&timeout);
+#endif
+      if (timeout == 0)
         {
           tv.tv_sec = 0;
           tv.tv_usec = 1;
         }
-      result = select(maxfd + 1, &readfds, NULL, NULL, &tv);
+      else
+        {
+          tv.tv_sec = timeout / 1000;
+          tv.tv_usec = (timeout % 1000) * 1000;
+        }
+      busy = cissys_gettime() - busyStart;
+      pumpUs = IOTPF_HIST_NOW_US() - busyUs;
+
+      /* Nothing due before the timeout: let the SoC sleep through it */
+
+      if (timeout > 0)
+        {
+          iotpf_pm_relax(IOTPF_PM_PUMP);
+          result = select(maxfd + 1, &readfds, NULL, NULL, &tv);
+          iotpf_pm_stay(IOTPF_PM_PUMP);
+        }
+      else
+        {
+          result = select(maxfd + 1, &readfds, NULL, NULL, &tv);
+        }
+      busyStart = cissys_gettime();
+      busyUs = IOTPF_HIST_NOW_US();
       if (result < 0)
         {
           LOGE("select error: %d %s", errno, strerror(errno));
@@ -1200,61 +1929,69 @@ int cisapi_sample_entry(const uint8_t *config_bin, uint32_t config_size)
                   LOGE("!!!!!!!!cisapi_onenet_thread quit");
                   break;
                 }
-            }
-          if (netFd > 0 && FD_ISSET(netFd, &readfds))
-            {
-              uint8_t buffer[MAX_PACKET_SIZE];
-              int numBytes;
-              numBytes = recv(netFd, (char*)buffer, MAX_PACKET_SIZE, 0);
-              if (numBytes < 0)
+#if CIS_ENABLE_UPDATE_MCU
+              if (c[0] == 'e' && g_sotaEraseCtx != NULL)
                 {
-                  LOGE("Error in recvfrom(): %d %s", errno, strerror(errno));
+                  if (g_sotaEraseResult == CIS_RET_OK)
+                    {
+                      cis_notify_sota_result(g_sotaEraseCtx->context, sota_erase_success);
+                    }
+                  else
+                    {
+                      LOGE("SOTA_FLASHERASE: erase failed");
+                      cis_notify_sota_result(g_sotaEraseCtx->context, sota_erase_fail);
+                    }
                 }
-              else if (numBytes > 0)
+#endif
+            }
+          for (i = 0; i < g_cmccCount; i++)
+            {
+              st_context_t *ctx = (st_context_t *)g_cmcc[i].context;
+
+              if (ctx->pNetContext && ctx->pNetContext->sock > 0 &&
+                  FD_ISSET(ctx->pNetContext->sock, &readfds))
                 {
-                  LOGI("[%s]received %d bytes", __func__, numBytes);
-                  uint8_t* data = (uint8_t*)cis_malloc(numBytes);
-                  cis_memcpy(data,buffer,numBytes);
-                  struct st_net_packet *packet = (struct st_net_packet*)cis_malloc(sizeof(struct st_net_packet));
-                  packet->next = NULL;
-                  packet->buffer = data;
-                  packet->length = numBytes;
-                  ctx->pNetContext->g_packetlist = (struct st_net_packet*)CIS_LIST_ADD(ctx->pNetContext->g_packetlist, packet);
+                  prv_net_drain(&g_cmcc[i], ctx->pNetContext->sock);
                 }
             }
         }
-      uint32_t nowtime;
-      /*data observe data report*/
-      nowtime = cissys_gettime();
-      struct st_observe_info *node = g_observeList;
-      if (nowtime - g_notifyLast > 60 * 1000)
+
+      for (i = 0; i < g_cmccCount; i++)
         {
-          g_notifyLast = nowtime;
-          while (node != NULL)
+          prv_contextNotify(&g_cmcc[i], cissys_gettime());
+        }
+
+      /* Time this iteration kept the pump away from the sockets */
+
+      busy += cissys_gettime() - busyStart;
+      IOTPF_HIST_ADD(pump_us, pumpUs + IOTPF_HIST_NOW_US() - busyUs);
+      if (busy > g_pumpStallMax)
+        {
+          g_pumpStallMax = busy;
+          if (busy >= SAMPLE_ACK_TIMEOUT_MS)
             {
-              if (node->mid == 0)
-                {
-                  continue;
-                }
-              if (node->uri.flag == 0)
-                {
-                  continue;
-                }
-              cis_uri_t uriLocal;
-              uriLocal = node->uri;
-              prv_observeNotify(g_cmcc_context, &uriLocal, node->mid);
-              node = node->next;
+              LOGE("pump stalled %u ms, over the CoAP ACK timeout", busy);
+            }
+          else
+            {
+              LOGI("pump stall max %u ms", busy);
             }
         }
     }
+  iotpf_pm_relax(IOTPF_PM_PUMP);
+#ifdef CIS_QUEUE_MODE
+  if (g_queueListening)
+    {
+      g_queueListening = false;
+      iotpf_pm_relax(IOTPF_PM_LISTEN);
+    }
+#endif
 
-  cis_deinit(&g_cmcc_context);
-  struct st_observe_info *delnode;
-  while (g_observeList != NULL)
+  for (i = 0; i < g_cmccCount; i++)
     {
-      g_observeList = (struct st_observe_info *)CIS_LIST_RM((cis_list_t *)g_observeList, g_observeList->mid, (cis_list_t **)&delnode);
-      cis_free(delnode);
+      prv_contextRemove(&g_cmcc[i]);
     }
+  g_cmccCount = 0;
 
   return 0;
 }
@@ -37,6 +37,7 @@
 
 #include "cis_api.h"
 #include "cis_list.h"
+#include "iotpf_rel.h"
 
 #define SAMPLE_OBJECT_MAX       2
 
@@ -44,16 +45,26 @@
 #define SAMPLE_OID_B            (3340)
 
 #define SAMPLE_A_INSTANCE_COUNT        3
-#define SAMPLE_A_INSTANCE_BITMAP      "100"
+#define SAMPLE_A_INSTANCE_BITMAP       0x80 /* "100" */
 
 #define SAMPLE_B_INSTANCE_COUNT        5
-#define SAMPLE_B_INSTANCE_BITMAP      "10000"
+#define SAMPLE_B_INSTANCE_BITMAP       0x80 /* "10000" */
+
+/* Longest string value, including the terminator, each instance can hold */
+
+#ifndef SAMPLE_A_STR_MAX
+#define SAMPLE_A_STR_MAX               64
+#endif
+
+#ifndef SAMPLE_B_STR_MAX
+#define SAMPLE_B_STR_MAX               64
+#endif
 
 typedef struct st_sample_object
 {
   cis_oid_t oid;
   cis_instcount_t instCount;
-  const char *instBitmap;
+  const uint8_t *instBitmap;
   const cis_rid_t *attrListPtr;
   uint16_t attrCount;
   const cis_rid_t *actListPtr;
@@ -65,10 +76,10 @@ typedef struct st_sample_object
 
 typedef struct st_object_a
 {
-  int32_t intValue;
   double floatValue;
+  char *strValue;
+  int32_t intValue;
   bool boolValue;
-  char strValue[1024];
   uint8_t update;
 }st_object_a;
 
@@ -108,10 +119,10 @@ static const cis_rid_t const_ActIds_a[] =
 
 typedef struct st_object_b
 {
-  int32_t intValue;
   double floatValue;
+  char *strValue;
+  int32_t intValue;
   bool boolValue;
-  char strValue[1024];
 
   //flag;
   uint8_t update;
@@ -154,6 +165,43 @@ struct st_observe_info
   cis_listid_t mid;
   cis_uri_t uri;
   cis_observe_attr_t params;
+  iotpf_rel_t rel;            /* CON/NON policy of its notifications */
+  uint32_t notified;          /* cissys_gettime() of the one awaiting ACK */
 };
 
+void cisapi_cmcc_wakeup_pump(void);
+uint32_t cisapi_cmcc_netpool_exhausted(void);
+uint32_t cisapi_cmcc_pump_stall_max(void);
+
+/* "</oid/iid>,..." of every enabled instance, for the iotpf_lib register
+ * and update payloads so they are not rebuilt from the object list.
+ */
+
+const char *cisapi_cmcc_object_links(void);
+
+/* Received packets come from a fixed pool. The iotpf_lib net layer must
+ * not cis_free() them, it hands them back here once consumed instead; a
+ * library that does defines CIS_HAVE_PACKET_RELEASE. Any other gets a
+ * heap copy per datagram.
+ */
+
+#if defined(CIS_NET_POOL) && !defined(CIS_HAVE_PACKET_RELEASE)
+#  undef CIS_NET_POOL
+#endif
+
+#ifdef CIS_NET_POOL
+
+bool cisapi_cmcc_packet_pooled(const void *ptr);
+void cisapi_cmcc_packet_release(const void *ptr);
+#endif
+
+#if CIS_ENABLE_UPDATE && defined(CIS_HAVE_FW_WRITE)
+/* Firmware download sink for the iotpf_lib firmware hook: data sits at
+ * offset in the downloaded package. CIS_RET_ERROR fails the download;
+ * where to resume one comes from iotpf_fw_saved_bytes().
+ */
+
+int cisapi_cmcc_fw_write(uint32_t offset, const uint8_t *data, uint32_t len);
+#endif
+
 #endif//_CIS_IF_API_CMCC_H_
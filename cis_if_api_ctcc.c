@@ -43,17 +43,37 @@
 #include "cis_api.h"
 #include "cis_if_api_ctcc.h"
 #include "object_control.h"
+#include "iotpf_conn.h"
+#include "iotpf_dtls.h"
+#include "iotpf_stats.h"
+#include "iotpf_dlog.h"
+#include "iotpf_bench.h"
+#include "iotpf_queue.h"
+#ifdef CIS_BLOCKWISE
+#include "iotpf_block.h"
+#endif
+#ifdef CIS_FW_DELTA
+#include "iotpf_delta.h"
+#endif
 
 #include "iotpf_user.h"
 
 #if CIS_ONE_MCU && CIS_OPERATOR_CTCC
 
+/* Link & bind type; 0 leaves the iotpf_lib default, U */
+
+#ifdef CIS_QUEUE_MODE
+#define CTCC_LINK_BIND          IOTPF_QUEUE_BINDING
+#else
+#define CTCC_LINK_BIND          0x00
+#endif
+
 static uint8_t config_hex[] =
 {
   0x13, 0x00, 0x2E,
   0xf1, 0x00, 0x03,
   0xf2, 0x00, 0x20,
-  0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00 /*mtu*/, CTCC_LINK_BIND /*Link & bind type*/, 0x00,
 
 #ifdef CIS_CTWING
   0x00, 0x15 /*host length*/, 0x32, 0x32, 0x31, 0x2e, 0x32, 0x32, 0x39, 0x2e,
@@ -72,6 +92,11 @@ static pthread_mutex_t g_reg_mutex;
 static pthread_cond_t g_reg_cond;
 static bool g_reg_status = false;
 static bool g_exit = false;
+static iotpf_conn_t g_conn;
+static int g_conn_wake_fd[2] = {-1, -1};
+#ifdef CIS_DTLS_SESSION
+static iotpf_dtls_t g_dtls;
+#endif
 
 static void *g_ctcc_context;
 
@@ -79,18 +104,120 @@ static pthread_t g_user_send_thread_tid = -1;
 static pthread_t g_user_recv_thread_tid = -1;
 static user_thread_context_t g_user_thread_context;
 
+#ifdef CIS_BLOCKWISE
+/* Block1 downlink in progress; its blocks go to the user thread one by
+ * one
+ */
+
+static iotpf_block_t g_rx_block;
+#endif
+
 //////////////////////////////////////////////////////////////////////////
 //private funcation;
 
+/* Waits on the send pipe for the next uplink, at most timeout_ms or until
+ * cis_api_onEvent() moves g_conn to another state. True when an uplink
+ * is ready to be read.
+ */
+
+static bool prv_send_wait(uint32_t timeout_ms)
+{
+  int sendFd = g_user_thread_context.send_pipe_fd[0];
+  int wakeFd = g_conn_wake_fd[0];
+  struct timeval tv;
+  fd_set readfds;
+  char drain[8];
+
+  FD_ZERO(&readfds);
+  FD_SET(sendFd, &readfds);
+  FD_SET(wakeFd, &readfds);
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+  if (select((sendFd > wakeFd ? sendFd : wakeFd) + 1, &readfds, NULL, NULL,
+             &tv) <= 0)
+    {
+      return false;
+    }
+
+  if (FD_ISSET(wakeFd, &readfds))
+    {
+      read(wakeFd, drain, sizeof(drain));
+    }
+
+  return FD_ISSET(sendFd, &readfds);
+}
+
+static void prv_reg_timedwait(uint32_t timeout_ms)
+{
+  struct timespec abstime;
+
+  clock_gettime(CLOCK_REALTIME, &abstime);
+  abstime.tv_sec += timeout_ms / 1000;
+  abstime.tv_nsec += (timeout_ms % 1000) * 1000000;
+  if (abstime.tv_nsec >= 1000000000)
+    {
+      abstime.tv_sec++;
+      abstime.tv_nsec -= 1000000000;
+    }
+  pthread_cond_timedwait(&g_reg_cond, &g_reg_mutex, &abstime);
+}
+
+/* Hands the ACK of an object notification to its object, false when
+ * no object owns it: then it answers a raw uplink
+ */
+
+static bool prv_notifyAcked(void *context, cis_mid_t mid, bool ok)
+{
+  int i;
+
+  for (i = 0; i < get_object_callback_mapping_num(); i++)
+    {
+      if (g_object_callback_mapping[i].onNotifyAcked != NULL &&
+          g_object_callback_mapping[i].onNotifyAcked(context, mid, ok))
+        {
+          return true;
+        }
+    }
+
+  return false;
+}
+
 static void cis_api_onEvent(void *context, cis_evt_t eid, void *param)
 {
+  iotpf_conn_state_t state;
+
+  pthread_mutex_lock(&g_reg_mutex);
+  state = g_conn.state;
+  iotpf_conn_event(&g_conn, eid);
+  if (g_conn.state != state && g_conn_wake_fd[1] >= 0)
+    {
+      write(g_conn_wake_fd[1], "c", 1);
+    }
+  pthread_cond_signal(&g_reg_cond);
+  pthread_mutex_unlock(&g_reg_mutex);
+
   switch (eid)
     {
       case CIS_EVENT_RESPONSE_FAILED:
-        LOGD("cis_on_event response failed mid:%d", (int32_t)param);
+        LOGD("cis_on_event response failed mid:%d", (int32_t)(intptr_t)param);
+        IOTPF_STAT_INC(response_failed);
         break;
       case CIS_EVENT_NOTIFY_FAILED:
-        LOGD("cis_on_event notify failed mid:%d", (int32_t)param);
+        LOGD("cis_on_event notify failed mid:%d", (int32_t)(intptr_t)param);
+        IOTPF_STAT_INC(notify_failed);
+        if (!prv_notifyAcked(context, (cis_mid_t)(intptr_t)param, false))
+          {
+            iotpf_bench_acked(false);
+            cisapi_user_acked(false);
+          }
+        break;
+      case CIS_EVENT_NOTIFY_SUCCESS:
+        IOTPF_STAT_INC(notify_acked);
+        if (!prv_notifyAcked(context, (cis_mid_t)(intptr_t)param, true))
+          {
+            iotpf_bench_acked(true);
+            cisapi_user_acked(true);
+          }
         break;
       case CIS_EVENT_CONNECT_SUCCESS:
         LOGD("cis_on_event connect success");
@@ -103,13 +230,20 @@ static void cis_api_onEvent(void *context, cis_evt_t eid, void *param)
         g_reg_status = true;
         pthread_cond_signal(&g_reg_cond);
         pthread_mutex_unlock(&g_reg_mutex);
+        cisapi_user_registered();
+#ifdef CIS_DTLS_SESSION
+        iotpf_dtls_registered(&g_dtls, context);
+#endif
         LOGD("cis_on_event reg success");
         break;
+      case CIS_EVENT_UPDATE_SUCCESS:
+        cisapi_user_registered();
+        break;
       case CIS_EVENT_REG_FAILED:
-        LOGD("cis_on_event reg failed");
+        LOGD("cis_on_event reg failed, state:%s", iotpf_conn_state_str(g_conn.state));
         break;
       case CIS_EVENT_REG_TIMEOUT:
-        LOGD("cis_on_event reg timeout");
+        LOGD("cis_on_event reg timeout, state:%s", iotpf_conn_state_str(g_conn.state));
         break;
       case CIS_EVENT_UPDATE_NEED:
         LOGD("cis_on_event update needed");
@@ -122,6 +256,26 @@ static void cis_api_onEvent(void *context, cis_evt_t eid, void *param)
         pthread_mutex_unlock(&g_reg_mutex);
         LOGD("cis_on_event unreg success");
         break;
+#ifdef CIS_FW_DELTA
+      case CIS_EVENT_FIRMWARE_DOWNLOADING:
+        LOGD("cis_on_event firmware downloading");
+        if (iotpf_delta_begin() < 0)
+          {
+            LOGE("cis_on_event firmware slot not writable");
+          }
+        break;
+      case CIS_EVENT_FIRMWARE_DOWNLOAD_FAILED:
+        LOGD("cis_on_event firmware download failed");
+        iotpf_delta_abort();
+        break;
+      case CIS_EVENT_FIRMWARE_DOWNLOADED:
+        LOGD("cis_on_event firmware downloaded");
+        if (iotpf_delta_finish() != CIS_RET_OK)
+          {
+            LOGE("cis_on_event firmware failed verification");
+          }
+        break;
+#endif
 #if CIS_ENABLE_UPDATE
       case CIS_EVENT_FIRMWARE_UPDATING:
         LOGD("cis_on_event firmware update updating");
@@ -138,26 +292,61 @@ static void cis_api_onEvent(void *context, cis_evt_t eid, void *param)
     }
 }
 
+#ifdef CIS_FW_DELTA
+int cisapi_ctcc_fw_write(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+  return iotpf_delta_write(offset, data, len);
+}
+#endif
+
+#ifdef CIS_BLOCKWISE
+static int prv_block_write(void *priv, uint32_t offset,
+                           const uint8_t *buf, uint32_t len, bool more)
+{
+  return cisapi_recv_block_from_server(&g_user_thread_context, offset, buf,
+                                       len, more);
+}
+
+static cis_coapret_t prv_block_downlink(const uint8_t *data, uint32_t length)
+{
+  int ret;
+
+  ret = iotpf_block_receive(&g_rx_block, data, length, prv_block_write,
+                            NULL);
+  return ret > 1 ? (cis_coapret_t)ret : CIS_RET_OK;
+}
+#endif
+
 static cis_coapret_t cis_api_onWriteRaw(void *context, const uint8_t *data, uint32_t length, cis_mid_t mid)
 {
-  /*TODO*/
-  int i;
-  int bufLen = 0;
-  char *buf = (char *)malloc(2 * length + 1);
-  memset(buf, 0x0, 2 * length + 1);
-  for (i = 0; i < length; i++)
+  DLOGI_HEX("cis_api_onWriteRaw :%u,", data, length);
+  cisapi_user_downlink();
+#ifdef CIS_BLOCKWISE
+  if (length > 0 && data[0] == IOTPF_BLOCK_TAG_BLOCK1)
     {
-      bufLen += snprintf(buf + bufLen, 2 * length + 1 - bufLen, "%02X", data[i]);
+      return prv_block_downlink(data, length);
     }
-  LOGI("cis_api_onWriteRaw :%d,%s", length, buf);
+  else if (length > 0 && data[0] == IOTPF_BLOCK_TAG_ESC)
+    {
+      data++;
+      length--;
+    }
+  else if (length > 0 && IOTPF_BLOCK_RESERVED(data[0]))
+    {
+      return IOTPF_BLOCK_BAD_FRAME;
+    }
+#endif
   cisapi_recv_data_from_server(&g_user_thread_context, data, length);
-  free(buf);
   return CIS_RET_OK;
 }
 
 static cis_coapret_t cis_api_onRead(void *context, cis_uri_t *uri, cis_mid_t mid)
 {
+  uint32_t start = IOTPF_HIST_NOW_US();
+  cis_coapret_t ret = CIS_RET_ERROR;
   int i = 0;
+
+  cisapi_user_downlink();
   for (i = 0; i < get_object_callback_mapping_num(); i++)
     {
       if (g_object_callback_mapping[i].onRead == NULL)
@@ -166,16 +355,22 @@ static cis_coapret_t cis_api_onRead(void *context, cis_uri_t *uri, cis_mid_t mid
         }
       if (uri->objectId == g_object_callback_mapping[i].objectId)
         {
-          return g_object_callback_mapping[i].onRead(context, uri, mid);
+          ret = g_object_callback_mapping[i].onRead(context, uri, mid);
+          break;
         }
     }
 
-  return CIS_RET_ERROR;
+  IOTPF_HIST_ADD(request_us, IOTPF_HIST_NOW_US() - start);
+  return ret;
 }
 
 static cis_coapret_t cis_api_onWrite(void *context, cis_uri_t *uri, const cis_data_t *value, cis_attrcount_t attrcount, cis_mid_t mid)
 {
+  uint32_t start = IOTPF_HIST_NOW_US();
+  cis_coapret_t ret = CIS_RET_ERROR;
   int i = 0;
+
+  cisapi_user_downlink();
   for (i = 0; i < get_object_callback_mapping_num(); i++)
     {
       if (g_object_callback_mapping[i].onWrite == NULL)
@@ -184,16 +379,22 @@ static cis_coapret_t cis_api_onWrite(void *context, cis_uri_t *uri, const cis_da
         }
       if (uri->objectId == g_object_callback_mapping[i].objectId)
         {
-          return g_object_callback_mapping[i].onWrite(context, uri, value, attrcount, mid);
+          ret = g_object_callback_mapping[i].onWrite(context, uri, value, attrcount, mid);
+          break;
         }
     }
 
-  return CIS_RET_ERROR;
+  IOTPF_HIST_ADD(request_us, IOTPF_HIST_NOW_US() - start);
+  return ret;
 }
 
 static cis_coapret_t cis_api_onExec(void *context, cis_uri_t *uri, const uint8_t *value, uint32_t length, cis_mid_t mid)
 {
+  uint32_t start = IOTPF_HIST_NOW_US();
+  cis_coapret_t ret = CIS_RET_ERROR;
   int i = 0;
+
+  cisapi_user_downlink();
   for (i = 0; i < get_object_callback_mapping_num(); i++)
     {
       if (g_object_callback_mapping[i].onExec == NULL)
@@ -202,16 +403,22 @@ static cis_coapret_t cis_api_onExec(void *context, cis_uri_t *uri, const uint8_t
         }
       if (uri->objectId == g_object_callback_mapping[i].objectId)
         {
-          return g_object_callback_mapping[i].onExec(context, uri, value, length, mid);
+          ret = g_object_callback_mapping[i].onExec(context, uri, value, length, mid);
+          break;
         }
     }
 
-  return CIS_RET_ERROR;
+  IOTPF_HIST_ADD(request_us, IOTPF_HIST_NOW_US() - start);
+  return ret;
 }
 
 static cis_coapret_t cis_api_onObserve(void *context, cis_uri_t *uri, bool flag, cis_mid_t mid)
 {
+  uint32_t start = IOTPF_HIST_NOW_US();
+  cis_coapret_t ret = CIS_RET_ERROR;
   int i = 0;
+
+  cisapi_user_downlink();
   for (i = 0; i < get_object_callback_mapping_num(); i++)
     {
       if (g_object_callback_mapping[i].onObserve == NULL)
@@ -220,11 +427,13 @@ static cis_coapret_t cis_api_onObserve(void *context, cis_uri_t *uri, bool flag,
         }
       if (uri->objectId == g_object_callback_mapping[i].objectId)
         {
-          return g_object_callback_mapping[i].onObserve(context, uri, flag, mid);
+          ret = g_object_callback_mapping[i].onObserve(context, uri, flag, mid);
+          break;
         }
     }
 
-  return CIS_RET_ERROR;
+  IOTPF_HIST_ADD(request_us, IOTPF_HIST_NOW_US() - start);
+  return ret;
 }
 
 static cis_coapret_t cis_api_onDiscovery(void *context, cis_uri_t *uri, cis_mid_t mid)
@@ -322,12 +531,25 @@ int cisapi_initialize(int iotpf_mode)
 
   cis_pump_initialize();
 
-  cis_register(g_ctcc_context, g_lifetime, &callback);
+#ifdef CIS_DTLS_SESSION
+  iotpf_dtls_init(&g_dtls, 0);
+#endif
 
   pthread_mutex_lock(&g_reg_mutex);
+  iotpf_conn_init(&g_conn);
   while (!g_reg_status)
     {
-      pthread_cond_wait(&g_reg_cond, &g_reg_mutex);
+      if (iotpf_conn_due(&g_conn))
+        {
+          pthread_mutex_unlock(&g_reg_mutex);
+#ifdef CIS_DTLS_SESSION
+          iotpf_dtls_register(&g_dtls, g_ctcc_context);
+#endif
+          cis_register(g_ctcc_context, g_lifetime, &callback);
+          pthread_mutex_lock(&g_reg_mutex);
+          continue;
+        }
+      prv_reg_timedwait(iotpf_conn_timeout(&g_conn));
     }
   pthread_mutex_unlock(&g_reg_mutex);
 
@@ -343,6 +565,7 @@ int cisapi_initialize(int iotpf_mode)
 
   pipe(g_user_thread_context.send_pipe_fd);
   pipe(g_user_thread_context.recv_pipe_fd);
+  pipe(g_conn_wake_fd);
 
   if (pthread_create(&g_user_send_thread_tid, NULL, cisapi_user_send_thread, &g_user_thread_context))
     {
@@ -360,14 +583,36 @@ int cisapi_initialize(int iotpf_mode)
 
   while (1)
     {
-      cisapi_send_data_to_server(&g_user_thread_context);
-      prv_observeNotify(g_ctcc_context);
+      uint32_t timeout;
+
+      pthread_mutex_lock(&g_reg_mutex);
+      timeout = iotpf_conn_timeout(&g_conn);
+      pthread_mutex_unlock(&g_reg_mutex);
+
+      /* Re-registration must not wait for the next uplink */
+
+      if (prv_send_wait(timeout))
+        {
+          cisapi_send_data_to_server(&g_user_thread_context);
+          prv_observeNotify(g_ctcc_context);
+        }
+
       pthread_mutex_lock(&g_reg_mutex);
       if (g_exit)
         {
           pthread_mutex_unlock(&g_reg_mutex);
           break;
         }
+      if (iotpf_conn_due(&g_conn))
+        {
+          pthread_mutex_unlock(&g_reg_mutex);
+          LOGI("registration lost, register again");
+#ifdef CIS_DTLS_SESSION
+          iotpf_dtls_register(&g_dtls, g_ctcc_context);
+#endif
+          cis_register(g_ctcc_context, g_lifetime, &callback);
+          continue;
+        }
       pthread_mutex_unlock(&g_reg_mutex);
     }
 
@@ -377,6 +622,12 @@ clean:
   close(g_user_thread_context.recv_pipe_fd[0]);
   close(g_user_thread_context.recv_pipe_fd[1]);
 
+  pthread_mutex_lock(&g_reg_mutex);
+  close(g_conn_wake_fd[0]);
+  close(g_conn_wake_fd[1]);
+  g_conn_wake_fd[0] = g_conn_wake_fd[1] = -1;
+  pthread_mutex_unlock(&g_reg_mutex);
+
   cis_unregister(g_ctcc_context);
 
   struct timeval now;
@@ -37,11 +37,18 @@
 
 #include "cis_api.h"
 #include "cis_list.h"
+#include "iotpf_rel.h"
 
 typedef void (*cis_notify_callback_t)(void *context);
 typedef void (*cis_clean_callback_t)(void *context);
 typedef cis_ret_t (*cis_make_sample_data)(void *contextP);
 
+/* A confirmable notification was answered (ok) or given up on; true
+ * when mid is one of the observes of the object
+ */
+
+typedef bool (*cis_acked_callback_t)(void *context, cis_mid_t mid, bool ok);
+
 
 typedef struct
 {
@@ -53,6 +60,7 @@ typedef struct
   cis_notify_callback_t onObserveNotify;
   cis_clean_callback_t onClean;
   cis_make_sample_data makeSampleData;
+  cis_acked_callback_t onNotifyAcked;
 } object_callback_mapping;
 
 typedef struct
@@ -61,8 +69,25 @@ typedef struct
   cis_listid_t mid;
   cis_uri_t uri;
   cis_observe_attr_t params;
+  iotpf_rel_t rel;            /* CON/NON policy of its notifications */
+  uint32_t notified;          /* cissys_gettime() of the one awaiting ACK */
 } st_observe_info;
 
+/* Firmware download sink for the iotpf_lib firmware hook: data sits at
+ * offset in the downloaded stream, a package or a patch (iotpf_delta.h).
+ * CIS_RET_ERROR fails the download; where to resume one comes from
+ * iotpf_delta_saved_bytes(). Only a library that defines
+ * CIS_HAVE_FW_WRITE hands downloads over.
+ */
+
+#if defined(CIS_FW_DELTA) && !defined(CIS_HAVE_FW_WRITE)
+#  undef CIS_FW_DELTA
+#endif
+
+#ifdef CIS_FW_DELTA
+
+int cisapi_ctcc_fw_write(uint32_t offset, const uint8_t *data, uint32_t len);
+#endif
 
 #endif//_CIS_IF_API_CTCC_H_
 
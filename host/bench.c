@@ -0,0 +1,462 @@
+/****************************************************************************
+ * external/services/iotpf/host/bench.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#include "cis_api.h"
+#include "senml.h"
+#include "iotpf_dlog.h"
+#include "bench.h"
+
+/* Usage: iotpf_bench_<op> [-o out.json] [-c baseline.json] [filter...]
+ *
+ * out.json holds one result per line so two runs diff cleanly; -c prints
+ * the change against an earlier file next to every case.
+ */
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#define BENCH_SAMPLES           5
+#define BENCH_SAMPLE_NS         100000000ull
+#define BENCH_RESULT_MAX        64
+#define BENCH_SINK_MAX          4096
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+typedef struct bench_result_s
+{
+  char name[48];
+  double ns;
+  double ns_min;
+  double allocs;
+  double bytes;
+  uint64_t iters;
+} bench_result_t;
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static bench_result_t g_results[BENCH_RESULT_MAX];
+static int g_nresults;
+static char **g_filters;
+static int g_nfilters;
+
+static double g_last_ns;
+
+static uint64_t g_allocs;
+static uint64_t g_alloc_bytes;
+
+static char g_sink[BENCH_SINK_MAX];
+static senml_writer_t g_sink_writer;
+
+uint64_t g_bench_records;
+uint64_t g_bench_bytes;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static uint64_t prv_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int prv_cmp(const void *a, const void *b)
+{
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static bool prv_selected(const char *name)
+{
+  int i;
+
+  if (g_nfilters == 0)
+    {
+      return true;
+    }
+
+  for (i = 0; i < g_nfilters; i++)
+    {
+      if (strstr(name, g_filters[i]) != NULL)
+        {
+          return true;
+        }
+    }
+
+  return false;
+}
+
+static void prv_sink(const cis_uri_t *uri, const cis_data_t *value,
+                     bool last)
+{
+  if (value != NULL)
+    {
+      if (g_sink_writer.count == 0 ||
+          g_sink_writer.len > BENCH_SINK_MAX - 256)
+        {
+          senml_begin(&g_sink_writer, g_sink, sizeof(g_sink));
+        }
+
+      senml_add(&g_sink_writer, uri, value);
+      g_bench_records++;
+    }
+
+  if (last)
+    {
+      g_bench_bytes += g_sink_writer.len;
+      g_sink_writer.count = 0;
+    }
+}
+
+static bool prv_baseline(const char *path, const char *name, double *ns)
+{
+  char line[256];
+  char key[64];
+  FILE *f;
+  bool found = false;
+
+  if (snprintf(key, sizeof(key), "\"name\":\"%s\",", name) >=
+      (int)sizeof(key))
+    {
+      return false;
+    }
+
+  f = fopen(path, "r");
+  if (f == NULL)
+    {
+      return false;
+    }
+
+  while (!found && fgets(line, sizeof(line), f) != NULL)
+    {
+      char *p = strstr(line, key);
+
+      p = p ? strstr(p, "\"ns_per_op\":") : NULL;
+      found = p != NULL && sscanf(p + 12, "%lf", ns) == 1;
+    }
+
+  fclose(f);
+  return found;
+}
+
+static void prv_write(const char *path, const char *suite)
+{
+  struct utsname uts;
+  char date[32];
+  time_t now = time(NULL);
+  FILE *f;
+  int i;
+
+  f = fopen(path, "w");
+  if (f == NULL)
+    {
+      perror(path);
+      return;
+    }
+
+  uname(&uts);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+  fprintf(f, "{\"suite\":\"%s\",\"date\":\"%s\",\"machine\":\"%s %s\","
+             "\"results\":[\n", suite, date, uts.machine, uts.release);
+  for (i = 0; i < g_nresults; i++)
+    {
+      bench_result_t *r = &g_results[i];
+
+      fprintf(f, "{\"name\":\"%s\",\"ns_per_op\":%.1f,\"ns_min\":%.1f,"
+                 "\"allocs_per_op\":%.2f,\"bytes_per_op\":%.1f,"
+                 "\"iterations\":%llu}%s\n",
+              r->name, r->ns, r->ns_min, r->allocs, r->bytes,
+              (unsigned long long)r->iters, i + 1 < g_nresults ? "," : "");
+    }
+
+  fprintf(f, "]}\n");
+  fclose(f);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* Heap accounting: the link wraps malloc and friends for every object */
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *s);
+
+void *__wrap_malloc(size_t size)
+{
+  g_allocs++;
+  g_alloc_bytes += size;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+  g_allocs++;
+  g_alloc_bytes += n * size;
+  return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+  g_allocs++;
+  g_alloc_bytes += size;
+  return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *s)
+{
+  g_allocs++;
+  g_alloc_bytes += strlen(s) + 1;
+  return __real_strdup(s);
+}
+
+/* The core's output side, see bench.h */
+
+cis_ret_t __wrap_cis_response(void *context, const cis_uri_t *uri,
+                              const cis_data_t *value, cis_mid_t mid,
+                              cis_coapret_t result)
+{
+  prv_sink(uri, value, result != CIS_RESPONSE_CONTINUE);
+  return CIS_RET_OK;
+}
+
+cis_ret_t __wrap_cis_notify(void *context, const cis_uri_t *uri,
+                            const cis_data_t *value, cis_mid_t mid,
+                            cis_coapret_t result, bool needAck)
+{
+  prv_sink(uri, value, result != CIS_NOTIFY_CONTINUE);
+  return CIS_RET_OK;
+}
+
+cis_ret_t __wrap_cis_notify_raw(void *context, const uint8_t *data,
+                                uint32_t length)
+{
+  g_bench_records++;
+  g_bench_bytes += length;
+  return CIS_RET_OK;
+}
+
+cis_ret_t __wrap_cis_notify_raw_ack(void *context, const uint8_t *data,
+                                    uint32_t length, bool needAck)
+{
+  return __wrap_cis_notify_raw(context, data, length);
+}
+
+/* No drain thread runs here; records are popped inside the timed loop so
+ * cases pay for the enqueue rather than for the full-ring drop.
+ */
+
+static inline void prv_op(bench_fn_t fn, void *arg)
+{
+#ifdef CIS_DLOG
+  iotpf_dlog_rec_t rec;
+#endif
+
+  fn(arg);
+#ifdef CIS_DLOG
+  while (iotpf_dlog_pop(&rec))
+    {
+    }
+#endif
+}
+
+void bench_run(const char *name, bench_fn_t fn, void *arg)
+{
+  double samples[BENCH_SAMPLES];
+  bench_result_t *r;
+  uint64_t iters = 1;
+  uint64_t allocs;
+  uint64_t bytes;
+  uint64_t t;
+  uint64_t i;
+  int s;
+
+  g_last_ns = 0;
+  if (!prv_selected(name) || g_nresults == BENCH_RESULT_MAX)
+    {
+      return;
+    }
+
+  /* Warm up and size the sample so timer overhead disappears */
+
+  for (; ; )
+    {
+      t = prv_now_ns();
+      for (i = 0; i < iters; i++)
+        {
+          prv_op(fn, arg);
+        }
+      t = prv_now_ns() - t;
+      if (t >= BENCH_SAMPLE_NS / 10)
+        {
+          break;
+        }
+      iters *= 2;
+    }
+
+  iters = iters * BENCH_SAMPLE_NS / (t ? t : 1) + 1;
+  allocs = g_allocs;
+  bytes = g_alloc_bytes;
+  for (s = 0; s < BENCH_SAMPLES; s++)
+    {
+      t = prv_now_ns();
+      for (i = 0; i < iters; i++)
+        {
+          prv_op(fn, arg);
+        }
+      samples[s] = (double)(prv_now_ns() - t) / iters;
+    }
+
+  r = &g_results[g_nresults++];
+  qsort(samples, BENCH_SAMPLES, sizeof(double), prv_cmp);
+  snprintf(r->name, sizeof(r->name), "%s", name);
+  r->ns = samples[BENCH_SAMPLES / 2];
+  r->ns_min = samples[0];
+  r->allocs = (double)(g_allocs - allocs) / (iters * BENCH_SAMPLES);
+  r->bytes = (double)(g_alloc_bytes - bytes) / (iters * BENCH_SAMPLES);
+  r->iters = iters * BENCH_SAMPLES;
+  g_last_ns = r->ns;
+}
+
+double bench_last_ns(void)
+{
+  return g_last_ns;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *suite = bench_suite_cmcc ? "cmcc" : "ctcc";
+  const char *baseline = NULL;
+  char out[64];
+  int opt;
+  int i;
+
+  /* Hot paths log per call; keep the terminal out of the numbers */
+
+  setenv("IOTPF_LOG", "e", 0);
+  snprintf(out, sizeof(out), "bench_%s.json", suite);
+  while ((opt = getopt(argc, argv, "o:c:")) != -1)
+    {
+      switch (opt)
+        {
+          case 'o':
+            snprintf(out, sizeof(out), "%s", optarg);
+            break;
+          case 'c':
+            baseline = optarg;
+            break;
+          default:
+            fprintf(stderr, "usage: %s [-o out.json] [-c baseline.json] "
+                            "[filter...]\n", argv[0]);
+            return 1;
+        }
+    }
+
+  g_filters = argv + optind;
+  g_nfilters = argc - optind;
+
+  if (bench_suite_user)
+    {
+      bench_suite_user();
+    }
+  if (bench_suite_ctcc)
+    {
+      bench_suite_ctcc();
+    }
+  if (bench_suite_cmcc)
+    {
+      bench_suite_cmcc();
+    }
+  if (bench_suite_log)
+    {
+      bench_suite_log();
+    }
+  if (bench_suite_at)
+    {
+      bench_suite_at();
+    }
+  if (bench_suite_comp)
+    {
+      bench_suite_comp();
+    }
+  if (bench_suite_clock)
+    {
+      bench_suite_clock();
+    }
+  if (bench_suite_hist)
+    {
+      bench_suite_hist();
+    }
+
+  printf("%-34s %10s %10s %9s %9s%s\n", "case", "ns/op", "min", "allocs",
+         "bytes", baseline ? "     delta" : "");
+  for (i = 0; i < g_nresults; i++)
+    {
+      bench_result_t *r = &g_results[i];
+      double base;
+
+      printf("%-34s %10.1f %10.1f %9.2f %9.1f", r->name, r->ns, r->ns_min,
+             r->allocs, r->bytes);
+      if (baseline != NULL && prv_baseline(baseline, r->name, &base))
+        {
+          printf("  %+7.1f%%", (r->ns - base) * 100 / base);
+        }
+      putchar('\n');
+    }
+
+  prv_write(out, suite);
+  printf("%d cases, %llu records encoded, results in %s\n", g_nresults,
+         (unsigned long long)g_bench_records, out);
+  return 0;
+}
@@ -0,0 +1,74 @@
+/****************************************************************************
+ * external/services/iotpf/host/bench.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _HOST_BENCH_H_
+#define _HOST_BENCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Microbenchmarks of the adapter hot paths. Each case is timed over enough
+ * iterations to run ~100 ms per sample, five samples, and reports the
+ * median ns/op plus the heap calls and bytes one op costs. cis_response(),
+ * cis_notify() and cis_notify_raw() are redirected at link time into a
+ * sink that SenML-encodes the records, so encoder cases include the
+ * serialisation the core would do but never touch a socket.
+ */
+
+typedef void (*bench_fn_t)(void *arg);
+
+void bench_run(const char *name, bench_fn_t fn, void *arg);
+
+/* Median ns/op of the last bench_run(), 0 when the filter skipped it */
+
+double bench_last_ns(void);
+
+/* Records and bytes the sink has seen, for sanity checks in the suites */
+
+extern uint64_t g_bench_records;
+extern uint64_t g_bench_bytes;
+
+/* Suites, each defined by the executable that has the adapter linked in */
+
+void bench_suite_user(void) __attribute__((weak));
+void bench_suite_ctcc(void) __attribute__((weak));
+void bench_suite_cmcc(void) __attribute__((weak));
+void bench_suite_log(void) __attribute__((weak));
+void bench_suite_at(void) __attribute__((weak));
+void bench_suite_comp(void) __attribute__((weak));
+void bench_suite_clock(void) __attribute__((weak));
+void bench_suite_hist(void) __attribute__((weak));
+
+#endif /* _HOST_BENCH_H_ */
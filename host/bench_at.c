@@ -0,0 +1,278 @@
+/****************************************************************************
+ * external/services/iotpf/host/bench_at.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/* The two-MCU AT link through a pty: this process plays the host MCU on
+ * the master end, iotpf_atbin sits on the slave end and hands commands to
+ * the stand-in AT parser in host_platform.c over a second pty. Every case
+ * sends AT+MIPLNOTIFY with a 64 byte payload, as hex in a line and waiting
+ * for each OK, or as binary frames with 1 or 4 commands in flight.
+ *
+ * A pty moves bytes at memory speed, so next to the measured rate each
+ * case prints what the UART bytes it used would allow at 115200 baud:
+ * one way after the other for the strict round trip, the busier direction
+ * alone once commands are pipelined.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "cis_api.h"
+#include "iotpf_atbin.h"
+#include "bench.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#define BENCH_AT_PAYLOAD        64
+#define BENCH_AT_BAUD           115200
+#define BENCH_AT_CMD            "AT+MIPLNOTIFY=0,1,3311,0,5701,1,64,\""
+#define BENCH_AT_TAIL           "\",0,0"
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+typedef struct bench_at_s
+{
+  int uart;                 /* our end of the host MCU link */
+  uint8_t window;           /* binary commands kept in flight */
+  uint8_t inflight;
+  uint8_t tag;
+  char cmd[256];
+  uint16_t cmd_len;
+  uint8_t payload[BENCH_AT_PAYLOAD];
+  uint8_t frame[256];
+  uint16_t frame_len;
+  uint8_t rx[1024];
+  uint32_t rx_len;
+  uint64_t up;              /* UART bytes host MCU to iotpf */
+  uint64_t down;
+  uint64_t cmds;
+} bench_at_t;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void *bench_at_parser(void *arg)
+{
+  cisat_readloop((int)(intptr_t)arg);
+  return NULL;
+}
+
+static void bench_at_read(bench_at_t *b)
+{
+  ssize_t n = read(b->uart, b->rx + b->rx_len, sizeof(b->rx) - b->rx_len);
+
+  if (n > 0)
+    {
+      b->rx_len += n;
+      b->down += n;
+    }
+}
+
+static void bench_at_text(void *arg)
+{
+  bench_at_t *b = (bench_at_t *)arg;
+  char *ok;
+
+  write(b->uart, b->cmd, b->cmd_len);
+  b->up += b->cmd_len;
+  b->cmds++;
+  b->rx_len = 0;
+  do
+    {
+      bench_at_read(b);
+      b->rx[b->rx_len] = '\0';
+      ok = strstr((char *)b->rx, "OK\r\n");
+    }
+  while (ok == NULL);
+}
+
+/* Consume whole reply frames, counting down the commands they end */
+
+static void bench_at_replies(bench_at_t *b)
+{
+  iotpf_atbin_frame_t frame;
+  uint32_t pos = 0;
+  int ret;
+
+  bench_at_read(b);
+  while ((ret = iotpf_atbin_decode(&frame, b->rx + pos,
+                                   b->rx_len - pos)) != 0)
+    {
+      if (ret < 0)
+        {
+          pos++;
+          continue;
+        }
+      if (frame.tag != 0 &&
+          iotpf_atbin_final((const char *)frame.text, frame.text_len))
+        {
+          b->inflight--;
+        }
+      pos += ret;
+    }
+
+  memmove(b->rx, b->rx + pos, b->rx_len - pos);
+  b->rx_len -= pos;
+}
+
+static void bench_at_binary(void *arg)
+{
+  bench_at_t *b = (bench_at_t *)arg;
+
+  /* Tags only have to be unique among the commands in flight */
+
+  if (++b->tag == 0)
+    {
+      b->tag = 1;
+    }
+  b->frame_len = iotpf_atbin_encode(b->tag, b->cmd, b->cmd_len, b->payload,
+                                    BENCH_AT_PAYLOAD,
+                                    sizeof(BENCH_AT_CMD) - 1, b->frame,
+                                    sizeof(b->frame));
+  write(b->uart, b->frame, b->frame_len);
+  b->up += b->frame_len;
+  b->cmds++;
+  b->inflight++;
+  while (b->inflight >= b->window)
+    {
+      bench_at_replies(b);
+    }
+}
+
+static void bench_at_case(bench_at_t *b, const char *name, bench_fn_t fn,
+                          bool pipelined)
+{
+  double ns;
+  double up;
+  double down;
+  double baud;
+
+  b->up = 0;
+  b->down = 0;
+  b->cmds = 0;
+  bench_run(name, fn, b);
+  while (b->inflight > 0)
+    {
+      bench_at_replies(b);
+    }
+
+  ns = bench_last_ns();
+  if (ns == 0 || b->cmds == 0)
+    {
+      return;
+    }
+
+  up = (double)b->up / b->cmds;
+  down = (double)b->down / b->cmds;
+  baud = BENCH_AT_BAUD / 10 / (pipelined ? (up > down ? up : down) :
+                                           up + down);
+  printf("# %-24s %8.0f cmd/s %9.0f B/s, UART %5.1f + %4.1f B/cmd, "
+         "%5.0f cmd/s %6.0f B/s at %d baud\n", name, 1e9 / ns,
+         1e9 / ns * BENCH_AT_PAYLOAD, up, down, baud,
+         baud * BENCH_AT_PAYLOAD, BENCH_AT_BAUD);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void bench_suite_at(void)
+{
+  static bench_at_t b;
+  struct termios tio;
+  pthread_t tid;
+  int parser;
+  int slave;
+  int i;
+
+  b.uart = posix_openpt(O_RDWR | O_NOCTTY);
+  if (b.uart < 0 || grantpt(b.uart) < 0 || unlockpt(b.uart) < 0)
+    {
+      perror("posix_openpt");
+      return;
+    }
+
+  slave = open(ptsname(b.uart), O_RDWR | O_NOCTTY);
+  if (slave < 0 || tcgetattr(slave, &tio) < 0)
+    {
+      perror(ptsname(b.uart));
+      return;
+    }
+
+  cfmakeraw(&tio);
+  tcsetattr(slave, TCSANOW, &tio);
+  parser = iotpf_atbin_start(slave);
+  if (parser < 0 ||
+      pthread_create(&tid, NULL, bench_at_parser, (void *)(intptr_t)parser))
+    {
+      return;
+    }
+
+  for (i = 0; i < BENCH_AT_PAYLOAD; i++)
+    {
+      b.payload[i] = i * 37;
+    }
+
+  /* Plain text: the payload hex encoded, one command at a time */
+
+  b.cmd_len = snprintf(b.cmd, sizeof(b.cmd), BENCH_AT_CMD);
+  for (i = 0; i < BENCH_AT_PAYLOAD; i++)
+    {
+      b.cmd_len += sprintf(b.cmd + b.cmd_len, "%02x", b.payload[i]);
+    }
+  b.cmd_len += sprintf(b.cmd + b.cmd_len, BENCH_AT_TAIL "\r\n");
+  bench_at_case(&b, "at/text/notify64", bench_at_text, false);
+
+  /* Binary frames, the payload raw at the end of the frame */
+
+  b.cmd_len = snprintf(b.cmd, sizeof(b.cmd), "AT+IOTPFBIN=1\r\n");
+  bench_at_text(&b);
+  b.cmd_len = snprintf(b.cmd, sizeof(b.cmd), BENCH_AT_CMD BENCH_AT_TAIL);
+
+  b.window = 1;
+  bench_at_case(&b, "at/binary/notify64", bench_at_binary, false);
+  b.window = 4;
+  bench_at_case(&b, "at/binary/notify64/pipe4", bench_at_binary, true);
+}
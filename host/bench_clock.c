@@ -0,0 +1,182 @@
+/****************************************************************************
+ * external/services/iotpf/host/bench_clock.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/* iotpf_clock against what handle_gprmc() and the rest used to reach for:
+ * CLOCK_REALTIME and mktime(). After the timed cases the clock is fed a
+ * synthetic GPS history, a 30 s session every 10 minutes for two hours
+ * on a monotonic clock running 40 ppm fast, with up to 10 ms of sentence
+ * latency, and then left alone for an hour.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "iotpf_clock.h"
+#include "bench.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#define BENCH_CLOCK_PPM         40
+#define BENCH_CLOCK_JITTER_MS   10
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static volatile uint64_t g_bench_sink;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void bench_mono(void *arg)
+{
+  g_bench_sink = iotpf_clock_mono_ms();
+}
+
+static void bench_utc(void *arg)
+{
+  g_bench_sink = iotpf_clock_utc_ms();
+}
+
+static void bench_civil(void *arg)
+{
+  g_bench_sink = iotpf_clock_civil_ms(2026, 10, 19, 9, 28, 58, 0);
+}
+
+static void bench_realtime(void *arg)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  g_bench_sink = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void bench_mktime(void *arg)
+{
+  struct tm t = { 0 };
+
+  t.tm_sec = 58;
+  t.tm_min = 28;
+  t.tm_hour = 9;
+  t.tm_mday = 19;
+  t.tm_mon = 9;
+  t.tm_year = 126;
+  g_bench_sink = (uint64_t)mktime(&t) * 1000;
+}
+
+/* UTC at a point of the synthetic monotonic clock */
+
+static uint64_t bench_clock_true(uint64_t mono0, uint64_t utc0,
+                                 uint64_t mono)
+{
+  uint64_t d = mono - mono0;
+
+  return utc0 + d - d * BENCH_CLOCK_PPM / 1000000;
+}
+
+static void bench_clock_discipline(void)
+{
+  const uint64_t mono0 = iotpf_clock_mono_ms() + 1000000000ull;
+  const uint64_t utc0 = iotpf_clock_civil_ms(2026, 10, 19, 0, 0, 0, 0);
+  iotpf_clock_status_t status;
+  uint64_t last = 0;
+  uint64_t mono = mono0;
+  int64_t err;
+  int64_t worst = 0;
+  int back = 0;
+  int session;
+  int k;
+
+  srand(1);
+  for (session = 0; session < 12; session++)
+    {
+      for (k = 0; k < 30; k++)
+        {
+          mono = mono0 + session * 600000 + k * 1000;
+          iotpf_clock_reference(IOTPF_CLOCK_GPS,
+                                bench_clock_true(mono0, utc0, mono) -
+                                rand() % (BENCH_CLOCK_JITTER_MS + 1), mono);
+        }
+
+      /* Between sessions, every 10 ms: never backwards, and how far off */
+
+      for (; mono < mono0 + (session + 1) * 600000; mono += 10)
+        {
+          uint64_t utc = iotpf_clock_utc_at(mono);
+
+          back += utc < last;
+          last = utc;
+          err = (int64_t)(utc - bench_clock_true(mono0, utc0, mono));
+          if (session > 0 && (err > worst || -err > worst))
+            {
+              worst = err > 0 ? err : -err;
+            }
+        }
+    }
+
+  mono += 3600000;
+  err = (int64_t)(iotpf_clock_utc_at(mono) -
+                  bench_clock_true(mono0, utc0, mono));
+  iotpf_clock_status(&status);
+  printf("# clock/discipline %d ppb true, %d ppb estimated, %lld ms worst "
+         "between fixes, %lld ms after 1 h holdover (%d uncorrected), "
+         "%d steps back\n", BENCH_CLOCK_PPM * 1000, status.drift_ppb,
+         (long long)worst, (long long)err, -3600 * BENCH_CLOCK_PPM / 1000,
+         back);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void bench_suite_clock(void)
+{
+  /* utc_ms() takes the synchronized path */
+
+  iotpf_clock_reference(IOTPF_CLOCK_GPS,
+                        iotpf_clock_civil_ms(2026, 10, 19, 9, 28, 58, 0),
+                        iotpf_clock_mono_ms());
+  bench_run("clock/mono_ms", bench_mono, NULL);
+  bench_run("clock/utc_ms", bench_utc, NULL);
+  bench_run("clock/civil_ms", bench_civil, NULL);
+  bench_run("clock/libc/realtime", bench_realtime, NULL);
+  bench_run("clock/libc/mktime", bench_mktime, NULL);
+  bench_clock_discipline();
+}
@@ -0,0 +1,141 @@
+/****************************************************************************
+ * external/services/iotpf/host/bench_cmcc.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/* The cmcc adapter is compiled into this file so its static read and
+ * notify encoders can be driven directly.
+ */
+
+#include "../cis_if_api_cmcc.c"
+
+#include "bench.h"
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+typedef struct bench_cmcc_s
+{
+  void *context;
+  cis_uri_t uri;
+  cis_data_t value;
+} bench_cmcc_t;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void bench_uri(cis_uri_t *uri, cis_oid_t oid, cis_iid_t iid,
+                      cis_rid_t rid)
+{
+  uri->objectId = oid;
+  uri->instanceId = iid;
+  uri->resourceId = rid;
+  cis_uri_update(uri);
+}
+
+static void bench_read(void *arg)
+{
+  bench_cmcc_t *b = (bench_cmcc_t *)arg;
+  cis_uri_t uri = b->uri;
+
+  prv_readResponse(b->context, &uri, 1);
+}
+
+static void bench_notify(void *arg)
+{
+  bench_cmcc_t *b = (bench_cmcc_t *)arg;
+  cis_uri_t uri = b->uri;
+
+  prv_observeNotify(b->context, &uri, 1, false);
+}
+
+static void bench_write(void *arg)
+{
+  bench_cmcc_t *b = (bench_cmcc_t *)arg;
+  cis_uri_t uri = b->uri;
+
+  prv_writeResponse(b->context, &uri, &b->value, 1, 1);
+}
+
+/* One extra platform context: created, objects added, torn down */
+
+static void bench_context(void *arg)
+{
+  if (prv_contextAdd(config_hex, sizeof(config_hex)) == 0)
+    {
+      prv_contextRemove(&g_cmcc[--g_cmccCount]);
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void bench_suite_cmcc(void)
+{
+  bench_cmcc_t b;
+
+  if (cis_init(&b.context, NULL, 0) != CIS_RET_OK)
+    {
+      return;
+    }
+
+  prv_make_sample_data();
+
+  bench_uri(&b.uri, SAMPLE_OID_A, URI_INVALID, URI_INVALID);
+  bench_run("cmcc/readResponse/object", bench_read, &b);
+  bench_uri(&b.uri, SAMPLE_OID_A, 0, URI_INVALID);
+  bench_run("cmcc/readResponse/instance", bench_read, &b);
+  bench_uri(&b.uri, SAMPLE_OID_A, 0, attributeA_stringValue);
+  bench_run("cmcc/readResponse/resource", bench_read, &b);
+
+  bench_uri(&b.uri, SAMPLE_OID_B, URI_INVALID, URI_INVALID);
+  bench_run("cmcc/observeNotify/object", bench_notify, &b);
+  bench_uri(&b.uri, SAMPLE_OID_B, 0, URI_INVALID);
+  bench_run("cmcc/observeNotify/instance", bench_notify, &b);
+  bench_uri(&b.uri, SAMPLE_OID_B, 0, attributeB_intValue);
+  bench_run("cmcc/observeNotify/resource", bench_notify, &b);
+
+  bench_uri(&b.uri, SAMPLE_OID_A, 0, attributeA_stringValue);
+  b.value.id = attributeA_stringValue;
+  cis_data_encode_string("hello bench", &b.value);
+  bench_run("cmcc/writeResponse/string", bench_write, &b);
+
+  printf("# st_cmcc_context %zu bytes, %d contexts max\n",
+         sizeof(st_cmcc_context), SAMPLE_CONTEXT_MAX);
+  bench_run("cmcc/context/add", bench_context, NULL);
+
+  cis_deinit(&b.context);
+}
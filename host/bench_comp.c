@@ -0,0 +1,325 @@
+/****************************************************************************
+ * external/services/iotpf/host/bench_comp.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/* Raw uplink compression on the kind of payloads iotpf sends: GPRMC
+ * sentences as handle_gprmc() forwards them, a binary sensor frame with
+ * slowly moving fields, a SenML-ish JSON report, the 6 byte heartbeat and
+ * incompressible bytes. Each payload is a stream of 16 frames; every op
+ * codes the next one. Besides ns/op each payload prints the size after
+ * every codec, with the header byte, and cycles/byte of the full stream
+ * encoder and decoder, counted in TSC cycles where there is a TSC.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "iotpf_comp.h"
+#include "bench.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#define BENCH_COMP_FRAMES       16
+#define BENCH_COMP_MAX          256
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+typedef struct bench_comp_s
+{
+  const char *name;
+  uint8_t frame[BENCH_COMP_FRAMES][BENCH_COMP_MAX];
+  uint16_t len[BENCH_COMP_FRAMES];
+  uint8_t coded[BENCH_COMP_FRAMES][BENCH_COMP_MAX + 1];
+  uint16_t coded_len[BENCH_COMP_FRAMES];
+  uint32_t bytes;           /* all frames, uncompressed */
+  iotpf_comp_t enc;
+  iotpf_comp_t dec;
+  uint8_t out[BENCH_COMP_MAX + 1];
+  uint32_t next;
+} bench_comp_t;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void bench_comp_add(bench_comp_t *b, const void *data, uint32_t len)
+{
+  memcpy(b->frame[b->next], data, len);
+  b->len[b->next] = len;
+  b->bytes += len;
+  b->next = (b->next + 1) % BENCH_COMP_FRAMES;
+}
+
+static void bench_comp_gprmc(bench_comp_t *b)
+{
+  char line[96];
+  int i;
+
+  for (i = 0; i < BENCH_COMP_FRAMES; i++)
+    {
+      uint8_t sum = 0;
+      char *p;
+      int n;
+
+      n = snprintf(line, sizeof(line),
+                   "$GPRMC,0928%02d.000,A,3114.%04d,N,12128.%04d,E,%d.%02d,"
+                   "%d.%02d,191026,,,A", 58 + i, 3960 + i * 7, 7430 - i * 3,
+                   i / 4, i * 13 % 100, 87 + i % 3, i * 29 % 100);
+      for (p = line + 1; *p != '\0'; p++)
+        {
+          sum ^= *p;
+        }
+      n += snprintf(line + n, sizeof(line) - n, "*%02X", sum);
+      bench_comp_add(b, line, n);
+    }
+}
+
+static void bench_comp_sensor(bench_comp_t *b)
+{
+  uint8_t f[32];
+  int i;
+
+  for (i = 0; i < BENCH_COMP_FRAMES; i++)
+    {
+      int16_t temp = 2310 + i % 5 - 2;
+      uint16_t hum = 4120 + i * 3;
+      uint32_t pressure = 101325 - i;
+      uint16_t mv = 3612 - i / 8;
+
+      memset(f, 0, sizeof(f));
+      memcpy(f, "\x01\x02\x0b\xee", 4);          /* type and device */
+      f[4] = i;                                   /* sequence */
+      memcpy(f + 6, &temp, 2);
+      memcpy(f + 8, &hum, 2);
+      memcpy(f + 12, &pressure, 4);
+      memcpy(f + 16, &mv, 2);
+      f[20] = 0x80;                               /* status flags */
+      bench_comp_add(b, f, sizeof(f));
+    }
+}
+
+static void bench_comp_json(bench_comp_t *b)
+{
+  char s[160];
+  int i;
+
+  for (i = 0; i < BENCH_COMP_FRAMES; i++)
+    {
+      int n = snprintf(s, sizeof(s),
+                       "[{\"bn\":\"urn:dev:imei:861234567890123:\","
+                       "\"bt\":%d},{\"n\":\"temp\",\"v\":23.%d},"
+                       "{\"n\":\"hum\",\"v\":%d},{\"n\":\"bat\",\"v\":3.6%d}]",
+                       1760860000 + i * 60, i % 10, 41 + i % 3, 1 - i / 8);
+
+      bench_comp_add(b, s, n);
+    }
+}
+
+static void bench_comp_heartbeat(bench_comp_t *b)
+{
+  static const uint8_t hb[6] = { 0x05, 0x40, 0x41, 0x42, 0x43, 0x44 };
+  int i;
+
+  for (i = 0; i < BENCH_COMP_FRAMES; i++)
+    {
+      bench_comp_add(b, hb, sizeof(hb));
+    }
+}
+
+static void bench_comp_random(bench_comp_t *b)
+{
+  uint8_t f[64];
+  int i;
+  int j;
+
+  srand(1);
+  for (i = 0; i < BENCH_COMP_FRAMES; i++)
+    {
+      for (j = 0; j < sizeof(f); j++)
+        {
+          f[j] = rand();
+        }
+      bench_comp_add(b, f, sizeof(f));
+    }
+}
+
+static void bench_lz(void *arg)
+{
+  bench_comp_t *b = (bench_comp_t *)arg;
+  uint32_t i = b->next++ % BENCH_COMP_FRAMES;
+
+  iotpf_comp_lz(b->frame[i], b->len[i], b->out, sizeof(b->out));
+}
+
+static void bench_delta(void *arg)
+{
+  bench_comp_t *b = (bench_comp_t *)arg;
+  uint32_t i = b->next++ % BENCH_COMP_FRAMES;
+  uint32_t prev = (i + BENCH_COMP_FRAMES - 1) % BENCH_COMP_FRAMES;
+
+  iotpf_comp_delta(b->frame[i], b->frame[prev], b->len[i], b->out,
+                   sizeof(b->out));
+}
+
+static void bench_encode(void *arg)
+{
+  bench_comp_t *b = (bench_comp_t *)arg;
+  uint32_t i = b->next++ % BENCH_COMP_FRAMES;
+
+  iotpf_comp_encode(&b->enc, b->frame[i], b->len[i], b->out);
+}
+
+static void bench_decode(void *arg)
+{
+  bench_comp_t *b = (bench_comp_t *)arg;
+  uint32_t i = b->next++ % BENCH_COMP_FRAMES;
+
+  if (iotpf_comp_decode(&b->dec, b->coded[i], b->coded_len[i], b->out,
+                        sizeof(b->out)) != b->len[i])
+    {
+      abort();
+    }
+}
+
+/* TSC ticks per ns, 0 without a TSC */
+
+static double bench_comp_ghz(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  struct timespec t0;
+  struct timespec t1;
+  uint64_t c0;
+  uint64_t c1;
+  double ns;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  c0 = __rdtsc();
+  do
+    {
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    }
+  while (ns < 20e6);
+  c1 = __rdtsc();
+  return (c1 - c0) / ns;
+#else
+  return 0;
+#endif
+}
+
+static void bench_comp_payload(const char *name,
+                               void (*fill)(bench_comp_t *b), double ghz)
+{
+  static bench_comp_t b;
+  uint32_t lz = 0;
+  uint32_t delta = 0;
+  uint32_t stream = 0;
+  double avg;
+  double enc;
+  double dec;
+  char title[48];
+  int i;
+
+  memset(&b, 0, sizeof(b));
+  fill(&b);
+  avg = (double)b.bytes / BENCH_COMP_FRAMES;
+
+  /* Sizes over one pass of the stream, the first frame without delta */
+
+  for (i = 0; i < BENCH_COMP_FRAMES; i++)
+    {
+      int n;
+
+      n = iotpf_comp_lz(b.frame[i], b.len[i], b.out, b.len[i]);
+      lz += 1 + (n >= 0 ? n : b.len[i]);
+      n = i == 0 || b.len[i] != b.len[i - 1] ? -1 :
+          iotpf_comp_delta(b.frame[i], b.frame[i - 1], b.len[i], b.out,
+                           b.len[i]);
+      delta += 1 + (n >= 0 ? n : b.len[i]);
+      b.coded_len[i] = iotpf_comp_encode(&b.enc, b.frame[i], b.len[i],
+                                         b.coded[i]);
+      stream += b.coded_len[i];
+    }
+
+  snprintf(title, sizeof(title), "comp/lz/%s", name);
+  bench_run(title, bench_lz, &b);
+  snprintf(title, sizeof(title), "comp/delta/%s", name);
+  bench_run(title, bench_delta, &b);
+  snprintf(title, sizeof(title), "comp/encode/%s", name);
+  bench_run(title, bench_encode, &b);
+  enc = bench_last_ns();
+
+  /* The decoder has to see the frames in order, from the key frame on */
+
+  b.next = 0;
+  snprintf(title, sizeof(title), "comp/decode/%s", name);
+  bench_run(title, bench_decode, &b);
+  dec = bench_last_ns();
+
+  if (enc == 0 || dec == 0)
+    {
+      return;
+    }
+
+  printf("# comp/%-10s %5.1f B/frame, lz %5.1f%% delta %5.1f%% "
+         "stream %5.1f%%, encode %5.1f decode %4.1f %s/B\n", name, avg,
+         lz * 100.0 / b.bytes, delta * 100.0 / b.bytes,
+         stream * 100.0 / b.bytes, (ghz ? enc * ghz : enc) / avg,
+         (ghz ? dec * ghz : dec) / avg, ghz ? "cycles" : "ns");
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void bench_suite_comp(void)
+{
+  double ghz = bench_comp_ghz();
+
+  bench_comp_payload("gprmc", bench_comp_gprmc, ghz);
+  bench_comp_payload("sensor", bench_comp_sensor, ghz);
+  bench_comp_payload("json", bench_comp_json, ghz);
+  bench_comp_payload("heartbeat", bench_comp_heartbeat, ghz);
+  bench_comp_payload("random", bench_comp_random, ghz);
+}
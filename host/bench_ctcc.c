@@ -0,0 +1,164 @@
+/****************************************************************************
+ * external/services/iotpf/host/bench_ctcc.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/* The ctcc adapter is compiled into this file for its static object
+ * dispatch; the light control object is linked as usual.
+ */
+
+#include "../cis_if_api_ctcc.c"
+
+#include "bench.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+/* Dimmer, private to object_light_control.c */
+
+#define BENCH_LIGHT_DIMMER      5851
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+typedef struct bench_light_s
+{
+  void *context;
+  cis_uri_t uri;
+  cis_data_t value;
+} bench_light_t;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void bench_uri(cis_uri_t *uri, cis_iid_t iid, cis_rid_t rid)
+{
+  uri->objectId = LIGHT_CONTROL_OBJECT_ID;
+  uri->instanceId = iid;
+  uri->resourceId = rid;
+  cis_uri_update(uri);
+}
+
+static void bench_on_read(void *arg)
+{
+  bench_light_t *b = (bench_light_t *)arg;
+  cis_uri_t uri = b->uri;
+
+  cis_api_onRead(b->context, &uri, 1);
+}
+
+static void bench_on_write(void *arg)
+{
+  bench_light_t *b = (bench_light_t *)arg;
+  cis_uri_t uri = b->uri;
+
+  cis_api_onWrite(b->context, &uri, &b->value, 1, 1);
+}
+
+static void bench_light_read(void *arg)
+{
+  bench_light_t *b = (bench_light_t *)arg;
+  cis_uri_t uri = b->uri;
+
+  light_control_read(b->context, &uri, 1);
+}
+
+static void bench_light_notify(void *arg)
+{
+  bench_light_t *b = (bench_light_t *)arg;
+
+  light_control_notify(b->context);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void bench_suite_ctcc(void)
+{
+  static const int counts[] = { 1, 8, 32 };
+  st_object_t *obj;
+  bench_light_t b;
+  char name[48];
+  unsigned i;
+  int n;
+
+  if (cis_init_with_vendor(&b.context, NULL, 0, 0) != CIS_RET_OK)
+    {
+      return;
+    }
+
+  cis_addobject(b.context, LIGHT_CONTROL_OBJECT_ID, NULL, NULL);
+  obj = cis_findObject(b.context, LIGHT_CONTROL_OBJECT_ID);
+
+  bench_uri(&b.uri, 0, BENCH_LIGHT_DIMMER);
+  b.value.id = BENCH_LIGHT_DIMMER;
+  cis_data_encode_int(60, &b.value);
+
+  for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+    {
+      light_control_clean(b.context);
+      for (n = 0; n < counts[i]; n++)
+        {
+          light_control_create(b.context, n, obj);
+        }
+
+      bench_uri(&b.uri, URI_INVALID, URI_INVALID);
+      snprintf(name, sizeof(name), "ctcc/onRead/object/inst%d", counts[i]);
+      bench_run(name, bench_on_read, &b);
+
+      snprintf(name, sizeof(name), "light/read/object/inst%d", counts[i]);
+      bench_run(name, bench_light_read, &b);
+
+      bench_uri(&b.uri, counts[i] - 1, URI_INVALID);
+      snprintf(name, sizeof(name), "light/read/instance/inst%d", counts[i]);
+      bench_run(name, bench_light_read, &b);
+
+      bench_uri(&b.uri, counts[i] - 1, BENCH_LIGHT_DIMMER);
+      snprintf(name, sizeof(name), "ctcc/onWrite/resource/inst%d", counts[i]);
+      bench_run(name, bench_on_write, &b);
+
+      /* One observation on the whole object, as ctwing sets it up */
+
+      bench_uri(&b.uri, URI_INVALID, URI_INVALID);
+      light_control_observe(b.context, &b.uri, true, 1);
+      snprintf(name, sizeof(name), "light/notify/object/inst%d", counts[i]);
+      bench_run(name, bench_light_notify, &b);
+    }
+
+  light_control_clean(b.context);
+  cis_deinit(&b.context);
+}
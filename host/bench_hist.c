@@ -0,0 +1,139 @@
+/****************************************************************************
+ * external/services/iotpf/host/bench_hist.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/* Cost of a latency sample on the hot paths, next to the plain counter
+ * bump it sits beside, and how far the bucket bounds put the reported
+ * percentiles from the exact ones over a long-tailed set of spans.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iotpf_hist.h"
+#include "bench.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#define BENCH_HIST_SAMPLES      100000
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static iotpf_hist_t g_bench_hist;
+static uint32_t g_bench_counter;
+static uint32_t g_bench_value;
+static uint32_t g_bench_spans[BENCH_HIST_SAMPLES];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void bench_add(void *arg)
+{
+  iotpf_hist_add(&g_bench_hist, g_bench_value++ & 0xffff);
+}
+
+static void bench_counter(void *arg)
+{
+  __atomic_fetch_add(&g_bench_counter, 1, __ATOMIC_RELAXED);
+}
+
+static void bench_now(void *arg)
+{
+  g_bench_value += iotpf_hist_now_us();
+}
+
+static int bench_hist_cmp(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* Mostly a few hundred ms, now and then seconds: ACKs after loss */
+
+static void bench_hist_accuracy(void)
+{
+  static const uint32_t permille[] = { 500, 900, 990, 999 };
+  iotpf_hist_t h;
+  unsigned i;
+
+  memset(&h, 0, sizeof(h));
+  srand(1);
+  for (i = 0; i < BENCH_HIST_SAMPLES; i++)
+    {
+      uint32_t v = 200 + rand() % 300;
+
+      if (rand() % 20 == 0)
+        {
+          v += 2000 << (rand() % 4);
+        }
+      g_bench_spans[i] = v;
+      iotpf_hist_add(&h, v);
+    }
+
+  qsort(g_bench_spans, BENCH_HIST_SAMPLES, sizeof(uint32_t), bench_hist_cmp);
+  printf("# hist/accuracy %u samples in %u bytes:", iotpf_hist_count(&h),
+         (unsigned)sizeof(h));
+  for (i = 0; i < sizeof(permille) / sizeof(permille[0]); i++)
+    {
+      uint32_t exact = g_bench_spans[(BENCH_HIST_SAMPLES * permille[i] +
+                                      999) / 1000 - 1];
+      uint32_t got = iotpf_hist_percentile(&h, permille[i]);
+
+      printf(" p%u.%u %u/%u (+%u%%)", permille[i] / 10, permille[i] % 10,
+             got, exact, (got - exact) * 100 / exact);
+    }
+
+  printf("\n");
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void bench_suite_hist(void)
+{
+  bench_run("hist/add", bench_add, NULL);
+  bench_run("hist/stat_inc", bench_counter, NULL);
+  bench_run("hist/now_us", bench_now, NULL);
+  bench_hist_accuracy();
+}
@@ -0,0 +1,177 @@
+/****************************************************************************
+ * external/services/iotpf/host/bench_log.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/* Per event cost of the LOGx() macros against the deferred DLOGx() ones,
+ * with the host console at debug level and pointed at /dev/null: the
+ * numbers are formatting and the write() call, without UART time.
+ * log/drain cases are the work the drain thread does later per record.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "cis_log.h"
+#include "iotpf_dlog.h"
+#include "bench.h"
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+typedef struct bench_hex_s
+{
+  const uint8_t *data;
+  uint32_t len;
+} bench_hex_t;
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static uint8_t g_log_bytes[256];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void bench_logi_int(void *arg)
+{
+  LOGI("cis_pump result:%d,%d", 1, 60);
+}
+
+static void bench_dlogi_int(void *arg)
+{
+  DLOGI("cis_pump result:%d,%d", 1, 60);
+}
+
+/* What recv_data_from_server() did before the deferred logger */
+
+static void bench_logi_hex(void *arg)
+{
+  bench_hex_t *h = (bench_hex_t *)arg;
+  char *buf;
+  int bufLen = 0;
+  int i;
+
+  buf = (char *)malloc(2 * h->len + 1);
+  memset(buf, 0x0, 2 * h->len + 1);
+  for (i = 0; i < h->len; i++)
+    {
+      bufLen += snprintf(buf + bufLen, 2 * h->len + 1 - bufLen, "%02X",
+                         h->data[i]);
+    }
+  LOGI("user_thread: recv data: %d,%s.", h->len, buf);
+  free(buf);
+}
+
+static void bench_dlogi_hex(void *arg)
+{
+  bench_hex_t *h = (bench_hex_t *)arg;
+
+  DLOGI_HEX("user_thread: recv data: %u,", h->data, h->len);
+}
+
+#ifdef CIS_DLOG
+static void bench_drain(void *arg)
+{
+  char line[160];
+
+  iotpf_dlog_format((iotpf_dlog_rec_t *)arg, line, sizeof(line));
+  LOGI("%s", line);
+}
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void bench_suite_log(void)
+{
+  static const uint32_t sizes[] = { 32, 256 };
+  char name[48];
+  bench_hex_t h;
+  int saved;
+  int null;
+  unsigned i;
+
+  for (i = 0; i < sizeof(g_log_bytes); i++)
+    {
+      g_log_bytes[i] = i * 13;
+    }
+
+  fflush(stderr);
+  saved = dup(STDERR_FILENO);
+  null = open("/dev/null", O_WRONLY);
+  dup2(null, STDERR_FILENO);
+  close(null);
+  cis_host_log_level('D');
+
+  bench_run("log/LOGI/int2", bench_logi_int, NULL);
+  bench_run("log/DLOGI/int2", bench_dlogi_int, NULL);
+
+  h.data = g_log_bytes;
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+      h.len = sizes[i];
+      snprintf(name, sizeof(name), "log/LOGI/hex/%u", sizes[i]);
+      bench_run(name, bench_logi_hex, &h);
+      snprintf(name, sizeof(name), "log/DLOGI_HEX/hex/%u", sizes[i]);
+      bench_run(name, bench_dlogi_hex, &h);
+    }
+
+#ifdef CIS_DLOG
+  {
+    iotpf_dlog_rec_t rec;
+
+    bench_dlogi_int(NULL);
+    iotpf_dlog_pop(&rec);
+    bench_run("log/drain/int2", bench_drain, &rec);
+
+    h.len = sizes[0];
+    bench_dlogi_hex(&h);
+    iotpf_dlog_pop(&rec);
+    bench_run("log/drain/hex/32", bench_drain, &rec);
+  }
+#endif
+
+  cis_host_log_level('E');
+  fflush(stderr);
+  dup2(saved, STDERR_FILENO);
+  close(saved);
+}
@@ -0,0 +1,182 @@
+/****************************************************************************
+ * external/services/iotpf/host/bench_user.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/* iotpf_user.c is compiled into this file so its static uplink, downlink
+ * and $GPRMC paths can be driven directly.
+ */
+
+#include "../iotpf_user.c"
+
+#include "bench.h"
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+typedef struct bench_payload_s
+{
+  user_thread_context_t *utc;
+  uint8_t *data;
+  uint32_t len;
+} bench_payload_t;
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static user_thread_context_t g_bench_utc;
+static uint8_t g_bench_data[1024];
+
+static const char g_bench_gprmc[] =
+  "$GPRMC,092858.000,A,3114.3960,N,12128.7430,E,0.00,0.00,191026,,,A*6B";
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void bench_uplink(void *arg)
+{
+  bench_payload_t *p = (bench_payload_t *)arg;
+
+  send_data_to_server(p->utc, p->data, p->len, IOTPF_REL_TELEMETRY);
+  cisapi_send_data_to_server(p->utc);
+}
+
+static void bench_downlink(void *arg)
+{
+  bench_payload_t *p = (bench_payload_t *)arg;
+
+  cisapi_recv_data_from_server(p->utc, p->data, p->len);
+  recv_data_from_server(p->utc);
+}
+
+/* What handle_gprmc() used to build from g_bench_gprmc before records */
+
+static void bench_csv(void *arg)
+{
+  char *out = (char *)arg;
+
+  sprintf(out, "%s,%s,%s,%s,%013llu,%u", "092858.000", "3114.3960",
+          "12128.7430", "191026", (unsigned long long)g_gps_fix.time_ms,
+          (unsigned)(g_gps_fix.time_ms / 1000));
+}
+
+static void bench_record(void *arg)
+{
+  user_report_encode((uint8_t *)arg, IOTPF_REC_MAX);
+}
+
+static void bench_record_decode(void *arg)
+{
+  iotpf_rec_reader_t r;
+  iotpf_rec_value_t v;
+
+  iotpf_rec_open(&r, g_bench_data, g_bench_data[IOTPF_REC_MAX]);
+  while (iotpf_rec_next(&r, &v) > 0)
+    {
+    }
+}
+
+static void bench_gprmc(void *arg)
+{
+  char line[sizeof(g_bench_gprmc)];
+
+  /* The tokenizer cuts the line in place */
+
+  memcpy(line, g_bench_gprmc, sizeof(line));
+  handle_gprmc(line);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void bench_suite_user(void)
+{
+  static const uint32_t sizes[] = { 16, 256, 1024 };
+  bench_payload_t p;
+  char name[48];
+  unsigned i;
+
+  pipe(g_bench_utc.send_pipe_fd);
+  pipe(g_bench_utc.recv_pipe_fd);
+  file_detach(g_bench_utc.send_pipe_fd[1], &g_bench_utc.send_pipe_file);
+  file_detach(g_bench_utc.recv_pipe_fd[0], &g_bench_utc.recv_pipe_file);
+  for (i = 0; i < sizeof(g_bench_data); i++)
+    {
+      g_bench_data[i] = i * 7;
+    }
+
+  p.utc = &g_bench_utc;
+  p.data = g_bench_data;
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+      p.len = sizes[i];
+      snprintf(name, sizeof(name), "uplink/queue+send/%u", sizes[i]);
+      bench_run(name, bench_uplink, &p);
+    }
+
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+      p.len = sizes[i];
+      snprintf(name, sizeof(name), "downlink/deliver/%u", sizes[i]);
+      bench_run(name, bench_downlink, &p);
+    }
+
+  pthread_mutex_init(&g_gps_mutex, NULL);
+  pthread_cond_init(&g_gps_cond, NULL);
+  bench_run("gps/handle_gprmc", bench_gprmc, NULL);
+
+  /* The report as it goes up now, with the fix just parsed, against the
+   * CSV text of the same fix. The decoder reads a copy of the record
+   * whose length sits right behind it.
+   */
+
+  {
+    char csv[96];
+    uint8_t hb[IOTPF_REC_MAX];
+    int len;
+
+    bench_gprmc(NULL);
+    bench_run("rec/report/csv", bench_csv, csv);
+    bench_run("rec/report/encode", bench_record, g_bench_data);
+    len = user_report_encode(g_bench_data, IOTPF_REC_MAX);
+    g_bench_data[IOTPF_REC_MAX] = len;
+    bench_run("rec/report/decode", bench_record_decode, NULL);
+    printf("# rec/report     csv %zu B, record %d B; heartbeat 6 B, "
+           "record %d B\n", strlen(csv), len,
+           user_heartbeat_encode(hb, sizeof(hb)));
+  }
+}
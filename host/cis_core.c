@@ -0,0 +1,2057 @@
+/****************************************************************************
+ * external/services/iotpf/host/cis_core.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "cis_api.h"
+#include "cis_internals.h"
+#include "cis_log.h"
+#include "coap.h"
+#include "senml.h"
+#include "host_platform.h"
+
+/* Host implementation of the iotpf_lib core: a small LwM2M client over
+ * plain CoAP/UDP. It registers with the server named by IOTPF_SERVER
+ * (default 127.0.0.1:5683), serves Read/Write/Execute/Observe/Discover
+ * through the adapter callbacks and carries ctcc raw data on /19/0/0
+ * (uplink notifications) and /19/1/0 (downlink writes). Firmware written
+ * to /5/0/0 goes to the ctcc adapter's download sink. Built with
+ * CIS_HOST_DTLS it runs all of that over DTLS with a PSK, see dtls.h, and
+ * offers the session of its last handshake on the next one.
+ */
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#define CIS_HOST_SERVER         "127.0.0.1:5683"
+#define CIS_HOST_RAW_OID        19
+#define CIS_HOST_IDLE_S         60
+#define CIS_HOST_REQUEST_MS     60000  /* adapter never answered */
+#define CIS_HOST_HANDSHAKE_MS   60000  /* DTLS flights unanswered */
+
+#define TX_REGISTER             1
+#define TX_UPDATE               2
+#define TX_DEREGISTER           3
+#define TX_NOTIFY               4
+#define TX_RESPONSE             5
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static st_context_t *g_context;
+static int g_wake_pipe[2] = { -1, -1 };
+static pthread_t g_pump_tid;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void prv_event(st_context_t *ctx, cis_evt_t eid, cis_mid_t mid)
+{
+  LOGD("core: event %s", cis_event_str(eid));
+  if (ctx->callback.onEvent != NULL)
+    {
+      ctx->callback.onEvent(ctx, eid, (void *)(uintptr_t)mid);
+    }
+}
+
+static uint16_t prv_coap_mid(st_context_t *ctx)
+{
+  return ctx->nextCoapMid++;
+}
+
+static cis_mid_t prv_next_mid(st_context_t *ctx)
+{
+  int i;
+
+  for (; ; )
+    {
+      bool used = false;
+
+      ctx->nextMid = (ctx->nextMid + 1) & 0xffff;
+      if (ctx->nextMid == 0)
+        {
+          continue;
+        }
+
+      for (i = 0; i < CIS_HOST_PENDING_MAX; i++)
+        {
+          used |= ctx->request[i].mid == ctx->nextMid;
+        }
+
+      for (i = 0; i < CIS_HOST_OBSERVE_MAX; i++)
+        {
+          used |= ctx->observe[i].mid == ctx->nextMid;
+        }
+
+      if (!used)
+        {
+          return ctx->nextMid;
+        }
+    }
+}
+
+static int prv_send_raw(st_context_t *ctx, const uint8_t *buf, int len)
+{
+  if (ctx->net.sock < 0 || len < 0)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  if (send(ctx->net.sock, buf, len, 0) != len)
+    {
+      LOGE("core: send %d bytes: %s", len, strerror(errno));
+      return CIS_RET_ERROR;
+    }
+
+  cis_host_radio_traffic();
+  return CIS_RET_OK;
+}
+
+#ifdef CIS_HOST_DTLS
+static int prv_dtls_flush(st_context_t *ctx)
+{
+  uint8_t buf[DTLS_MTU + 256];
+  int ret = CIS_RET_OK;
+  int n;
+
+  while ((n = dtls_output(ctx->ssl, buf, sizeof(buf))) > 0)
+    {
+      ret |= prv_send_raw(ctx, buf, n);
+    }
+
+  return ret;
+}
+#endif
+
+static int prv_send(st_context_t *ctx, const uint8_t *buf, int len)
+{
+#ifdef CIS_HOST_DTLS
+  if (ctx->ssl == NULL || !ctx->secure || len < 0)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  if (SSL_write(ctx->ssl, buf, len) != len)
+    {
+      LOGE("core: dtls write %d bytes failed", len);
+      return CIS_RET_ERROR;
+    }
+
+  return prv_dtls_flush(ctx);
+#else
+  return prv_send_raw(ctx, buf, len);
+#endif
+}
+
+/* Queues a CON message we sent for retransmission until it is ACKed */
+
+static int prv_tx(st_context_t *ctx, uint8_t kind, cis_mid_t mid,
+                  const uint8_t *buf, int len)
+{
+  st_host_tx_t *tx = NULL;
+  int i;
+
+  if (len < 0)
+    {
+      LOGE("core: message too large");
+      return CIS_RET_ERROR;
+    }
+
+  for (i = 0; i < CIS_HOST_TX_MAX && tx == NULL; i++)
+    {
+      if (ctx->tx[i].kind == 0)
+        {
+          tx = &ctx->tx[i];
+        }
+    }
+
+  if (tx == NULL)
+    {
+      LOGE("core: too many messages in flight");
+      return CIS_RET_ERROR;
+    }
+
+  tx->kind = kind;
+  tx->mid = mid;
+  tx->coapMid = (buf[2] << 8) | buf[3];
+  tx->retries = 0;
+  tx->sent = cissys_gettime();
+  tx->timeout = COAP_ACK_TIMEOUT_MS + cissys_rand() % (COAP_ACK_TIMEOUT_MS / 2);
+  tx->deadline = tx->sent + tx->timeout;
+  tx->len = len;
+  memcpy(tx->buf, buf, len);
+  return prv_send(ctx, buf, len);
+}
+
+static void prv_body_reset(st_host_body_t *body, uint8_t format)
+{
+  body->format = format;
+  body->count = 0;
+  body->len = 0;
+}
+
+static int prv_body_add(st_host_body_t *body, const cis_uri_t *base,
+                        const cis_uri_t *uri, const cis_data_t *value)
+{
+  senml_writer_t w;
+  char link[32];
+  int n;
+
+  /* Discover answers name only the resource, the rest comes from the
+   * request.
+   */
+
+  if (value == NULL)
+    {
+      n = snprintf(link, sizeof(link), "</%u", base->objectId);
+      if (CIS_URI_IS_SET_INSTANCE(base))
+        {
+          n += snprintf(link + n, sizeof(link) - n, "/%u", base->instanceId);
+        }
+      if (uri->resourceId != URI_INVALID)
+        {
+          n += snprintf(link + n, sizeof(link) - n, "/%u", uri->resourceId);
+        }
+
+      n = snprintf(body->data + body->len, sizeof(body->data) - body->len,
+                   "%s%s>", body->count ? "," : "", link);
+      if (body->len + n >= sizeof(body->data))
+        {
+          return CIS_RET_ERROR;
+        }
+
+      body->format = COAP_FORMAT_LINK;
+      body->len += n;
+      body->count++;
+      return CIS_RET_OK;
+    }
+
+  /* Leave room for the closing bracket */
+
+  if (body->count == 0)
+    {
+      senml_begin(&w, body->data, sizeof(body->data) - 1);
+    }
+  else
+    {
+      w.buf = body->data;
+      w.size = sizeof(body->data) - 1;
+      w.len = body->len;
+      w.count = body->count;
+    }
+
+  if (senml_add(&w, uri, value) < 0)
+    {
+      LOGE("core: response body full");
+      return CIS_RET_ERROR;
+    }
+
+  body->format = COAP_FORMAT_SENML_JSON;
+  body->len = w.len;
+  body->count = w.count;
+  return CIS_RET_OK;
+}
+
+static void prv_body_close(st_host_body_t *body)
+{
+  if (body->format == COAP_FORMAT_SENML_JSON && body->count > 0)
+    {
+      body->data[body->len++] = ']';
+    }
+}
+
+static void prv_cache(st_context_t *ctx, const uint8_t *buf, int len)
+{
+  st_host_cache_t *c = &ctx->cache[ctx->cacheNext++ % CIS_HOST_CACHE_MAX];
+
+  c->coapMid = (buf[2] << 8) | buf[3];
+  c->len = len;
+  memcpy(c->buf, buf, len);
+}
+
+static st_host_request_t *prv_request(st_context_t *ctx, cis_mid_t mid)
+{
+  int i;
+
+  for (i = 0; i < CIS_HOST_PENDING_MAX; i++)
+    {
+      if (ctx->request[i].mid != 0 && ctx->request[i].mid == mid)
+        {
+          return &ctx->request[i];
+        }
+    }
+
+  return NULL;
+}
+
+static st_host_observe_t *prv_observe(st_context_t *ctx, cis_mid_t mid)
+{
+  int i;
+
+  for (i = 0; i < CIS_HOST_OBSERVE_MAX; i++)
+    {
+      if (ctx->observe[i].mid != 0 && ctx->observe[i].mid == mid)
+        {
+          return &ctx->observe[i];
+        }
+    }
+
+  return NULL;
+}
+
+/* Answers a server request: piggybacked if it was not ACKed yet, as a
+ * separate CON response otherwise.
+ */
+
+static void prv_answer(st_context_t *ctx, st_host_request_t *req,
+                       uint8_t code)
+{
+  uint8_t buf[COAP_HDR_MAX + CIS_HOST_BODY_MAX];
+  st_host_observe_t *obs = req->observe ? prv_observe(ctx, req->mid) : NULL;
+  coap_writer_t w;
+  uint8_t type;
+  uint16_t coapMid = req->coapMid;
+  int len;
+
+  if (req->type == COAP_TYPE_NON)
+    {
+      type = COAP_TYPE_NON;
+      coapMid = prv_coap_mid(ctx);
+    }
+  else if (req->acked)
+    {
+      type = COAP_TYPE_CON;
+      coapMid = prv_coap_mid(ctx);
+    }
+  else
+    {
+      type = COAP_TYPE_ACK;
+    }
+
+  prv_body_close(&req->body);
+  coap_begin(&w, buf, sizeof(buf), type, code, coapMid, req->token, req->tkl);
+  if (obs != NULL && (code >> 5) == 2)
+    {
+      coap_option_u(&w, COAP_OPT_OBSERVE, obs->seq++);
+    }
+  if (req->body.len > 0)
+    {
+      coap_option_u(&w, COAP_OPT_CONTENT_FORMAT, req->body.format);
+      coap_payload(&w, req->body.data, req->body.len);
+    }
+
+  len = coap_end(&w);
+  if (type == COAP_TYPE_CON)
+    {
+      prv_tx(ctx, TX_RESPONSE, req->mid, buf, len);
+    }
+  else if (len > 0)
+    {
+      prv_send(ctx, buf, len);
+      if (type == COAP_TYPE_ACK)
+        {
+          prv_cache(ctx, buf, len);
+        }
+    }
+
+  if (obs != NULL && (code >> 5) != 2)
+    {
+      obs->mid = 0;
+    }
+
+  req->mid = 0;
+}
+
+/* block1: the Block1 option of msg to echo, NULL for none */
+
+static void prv_reply_block(st_context_t *ctx, const coap_msg_t *msg,
+                            uint8_t code, const coap_option_t *block1)
+{
+  uint8_t buf[COAP_HDR_MAX];
+  coap_writer_t w;
+  int len;
+
+  coap_begin(&w, buf, sizeof(buf),
+             msg->type == COAP_TYPE_CON ? COAP_TYPE_ACK : COAP_TYPE_NON,
+             code, msg->type == COAP_TYPE_CON ? msg->mid : prv_coap_mid(ctx),
+             msg->token, msg->tkl);
+  if (block1 != NULL)
+    {
+      coap_option(&w, COAP_OPT_BLOCK1, block1->val, block1->len);
+    }
+  len = coap_end(&w);
+  prv_send(ctx, buf, len);
+  if (msg->type == COAP_TYPE_CON && len > 0)
+    {
+      prv_cache(ctx, buf, len);
+    }
+}
+
+static void prv_reply(st_context_t *ctx, const coap_msg_t *msg, uint8_t code)
+{
+  prv_reply_block(ctx, msg, code, NULL);
+}
+
+/* The cmcc adapter keeps its object links prebuilt (cis_if_api_cmcc.h);
+ * when it offers them they replace the walk over the object list.
+ */
+
+const char *cisapi_cmcc_object_links(void) __attribute__((weak));
+
+static void prv_links(st_context_t *ctx, char *buf, int size)
+{
+  const char *prebuilt = NULL;
+  st_object_t *obj;
+  int len;
+  int i;
+
+  len = snprintf(buf, size, "</>;rt=\"oma.lwm2m\";ct=%d",
+                 COAP_FORMAT_SENML_JSON);
+  if (cisapi_cmcc_object_links)
+    {
+      prebuilt = cisapi_cmcc_object_links();
+    }
+
+  if (prebuilt != NULL)
+    {
+      len += snprintf(buf + len, size - len, ",%s", prebuilt);
+    }
+
+  for (obj = ctx->objectList;
+       prebuilt == NULL && obj != NULL && len < size; obj = obj->next)
+    {
+      bool any = false;
+
+      for (i = 0; obj->instBitmapPtr != NULL && i < obj->instBitmapCount; i++)
+        {
+          if (obj->instBitmapPtr[i / 8] & (0x80 >> (i % 8)))
+            {
+              len += snprintf(buf + len, size - len, ",</%u/%d>",
+                              obj->objID, i);
+              any = true;
+            }
+        }
+
+      if (!any)
+        {
+          len += snprintf(buf + len, size - len, ",</%u/0>", obj->objID);
+        }
+    }
+
+  if (ctx->vendor && len < size)
+    {
+      snprintf(buf + len, size - len, ",</%d/0>,</%d/1>",
+               CIS_HOST_RAW_OID, CIS_HOST_RAW_OID);
+    }
+}
+
+/* Closes the socket. A DTLS session that got through its handshake is
+ * kept to be offered again on the next one.
+ */
+
+static void prv_close(st_context_t *ctx)
+{
+#ifdef CIS_HOST_DTLS
+  if (ctx->ssl != NULL && ctx->secure)
+    {
+      SSL_SESSION_free(ctx->session);
+      ctx->session = SSL_get1_session(ctx->ssl);
+    }
+
+  SSL_free(ctx->ssl);
+  ctx->ssl = NULL;
+  ctx->secure = false;
+#endif
+  if (ctx->net.sock >= 0)
+    {
+      close(ctx->net.sock);
+      ctx->net.sock = -1;
+    }
+}
+
+#ifdef CIS_HOST_DTLS
+static int prv_dtls_start(st_context_t *ctx)
+{
+  static SSL_CTX *dtls_ctx;
+
+  if (dtls_ctx == NULL)
+    {
+      dtls_ctx = dtls_context(false);
+    }
+
+  ctx->ssl = dtls_ctx != NULL ? dtls_new(dtls_ctx, false) : NULL;
+  if (ctx->ssl == NULL)
+    {
+      LOGE("core: no DTLS context");
+      return CIS_RET_ERROR;
+    }
+
+  if (ctx->session != NULL)
+    {
+      SSL_set_session(ctx->ssl, ctx->session);
+    }
+
+  ctx->secure = false;
+  ctx->handshakeStart = cissys_gettime();
+  SSL_do_handshake(ctx->ssl);
+  return prv_dtls_flush(ctx);
+}
+#endif
+
+static int prv_connect(st_context_t *ctx)
+{
+  if (ctx->net.sock >= 0)
+    {
+      return CIS_RET_OK;
+    }
+
+  ctx->net.sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (ctx->net.sock < 0 ||
+      connect(ctx->net.sock, (struct sockaddr *)&ctx->server,
+              sizeof(ctx->server)) < 0)
+    {
+      LOGE("core: connect: %s", strerror(errno));
+      if (ctx->net.sock >= 0)
+        {
+          close(ctx->net.sock);
+          ctx->net.sock = -1;
+        }
+      prv_event(ctx, CIS_EVENT_CONNECT_FAILED, 0);
+      return CIS_RET_ERROR;
+    }
+
+  fcntl(ctx->net.sock, F_SETFL, fcntl(ctx->net.sock, F_GETFL) | O_NONBLOCK);
+#ifdef CIS_HOST_DTLS
+  /* Connected once the handshake is done */
+
+  if (prv_dtls_start(ctx) != CIS_RET_OK)
+    {
+      prv_close(ctx);
+      prv_event(ctx, CIS_EVENT_CONNECT_FAILED, 0);
+      return CIS_RET_ERROR;
+    }
+#else
+  prv_event(ctx, CIS_EVENT_CONNECT_SUCCESS, 0);
+#endif
+  return CIS_RET_OK;
+}
+
+static void prv_register(st_context_t *ctx)
+{
+  uint8_t buf[COAP_HDR_MAX + CIS_HOST_BODY_MAX];
+  char links[CIS_HOST_BODY_MAX];
+  char query[64];
+  coap_writer_t w;
+  uint32_t token;
+
+  if (prv_connect(ctx) != CIS_RET_OK)
+    {
+      ctx->state = PUMP_STATE_INITIAL;
+      return;
+    }
+
+#ifdef CIS_HOST_DTLS
+  if (!ctx->secure)
+    {
+      /* prv_dtls_handshake() registers once it is done */
+
+      ctx->state = PUMP_STATE_CONNECTING;
+      return;
+    }
+#endif
+
+  token = ctx->nextToken++;
+  prv_links(ctx, links, sizeof(links));
+  coap_begin(&w, buf, sizeof(buf), COAP_TYPE_CON, COAP_POST,
+             prv_coap_mid(ctx), (uint8_t *)&token, sizeof(token));
+  coap_option_path(&w, COAP_OPT_URI_PATH, "rd");
+  coap_option_u(&w, COAP_OPT_CONTENT_FORMAT, COAP_FORMAT_LINK);
+  snprintf(query, sizeof(query), "ep=%s", ctx->endpoint);
+  coap_option(&w, COAP_OPT_URI_QUERY, query, strlen(query));
+  snprintf(query, sizeof(query), "lt=%u", ctx->lifetime);
+  coap_option(&w, COAP_OPT_URI_QUERY, query, strlen(query));
+  coap_option(&w, COAP_OPT_URI_QUERY, "lwm2m=1.1", 9);
+  coap_option(&w, COAP_OPT_URI_QUERY, "b=U", 3);
+  if (ctx->queue)
+    {
+      coap_option(&w, COAP_OPT_URI_QUERY, "Q", 1);
+    }
+  coap_payload(&w, links, strlen(links));
+
+  LOGI("core: register %s lt=%u%s %s", ctx->endpoint, ctx->lifetime,
+       ctx->queue ? " queue mode" : "", links);
+  ctx->state = PUMP_STATE_REGISTERING;
+  if (prv_tx(ctx, TX_REGISTER, 0, buf, coap_end(&w)) != CIS_RET_OK)
+    {
+      ctx->state = PUMP_STATE_INITIAL;
+      prv_event(ctx, CIS_EVENT_REG_FAILED, 0);
+    }
+}
+
+static void prv_drop_session(st_context_t *ctx)
+{
+  ctx->registered = false;
+  memset(ctx->request, 0, sizeof(ctx->request));
+  memset(ctx->observe, 0, sizeof(ctx->observe));
+  memset(ctx->tx, 0, sizeof(ctx->tx));
+}
+
+#ifdef CIS_HOST_DTLS
+/* The session offered is forgotten too, in case it is what the server
+ * choked on
+ */
+
+static void prv_dtls_failed(st_context_t *ctx)
+{
+  SSL_SESSION_free(ctx->session);
+  ctx->session = NULL;
+  SSL_free(ctx->ssl);
+  ctx->ssl = NULL;
+  prv_close(ctx);
+  prv_drop_session(ctx);
+  ctx->state = PUMP_STATE_INITIAL;
+  prv_event(ctx, CIS_EVENT_CONNECT_FAILED, 0);
+}
+
+static void prv_dtls_handshake(st_context_t *ctx)
+{
+  int ret = SSL_do_handshake(ctx->ssl);
+
+  prv_dtls_flush(ctx);
+  if (ret != 1)
+    {
+      if (SSL_get_error(ctx->ssl, ret) != SSL_ERROR_WANT_READ)
+        {
+          LOGE("core: dtls handshake failed");
+          prv_dtls_failed(ctx);
+        }
+      return;
+    }
+
+  ctx->secure = true;
+  LOGI("core: dtls %s handshake in %u ms",
+       SSL_session_reused(ctx->ssl) ? "abbreviated" : "full",
+       cissys_gettime() - ctx->handshakeStart);
+  prv_event(ctx, CIS_EVENT_CONNECT_SUCCESS, 0);
+  if (ctx->state == PUMP_STATE_CONNECTING)
+    {
+      prv_register(ctx);
+    }
+}
+#endif
+
+static void prv_tx_done(st_context_t *ctx, st_host_tx_t *tx,
+                        const coap_msg_t *msg)
+{
+  uint8_t code = msg ? msg->code : 0;
+  uint8_t kind = tx->kind;
+  cis_mid_t mid = tx->mid;
+  uint32_t now = cissys_gettime();
+
+  tx->kind = 0;
+  switch (kind)
+    {
+      case TX_REGISTER:
+        if (code == COAP_201_CREATED)
+          {
+            coap_path(msg, COAP_OPT_LOCATION_PATH, ctx->location,
+                      sizeof(ctx->location));
+            ctx->registered = true;
+            ctx->state = PUMP_STATE_READY;
+            ctx->regTime = now;
+            ctx->updateNeedSent = false;
+            LOGI("core: registered at %s in %u ms", ctx->location,
+                 now - tx->sent);
+            prv_event(ctx, CIS_EVENT_REG_SUCCESS, 0);
+          }
+        else
+          {
+            ctx->state = PUMP_STATE_INITIAL;
+            prv_event(ctx, msg ? CIS_EVENT_REG_FAILED :
+                                 CIS_EVENT_REG_TIMEOUT, 0);
+          }
+        break;
+      case TX_UPDATE:
+        if (code == COAP_204_CHANGED)
+          {
+            ctx->regTime = now;
+            ctx->updateNeedSent = false;
+            prv_event(ctx, CIS_EVENT_UPDATE_SUCCESS, 0);
+          }
+        else
+          {
+            if (code == COAP_404_NOT_FOUND)
+              {
+                prv_drop_session(ctx);
+                ctx->state = PUMP_STATE_INITIAL;
+              }
+            prv_event(ctx, msg ? CIS_EVENT_UPDATE_FAILED :
+                                 CIS_EVENT_UPDATE_TIMEOUT, 0);
+          }
+        break;
+      case TX_DEREGISTER:
+        prv_drop_session(ctx);
+        ctx->state = PUMP_STATE_INITIAL;
+        prv_event(ctx, CIS_EVENT_UNREG_DONE, 0);
+        break;
+      case TX_NOTIFY:
+        if (msg == NULL || msg->type == COAP_TYPE_RST)
+          {
+            st_host_observe_t *obs = prv_observe(ctx, mid);
+
+            /* A reset notification cancels the observation */
+
+            if (obs != NULL && msg != NULL)
+              {
+                obs->mid = 0;
+              }
+            prv_event(ctx, CIS_EVENT_NOTIFY_FAILED, mid);
+          }
+        else
+          {
+            prv_event(ctx, CIS_EVENT_NOTIFY_SUCCESS, mid);
+          }
+        break;
+      case TX_RESPONSE:
+        prv_event(ctx, msg && msg->type == COAP_TYPE_ACK ?
+                       CIS_EVENT_RESPONSE_SUCCESS :
+                       CIS_EVENT_RESPONSE_FAILED, mid);
+        break;
+    }
+}
+
+static int prv_write_record(void *priv, const char *name,
+                            const cis_data_t *value)
+{
+  cis_data_t *list = (cis_data_t *)priv;
+  cis_uri_t uri;
+  int i;
+
+  if (senml_uri(name, &uri) < 0 || !CIS_URI_IS_SET_RESOURCE(&uri))
+    {
+      return -1;
+    }
+
+  /* Slot 0 holds the count */
+
+  i = ++list[0].id;
+  if (i >= 16)
+    {
+      return -1;
+    }
+
+  list[i] = *value;
+  list[i].id = uri.resourceId;
+  return 0;
+}
+
+static void prv_handle_write(st_context_t *ctx, st_host_request_t *req,
+                             const coap_msg_t *msg, cis_coapret_t *ret)
+{
+  cis_data_t list[16];
+  char text[CIS_HOST_BODY_MAX + 1];
+  const coap_option_t *opt;
+  uint32_t format = COAP_FORMAT_TEXT;
+  int count;
+
+  opt = coap_find(msg, COAP_OPT_CONTENT_FORMAT, NULL);
+  if (opt != NULL)
+    {
+      format = coap_option_uint(opt);
+    }
+
+  if (msg->payload_len > CIS_HOST_BODY_MAX || ctx->callback.onWrite == NULL)
+    {
+      *ret = CIS_RESPONSE_BAD_REQUEST;
+      return;
+    }
+
+  memcpy(text, msg->payload, msg->payload_len);
+  text[msg->payload_len] = '\0';
+  memset(list, 0, sizeof(list));
+
+  if (format == COAP_FORMAT_SENML_JSON)
+    {
+      if (senml_parse(text, msg->payload_len, prv_write_record, list) < 0)
+        {
+          *ret = CIS_RESPONSE_BAD_REQUEST;
+          return;
+        }
+
+      count = list[0].id;
+      memmove(list, list + 1, count * sizeof(cis_data_t));
+    }
+  else if (CIS_URI_IS_SET_RESOURCE(&req->uri))
+    {
+      char *end;
+
+      /* Plain text or opaque for a single resource */
+
+      list[0].id = req->uri.resourceId;
+      list[0].asBuffer.buffer = (uint8_t *)text;
+      list[0].asBuffer.length = msg->payload_len;
+      list[0].type = format == COAP_FORMAT_OPAQUE ? cis_data_type_opaque :
+                                                    cis_data_type_string;
+      if (format == COAP_FORMAT_TEXT && msg->payload_len > 0)
+        {
+          list[0].value.asInteger = strtoll(text, &end, 10);
+          if (*end == '\0')
+            {
+              list[0].type = cis_data_type_integer;
+            }
+          else
+            {
+              list[0].value.asFloat = strtod(text, &end);
+              if (*end == '\0')
+                {
+                  list[0].type = cis_data_type_float;
+                }
+            }
+        }
+      count = 1;
+    }
+  else
+    {
+      *ret = CIS_RESPONSE_BAD_REQUEST;
+      return;
+    }
+
+  *ret = ctx->callback.onWrite(ctx, &req->uri, list, count, req->mid);
+}
+
+static void prv_parse_attrs(const coap_msg_t *msg, cis_observe_attr_t *attr)
+{
+  const coap_option_t *opt = NULL;
+  char q[32];
+
+  memset(attr, 0, sizeof(*attr));
+  while ((opt = coap_find(msg, COAP_OPT_URI_QUERY, opt)) != NULL)
+    {
+      int n = opt->len < sizeof(q) - 1 ? opt->len : sizeof(q) - 1;
+
+      memcpy(q, opt->val, n);
+      q[n] = '\0';
+      if (strncmp(q, "pmin=", 5) == 0)
+        {
+          attr->minPeriod = atoi(q + 5);
+        }
+      else if (strncmp(q, "pmax=", 5) == 0)
+        {
+          attr->maxPeriod = atoi(q + 5);
+        }
+      else if (strncmp(q, "gt=", 3) == 0)
+        {
+          attr->greaterThan = atof(q + 3);
+        }
+      else if (strncmp(q, "lt=", 3) == 0)
+        {
+          attr->lessThan = atof(q + 3);
+        }
+      else if (strncmp(q, "st=", 3) == 0)
+        {
+          attr->step = atof(q + 3);
+        }
+    }
+}
+
+/* A firmware package or patch written to /5/0/0 in Block1 blocks
+ * (RFC 7959) goes to the ctcc adapter's sink, when it has one, as the
+ * iotpf_lib download hands it to the firmware hooks.
+ */
+
+int cisapi_ctcc_fw_write(uint32_t offset, const uint8_t *data,
+                         uint32_t len) __attribute__((weak));
+
+static void prv_handle_firmware(st_context_t *ctx, const coap_msg_t *msg)
+{
+  const coap_option_t *opt = coap_find(msg, COAP_OPT_BLOCK1, NULL);
+  uint32_t block = opt != NULL ? coap_option_uint(opt) : 0;
+  uint32_t offset = (block >> 4) * (16u << (block & 0x07));
+  uint8_t code = COAP_204_CHANGED;
+
+  if (offset == 0)
+    {
+      prv_event(ctx, CIS_EVENT_FIRMWARE_DOWNLOADING, 0);
+    }
+
+  if (cisapi_ctcc_fw_write(offset, msg->payload,
+                           msg->payload_len) != CIS_RET_OK)
+    {
+      prv_event(ctx, CIS_EVENT_FIRMWARE_DOWNLOAD_FAILED, 0);
+      code = COAP_500_INTERNAL;
+    }
+  else if (block & 0x08)
+    {
+      code = COAP_231_CONTINUE;
+    }
+  else
+    {
+      prv_event(ctx, CIS_EVENT_FIRMWARE_DOWNLOADED, 0);
+    }
+
+  prv_reply_block(ctx, msg, code, opt);
+}
+
+static void prv_handle_request(st_context_t *ctx, const coap_msg_t *msg)
+{
+  st_host_request_t *req = NULL;
+  st_host_observe_t *obs = NULL;
+  const coap_option_t *opt;
+  cis_coapret_t ret = CIS_RESPONSE_NOT_FOUND;
+  char path[32];
+  bool raw;
+  int i;
+
+  /* Duplicates of a CON we already answered or are working on */
+
+  if (msg->type == COAP_TYPE_CON)
+    {
+      for (i = 0; i < CIS_HOST_CACHE_MAX; i++)
+        {
+          if (ctx->cache[i].len > 0 && ctx->cache[i].coapMid == msg->mid)
+            {
+              prv_send(ctx, ctx->cache[i].buf, ctx->cache[i].len);
+              return;
+            }
+        }
+
+      for (i = 0; i < CIS_HOST_PENDING_MAX; i++)
+        {
+          if (ctx->request[i].mid != 0 && ctx->request[i].coapMid == msg->mid)
+            {
+              return;
+            }
+        }
+    }
+
+  if ((msg->code == COAP_PUT || msg->code == COAP_POST) &&
+      cisapi_ctcc_fw_write != NULL &&
+      coap_path(msg, COAP_OPT_URI_PATH, path, sizeof(path)) > 0 &&
+      strcmp(path, "/5/0/0") == 0)
+    {
+      prv_handle_firmware(ctx, msg);
+      return;
+    }
+
+  for (i = 0; i < CIS_HOST_PENDING_MAX && req == NULL; i++)
+    {
+      if (ctx->request[i].mid == 0)
+        {
+          req = &ctx->request[i];
+        }
+    }
+
+  if (coap_path(msg, COAP_OPT_URI_PATH, path, sizeof(path)) < 0 ||
+      req == NULL)
+    {
+      prv_reply(ctx, msg, req ? COAP_404_NOT_FOUND : COAP_500_INTERNAL);
+      return;
+    }
+
+  memset(req, 0, sizeof(*req));
+  if (senml_uri(path, &req->uri) < 0)
+    {
+      prv_reply(ctx, msg, COAP_404_NOT_FOUND);
+      return;
+    }
+
+  req->mid = prv_next_mid(ctx);
+  req->coapMid = msg->mid;
+  req->type = msg->type;
+  req->time = cissys_gettime();
+  req->tkl = msg->tkl;
+  memcpy(req->token, msg->token, msg->tkl);
+  prv_body_reset(&req->body, COAP_FORMAT_SENML_JSON);
+
+  raw = ctx->vendor && req->uri.objectId == CIS_HOST_RAW_OID;
+  LOGD("core: request %d %s mid:%u", msg->code, path, req->mid);
+
+  switch (msg->code)
+    {
+      case COAP_GET:
+        opt = coap_find(msg, COAP_OPT_OBSERVE, NULL);
+        if (opt != NULL && coap_option_uint(opt) == 0)
+          {
+            for (i = 0; i < CIS_HOST_OBSERVE_MAX && obs == NULL; i++)
+              {
+                if (ctx->observe[i].mid == 0)
+                  {
+                    obs = &ctx->observe[i];
+                  }
+              }
+            if (obs == NULL)
+              {
+                ret = COAP_500_INTERNAL;
+                break;
+              }
+
+            memset(obs, 0, sizeof(*obs));
+            obs->mid = req->mid;
+            obs->tkl = msg->tkl;
+            memcpy(obs->token, msg->token, msg->tkl);
+            obs->uri = req->uri;
+            obs->raw = raw;
+            req->observe = true;
+            if (raw)
+              {
+                prv_answer(ctx, req, COAP_205_CONTENT);
+                return;
+              }
+            ret = ctx->callback.onObserve ?
+                  ctx->callback.onObserve(ctx, &req->uri, true, req->mid) :
+                  CIS_RESPONSE_NOT_FOUND;
+          }
+        else if (opt != NULL)
+          {
+            for (i = 0; i < CIS_HOST_OBSERVE_MAX; i++)
+              {
+                if (ctx->observe[i].mid != 0 && ctx->observe[i].tkl == msg->tkl &&
+                    memcmp(ctx->observe[i].token, msg->token, msg->tkl) == 0)
+                  {
+                    ctx->observe[i].mid = 0;
+                  }
+              }
+            if (raw)
+              {
+                prv_answer(ctx, req, COAP_205_CONTENT);
+                return;
+              }
+            ret = ctx->callback.onObserve ?
+                  ctx->callback.onObserve(ctx, &req->uri, false, req->mid) :
+                  CIS_RESPONSE_NOT_FOUND;
+          }
+        else if ((opt = coap_find(msg, COAP_OPT_ACCEPT, NULL)) != NULL &&
+                 coap_option_uint(opt) == COAP_FORMAT_LINK)
+          {
+            ret = ctx->callback.onDiscover ?
+                  ctx->callback.onDiscover(ctx, &req->uri, req->mid) :
+                  CIS_RESPONSE_NOT_FOUND;
+          }
+        else if (ctx->callback.onRead != NULL)
+          {
+            ret = ctx->callback.onRead(ctx, &req->uri, req->mid);
+          }
+        break;
+
+      case COAP_PUT:
+      case COAP_POST:
+        if (raw)
+          {
+            ret = ctx->callback.onWriteRaw ?
+                  ctx->callback.onWriteRaw(ctx, msg->payload,
+                                           msg->payload_len, req->mid) :
+                  CIS_RESPONSE_NOT_FOUND;
+            if (ret == CIS_RET_OK && req->mid != 0)
+              {
+                prv_answer(ctx, req, COAP_204_CHANGED);
+                return;
+              }
+          }
+        else if (msg->code == COAP_PUT &&
+                 coap_find(msg, COAP_OPT_URI_QUERY, NULL) != NULL)
+          {
+            cis_observe_attr_t attr;
+
+            prv_parse_attrs(msg, &attr);
+            ret = ctx->callback.onSetParams ?
+                  ctx->callback.onSetParams(ctx, &req->uri, attr, req->mid) :
+                  CIS_RESPONSE_NOT_FOUND;
+          }
+        else if (msg->code == COAP_POST && CIS_URI_IS_SET_RESOURCE(&req->uri))
+          {
+            ret = ctx->callback.onExec ?
+                  ctx->callback.onExec(ctx, &req->uri, msg->payload,
+                                       msg->payload_len, req->mid) :
+                  CIS_RESPONSE_NOT_FOUND;
+          }
+        else
+          {
+            prv_handle_write(ctx, req, msg, &ret);
+          }
+        break;
+
+      default:
+        ret = COAP_405_NOT_ALLOWED;
+        break;
+    }
+
+  if (req->mid == 0)
+    {
+      /* Answered from inside the callback */
+
+      return;
+    }
+
+  if (ret != CIS_RET_OK)
+    {
+      prv_body_reset(&req->body, COAP_FORMAT_TEXT);
+      prv_answer(ctx, req, ret >= 0x80 && ret != (cis_coapret_t)CIS_RET_ERROR ?
+                           ret : COAP_400_BAD_REQUEST);
+      return;
+    }
+
+  /* The adapter answers later: stop the server retransmitting meanwhile */
+
+  if (req->type == COAP_TYPE_CON && !req->acked)
+    {
+      uint8_t buf[4];
+      coap_writer_t w;
+
+      coap_begin(&w, buf, sizeof(buf), COAP_TYPE_ACK, COAP_EMPTY,
+                 req->coapMid, NULL, 0);
+      prv_send(ctx, buf, coap_end(&w));
+      req->acked = true;
+    }
+}
+
+static void prv_handle(st_context_t *ctx, const uint8_t *buf, uint32_t len)
+{
+  coap_msg_t msg;
+  int i;
+
+  if (coap_parse(&msg, buf, len) < 0)
+    {
+      LOGE("core: dropped %u byte datagram", len);
+      return;
+    }
+
+  if (msg.type == COAP_TYPE_ACK || msg.type == COAP_TYPE_RST)
+    {
+      for (i = 0; i < CIS_HOST_TX_MAX; i++)
+        {
+          if (ctx->tx[i].kind != 0 && ctx->tx[i].coapMid == msg.mid)
+            {
+              prv_tx_done(ctx, &ctx->tx[i], &msg);
+              return;
+            }
+        }
+      return;
+    }
+
+  if (msg.code >= 1 && msg.code < 32)
+    {
+      prv_handle_request(ctx, &msg);
+    }
+  else if (msg.type == COAP_TYPE_CON)
+    {
+      prv_reply(ctx, &msg, COAP_EMPTY);
+    }
+}
+
+/* A datagram off the socket: DTLS records with CIS_HOST_DTLS, handshake
+ * until it is done and CoAP messages after that
+ */
+
+static void prv_input(st_context_t *ctx, const uint8_t *buf, uint32_t len)
+{
+#ifdef CIS_HOST_DTLS
+  uint8_t plain[COAP_HDR_MAX + CIS_HOST_BODY_MAX];
+  int n;
+
+  if (ctx->ssl == NULL)
+    {
+      return;
+    }
+
+  dtls_input(ctx->ssl, buf, len);
+  if (!ctx->secure)
+    {
+      prv_dtls_handshake(ctx);
+      if (ctx->ssl == NULL || !ctx->secure)
+        {
+          return;
+        }
+    }
+
+  while (ctx->ssl != NULL &&
+         (n = SSL_read(ctx->ssl, plain, sizeof(plain))) > 0)
+    {
+      prv_handle(ctx, plain, n);
+    }
+
+  if (ctx->ssl != NULL)
+    {
+      n = SSL_get_error(ctx->ssl, n);
+      prv_dtls_flush(ctx);
+      if (n == SSL_ERROR_ZERO_RETURN || n == SSL_ERROR_SSL)
+        {
+          LOGE("core: dtls session closed by the server");
+          prv_dtls_failed(ctx);
+        }
+    }
+#else
+  prv_handle(ctx, buf, len);
+#endif
+}
+
+/* The cmcc adapter may hand us packets from its own pool (CIS_NET_POOL);
+ * those go back to it instead of the heap.
+ */
+
+bool cisapi_cmcc_packet_pooled(const void *ptr) __attribute__((weak));
+void cisapi_cmcc_packet_release(const void *ptr) __attribute__((weak));
+
+static void prv_free_packet(struct st_net_packet *packet)
+{
+  if (cisapi_cmcc_packet_pooled && cisapi_cmcc_packet_pooled(packet))
+    {
+      cisapi_cmcc_packet_release(packet);
+      return;
+    }
+
+  cis_free(packet->buffer);
+  cis_free(packet);
+}
+
+static void prv_drain(st_context_t *ctx)
+{
+  struct st_net_packet **tail;
+  struct st_net_packet *packet;
+  uint8_t buf[COAP_HDR_MAX + CIS_HOST_BODY_MAX];
+  int n;
+
+  for (; ; )
+    {
+      n = recv(ctx->net.sock, buf, sizeof(buf), MSG_DONTWAIT);
+      if (n <= 0)
+        {
+          return;
+        }
+
+      cis_host_radio_traffic();
+
+      packet = cis_malloc(sizeof(*packet));
+      packet->buffer = cis_malloc(n);
+      packet->length = n;
+      packet->next = NULL;
+      memcpy(packet->buffer, buf, n);
+
+      pthread_mutex_lock(&ctx->lock);
+      for (tail = &ctx->net.g_packetlist; *tail; tail = &(*tail)->next);
+      *tail = packet;
+      pthread_mutex_unlock(&ctx->lock);
+    }
+}
+
+static void *prv_pump_thread(void *arg)
+{
+  pthread_setname_np(pthread_self(), "cis_pump");
+
+  for (; ; )
+    {
+      st_context_t *ctx = g_context;
+      struct timeval tv;
+      time_t sleep = CIS_HOST_IDLE_S;
+      fd_set rfds;
+      int maxfd = g_wake_pipe[0];
+
+      FD_ZERO(&rfds);
+      FD_SET(g_wake_pipe[0], &rfds);
+      if (ctx != NULL)
+        {
+          if (cis_pump(ctx, &sleep) == PUMP_RET_NOSLEEP)
+            {
+              sleep = 0;
+            }
+
+          if (ctx->net.sock >= 0)
+            {
+              FD_SET(ctx->net.sock, &rfds);
+              maxfd = ctx->net.sock > maxfd ? ctx->net.sock : maxfd;
+            }
+        }
+
+      tv.tv_sec = sleep;
+      tv.tv_usec = 0;
+      if (select(maxfd + 1, &rfds, NULL, NULL, &tv) <= 0)
+        {
+          continue;
+        }
+
+      if (FD_ISSET(g_wake_pipe[0], &rfds))
+        {
+          char c[16];
+
+          read(g_wake_pipe[0], c, sizeof(c));
+        }
+
+      if (ctx != NULL && ctx->net.sock >= 0 && FD_ISSET(ctx->net.sock, &rfds))
+        {
+          prv_drain(ctx);
+        }
+    }
+
+  return NULL;
+}
+
+static cis_ret_t prv_init(void **context, bool vendor)
+{
+  pthread_mutexattr_t attr;
+  st_context_t *ctx;
+  static int count;
+  const char *server = getenv("IOTPF_SERVER");
+  const char *ep = getenv("IOTPF_EP");
+  char host[64];
+  char *port;
+  int n;
+
+  ctx = calloc(1, sizeof(*ctx));
+  if (ctx == NULL)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&ctx->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  /* IOTPF_SERVER may list one server per context: the nth cis_init() takes
+   * the nth entry, later ones reuse the last.
+   */
+
+  server = server ? server : CIS_HOST_SERVER;
+  for (n = 0; n < count && strchr(server, ',') != NULL; n++)
+    {
+      server = strchr(server, ',') + 1;
+    }
+  snprintf(host, sizeof(host), "%.*s", (int)strcspn(server, ","), server);
+  port = strrchr(host, ':');
+  if (port != NULL)
+    {
+      *port++ = '\0';
+    }
+
+  ctx->server.sin_family = AF_INET;
+  ctx->server.sin_port = htons(port ? atoi(port) : 5683);
+  if (inet_pton(AF_INET, host, &ctx->server.sin_addr) != 1)
+    {
+      LOGE("core: bad IOTPF_SERVER %s", host);
+      free(ctx);
+      return CIS_RET_ERROR;
+    }
+
+  if (ep != NULL)
+    {
+      snprintf(ctx->endpoint, sizeof(ctx->endpoint), "%s", ep);
+    }
+  else
+    {
+      snprintf(ctx->endpoint, sizeof(ctx->endpoint), "iotpf-host-%d",
+               (int)getpid());
+    }
+  if (count > 0)
+    {
+      n = strlen(ctx->endpoint);
+      snprintf(ctx->endpoint + n, sizeof(ctx->endpoint) - n, "-%d", count);
+    }
+  count++;
+
+  ctx->pNetContext = &ctx->net;
+  ctx->net.sock = -1;
+  ctx->vendor = vendor;
+  ctx->state = PUMP_STATE_INITIAL;
+  ctx->nextCoapMid = cissys_rand();
+  ctx->nextToken = cissys_rand();
+  g_context = ctx;
+  *context = ctx;
+  return CIS_RET_OK;
+}
+
+/* The only part of the config blob the stand-in looks at: the link and
+ * bind byte after the MTU in section 0xf2, binding 2 being UQ
+ */
+
+static void prv_config(st_context_t *ctx, const uint8_t *config,
+                       uint16_t size)
+{
+  uint32_t offset = 3;
+
+  while (config != NULL && offset + 6 <= size)
+    {
+      uint32_t len = (config[offset + 1] << 8) | config[offset + 2];
+
+      if (config[offset] == 0xf2)
+        {
+          ctx->queue = (config[offset + 5] & 0x0f) == 2;
+          return;
+        }
+
+      if (len < 3)
+        {
+          return;
+        }
+      offset += len;
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+cis_ret_t cis_init(void **context, void *config, uint16_t size)
+{
+  if (prv_init(context, false) != CIS_RET_OK)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  prv_config((st_context_t *)*context, config, size);
+  return CIS_RET_OK;
+}
+
+cis_ret_t cis_init_with_vendor(void **context, void *config, uint16_t size,
+                               int vendor)
+{
+  if (prv_init(context, true) != CIS_RET_OK)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  prv_config((st_context_t *)*context, config, size);
+  return CIS_RET_OK;
+}
+
+cis_ret_t cis_deinit(void **context)
+{
+  st_context_t *ctx = (st_context_t *)*context;
+  struct st_net_packet *packet;
+  st_object_t *obj;
+
+  if (ctx == NULL)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  pthread_mutex_lock(&ctx->lock);
+  g_context = NULL;
+  prv_close(ctx);
+#ifdef CIS_HOST_DTLS
+  SSL_SESSION_free(ctx->session);
+#endif
+
+  while ((packet = ctx->net.g_packetlist) != NULL)
+    {
+      ctx->net.g_packetlist = packet->next;
+      prv_free_packet(packet);
+    }
+
+  while ((obj = ctx->objectList) != NULL)
+    {
+      ctx->objectList = obj->next;
+      free(obj->instBitmapPtr);
+      free(obj);
+    }
+
+  pthread_mutex_unlock(&ctx->lock);
+  pthread_mutex_destroy(&ctx->lock);
+  free(ctx);
+  *context = NULL;
+  return CIS_RET_OK;
+}
+
+cis_ret_t cis_addobject(void *context, cis_oid_t objectid,
+                        const cis_inst_bitmap_t *bitmap,
+                        const cis_res_count_t *resource)
+{
+  st_context_t *ctx = (st_context_t *)context;
+  st_object_t **tail;
+  st_object_t *obj;
+
+  if (cis_findObject(context, objectid) != NULL)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  obj = calloc(1, sizeof(*obj));
+  if (obj == NULL)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  obj->objID = objectid;
+  if (bitmap != NULL && bitmap->instanceBytes > 0)
+    {
+      obj->instBitmapPtr = malloc(bitmap->instanceBytes);
+      memcpy(obj->instBitmapPtr, bitmap->instanceBitmap, bitmap->instanceBytes);
+      obj->instBitmapBytes = bitmap->instanceBytes;
+      obj->instBitmapCount = bitmap->instanceCount;
+    }
+
+  if (resource != NULL)
+    {
+      obj->attributeCount = resource->attrCount;
+      obj->actionCount = resource->actCount;
+    }
+
+  pthread_mutex_lock(&ctx->lock);
+  for (tail = &ctx->objectList; *tail; tail = &(*tail)->next);
+  *tail = obj;
+  pthread_mutex_unlock(&ctx->lock);
+  return CIS_RET_OK;
+}
+
+cis_ret_t cis_delobject(void *context, cis_oid_t objectid)
+{
+  st_context_t *ctx = (st_context_t *)context;
+  st_object_t **pp;
+  st_object_t *obj;
+
+  pthread_mutex_lock(&ctx->lock);
+  for (pp = &ctx->objectList; (obj = *pp) != NULL; pp = &obj->next)
+    {
+      if (obj->objID == objectid)
+        {
+          *pp = obj->next;
+          free(obj->instBitmapPtr);
+          free(obj);
+          break;
+        }
+    }
+
+  pthread_mutex_unlock(&ctx->lock);
+  return obj != NULL ? CIS_RET_OK : CIS_RET_ERROR;
+}
+
+st_object_t *cis_findObject(void *context, cis_oid_t objectid)
+{
+  st_context_t *ctx = (st_context_t *)context;
+  st_object_t *obj;
+
+  for (obj = ctx->objectList; obj != NULL; obj = obj->next)
+    {
+      if (obj->objID == objectid)
+        {
+          return obj;
+        }
+    }
+
+  return NULL;
+}
+
+cis_ret_t cis_register(void *context, cis_time_t lifetime,
+                       const cis_callback_t *cb)
+{
+  st_context_t *ctx = (st_context_t *)context;
+
+  pthread_mutex_lock(&ctx->lock);
+  ctx->callback = *cb;
+  if (!ctx->vendor)
+    {
+      /* cmcc leaves it uninitialised */
+
+      ctx->callback.onWriteRaw = NULL;
+    }
+  ctx->lifetime = lifetime;
+  if (ctx->state != PUMP_STATE_REGISTERING)
+    {
+#ifdef CIS_HOST_DTLS
+      /* The server may have lost the session; the handshake on the new
+       * socket offers it again, abbreviated if it did not
+       */
+
+      prv_close(ctx);
+#endif
+      ctx->state = PUMP_STATE_REGISTER_REQUIRED;
+    }
+
+  /* Open the socket now so a loop that builds its fd set before calling
+   * cis_pump() already waits on it.
+   */
+
+  prv_connect(ctx);
+  pthread_mutex_unlock(&ctx->lock);
+  cisapi_wakeup_pump();
+  return CIS_RET_OK;
+}
+
+cis_ret_t cis_update_reg(void *context, cis_time_t lifetime,
+                         bool withObjects)
+{
+  st_context_t *ctx = (st_context_t *)context;
+  uint8_t buf[COAP_HDR_MAX + CIS_HOST_BODY_MAX];
+  char links[CIS_HOST_BODY_MAX];
+  char query[32];
+  coap_writer_t w;
+  uint32_t token;
+  int ret;
+
+  pthread_mutex_lock(&ctx->lock);
+  if (!ctx->registered)
+    {
+      pthread_mutex_unlock(&ctx->lock);
+      return CIS_RET_ERROR;
+    }
+
+  token = ctx->nextToken++;
+  coap_begin(&w, buf, sizeof(buf), COAP_TYPE_CON, COAP_POST,
+             prv_coap_mid(ctx), (uint8_t *)&token, sizeof(token));
+  coap_option_path(&w, COAP_OPT_URI_PATH, ctx->location);
+  if (withObjects)
+    {
+      coap_option_u(&w, COAP_OPT_CONTENT_FORMAT, COAP_FORMAT_LINK);
+    }
+  if (lifetime != LIFETIME_INVALID)
+    {
+      ctx->lifetime = lifetime;
+      snprintf(query, sizeof(query), "lt=%u", lifetime);
+      coap_option(&w, COAP_OPT_URI_QUERY, query, strlen(query));
+    }
+  if (withObjects)
+    {
+      prv_links(ctx, links, sizeof(links));
+      coap_payload(&w, links, strlen(links));
+    }
+
+  LOGD("core: update %s", ctx->location);
+  ret = prv_tx(ctx, TX_UPDATE, 0, buf, coap_end(&w));
+  pthread_mutex_unlock(&ctx->lock);
+  return ret;
+}
+
+cis_ret_t cis_unregister(void *context)
+{
+  st_context_t *ctx = (st_context_t *)context;
+  uint8_t buf[COAP_HDR_MAX];
+  coap_writer_t w;
+  uint32_t token;
+
+  pthread_mutex_lock(&ctx->lock);
+  if (!ctx->registered)
+    {
+      prv_drop_session(ctx);
+      ctx->state = PUMP_STATE_INITIAL;
+      prv_event(ctx, CIS_EVENT_UNREG_DONE, 0);
+      pthread_mutex_unlock(&ctx->lock);
+      return CIS_RET_OK;
+    }
+
+  token = ctx->nextToken++;
+  coap_begin(&w, buf, sizeof(buf), COAP_TYPE_CON, COAP_DELETE,
+             prv_coap_mid(ctx), (uint8_t *)&token, sizeof(token));
+  coap_option_path(&w, COAP_OPT_URI_PATH, ctx->location);
+  ctx->state = PUMP_STATE_UNREGISTER;
+  prv_tx(ctx, TX_DEREGISTER, 0, buf, coap_end(&w));
+  pthread_mutex_unlock(&ctx->lock);
+  return CIS_RET_OK;
+}
+
+uint32_t cis_pump(void *context, time_t *sleep)
+{
+  st_context_t *ctx = (st_context_t *)context;
+  struct st_net_packet *packet;
+  uint32_t now;
+  uint32_t next = CIS_HOST_IDLE_S * 1000;
+  bool nosleep = false;
+  int i;
+
+  pthread_mutex_lock(&ctx->lock);
+  while ((packet = ctx->net.g_packetlist) != NULL)
+    {
+      ctx->net.g_packetlist = packet->next;
+      prv_input(ctx, packet->buffer, packet->length);
+      prv_free_packet(packet);
+    }
+
+  now = cissys_gettime();
+#ifdef CIS_HOST_DTLS
+  if (ctx->ssl != NULL && !ctx->secure)
+    {
+      uint32_t wait = dtls_timeout(ctx->ssl);
+
+      if (now - ctx->handshakeStart >= CIS_HOST_HANDSHAKE_MS)
+        {
+          LOGE("core: dtls handshake timed out");
+          prv_dtls_failed(ctx);
+        }
+      else if (wait == 0)
+        {
+          DTLSv1_handle_timeout(ctx->ssl);
+          prv_dtls_flush(ctx);
+        }
+      else if (wait < next)
+        {
+          next = wait;
+        }
+    }
+#endif
+  switch (ctx->state)
+    {
+      case PUMP_STATE_REGISTER_REQUIRED:
+        prv_register(ctx);
+        nosleep = true;
+        break;
+      case PUMP_STATE_DISCONNECTED:
+        if (cis_host_radio_on() && cis_host_radio_epoch() != ctx->radioEpoch)
+          {
+            LOGI("core: radio back, registering again");
+            prv_register(ctx);
+            nosleep = true;
+          }
+        break;
+      case PUMP_STATE_READY:
+        {
+          uint32_t due = ctx->regTime + ctx->lifetime * 900;
+
+          if (!ctx->updateNeedSent && (int32_t)(now - due) >= 0)
+            {
+              ctx->updateNeedSent = true;
+              prv_event(ctx, CIS_EVENT_UPDATE_NEED,
+                        ctx->lifetime - ctx->lifetime * 9 / 10);
+            }
+          else if (!ctx->updateNeedSent && due - now < next)
+            {
+              next = due - now;
+            }
+        }
+        break;
+      default:
+        break;
+    }
+
+  for (i = 0; i < CIS_HOST_PENDING_MAX; i++)
+    {
+      if (ctx->request[i].mid != 0 &&
+          now - ctx->request[i].time >= CIS_HOST_REQUEST_MS)
+        {
+          LOGE("core: mid:%u never answered, dropped", ctx->request[i].mid);
+          ctx->request[i].mid = 0;
+        }
+    }
+
+  for (i = 0; i < CIS_HOST_TX_MAX; i++)
+    {
+      st_host_tx_t *tx = &ctx->tx[i];
+
+      if (tx->kind == 0)
+        {
+          continue;
+        }
+
+      if ((int32_t)(now - tx->deadline) >= 0)
+        {
+          if (tx->retries == COAP_MAX_RETRANSMIT)
+            {
+              LOGI("core: message %u timed out", tx->coapMid);
+              prv_tx_done(ctx, tx, NULL);
+              continue;
+            }
+
+          tx->retries++;
+          tx->timeout *= 2;
+          tx->deadline = now + tx->timeout;
+          prv_send(ctx, tx->buf, tx->len);
+        }
+
+      if (tx->deadline - now < next)
+        {
+          next = tx->deadline - now;
+        }
+    }
+
+  *sleep = (next + 999) / 1000;
+  nosleep |= ctx->net.g_packetlist != NULL;
+  pthread_mutex_unlock(&ctx->lock);
+  return nosleep ? PUMP_RET_NOSLEEP : PUMP_RET_CUSTOM;
+}
+
+void cis_pump_initialize(void)
+{
+  if (g_wake_pipe[0] >= 0)
+    {
+      return;
+    }
+
+  pipe(g_wake_pipe);
+  fcntl(g_wake_pipe[0], F_SETFL, O_NONBLOCK);
+  fcntl(g_wake_pipe[1], F_SETFL, O_NONBLOCK);
+  pthread_create(&g_pump_tid, NULL, prv_pump_thread, NULL);
+}
+
+void cisapi_wakeup_pump(void)
+{
+  if (g_wake_pipe[1] >= 0)
+    {
+      write(g_wake_pipe[1], "w", 1);
+    }
+}
+
+void core_updatePumpState(void *context, int state)
+{
+  st_context_t *ctx = (st_context_t *)context;
+
+  pthread_mutex_lock(&ctx->lock);
+  if (state == PUMP_STATE_DISCONNECTED)
+    {
+      prv_close(ctx);
+      prv_drop_session(ctx);
+      ctx->radioEpoch = cis_host_radio_epoch();
+    }
+
+  ctx->state = state;
+  pthread_mutex_unlock(&ctx->lock);
+}
+
+cis_ret_t cis_response(void *context, const cis_uri_t *uri,
+                       const cis_data_t *value, cis_mid_t mid,
+                       cis_coapret_t result)
+{
+  st_context_t *ctx = (st_context_t *)context;
+  st_host_request_t *req;
+  int ret = CIS_RET_OK;
+
+  pthread_mutex_lock(&ctx->lock);
+  req = prv_request(ctx, mid);
+  if (req == NULL)
+    {
+      pthread_mutex_unlock(&ctx->lock);
+      return CIS_RET_ERROR;
+    }
+
+  if (uri != NULL)
+    {
+      ret = prv_body_add(&req->body, &req->uri, uri, value);
+    }
+
+  if (result != CIS_RESPONSE_CONTINUE)
+    {
+      prv_answer(ctx, req, ret == CIS_RET_OK ? result : COAP_500_INTERNAL);
+    }
+
+  pthread_mutex_unlock(&ctx->lock);
+  return ret;
+}
+
+cis_ret_t cis_notify(void *context, const cis_uri_t *uri,
+                     const cis_data_t *value, cis_mid_t mid,
+                     cis_coapret_t result, bool needAck)
+{
+  st_context_t *ctx = (st_context_t *)context;
+  uint8_t buf[COAP_HDR_MAX + CIS_HOST_BODY_MAX];
+  st_host_observe_t *obs;
+  coap_writer_t w;
+  int ret = CIS_RET_OK;
+  int len;
+
+  pthread_mutex_lock(&ctx->lock);
+  obs = prv_observe(ctx, mid);
+  if (obs == NULL)
+    {
+      pthread_mutex_unlock(&ctx->lock);
+      return CIS_RET_ERROR;
+    }
+
+  if (uri != NULL && value != NULL)
+    {
+      ret = prv_body_add(&obs->body, &obs->uri, uri, value);
+    }
+
+  if (result == CIS_NOTIFY_CONTINUE && ret == CIS_RET_OK)
+    {
+      pthread_mutex_unlock(&ctx->lock);
+      return CIS_RET_OK;
+    }
+
+  prv_body_close(&obs->body);
+  coap_begin(&w, buf, sizeof(buf), needAck ? COAP_TYPE_CON : COAP_TYPE_NON,
+             COAP_205_CONTENT, prv_coap_mid(ctx), obs->token, obs->tkl);
+  coap_option_u(&w, COAP_OPT_OBSERVE, obs->seq++ & 0xffffff);
+  coap_option_u(&w, COAP_OPT_CONTENT_FORMAT, obs->body.format);
+  coap_payload(&w, obs->body.data, obs->body.len);
+  prv_body_reset(&obs->body, COAP_FORMAT_SENML_JSON);
+  len = coap_end(&w);
+  if (ret == CIS_RET_OK)
+    {
+      ret = needAck ? prv_tx(ctx, TX_NOTIFY, mid, buf, len) :
+                      prv_send(ctx, buf, len);
+    }
+
+  pthread_mutex_unlock(&ctx->lock);
+  return ret;
+}
+
+cis_ret_t cis_notify_raw(void *context, const uint8_t *data, uint32_t length)
+{
+  return cis_notify_raw_ack(context, data, length, true);
+}
+
+cis_ret_t cis_notify_raw_ack(void *context, const uint8_t *data,
+                             uint32_t length, bool needAck)
+{
+  st_context_t *ctx = (st_context_t *)context;
+  uint8_t buf[COAP_HDR_MAX + CIS_HOST_BODY_MAX];
+  st_host_observe_t *obs = NULL;
+  coap_writer_t w;
+  int ret;
+  int i;
+
+  pthread_mutex_lock(&ctx->lock);
+  for (i = 0; i < CIS_HOST_OBSERVE_MAX && obs == NULL; i++)
+    {
+      if (ctx->observe[i].mid != 0 && ctx->observe[i].raw)
+        {
+          obs = &ctx->observe[i];
+        }
+    }
+
+  if (obs == NULL || length > CIS_HOST_BODY_MAX)
+    {
+      LOGE("core: raw uplink of %u bytes dropped, %s", length,
+           obs ? "too large" : "/19/0/0 not observed");
+      pthread_mutex_unlock(&ctx->lock);
+      return CIS_RET_ERROR;
+    }
+
+  coap_begin(&w, buf, sizeof(buf), needAck ? COAP_TYPE_CON : COAP_TYPE_NON,
+             COAP_205_CONTENT, prv_coap_mid(ctx), obs->token, obs->tkl);
+  coap_option_u(&w, COAP_OPT_OBSERVE, obs->seq++ & 0xffffff);
+  coap_option_u(&w, COAP_OPT_CONTENT_FORMAT, COAP_FORMAT_OPAQUE);
+  coap_payload(&w, data, length);
+  ret = needAck ? prv_tx(ctx, TX_NOTIFY, obs->mid, buf, coap_end(&w)) :
+                  prv_send(ctx, buf, coap_end(&w));
+  pthread_mutex_unlock(&ctx->lock);
+  return ret;
+}
+
+#ifdef CIS_HOST_DTLS
+int cis_dtls_session_get(void *context, uint8_t *buf, uint32_t size)
+{
+  st_context_t *ctx = (st_context_t *)context;
+  SSL_SESSION *session;
+  int len = 0;
+
+  pthread_mutex_lock(&ctx->lock);
+  session = ctx->ssl != NULL && ctx->secure ?
+            SSL_get_session(ctx->ssl) : ctx->session;
+  if (session != NULL)
+    {
+      len = i2d_SSL_SESSION(session, NULL);
+      if (len <= 0 || len > size)
+        {
+          len = CIS_RET_ERROR;
+        }
+      else
+        {
+          i2d_SSL_SESSION(session, &buf);
+        }
+    }
+
+  pthread_mutex_unlock(&ctx->lock);
+  return len;
+}
+
+cis_ret_t cis_dtls_session_set(void *context, const uint8_t *buf,
+                               uint32_t len)
+{
+  st_context_t *ctx = (st_context_t *)context;
+  SSL_SESSION *session = d2i_SSL_SESSION(NULL, &buf, len);
+
+  if (session == NULL)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  pthread_mutex_lock(&ctx->lock);
+  SSL_SESSION_free(ctx->session);
+  ctx->session = session;
+  pthread_mutex_unlock(&ctx->lock);
+  return CIS_RET_OK;
+}
+
+bool cis_dtls_session_resumed(void *context)
+{
+  st_context_t *ctx = (st_context_t *)context;
+  bool resumed;
+
+  pthread_mutex_lock(&ctx->lock);
+  resumed = ctx->ssl != NULL && ctx->secure &&
+            SSL_session_reused(ctx->ssl);
+  pthread_mutex_unlock(&ctx->lock);
+  return resumed;
+}
+#endif
+
+cis_ret_t cis_uri_update(cis_uri_t *uri)
+{
+  uri->flag = 0;
+  if (uri->objectId != URI_INVALID)
+    {
+      uri->flag |= CIS_URI_FLAG_OBJECT_ID;
+    }
+  if (uri->instanceId != URI_INVALID)
+    {
+      uri->flag |= CIS_URI_FLAG_INSTANCE_ID;
+    }
+  if (uri->resourceId != URI_INVALID)
+    {
+      uri->flag |= CIS_URI_FLAG_RESOURCE_ID;
+    }
+
+  return CIS_RET_OK;
+}
+
+const char *cis_event_str(cis_evt_t eid)
+{
+  static const char *const names[] =
+  {
+    "BASE", "BOOTSTRAP_START", "BOOTSTRAP_SUCCESS", "BOOTSTRAP_FAILED",
+    "CONNECT_SUCCESS", "CONNECT_FAILED", "REG_SUCCESS", "REG_FAILED",
+    "REG_TIMEOUT", "LIFETIME_TIMEOUT", "STATUS_HALT", "UPDATE_SUCCESS",
+    "UPDATE_FAILED", "UPDATE_TIMEOUT", "UPDATE_NEED", "UNREG_DONE",
+    "RESPONSE_FAILED", "RESPONSE_SUCCESS", "NOTIFY_FAILED",
+    "NOTIFY_SUCCESS", "FIRMWARE_DOWNLOADING", "FIRMWARE_DOWNLOAD_FAILED",
+    "FIRMWARE_DOWNLOADED", "FIRMWARE_UPDATING", "FIRMWARE_TRIGGER",
+    "SOTA_DOWNLOADING", "SOTA_DOWNLOAED", "SOTA_FLASHERASE",
+    "SOTA_UPDATING", "START_NB_GPS_THREAD",
+  };
+
+  if (eid < 0 || eid >= (cis_evt_t)(sizeof(names) / sizeof(names[0])))
+    {
+      return "UNKNOWN";
+    }
+
+  return names[eid];
+}
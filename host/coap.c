@@ -0,0 +1,326 @@
+/****************************************************************************
+ * external/services/iotpf/host/coap.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <string.h>
+
+#include "coap.h"
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static const uint8_t *coap_ext(const uint8_t *p, const uint8_t *end,
+                               uint8_t nibble, uint32_t *out)
+{
+  if (nibble < 13)
+    {
+      *out = nibble;
+    }
+  else if (nibble == 13 && p < end)
+    {
+      *out = 13 + *p++;
+    }
+  else if (nibble == 14 && p + 1 < end)
+    {
+      *out = 269 + ((p[0] << 8) | p[1]);
+      p += 2;
+    }
+  else
+    {
+      return NULL;
+    }
+
+  return p;
+}
+
+static uint8_t coap_nibble(uint32_t v, uint8_t *ext, uint8_t *extlen)
+{
+  if (v < 13)
+    {
+      *extlen = 0;
+      return v;
+    }
+
+  if (v < 269)
+    {
+      ext[0] = v - 13;
+      *extlen = 1;
+      return 13;
+    }
+
+  ext[0] = (v - 269) >> 8;
+  ext[1] = (v - 269) & 0xff;
+  *extlen = 2;
+  return 14;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int coap_parse(coap_msg_t *msg, const uint8_t *buf, uint16_t len)
+{
+  const uint8_t *p = buf + 4;
+  const uint8_t *end = buf + len;
+  uint32_t num = 0;
+
+  memset(msg, 0, sizeof(*msg));
+  if (len < 4 || (buf[0] >> 6) != COAP_VERSION)
+    {
+      return -1;
+    }
+
+  msg->type = (buf[0] >> 4) & 0x03;
+  msg->tkl = buf[0] & 0x0f;
+  msg->code = buf[1];
+  msg->mid = (buf[2] << 8) | buf[3];
+  if (msg->tkl > 8 || p + msg->tkl > end)
+    {
+      return -1;
+    }
+
+  memcpy(msg->token, p, msg->tkl);
+  p += msg->tkl;
+
+  while (p < end)
+    {
+      uint32_t delta;
+      uint32_t olen;
+      uint8_t b = *p++;
+
+      if (b == 0xff)
+        {
+          if (p == end)
+            {
+              return -1;
+            }
+
+          msg->payload = p;
+          msg->payload_len = end - p;
+          break;
+        }
+
+      p = coap_ext(p, end, b >> 4, &delta);
+      if (p != NULL)
+        {
+          p = coap_ext(p, end, b & 0x0f, &olen);
+        }
+
+      if (p == NULL || p + olen > end || msg->nopt == COAP_OPTION_MAX)
+        {
+          return -1;
+        }
+
+      num += delta;
+      msg->opt[msg->nopt].num = num;
+      msg->opt[msg->nopt].len = olen;
+      msg->opt[msg->nopt].val = p;
+      msg->nopt++;
+      p += olen;
+    }
+
+  return 0;
+}
+
+const coap_option_t *coap_find(const coap_msg_t *msg, uint16_t num,
+                               const coap_option_t *after)
+{
+  const coap_option_t *opt = after ? after + 1 : msg->opt;
+
+  for (; opt < msg->opt + msg->nopt; opt++)
+    {
+      if (opt->num == num)
+        {
+          return opt;
+        }
+    }
+
+  return NULL;
+}
+
+uint32_t coap_option_uint(const coap_option_t *opt)
+{
+  uint32_t v = 0;
+  int i;
+
+  for (i = 0; i < opt->len && i < 4; i++)
+    {
+      v = (v << 8) | opt->val[i];
+    }
+
+  return v;
+}
+
+/* Joins every option num (Uri-Path, Location-Path) into "/a/b/c" */
+
+int coap_path(const coap_msg_t *msg, uint16_t num, char *buf, int size)
+{
+  const coap_option_t *opt = NULL;
+  int len = 0;
+
+  buf[0] = '\0';
+  while ((opt = coap_find(msg, num, opt)) != NULL)
+    {
+      if (len + 1 + opt->len >= size)
+        {
+          return -1;
+        }
+
+      buf[len++] = '/';
+      memcpy(buf + len, opt->val, opt->len);
+      len += opt->len;
+      buf[len] = '\0';
+    }
+
+  return len;
+}
+
+void coap_begin(coap_writer_t *w, uint8_t *buf, uint16_t size, uint8_t type,
+                uint8_t code, uint16_t mid, const uint8_t *token,
+                uint8_t tkl)
+{
+  w->buf = buf;
+  w->size = size;
+  w->last = 0;
+  w->overflow = size < 4 + tkl;
+  if (w->overflow)
+    {
+      w->len = 0;
+      return;
+    }
+
+  buf[0] = (COAP_VERSION << 6) | (type << 4) | tkl;
+  buf[1] = code;
+  buf[2] = mid >> 8;
+  buf[3] = mid & 0xff;
+  memcpy(buf + 4, token, tkl);
+  w->len = 4 + tkl;
+}
+
+void coap_option(coap_writer_t *w, uint16_t num, const void *val,
+                 uint16_t len)
+{
+  uint8_t dext[2];
+  uint8_t lext[2];
+  uint8_t dlen;
+  uint8_t llen;
+  uint8_t b;
+
+  b = coap_nibble(num - w->last, dext, &dlen) << 4;
+  b |= coap_nibble(len, lext, &llen);
+  if (w->overflow || w->len + 1 + dlen + llen + len > w->size)
+    {
+      w->overflow = true;
+      return;
+    }
+
+  w->buf[w->len++] = b;
+  memcpy(w->buf + w->len, dext, dlen);
+  w->len += dlen;
+  memcpy(w->buf + w->len, lext, llen);
+  w->len += llen;
+  memcpy(w->buf + w->len, val, len);
+  w->len += len;
+  w->last = num;
+}
+
+/* Unsigned options use the shortest big endian form, 0 is empty */
+
+void coap_option_u(coap_writer_t *w, uint16_t num, uint32_t val)
+{
+  uint8_t be[4];
+  int n = 0;
+  int i;
+
+  for (i = 3; i >= 0; i--)
+    {
+      if (n > 0 || (val >> (8 * i)) & 0xff)
+        {
+          be[n++] = (val >> (8 * i)) & 0xff;
+        }
+    }
+
+  coap_option(w, num, be, n);
+}
+
+/* "a/b?x=1&y=2" style strings: one option per segment */
+
+void coap_option_path(coap_writer_t *w, uint16_t num, const char *path)
+{
+  const char *seg;
+
+  while (*path == '/')
+    {
+      path++;
+    }
+
+  while (*path != '\0')
+    {
+      seg = path;
+      while (*path != '\0' && *path != '/')
+        {
+          path++;
+        }
+
+      coap_option(w, num, seg, path - seg);
+      while (*path == '/')
+        {
+          path++;
+        }
+    }
+}
+
+void coap_payload(coap_writer_t *w, const void *data, uint16_t len)
+{
+  if (len == 0)
+    {
+      return;
+    }
+
+  if (w->overflow || w->len + 1 + len > w->size)
+    {
+      w->overflow = true;
+      return;
+    }
+
+  w->buf[w->len++] = 0xff;
+  memcpy(w->buf + w->len, data, len);
+  w->len += len;
+}
+
+int coap_end(coap_writer_t *w)
+{
+  return w->overflow ? -1 : w->len;
+}
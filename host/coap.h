@@ -0,0 +1,134 @@
+/****************************************************************************
+ * external/services/iotpf/host/coap.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _HOST_COAP_H_
+#define _HOST_COAP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Minimal RFC 7252 message codec shared by the host core and the
+ * stand-in server. Options have to be added in ascending order.
+ */
+
+#define COAP_VERSION            1
+#define COAP_HDR_MAX            128   /* header, token and options */
+#define COAP_OPTION_MAX         16
+
+#define COAP_TYPE_CON           0
+#define COAP_TYPE_NON           1
+#define COAP_TYPE_ACK           2
+#define COAP_TYPE_RST           3
+
+#define COAP_CODE(c, d)         (((c) << 5) | (d))
+#define COAP_EMPTY              0x00
+#define COAP_GET                0x01
+#define COAP_POST               0x02
+#define COAP_PUT                0x03
+#define COAP_DELETE             0x04
+#define COAP_201_CREATED        COAP_CODE(2, 1)
+#define COAP_202_DELETED        COAP_CODE(2, 2)
+#define COAP_204_CHANGED        COAP_CODE(2, 4)
+#define COAP_205_CONTENT        COAP_CODE(2, 5)
+#define COAP_231_CONTINUE       COAP_CODE(2, 31)
+#define COAP_400_BAD_REQUEST    COAP_CODE(4, 0)
+#define COAP_404_NOT_FOUND      COAP_CODE(4, 4)
+#define COAP_405_NOT_ALLOWED    COAP_CODE(4, 5)
+#define COAP_500_INTERNAL       COAP_CODE(5, 0)
+
+#define COAP_OPT_OBSERVE        6
+#define COAP_OPT_LOCATION_PATH  8
+#define COAP_OPT_URI_PATH       11
+#define COAP_OPT_CONTENT_FORMAT 12
+#define COAP_OPT_URI_QUERY      15
+#define COAP_OPT_ACCEPT         17
+#define COAP_OPT_BLOCK1         27
+
+#define COAP_FORMAT_TEXT        0
+#define COAP_FORMAT_LINK        40
+#define COAP_FORMAT_OPAQUE      42
+#define COAP_FORMAT_SENML_JSON  110
+
+/* RFC 7252 section 4.8 transmission parameters */
+
+#define COAP_ACK_TIMEOUT_MS     2000
+#define COAP_MAX_RETRANSMIT     4
+
+typedef struct coap_option_s
+{
+  uint16_t num;
+  uint16_t len;
+  const uint8_t *val;
+} coap_option_t;
+
+typedef struct coap_msg_s
+{
+  uint8_t type;
+  uint8_t code;
+  uint16_t mid;
+  uint8_t tkl;
+  uint8_t token[8];
+  uint8_t nopt;
+  coap_option_t opt[COAP_OPTION_MAX];
+  const uint8_t *payload;
+  uint16_t payload_len;
+} coap_msg_t;
+
+typedef struct coap_writer_s
+{
+  uint8_t *buf;
+  uint16_t size;
+  uint16_t len;
+  uint16_t last;     /* number of the last option written */
+  bool overflow;
+} coap_writer_t;
+
+int coap_parse(coap_msg_t *msg, const uint8_t *buf, uint16_t len);
+const coap_option_t *coap_find(const coap_msg_t *msg, uint16_t num,
+                               const coap_option_t *after);
+uint32_t coap_option_uint(const coap_option_t *opt);
+int coap_path(const coap_msg_t *msg, uint16_t num, char *buf, int size);
+
+void coap_begin(coap_writer_t *w, uint8_t *buf, uint16_t size, uint8_t type,
+                uint8_t code, uint16_t mid, const uint8_t *token,
+                uint8_t tkl);
+void coap_option(coap_writer_t *w, uint16_t num, const void *val,
+                 uint16_t len);
+void coap_option_u(coap_writer_t *w, uint16_t num, uint32_t val);
+void coap_option_path(coap_writer_t *w, uint16_t num, const char *path);
+void coap_payload(coap_writer_t *w, const void *data, uint16_t len);
+int coap_end(coap_writer_t *w);
+
+#endif /* _HOST_COAP_H_ */
@@ -0,0 +1,183 @@
+/****************************************************************************
+ * external/services/iotpf/host/dtls.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "dtls.h"
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static unsigned int prv_psk_client(SSL *ssl, const char *hint,
+                                   char *identity,
+                                   unsigned int max_identity_len,
+                                   unsigned char *psk,
+                                   unsigned int max_psk_len)
+{
+  if (max_identity_len <= strlen(DTLS_PSK_IDENTITY) ||
+      max_psk_len < strlen(DTLS_PSK_KEY))
+    {
+      return 0;
+    }
+
+  strcpy(identity, DTLS_PSK_IDENTITY);
+  memcpy(psk, DTLS_PSK_KEY, strlen(DTLS_PSK_KEY));
+  return strlen(DTLS_PSK_KEY);
+}
+
+static unsigned int prv_psk_server(SSL *ssl, const char *identity,
+                                   unsigned char *psk,
+                                   unsigned int max_psk_len)
+{
+  if (strcmp(identity, DTLS_PSK_IDENTITY) != 0 ||
+      max_psk_len < strlen(DTLS_PSK_KEY))
+    {
+      return 0;
+    }
+
+  memcpy(psk, DTLS_PSK_KEY, strlen(DTLS_PSK_KEY));
+  return strlen(DTLS_PSK_KEY);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* The LwM2M mandatory PSK suite first. The server caches sessions, so a
+ * client offering one it still has gets the abbreviated handshake.
+ */
+
+SSL_CTX *dtls_context(bool server)
+{
+  SSL_CTX *ctx;
+
+  ctx = SSL_CTX_new(server ? DTLS_server_method() : DTLS_client_method());
+  if (ctx == NULL)
+    {
+      return NULL;
+    }
+
+  SSL_CTX_set_min_proto_version(ctx, DTLS1_2_VERSION);
+  SSL_CTX_set_max_proto_version(ctx, DTLS1_2_VERSION);
+  if (SSL_CTX_set_cipher_list(ctx, "PSK-AES128-CCM8:PSK-AES128-GCM-SHA256")
+      != 1)
+    {
+      SSL_CTX_free(ctx);
+      return NULL;
+    }
+
+  if (server)
+    {
+      SSL_CTX_set_psk_server_callback(ctx, prv_psk_server);
+      SSL_CTX_set_session_id_context(ctx, (const uint8_t *)"iotpf", 5);
+      SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    }
+  else
+    {
+      SSL_CTX_set_psk_client_callback(ctx, prv_psk_client);
+      SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    }
+
+  return ctx;
+}
+
+SSL *dtls_new(SSL_CTX *ctx, bool server)
+{
+  SSL *ssl = SSL_new(ctx);
+  BIO *rbio = BIO_new(BIO_s_mem());
+  BIO *wbio = BIO_new(BIO_s_mem());
+
+  if (ssl == NULL || rbio == NULL || wbio == NULL)
+    {
+      SSL_free(ssl);
+      BIO_free(rbio);
+      BIO_free(wbio);
+      return NULL;
+    }
+
+  /* An empty memory BIO is "try again", not end of file */
+
+  BIO_set_mem_eof_return(rbio, -1);
+  BIO_set_mem_eof_return(wbio, -1);
+  SSL_set_bio(ssl, rbio, wbio);
+  SSL_set_options(ssl, SSL_OP_NO_QUERY_MTU);
+  SSL_set_mtu(ssl, DTLS_MTU);
+  if (server)
+    {
+      SSL_set_accept_state(ssl);
+    }
+  else
+    {
+      SSL_set_connect_state(ssl);
+    }
+
+  return ssl;
+}
+
+void dtls_input(SSL *ssl, const uint8_t *buf, int len)
+{
+  BIO_write(SSL_get_rbio(ssl), buf, len);
+}
+
+/* What the last calls left to send, the records of a flight together in
+ * one datagram. 0 when there is nothing.
+ */
+
+int dtls_output(SSL *ssl, uint8_t *buf, int size)
+{
+  int n = BIO_read(SSL_get_wbio(ssl), buf, size);
+
+  return n > 0 ? n : 0;
+}
+
+/* Milliseconds until a lost flight has to be sent again, UINT32_MAX when
+ * nothing waits for an answer
+ */
+
+uint32_t dtls_timeout(SSL *ssl)
+{
+  struct timeval tv;
+
+  if (DTLSv1_get_timeout(ssl, &tv) != 1)
+    {
+      return UINT32_MAX;
+    }
+
+  return tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000;
+}
@@ -0,0 +1,60 @@
+/****************************************************************************
+ * external/services/iotpf/host/dtls.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _HOST_DTLS_H_
+#define _HOST_DTLS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <openssl/ssl.h>
+
+/* DTLS 1.2 with a pre-shared key for the host core and the stand-in
+ * server, over OpenSSL. Records go in and out through memory BIOs so the
+ * callers keep their own sockets, and iotpf_server its impairment path.
+ * Both ends use the same identity and key.
+ */
+
+#define DTLS_PSK_IDENTITY       "iotpf"
+#define DTLS_PSK_KEY            "iotpf host psk!!"
+#define DTLS_MTU                1200
+
+SSL_CTX *dtls_context(bool server);
+SSL *dtls_new(SSL_CTX *ctx, bool server);
+void dtls_input(SSL *ssl, const uint8_t *buf, int len);
+int dtls_output(SSL *ssl, uint8_t *buf, int size);
+uint32_t dtls_timeout(SSL *ssl);
+
+#endif /* _HOST_DTLS_H_ */
@@ -0,0 +1,311 @@
+/****************************************************************************
+ * external/services/iotpf/host/fwgen.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/* Greedy patch builder: every 8 byte window of the source goes into a
+ * hash table, the target is walked left to right and each position takes
+ * the longer of the match continuing the previous COPY and the one the
+ * table offers. What matches nothing becomes INSERT, or FILL for runs.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iotpf_sha256.h"
+#include "iotpf_fw.h"
+#include "fwgen.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#define FWGEN_MATCH_MIN         8
+#define FWGEN_RUN_MIN           8
+#define FWGEN_HASH_BITS_MAX     22
+
+#define FWGEN_OP_COPY           0x00
+#define FWGEN_OP_INSERT         0x01
+#define FWGEN_OP_FILL           0x02
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+typedef struct fwgen_buf_s
+{
+  uint8_t *data;
+  uint32_t len;
+  uint32_t size;
+  int failed;
+} fwgen_buf_t;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void fwgen_put(fwgen_buf_t *b, const void *data, uint32_t len)
+{
+  uint8_t *grown;
+
+  if (b->len + len > b->size)
+    {
+      b->size = (b->len + len) * 2;
+      grown = realloc(b->data, b->size);
+      if (grown == NULL)
+        {
+          b->failed = 1;
+          return;
+        }
+      b->data = grown;
+    }
+
+  if (!b->failed)
+    {
+      memcpy(b->data + b->len, data, len);
+      b->len += len;
+    }
+}
+
+static void fwgen_byte(fwgen_buf_t *b, uint8_t value)
+{
+  fwgen_put(b, &value, 1);
+}
+
+static void fwgen_le32(fwgen_buf_t *b, uint32_t value)
+{
+  uint8_t le[4];
+
+  le[0] = value & 0xff;
+  le[1] = (value >> 8) & 0xff;
+  le[2] = (value >> 16) & 0xff;
+  le[3] = value >> 24;
+  fwgen_put(b, le, 4);
+}
+
+static void fwgen_varint(fwgen_buf_t *b, uint32_t value)
+{
+  while (value >= 0x80)
+    {
+      fwgen_byte(b, (value & 0x7f) | 0x80);
+      value >>= 7;
+    }
+
+  fwgen_byte(b, value);
+}
+
+static void fwgen_sha(fwgen_buf_t *b, const uint8_t *data, uint32_t len)
+{
+  uint8_t digest[IOTPF_SHA256_DIGEST_LEN];
+  iotpf_sha256_t sha;
+
+  iotpf_sha256_init(&sha);
+  iotpf_sha256_update(&sha, data, len);
+  iotpf_sha256_final(&sha, digest);
+  fwgen_put(b, digest, sizeof(digest));
+}
+
+static uint32_t fwgen_hash(const uint8_t *p, int bits)
+{
+  uint32_t a;
+  uint32_t c;
+
+  memcpy(&a, p, 4);
+  memcpy(&c, p + 4, 4);
+  return ((a * 2654435761u) ^ (c * 2246822519u)) >> (32 - bits);
+}
+
+static uint32_t fwgen_match(const uint8_t *a, uint32_t alen,
+                            const uint8_t *b, uint32_t blen)
+{
+  uint32_t max = alen < blen ? alen : blen;
+  uint32_t n = 0;
+
+  while (n < max && a[n] == b[n])
+    {
+      n++;
+    }
+
+  return n;
+}
+
+/* dst[from, to) matched nothing: literal bytes, runs of one value filled */
+
+static void fwgen_literals(fwgen_buf_t *b, const uint8_t *dst,
+                           uint32_t from, uint32_t to)
+{
+  uint32_t k = from;
+  uint32_t r;
+
+  while (k < to)
+    {
+      for (r = 1; k + r < to && dst[k + r] == dst[k]; r++)
+        {
+        }
+
+      if (r < FWGEN_RUN_MIN)
+        {
+          k += r;
+          continue;
+        }
+
+      if (k > from)
+        {
+          fwgen_byte(b, FWGEN_OP_INSERT);
+          fwgen_varint(b, k - from);
+          fwgen_put(b, dst + from, k - from);
+        }
+
+      fwgen_byte(b, FWGEN_OP_FILL);
+      fwgen_varint(b, r);
+      fwgen_byte(b, dst[k]);
+      k += r;
+      from = k;
+    }
+
+  if (to > from)
+    {
+      fwgen_byte(b, FWGEN_OP_INSERT);
+      fwgen_varint(b, to - from);
+      fwgen_put(b, dst + from, to - from);
+    }
+}
+
+static uint8_t *fwgen_done(fwgen_buf_t *b, uint32_t *out)
+{
+  if (b->failed)
+    {
+      free(b->data);
+      return NULL;
+    }
+
+  *out = b->len;
+  return b->data;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+uint8_t *fwgen_package(const uint8_t *image, uint32_t len, uint32_t *out)
+{
+  fwgen_buf_t b;
+
+  memset(&b, 0, sizeof(b));
+  fwgen_put(&b, IOTPF_FW_MANIFEST_MAGIC, 4);
+  fwgen_le32(&b, len);
+  fwgen_sha(&b, image, len);
+  fwgen_put(&b, image, len);
+  return fwgen_done(&b, out);
+}
+
+uint8_t *fwgen_delta(const uint8_t *src, uint32_t src_len,
+                     const uint8_t *dst, uint32_t dst_len, uint32_t *out)
+{
+  uint32_t *table;
+  uint32_t src_pos = 0;
+  uint32_t lit = 0;
+  uint32_t i = 0;
+  uint32_t best;
+  uint32_t at;
+  uint32_t n;
+  int32_t seek;
+  int bits = 10;
+  fwgen_buf_t b;
+
+  memset(&b, 0, sizeof(b));
+  fwgen_put(&b, "IPD1", 4);
+  fwgen_le32(&b, src_len);
+  fwgen_le32(&b, dst_len);
+  fwgen_sha(&b, src, src_len);
+  fwgen_sha(&b, dst, dst_len);
+
+  while (bits < FWGEN_HASH_BITS_MAX && (1u << bits) < src_len)
+    {
+      bits++;
+    }
+
+  /* Positions are kept plus one, 0 is an empty slot */
+
+  table = calloc(1u << bits, sizeof(uint32_t));
+  if (table == NULL)
+    {
+      free(b.data);
+      return NULL;
+    }
+
+  for (n = 0; n + FWGEN_MATCH_MIN <= src_len; n++)
+    {
+      table[fwgen_hash(src + n, bits)] = n + 1;
+    }
+
+  while (i + FWGEN_MATCH_MIN <= dst_len)
+    {
+      best = src_pos < src_len ?
+             fwgen_match(src + src_pos, src_len - src_pos,
+                         dst + i, dst_len - i) : 0;
+      at = src_pos;
+
+      n = table[fwgen_hash(dst + i, bits)];
+      if (n > 0)
+        {
+          n = fwgen_match(src + n - 1, src_len - n + 1, dst + i, dst_len - i);
+          if (n > best)
+            {
+              best = n;
+              at = table[fwgen_hash(dst + i, bits)] - 1;
+            }
+        }
+
+      if (best < FWGEN_MATCH_MIN)
+        {
+          i++;
+          continue;
+        }
+
+      fwgen_literals(&b, dst, lit, i);
+
+      seek = (int32_t)(at - src_pos);
+      fwgen_byte(&b, FWGEN_OP_COPY);
+      fwgen_varint(&b, ((uint32_t)seek << 1) ^ (uint32_t)(seek >> 31));
+      fwgen_varint(&b, best);
+      src_pos = at + best;
+      i += best;
+      lit = i;
+    }
+
+  fwgen_literals(&b, dst, lit, dst_len);
+  free(table);
+  return fwgen_done(&b, out);
+}
@@ -0,0 +1,802 @@
+/****************************************************************************
+ * external/services/iotpf/host/host_platform.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <nuttx/config.h>
+#include <nuttx/fs/fs.h>
+#include <nuttx/power/pm.h>
+
+#include "cis_api.h"
+#include "cis_log.h"
+#include "at_api.h"
+#include "host_platform.h"
+
+/* Everything iotpf expects from NuttX, the modem and iotpf_lib's platform
+ * layer, backed by POSIX. The radio is a flag: ciscom_setRadioPower() flips
+ * it and bumps an epoch so the core knows the "network" came back.
+ *
+ * For the radio-on comparison the modem also keeps a pretend RRC state.
+ * Powering on attaches for IOTPF_ATTACH_MS (default 2000) before the core
+ * may register. Traffic keeps RRC connected until IOTPF_RRC_INACTIVITY_MS
+ * (default 20000) after the last datagram, or until release assistance.
+ * Idle then lasts the PSM active time before PSM, or forever without PSM.
+ * Cumulative residency is logged whenever RRC is released or the radio
+ * goes off.
+ */
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static bool g_radio_on = true;
+static uint32_t g_radio_epoch;
+
+enum
+{
+  HOST_RRC_CONNECTED = 0,
+  HOST_RRC_IDLE,
+  HOST_RRC_PSM,
+  HOST_RRC_OFF,
+  HOST_RRC_NSTATES
+};
+
+static pthread_mutex_t g_rrc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int g_rrc;                    /* HOST_RRC_CONNECTED at boot */
+static uint32_t g_rrc_since;
+static uint32_t g_rrc_deadline;      /* of the current state, if timed */
+static bool g_rrc_timed;
+static uint32_t g_rrc_ms[HOST_RRC_NSTATES];
+static int32_t g_psm_active_ms = -1; /* -1 without PSM */
+static uint32_t g_attached_at;       /* registration allowed from */
+static uint32_t g_attaches;
+static uint32_t g_resumes;           /* idle or PSM back to connected */
+static int g_pm_count[PM_COUNT];
+static enum pm_state_e g_pm_state = PM_NORMAL;
+static struct pm_callback_s *g_pm_cb;
+static pthread_mutex_t g_pm_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct
+{
+  const char *prefix;
+  at_indication_t cb;
+} g_indications[4];
+static pthread_t g_gps_tid;
+static volatile bool g_gps_run;
+static char g_log_level;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static char prv_log_level(void)
+{
+  if (g_log_level == 0)
+    {
+      const char *env = getenv("IOTPF_LOG");
+
+      g_log_level = env ? toupper((unsigned char)env[0]) : 'I';
+    }
+
+  return g_log_level;
+}
+
+static int prv_level_rank(char level)
+{
+  switch (level)
+    {
+      case 'E':
+        return 0;
+      case 'W':
+        return 1;
+      case 'I':
+        return 2;
+      default:
+        return 3;
+    }
+}
+
+static void prv_indicate(const char *line)
+{
+  int i;
+
+  for (i = 0; i < sizeof(g_indications) / sizeof(g_indications[0]); i++)
+    {
+      if (g_indications[i].prefix != NULL &&
+          strncmp(line, g_indications[i].prefix,
+                  strlen(g_indications[i].prefix)) == 0)
+        {
+          g_indications[i].cb(line);
+          return;
+        }
+    }
+}
+
+static void *prv_gps_thread(void *arg)
+{
+  while (g_gps_run)
+    {
+      char line[96];
+      char body[80];
+      struct tm tm;
+      time_t now = time(NULL);
+      uint8_t sum = 0;
+      int i;
+
+      gmtime_r(&now, &tm);
+      snprintf(body, sizeof(body),
+               "GPRMC,%02d%02d%02d.000,A,3114.3960,N,12128.7430,E,"
+               "0.00,0.00,%02d%02d%02d,,,A",
+               tm.tm_hour, tm.tm_min, tm.tm_sec,
+               tm.tm_mday, tm.tm_mon + 1, tm.tm_year % 100);
+      for (i = 0; body[i]; i++)
+        {
+          sum ^= body[i];
+        }
+
+      snprintf(line, sizeof(line), "$%s*%02X", body, sum);
+      prv_indicate(line);
+
+      sleep(1);
+    }
+
+  return NULL;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void cis_host_log(char level, const char *fmt, ...)
+{
+  va_list ap;
+
+  if (prv_level_rank(level) > prv_level_rank(prv_log_level()))
+    {
+      return;
+    }
+
+  fprintf(stderr, "%10u %c ", cissys_gettime(), level);
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+  va_end(ap);
+  fputc('\n', stderr);
+}
+
+void cis_host_log_level(char level)
+{
+  g_log_level = toupper((unsigned char)level);
+}
+
+static uint32_t prv_env_ms(const char *name, uint32_t def)
+{
+  const char *env = getenv(name);
+
+  return env ? strtoul(env, NULL, 10) : def;
+}
+
+static void prv_rrc_enter(int state, uint32_t now)
+{
+  if (g_rrc_since == 0)
+    {
+      g_rrc_since = now;
+    }
+
+  g_rrc_ms[g_rrc] += now - g_rrc_since;
+  g_rrc = state;
+  g_rrc_since = now;
+  g_rrc_timed = false;
+  if (state == HOST_RRC_CONNECTED)
+    {
+      g_rrc_timed = true;
+      g_rrc_deadline = now + prv_env_ms("IOTPF_RRC_INACTIVITY_MS", 20000);
+    }
+  else if (state == HOST_RRC_IDLE && g_psm_active_ms >= 0)
+    {
+      g_rrc_timed = true;
+      g_rrc_deadline = now + g_psm_active_ms;
+    }
+
+  if (state == HOST_RRC_IDLE || state == HOST_RRC_OFF)
+    {
+      LOGI("host: rrc connected %u.%u s idle %u.%u s psm %u.%u s "
+           "off %u.%u s, %u attaches %u resumes",
+           g_rrc_ms[HOST_RRC_CONNECTED] / 1000,
+           g_rrc_ms[HOST_RRC_CONNECTED] % 1000 / 100,
+           g_rrc_ms[HOST_RRC_IDLE] / 1000,
+           g_rrc_ms[HOST_RRC_IDLE] % 1000 / 100,
+           g_rrc_ms[HOST_RRC_PSM] / 1000, g_rrc_ms[HOST_RRC_PSM] % 1000 / 100,
+           g_rrc_ms[HOST_RRC_OFF] / 1000, g_rrc_ms[HOST_RRC_OFF] % 1000 / 100,
+           g_attaches, g_resumes);
+    }
+}
+
+/* Plays the timers out up to now */
+
+static void prv_rrc_advance(uint32_t now)
+{
+  while (g_rrc_timed && (int32_t)(now - g_rrc_deadline) >= 0)
+    {
+      prv_rrc_enter(g_rrc == HOST_RRC_CONNECTED ? HOST_RRC_IDLE :
+                    HOST_RRC_PSM, g_rrc_deadline);
+    }
+}
+
+bool cis_host_radio_on(void)
+{
+  return g_radio_on && (int32_t)(cissys_gettime() - g_attached_at) >= 0;
+}
+
+void cis_host_radio_traffic(void)
+{
+  uint32_t now = cissys_gettime();
+
+  pthread_mutex_lock(&g_rrc_mutex);
+  prv_rrc_advance(now);
+  if (g_rrc == HOST_RRC_IDLE || g_rrc == HOST_RRC_PSM)
+    {
+      g_resumes++;
+    }
+  if (g_rrc != HOST_RRC_OFF)
+    {
+      prv_rrc_enter(HOST_RRC_CONNECTED, now);
+    }
+  pthread_mutex_unlock(&g_rrc_mutex);
+}
+
+uint32_t cis_host_radio_epoch(void)
+{
+  return g_radio_epoch;
+}
+
+/* iotpf_lib platform */
+
+void *cis_malloc(size_t size)
+{
+  return malloc(size);
+}
+
+void cis_free(void *ptr)
+{
+  free(ptr);
+}
+
+void *cis_memset(void *ptr, int value, size_t size)
+{
+  return memset(ptr, value, size);
+}
+
+void *cis_memcpy(void *dst, const void *src, size_t size)
+{
+  return memcpy(dst, src, size);
+}
+
+uint32_t cissys_rand(void)
+{
+  static bool seeded;
+
+  if (!seeded)
+    {
+      srandom(getpid() ^ time(NULL));
+      seeded = true;
+    }
+
+  return random();
+}
+
+uint32_t cissys_gettime(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void cissys_sleepms(uint32_t ms)
+{
+  usleep(ms * 1000);
+}
+
+void cissys_assert(bool cond)
+{
+  if (!cond)
+    {
+      LOGE("cissys_assert failed");
+      abort();
+    }
+}
+
+void cissys_recover_psm(void)
+{
+}
+
+cis_list_t *cis_list_add(cis_list_t *head, cis_list_t *node)
+{
+  cis_list_t *target;
+
+  if (head == NULL || head->id > node->id)
+    {
+      node->next = head;
+      return node;
+    }
+
+  for (target = head; target->next != NULL && target->next->id < node->id;
+       target = target->next);
+
+  node->next = target->next;
+  target->next = node;
+  return head;
+}
+
+cis_list_t *cis_list_remove(cis_list_t *head, cis_listid_t id,
+                            cis_list_t **nodeP)
+{
+  cis_list_t **pp;
+
+  if (nodeP != NULL)
+    {
+      *nodeP = NULL;
+    }
+
+  for (pp = &head; *pp != NULL; pp = &(*pp)->next)
+    {
+      if ((*pp)->id == id)
+        {
+          if (nodeP != NULL)
+            {
+              *nodeP = *pp;
+            }
+          *pp = (*pp)->next;
+          break;
+        }
+    }
+
+  return head;
+}
+
+cis_list_t *cis_list_find(cis_list_t *head, cis_listid_t id)
+{
+  for (; head != NULL && head->id != id; head = head->next);
+  return head;
+}
+
+cis_listid_t cis_list_count(cis_list_t *head)
+{
+  cis_listid_t count = 0;
+
+  for (; head != NULL; head = head->next)
+    {
+      count++;
+    }
+
+  return count;
+}
+
+void cis_data_encode_bool(bool value, cis_data_t *dataP)
+{
+  dataP->type = cis_data_type_bool;
+  dataP->value.asBoolean = value;
+}
+
+void cis_data_encode_int(int64_t value, cis_data_t *dataP)
+{
+  dataP->type = cis_data_type_integer;
+  dataP->value.asInteger = value;
+}
+
+void cis_data_encode_float(double value, cis_data_t *dataP)
+{
+  dataP->type = cis_data_type_float;
+  dataP->value.asFloat = value;
+}
+
+void cis_data_encode_string(const char *string, cis_data_t *dataP)
+{
+  dataP->type = cis_data_type_string;
+  dataP->asBuffer.buffer = (uint8_t *)string;
+  dataP->asBuffer.length = strlen(string);
+}
+
+int cis_data_decode_bool(const cis_data_t *dataP, bool *valueP)
+{
+  if (dataP->type == cis_data_type_bool)
+    {
+      *valueP = dataP->value.asBoolean;
+      return 1;
+    }
+
+  if (dataP->type == cis_data_type_integer)
+    {
+      *valueP = dataP->value.asInteger != 0;
+      return 1;
+    }
+
+  return 0;
+}
+
+int cis_data_decode_int(const cis_data_t *dataP, int64_t *valueP)
+{
+  switch (dataP->type)
+    {
+      case cis_data_type_integer:
+        *valueP = dataP->value.asInteger;
+        return 1;
+      case cis_data_type_float:
+        *valueP = (int64_t)dataP->value.asFloat;
+        return 1;
+      case cis_data_type_bool:
+        *valueP = dataP->value.asBoolean;
+        return 1;
+      default:
+        return 0;
+    }
+}
+
+int cis_data_decode_float(const cis_data_t *dataP, double *valueP)
+{
+  switch (dataP->type)
+    {
+      case cis_data_type_integer:
+        *valueP = dataP->value.asInteger;
+        return 1;
+      case cis_data_type_float:
+        *valueP = dataP->value.asFloat;
+        return 1;
+      default:
+        return 0;
+    }
+}
+
+/* Modem */
+
+int ciscom_initialize(cis_iotpf_configs *configs)
+{
+  return 0;
+}
+
+void ciscom_destory(void)
+{
+}
+
+void ciscom_setRadioPower(bool on)
+{
+  uint32_t ms = cissys_gettime();
+
+  pthread_mutex_lock(&g_rrc_mutex);
+  prv_rrc_advance(ms);
+  if (on && !g_radio_on)
+    {
+      g_attaches++;
+      g_attached_at = ms + prv_env_ms("IOTPF_ATTACH_MS", 2000);
+      prv_rrc_enter(HOST_RRC_CONNECTED, ms);
+    }
+  else if (!on && g_radio_on)
+    {
+      prv_rrc_enter(HOST_RRC_OFF, ms);
+    }
+  pthread_mutex_unlock(&g_rrc_mutex);
+
+  if (on && !g_radio_on)
+    {
+      char line[64];
+      struct tm tm;
+      time_t now = time(NULL);
+
+      g_radio_epoch++;
+      gmtime_r(&now, &tm);
+      snprintf(line, sizeof(line),
+               "+CTZE: \"+32\",0,\"%02d/%02d/%02d,%02d:%02d:%02d\"",
+               tm.tm_year % 100, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour,
+               tm.tm_min, tm.tm_sec);
+      prv_indicate(line);
+    }
+
+  g_radio_on = on;
+  LOGI("host: radio %s", on ? "on" : "off");
+}
+
+int ciscom_getRegisteredStaus(void)
+{
+  return cis_host_radio_on() ? 1 : g_radio_on ? 2 : 0;
+}
+
+int ciscom_setPowerSaving(const char *tau, const char *active,
+                          const char *edrx)
+{
+  static const int32_t unit[8] = { 2000, 60000, 360000, 0, 0, 0, 0, -1 };
+  uint32_t bits = strtoul(active, NULL, 2);
+
+  pthread_mutex_lock(&g_rrc_mutex);
+  g_psm_active_ms = unit[bits >> 5] < 0 ? -1 : unit[bits >> 5] * (bits & 31);
+  pthread_mutex_unlock(&g_rrc_mutex);
+  LOGI("host: AT+CPSMS=1,,,\"%s\",\"%s\"%s%s", tau, active,
+       edrx ? " AT+CEDRXS=2,5,\"" : "", edrx ? edrx : "");
+  return 0;
+}
+
+int ciscom_releaseAssist(void)
+{
+  uint32_t now = cissys_gettime();
+
+  pthread_mutex_lock(&g_rrc_mutex);
+  prv_rrc_advance(now);
+  if (g_rrc == HOST_RRC_CONNECTED)
+    {
+      prv_rrc_enter(HOST_RRC_IDLE, now);
+    }
+  pthread_mutex_unlock(&g_rrc_mutex);
+  return 0;
+}
+
+bool ciscom_isRegistered(int status)
+{
+  return status == 1 || status == 5;
+}
+
+int ciscom_getATHandle(void)
+{
+  return -1;
+}
+
+int cisat_initialize(void)
+{
+  return 0;
+}
+
+/* Stand-in AT parser: every command line is answered OK, one at a time */
+
+void cisat_readloop(int fd)
+{
+  char buf[256];
+  size_t len = 0;
+  bool at = false;
+  ssize_t n;
+  ssize_t i;
+
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+      for (i = 0; i < n; i++)
+        {
+          if (buf[i] != '\r' && buf[i] != '\n')
+            {
+              at = len == 1 ? at && toupper(buf[i]) == 'T' :
+                   len == 0 ? toupper(buf[i]) == 'A' : at;
+              len++;
+              continue;
+            }
+          if (at && len >= 2)
+            {
+              write(fd, "\r\nOK\r\n", 6);
+            }
+          at = false;
+          len = 0;
+        }
+    }
+}
+
+/* ril/at_client */
+
+int at_tok_start(char **p_cur)
+{
+  char *p = *p_cur ? strchr(*p_cur, ':') : NULL;
+
+  if (p == NULL)
+    {
+      return -1;
+    }
+
+  *p_cur = p + 1;
+  return 0;
+}
+
+int at_tok_nextstr(char **p_cur, char **p_out)
+{
+  char *p = *p_cur;
+
+  if (p == NULL)
+    {
+      return -1;
+    }
+
+  while (*p == ' ')
+    {
+      p++;
+    }
+
+  if (*p == '"')
+    {
+      *p_out = ++p;
+      p = strchr(p, '"');
+      if (p == NULL)
+        {
+          return -1;
+        }
+      *p++ = '\0';
+      p = strchr(p, ',');
+    }
+  else
+    {
+      *p_out = p;
+      p = strchr(p, ',');
+      if (p != NULL)
+        {
+          *p = '\0';
+        }
+    }
+
+  *p_cur = p ? p + 1 : NULL;
+  return 0;
+}
+
+int at_tok_nextint(char **p_cur, int *p_out)
+{
+  char *s;
+  char *end;
+
+  if (at_tok_nextstr(p_cur, &s) < 0)
+    {
+      return -1;
+    }
+
+  *p_out = strtol(s, &end, 10);
+  return end == s ? -1 : 0;
+}
+
+int at_tok_hasmore(char **p_cur)
+{
+  return *p_cur != NULL && **p_cur != '\0';
+}
+
+void register_indication(int fd, const char *prefix, at_indication_t cb)
+{
+  int i;
+
+  for (i = 0; i < sizeof(g_indications) / sizeof(g_indications[0]); i++)
+    {
+      if (g_indications[i].prefix == NULL ||
+          strcmp(g_indications[i].prefix, prefix) == 0)
+        {
+          g_indications[i].prefix = prefix;
+          g_indications[i].cb = cb;
+          return;
+        }
+    }
+}
+
+void start_gps(int fd, bool hot)
+{
+  if (g_gps_run)
+    {
+      return;
+    }
+
+  g_gps_run = true;
+  pthread_create(&g_gps_tid, NULL, prv_gps_thread, NULL);
+}
+
+void stop_gps(int fd)
+{
+  if (g_gps_run)
+    {
+      g_gps_run = false;
+      pthread_join(g_gps_tid, NULL);
+    }
+}
+
+/* NuttX */
+
+static void prv_pm_govern(void)
+{
+  enum pm_state_e state = PM_SLEEP;
+  int i;
+
+  for (i = PM_STANDBY; i >= PM_NORMAL; i--)
+    {
+      if (g_pm_count[i] > 0)
+        {
+          state = i;
+        }
+    }
+
+  if (state != g_pm_state)
+    {
+      g_pm_state = state;
+      if (g_pm_cb != NULL && g_pm_cb->notify != NULL)
+        {
+          g_pm_cb->notify(g_pm_cb, PM_IDLE_DOMAIN, state);
+        }
+    }
+}
+
+int pm_register(struct pm_callback_s *callbacks)
+{
+  g_pm_cb = callbacks;
+  return 0;
+}
+
+void pm_stay(int domain, enum pm_state_e state)
+{
+  pthread_mutex_lock(&g_pm_mutex);
+  g_pm_count[state]++;
+  prv_pm_govern();
+  pthread_mutex_unlock(&g_pm_mutex);
+}
+
+void pm_relax(int domain, enum pm_state_e state)
+{
+  pthread_mutex_lock(&g_pm_mutex);
+  g_pm_count[state]--;
+  prv_pm_govern();
+  pthread_mutex_unlock(&g_pm_mutex);
+}
+
+int task_create(const char *name, int priority, int stack_size,
+                int (*entry)(int argc, char *argv[]), char * const argv[])
+{
+  char *args[8] = { (char *)name };
+  int argc = 1;
+
+  while (argv != NULL && argv[argc - 1] != NULL && argc < 7)
+    {
+      args[argc] = argv[argc - 1];
+      argc++;
+    }
+
+  return entry(argc, args);
+}
+
+int file_detach(int fd, struct file *filep)
+{
+  filep->f_fd = fd;
+  return 0;
+}
+
+ssize_t file_read(struct file *filep, void *buf, size_t nbytes)
+{
+  return read(filep->f_fd, buf, nbytes);
+}
+
+ssize_t file_write(struct file *filep, const void *buf, size_t nbytes)
+{
+  return write(filep->f_fd, buf, nbytes);
+}
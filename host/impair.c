@@ -0,0 +1,881 @@
+/****************************************************************************
+ * external/services/iotpf/host/impair.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "coap.h"
+#include "impair.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#define IMPAIR_SCENARIO_MAX     16
+#define IMPAIR_QUEUE_MAX        256
+#define IMPAIR_EXCHANGE_MAX     256
+#define IMPAIR_NAT_MAX          16
+#define IMPAIR_SAMPLE_MAX       1024
+#define IMPAIR_BUF_MAX          1280
+#define IMPAIR_NAT_PORT         20000  /* first port handed out by the NAT */
+
+#define IMPAIR_UP               0      /* client -> server */
+#define IMPAIR_DOWN             1
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct impair_stats_s
+{
+  uint32_t pkts[2];        /* offered to the emulator */
+  uint32_t lost[2];
+  uint32_t dup;
+  uint32_t reordered;
+  uint32_t nat_drops;      /* downlink to an expired mapping */
+  uint32_t rebinds;        /* uplink that needed a new mapping */
+  uint32_t overflow;       /* queue full */
+  uint32_t offered;        /* distinct uplink messages sent */
+  uint32_t msgs;           /* of them delivered */
+  uint32_t bytes;          /* their payload */
+  uint32_t retx[2];        /* CON sent again, by the client / the server */
+  uint32_t done;
+  uint32_t open;           /* CON never acknowledged */
+  uint32_t radio_ms;       /* modelled client radio on time */
+  uint32_t nsamples;
+  uint32_t samples[IMPAIR_SAMPLE_MAX];
+};
+
+struct impair_scenario_s
+{
+  char name[16];
+  char line[96];
+  uint32_t seconds;
+  uint32_t delay;
+  uint32_t jitter;
+  double loss;
+  double ge_p;
+  double ge_r;
+  double ge_h;
+  double dup;
+  double reorder;
+  uint32_t gap;
+  double rate;             /* kbit/s, 0 is unlimited */
+  uint32_t nat;            /* seconds, 0 never expires */
+  uint32_t tail;           /* ms the radio stays on after a datagram */
+  uint32_t start;
+  uint32_t end;
+  struct impair_stats_s st;
+};
+
+struct impair_pkt_s
+{
+  bool used;
+  bool up;
+  bool copy;               /* second copy of a duplicated datagram */
+  uint32_t due;
+  uint32_t seq;
+  struct sockaddr_in real; /* the client's own address */
+  struct sockaddr_in virt; /* the address the server sees */
+  int len;
+  uint8_t buf[IMPAIR_BUF_MAX];
+};
+
+/* A confirmable exchange, from the first transmission of a CON until its
+ * ACK/RST gets through to the sender.
+ */
+
+struct impair_exchange_s
+{
+  bool used;
+  bool done;
+  bool delivered;          /* uplink: counted in msgs/bytes already */
+  uint8_t dir;
+  uint16_t mid;
+  struct sockaddr_in peer; /* up: real client, down: virtual client */
+  uint32_t first;
+  uint8_t scenario;
+};
+
+struct impair_nat_s
+{
+  bool used;
+  struct sockaddr_in real;
+  struct sockaddr_in virt;
+  uint32_t last;           /* last uplink through the mapping */
+  uint32_t radio_until;    /* the client's radio is on until then */
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct impair_scenario_s g_scenario[IMPAIR_SCENARIO_MAX];
+static int g_nscenario;
+static int g_current = -1;
+static int g_sock;
+static impair_deliver_t g_deliver;
+static uint32_t g_rand;
+static uint32_t g_seq;
+static bool g_bad[2];
+static uint32_t g_link_free[2];
+static uint16_t g_nat_port = IMPAIR_NAT_PORT;
+static struct impair_pkt_s g_queue[IMPAIR_QUEUE_MAX];
+static struct impair_exchange_s g_exchange[IMPAIR_EXCHANGE_MAX];
+static struct impair_nat_s g_nat[IMPAIR_NAT_MAX];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* xorshift32, so that drops depend on the seed and nothing else */
+
+static uint32_t prv_rand(void)
+{
+  g_rand ^= g_rand << 13;
+  g_rand ^= g_rand >> 17;
+  g_rand ^= g_rand << 5;
+  return g_rand;
+}
+
+static bool prv_chance(double percent)
+{
+  return percent > 0 && prv_rand() % 1000000 < percent * 10000;
+}
+
+static bool prv_same(const struct sockaddr_in *a, const struct sockaddr_in *b)
+{
+  return a->sin_addr.s_addr == b->sin_addr.s_addr &&
+         a->sin_port == b->sin_port;
+}
+
+static struct impair_stats_s *prv_stats(void)
+{
+  return &g_scenario[g_current].st;
+}
+
+static int prv_parse(struct impair_scenario_s *s, char *line)
+{
+  char *tok;
+  char *save;
+
+  memset(s, 0, sizeof(*s));
+  snprintf(s->line, sizeof(s->line), "%.*s", (int)sizeof(s->line) - 1,
+           line);
+  s->ge_h = 100;
+  s->gap = 100;
+  s->tail = 10000;
+
+  tok = strtok_r(line, " \t", &save);
+  snprintf(s->name, sizeof(s->name), "%s", tok);
+  tok = strtok_r(NULL, " \t", &save);
+  if (tok == NULL || (s->seconds = atoi(tok)) == 0)
+    {
+      return -1;
+    }
+
+  while ((tok = strtok_r(NULL, " \t", &save)) != NULL)
+    {
+      char *val = strchr(tok, '=');
+
+      if (val == NULL)
+        {
+          return -1;
+        }
+
+      *val++ = '\0';
+      if (strcmp(tok, "delay") == 0)
+        {
+          s->delay = atoi(val);
+        }
+      else if (strcmp(tok, "jitter") == 0)
+        {
+          s->jitter = atoi(val);
+        }
+      else if (strcmp(tok, "loss") == 0)
+        {
+          s->loss = atof(val);
+        }
+      else if (strcmp(tok, "ge") == 0)
+        {
+          if (sscanf(val, "%lf,%lf,%lf", &s->ge_p, &s->ge_r, &s->ge_h) < 2)
+            {
+              return -1;
+            }
+        }
+      else if (strcmp(tok, "dup") == 0)
+        {
+          s->dup = atof(val);
+        }
+      else if (strcmp(tok, "reorder") == 0)
+        {
+          s->reorder = atof(val);
+        }
+      else if (strcmp(tok, "gap") == 0)
+        {
+          s->gap = atoi(val);
+        }
+      else if (strcmp(tok, "rate") == 0)
+        {
+          s->rate = atof(val);
+        }
+      else if (strcmp(tok, "nat") == 0)
+        {
+          s->nat = atoi(val);
+        }
+      else if (strcmp(tok, "tail") == 0)
+        {
+          s->tail = atoi(val);
+        }
+      else
+        {
+          return -1;
+        }
+    }
+
+  return 0;
+}
+
+static void prv_start(int index, uint32_t now)
+{
+  if (g_current >= 0)
+    {
+      g_scenario[g_current].end = now;
+    }
+
+  g_current = index;
+  if (index < g_nscenario)
+    {
+      g_scenario[index].start = now;
+      printf("%10u impair: %s\n", now, g_scenario[index].line);
+      fflush(stdout);
+    }
+}
+
+/* Loss for one datagram, Gilbert-Elliott when ge= is set */
+
+static bool prv_lost(const struct impair_scenario_s *s, int dir)
+{
+  if (s->ge_p > 0)
+    {
+      if (g_bad[dir])
+        {
+          g_bad[dir] = !prv_chance(s->ge_r);
+        }
+      else
+        {
+          g_bad[dir] = prv_chance(s->ge_p);
+        }
+
+      if (g_bad[dir])
+        {
+          return prv_chance(s->ge_h);
+        }
+    }
+
+  return prv_chance(s->loss);
+}
+
+static uint32_t prv_latency(const struct impair_scenario_s *s)
+{
+  int32_t ms = s->delay;
+
+  if (s->jitter > 0)
+    {
+      ms += (int32_t)(prv_rand() % (2 * s->jitter + 1)) - (int32_t)s->jitter;
+    }
+
+  return ms > 0 ? ms : 0;
+}
+
+static void prv_enqueue(bool up, bool copy, uint32_t due,
+                        const struct sockaddr_in *real,
+                        const struct sockaddr_in *virt,
+                        const uint8_t *buf, int len)
+{
+  int i;
+
+  for (i = 0; i < IMPAIR_QUEUE_MAX; i++)
+    {
+      struct impair_pkt_s *p = &g_queue[i];
+
+      if (!p->used)
+        {
+          p->used = true;
+          p->up = up;
+          p->copy = copy;
+          p->due = due;
+          p->seq = g_seq++;
+          p->real = *real;
+          p->virt = *virt;
+          p->len = len;
+          memcpy(p->buf, buf, len);
+          return;
+        }
+    }
+
+  prv_stats()->overflow++;
+}
+
+/* Runs one datagram through the current scenario */
+
+static void prv_impair(bool up, const struct sockaddr_in *real,
+                       const struct sockaddr_in *virt, const uint8_t *buf,
+                       int len, uint32_t now)
+{
+  struct impair_scenario_s *s = &g_scenario[g_current];
+  int dir = up ? IMPAIR_UP : IMPAIR_DOWN;
+  uint32_t due = now;
+
+  s->st.pkts[dir]++;
+  if (len > IMPAIR_BUF_MAX || prv_lost(s, dir))
+    {
+      s->st.lost[dir]++;
+      return;
+    }
+
+  if (s->rate > 0)
+    {
+      if ((int32_t)(g_link_free[dir] - now) > 0)
+        {
+          due = g_link_free[dir];
+        }
+
+      due += len * 8 / s->rate + 0.5;
+      g_link_free[dir] = due;
+    }
+
+  if (prv_chance(s->reorder))
+    {
+      s->st.reordered++;
+      due += s->gap;
+    }
+
+  prv_enqueue(up, false, due + prv_latency(s), real, virt, buf, len);
+  if (prv_chance(s->dup))
+    {
+      s->st.dup++;
+      prv_enqueue(up, true, due + prv_latency(s), real, virt, buf, len);
+    }
+}
+
+static struct impair_exchange_s *prv_exchange(uint8_t dir,
+                                              const struct sockaddr_in *peer,
+                                              uint16_t mid)
+{
+  int i;
+
+  for (i = 0; i < IMPAIR_EXCHANGE_MAX; i++)
+    {
+      struct impair_exchange_s *x = &g_exchange[i];
+
+      if (x->used && x->dir == dir && x->mid == mid && prv_same(&x->peer, peer))
+        {
+          return x;
+        }
+    }
+
+  return NULL;
+}
+
+static void prv_close(struct impair_exchange_s *x)
+{
+  if (x->used && !x->done)
+    {
+      g_scenario[x->scenario].st.open++;
+    }
+
+  x->used = false;
+}
+
+/* First transmission of a CON opens an exchange, later ones are
+ * retransmissions. The oldest exchange makes room when the table is full.
+ */
+
+static struct impair_exchange_s *prv_con(uint8_t dir,
+                                         const struct sockaddr_in *peer,
+                                         const uint8_t *buf, uint32_t now)
+{
+  struct impair_exchange_s *x;
+  struct impair_exchange_s *oldest = NULL;
+  uint16_t mid = (buf[2] << 8) | buf[3];
+  int i;
+
+  x = prv_exchange(dir, peer, mid);
+  if (x != NULL)
+    {
+      prv_stats()->retx[dir]++;
+      return x;
+    }
+
+  for (i = 0; i < IMPAIR_EXCHANGE_MAX; i++)
+    {
+      x = &g_exchange[i];
+      if (!x->used)
+        {
+          break;
+        }
+
+      if (oldest == NULL || (x->done && !oldest->done) ||
+          (x->done == oldest->done &&
+           (int32_t)(x->first - oldest->first) < 0))
+        {
+          oldest = x;
+        }
+    }
+
+  if (i == IMPAIR_EXCHANGE_MAX)
+    {
+      x = oldest;
+      prv_close(x);
+    }
+
+  memset(x, 0, sizeof(*x));
+  x->used = true;
+  x->dir = dir;
+  x->mid = mid;
+  x->peer = *peer;
+  x->first = now;
+  x->scenario = g_current;
+  return x;
+}
+
+/* An ACK or RST on its way to the sender completes the exchange */
+
+static void prv_ack(uint8_t dir, const struct sockaddr_in *peer,
+                    const uint8_t *buf, uint32_t now)
+{
+  struct impair_exchange_s *x;
+  struct impair_stats_s *st;
+
+  x = prv_exchange(dir, peer, (buf[2] << 8) | buf[3]);
+  if (x == NULL || x->done)
+    {
+      return;
+    }
+
+  x->done = true;
+  st = &g_scenario[x->scenario].st;
+  st->done++;
+  if (st->nsamples < IMPAIR_SAMPLE_MAX)
+    {
+      st->samples[st->nsamples++] = now - x->first;
+    }
+}
+
+static struct impair_nat_s *prv_nat_by_virt(const struct sockaddr_in *virt)
+{
+  int i;
+
+  for (i = 0; i < IMPAIR_NAT_MAX; i++)
+    {
+      if (g_nat[i].used && prv_same(&g_nat[i].virt, virt))
+        {
+          return &g_nat[i];
+        }
+    }
+
+  return NULL;
+}
+
+static bool prv_nat_expired(const struct impair_nat_s *n, uint32_t now)
+{
+  uint32_t nat = g_scenario[g_current].nat;
+
+  return nat > 0 && now - n->last >= nat * 1000;
+}
+
+/* Maps the client's address to the one the server sees, like a NAT in
+ * front of the module: a binding idle for longer than nat= is forgotten
+ * and the next uplink comes from a new port.
+ */
+
+static struct impair_nat_s *prv_nat_out(const struct sockaddr_in *real,
+                                        struct sockaddr_in *virt,
+                                        uint32_t now)
+{
+  struct impair_nat_s *n = NULL;
+  struct impair_nat_s *oldest = NULL;
+  int i;
+
+  for (i = 0; i < IMPAIR_NAT_MAX && n == NULL; i++)
+    {
+      if (g_nat[i].used && prv_same(&g_nat[i].real, real))
+        {
+          n = &g_nat[i];
+        }
+    }
+
+  if (n != NULL && prv_nat_expired(n, now))
+    {
+      prv_stats()->rebinds++;
+      n->virt.sin_port = htons(g_nat_port++);
+    }
+
+  for (i = 0; i < IMPAIR_NAT_MAX && n == NULL; i++)
+    {
+      if (!g_nat[i].used)
+        {
+          n = &g_nat[i];
+        }
+      else if (oldest == NULL ||
+               (int32_t)(g_nat[i].last - oldest->last) < 0)
+        {
+          oldest = &g_nat[i];
+        }
+    }
+
+  if (n == NULL)
+    {
+      n = oldest;
+    }
+
+  if (!n->used || !prv_same(&n->real, real))
+    {
+      n->used = true;
+      n->real = *real;
+      n->virt = *real;
+      n->virt.sin_port = htons(g_nat_port++);
+    }
+
+  n->last = now;
+  *virt = n->virt;
+  return n;
+}
+
+/* The client's radio stays connected for tail= after every datagram it
+ * sends or receives, like the RRC inactivity timer of the cell.
+ */
+
+static void prv_radio(struct impair_nat_s *n, uint32_t now)
+{
+  uint32_t tail = g_scenario[g_current].tail;
+
+  if ((int32_t)(n->radio_until - now) <= 0)
+    {
+      prv_stats()->radio_ms += tail;
+    }
+  else if ((int32_t)(now + tail - n->radio_until) > 0)
+    {
+      prv_stats()->radio_ms += now + tail - n->radio_until;
+    }
+  else
+    {
+      return;
+    }
+
+  n->radio_until = now + tail;
+}
+
+static void prv_release(struct impair_pkt_s *p, uint32_t now)
+{
+  struct impair_stats_s *st = prv_stats();
+  uint8_t type = (p->buf[0] >> 4) & 3;
+  bool ack = p->len >= 4 && (type == COAP_TYPE_ACK || type == COAP_TYPE_RST);
+
+  if (p->up)
+    {
+      if (ack)
+        {
+          prv_ack(IMPAIR_DOWN, &p->virt, p->buf, now);
+        }
+      else if (p->len >= 4 && p->buf[1] != COAP_EMPTY)
+        {
+          struct impair_exchange_s *x = NULL;
+          coap_msg_t msg;
+
+          if (type == COAP_TYPE_CON)
+            {
+              x = prv_exchange(IMPAIR_UP, &p->real,
+                               (p->buf[2] << 8) | p->buf[3]);
+            }
+
+          if ((x != NULL ? !x->delivered : !p->copy) &&
+              coap_parse(&msg, p->buf, p->len) == 0)
+            {
+              st->msgs++;
+              st->bytes += msg.payload_len;
+            }
+
+          if (x != NULL)
+            {
+              x->delivered = true;
+            }
+        }
+
+      g_deliver(&p->virt, p->buf, p->len);
+    }
+  else
+    {
+      struct impair_nat_s *n = prv_nat_by_virt(&p->virt);
+
+      if (n == NULL || prv_nat_expired(n, now))
+        {
+          st->nat_drops++;
+          return;
+        }
+
+      if (ack)
+        {
+          prv_ack(IMPAIR_UP, &n->real, p->buf, now);
+        }
+
+      prv_radio(n, now);
+
+      sendto(g_sock, p->buf, p->len, 0, (const struct sockaddr *)&n->real,
+             sizeof(n->real));
+    }
+}
+
+static int prv_cmp(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int impair_load(const char *path, uint32_t seed, int sock,
+                impair_deliver_t deliver, uint32_t now)
+{
+  FILE *fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+  char line[256];
+  int lineno = 0;
+  bool bad = false;
+
+  if (fp == NULL)
+    {
+      perror(path);
+      return -1;
+    }
+
+  while (fgets(line, sizeof(line), fp) != NULL)
+    {
+      char *p = line + strspn(line, " \t");
+
+      lineno++;
+      p[strcspn(p, "#\r\n")] = '\0';
+      while (*p != '\0' && strchr(" \t", p[strlen(p) - 1]) != NULL)
+        {
+          p[strlen(p) - 1] = '\0';
+        }
+
+      if (*p == '\0')
+        {
+          continue;
+        }
+
+      if (g_nscenario == IMPAIR_SCENARIO_MAX ||
+          prv_parse(&g_scenario[g_nscenario], p) < 0)
+        {
+          fprintf(stderr, "%s:%d: bad scenario\n", path, lineno);
+          bad = true;
+          break;
+        }
+
+      g_nscenario++;
+    }
+
+  if (fp != stdin)
+    {
+      fclose(fp);
+    }
+
+  if (g_nscenario == 0 || bad)
+    {
+      return -1;
+    }
+
+  g_sock = sock;
+  g_deliver = deliver;
+  g_rand = seed != 0 ? seed : 1;
+  prv_start(0, now);
+  return 0;
+}
+
+bool impair_active(void)
+{
+  return g_current >= 0 && g_current < g_nscenario;
+}
+
+void impair_uplink(const struct sockaddr_in *from, const uint8_t *buf,
+                   int len, uint32_t now)
+{
+  uint8_t type = len >= 4 ? (buf[0] >> 4) & 3 : COAP_TYPE_RST;
+  struct sockaddr_in virt;
+
+  if (type == COAP_TYPE_CON && buf[1] != COAP_EMPTY)
+    {
+      if (prv_exchange(IMPAIR_UP, from, (buf[2] << 8) | buf[3]) == NULL)
+        {
+          prv_stats()->offered++;
+        }
+
+      prv_con(IMPAIR_UP, from, buf, now);
+    }
+  else if (type == COAP_TYPE_NON && buf[1] != COAP_EMPTY)
+    {
+      prv_stats()->offered++;
+    }
+
+  prv_radio(prv_nat_out(from, &virt, now), now);
+  prv_impair(true, from, &virt, buf, len, now);
+}
+
+void impair_downlink(const struct sockaddr_in *to, const uint8_t *buf,
+                     int len, uint32_t now)
+{
+  if (len >= 4 && ((buf[0] >> 4) & 3) == COAP_TYPE_CON)
+    {
+      prv_con(IMPAIR_DOWN, to, buf, now);
+    }
+
+  prv_impair(false, to, to, buf, len, now);
+}
+
+/* Delivers what is due in order and moves on to the next scenario.
+ * Returns how long the caller may sleep, -1 once the profile is over.
+ */
+
+int impair_poll(uint32_t now)
+{
+  struct impair_pkt_s *next;
+  int i;
+
+  if (g_current < 0 || g_current >= g_nscenario)
+    {
+      return -1;
+    }
+
+  if (now - g_scenario[g_current].start >=
+      g_scenario[g_current].seconds * 1000)
+    {
+      prv_start(g_current + 1, now);
+      if (g_current == g_nscenario)
+        {
+          return -1;
+        }
+    }
+
+  for (; ; )
+    {
+      next = NULL;
+      for (i = 0; i < IMPAIR_QUEUE_MAX; i++)
+        {
+          struct impair_pkt_s *p = &g_queue[i];
+
+          if (p->used && (next == NULL ||
+                          (int32_t)(p->due - next->due) < 0 ||
+                          (p->due == next->due && p->seq < next->seq)))
+            {
+              next = p;
+            }
+        }
+
+      if (next == NULL)
+        {
+          return 100;
+        }
+
+      if ((int32_t)(next->due - now) > 0)
+        {
+          return next->due - now < 100 ? next->due - now : 100;
+        }
+
+      next->used = false;
+      prv_release(next, now);
+    }
+}
+
+void impair_report(uint32_t now)
+{
+  int i;
+
+  for (i = 0; i < IMPAIR_EXCHANGE_MAX; i++)
+    {
+      prv_close(&g_exchange[i]);
+    }
+
+  printf("\n%-10s %5s %11s %9s %4s %5s %4s %4s %11s %5s %10s %9s %5s "
+         "%4s %6s %6s %6s %6s\n", "scenario", "secs", "pkts up/dn", "lost",
+         "dup", "reord", "nat", "rebd", "msgs dlvd", "%", "goodput",
+         "retx c/s", "done", "open", "p50", "p95", "max", "radio");
+
+  for (i = 0; i < g_nscenario && i <= g_current; i++)
+    {
+      struct impair_scenario_s *s = &g_scenario[i];
+      struct impair_stats_s *st = &s->st;
+      uint32_t end = i < g_current ? s->end : now;
+      uint32_t ms = end - s->start > 0 ? end - s->start : 1;
+      char pkts[16];
+      char lost[16];
+      char retx[16];
+      char msgs[24];
+      uint32_t n = st->nsamples;
+
+      qsort(st->samples, n, sizeof(st->samples[0]), prv_cmp);
+      snprintf(pkts, sizeof(pkts), "%u/%u", st->pkts[0], st->pkts[1]);
+      snprintf(lost, sizeof(lost), "%u/%u", st->lost[0], st->lost[1]);
+      snprintf(retx, sizeof(retx), "%u/%u", st->retx[0], st->retx[1]);
+      snprintf(msgs, sizeof(msgs), "%u/%u", st->msgs, st->offered);
+      printf("%-10s %5u %11s %9s %4u %5u %4u %4u %11s %5.1f %7.1fB/s %9s "
+             "%5u %4u %4ums %4ums %4ums %5.1fs\n",
+             s->name, ms / 1000, pkts, lost, st->dup, st->reordered,
+             st->nat_drops, st->rebinds, msgs,
+             st->offered ? st->msgs * 100.0 / st->offered : 0.0,
+             st->bytes * 1000.0 / ms, retx, st->done, st->open,
+             n ? st->samples[n / 2] : 0, n ? st->samples[n * 95 / 100] : 0,
+             n ? st->samples[n - 1] : 0, st->radio_ms / 1000.0);
+      if (st->overflow > 0)
+        {
+          printf("%-10s %u datagrams dropped, queue full\n", "",
+                 st->overflow);
+        }
+    }
+
+  fflush(stdout);
+}
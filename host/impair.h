@@ -0,0 +1,86 @@
+/****************************************************************************
+ * external/services/iotpf/host/impair.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _HOST_IMPAIR_H_
+#define _HOST_IMPAIR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+/* Network impairment emulation for iotpf_server. A profile is a list of
+ * scenarios played one after the other, one per line:
+ *
+ *   # name    seconds  impairments
+ *   clean     60
+ *   lossy     120      loss=5 delay=300 jitter=100
+ *   bursty    120      ge=2,30 delay=300
+ *   narrow    120      rate=2.4 delay=800 reorder=5 gap=400
+ *   natted    300      nat=45 dup=1
+ *
+ *   delay=ms jitter=ms   one way latency, uniform in delay +- jitter
+ *   loss=%               uniform loss, the good state loss with ge=
+ *   ge=p,r[,h]           Gilbert-Elliott: % good->bad, % bad->good,
+ *                        % lost in the bad state (100)
+ *   dup=%                delivered twice
+ *   reorder=% gap=ms     held back gap ms (100) so later ones overtake
+ *   rate=kbit/s          serialisation at that rate, per direction
+ *   nat=seconds          the client's mapping expires after that long
+ *                        without uplink, later uplink gets a new port
+ *   tail=ms              the client's radio stays on that long after each
+ *                        datagram it sends or gets (10000)
+ *
+ * Every impairment applies to both directions with its own state. The
+ * random sequence comes from the seed only, so the same profile and seed
+ * replay the same drops. When the last scenario ends impair_poll() returns
+ * -1 and impair_report() prints per scenario the messages delivered out
+ * of those sent, goodput, message completion time, retransmissions and
+ * the modelled radio on time.
+ */
+
+typedef void (*impair_deliver_t)(const struct sockaddr_in *addr,
+                                 const uint8_t *buf, int len);
+
+int impair_load(const char *path, uint32_t seed, int sock,
+                impair_deliver_t deliver, uint32_t now);
+bool impair_active(void);
+void impair_uplink(const struct sockaddr_in *from, const uint8_t *buf,
+                   int len, uint32_t now);
+void impair_downlink(const struct sockaddr_in *to, const uint8_t *buf,
+                     int len, uint32_t now);
+int impair_poll(uint32_t now);
+void impair_report(uint32_t now);
+
+#endif /* _HOST_IMPAIR_H_ */
@@ -0,0 +1,427 @@
+/****************************************************************************
+ * external/services/iotpf/host/include/cis_api.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _CIS_API_H_
+#define _CIS_API_H_
+
+/* Host stand-in for the iotpf_lib public API. Only what the adapters in
+ * this directory use is declared; cis_core.c implements it over CoAP/UDP.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "cis_list.h"
+
+typedef int32_t  cis_ret_t;
+typedef uint8_t  cis_coapret_t;
+typedef uint32_t cis_mid_t;
+typedef uint16_t cis_oid_t;
+typedef uint16_t cis_iid_t;
+typedef uint16_t cis_rid_t;
+typedef uint16_t cis_instcount_t;
+typedef uint16_t cis_attrcount_t;
+typedef uint32_t cis_time_t;
+typedef int32_t  cis_evt_t;
+
+#define CIS_RET_OK                  0
+#define CIS_RET_ERROR               -1
+
+#define URI_INVALID                 0xFFFF
+#define LIFETIME_INVALID            0
+
+#define CIS_URI_FLAG_OBJECT_ID      0x04
+#define CIS_URI_FLAG_INSTANCE_ID    0x02
+#define CIS_URI_FLAG_RESOURCE_ID    0x01
+
+#define CIS_URI_IS_SET_INSTANCE(u)  (((u)->flag & CIS_URI_FLAG_INSTANCE_ID) != 0)
+#define CIS_URI_IS_SET_RESOURCE(u)  (((u)->flag & CIS_URI_FLAG_RESOURCE_ID) != 0)
+
+typedef struct
+{
+  uint8_t flag;
+  cis_oid_t objectId;
+  cis_iid_t instanceId;
+  cis_rid_t resourceId;
+} cis_uri_t;
+
+typedef enum
+{
+  cis_data_type_undefine = 0,
+  cis_data_type_string,
+  cis_data_type_opaque,
+  cis_data_type_integer,
+  cis_data_type_float,
+  cis_data_type_bool,
+} cis_datatype_t;
+
+typedef struct
+{
+  cis_rid_t id;
+  cis_datatype_t type;
+  struct
+  {
+    uint32_t length;
+    uint8_t *buffer;
+  } asBuffer;
+  union
+  {
+    bool asBoolean;
+    int64_t asInteger;
+    double asFloat;
+  } value;
+} cis_data_t;
+
+typedef struct
+{
+  uint8_t toSet;
+  uint8_t toClear;
+  cis_time_t minPeriod;
+  cis_time_t maxPeriod;
+  float greaterThan;
+  float lessThan;
+  float step;
+} cis_observe_attr_t;
+
+typedef struct
+{
+  cis_instcount_t instanceCount;
+  cis_instcount_t instanceBytes;
+  const uint8_t *instanceBitmap;
+} cis_inst_bitmap_t;
+
+typedef struct
+{
+  cis_attrcount_t attrCount;
+  cis_attrcount_t actCount;
+} cis_res_count_t;
+
+typedef struct st_object
+{
+  struct st_object *next;
+  cis_oid_t objID;
+  uint16_t attributeCount;
+  uint16_t actionCount;
+  uint16_t instBitmapCount;
+  uint8_t instBitmapBytes;
+  uint8_t *instBitmapPtr;
+} st_object_t;
+
+typedef cis_coapret_t (*cis_read_callback_t)(void *context, cis_uri_t *uri,
+                                             cis_mid_t mid);
+typedef cis_coapret_t (*cis_write_callback_t)(void *context, cis_uri_t *uri,
+                                              const cis_data_t *value,
+                                              cis_attrcount_t count,
+                                              cis_mid_t mid);
+typedef cis_coapret_t (*cis_exec_callback_t)(void *context, cis_uri_t *uri,
+                                             const uint8_t *buffer,
+                                             uint32_t length, cis_mid_t mid);
+typedef cis_coapret_t (*cis_observe_callback_t)(void *context, cis_uri_t *uri,
+                                                bool flag, cis_mid_t mid);
+typedef cis_coapret_t (*cis_discover_callback_t)(void *context, cis_uri_t *uri,
+                                                 cis_mid_t mid);
+typedef cis_coapret_t (*cis_set_params_callback_t)(void *context,
+                                                   cis_uri_t *uri,
+                                                   cis_observe_attr_t params,
+                                                   cis_mid_t mid);
+typedef cis_coapret_t (*cis_write_raw_callback_t)(void *context,
+                                                  const uint8_t *buffer,
+                                                  uint32_t length,
+                                                  cis_mid_t mid);
+typedef void (*cis_event_callback_t)(void *context, cis_evt_t eid,
+                                     void *param);
+
+typedef struct
+{
+  cis_read_callback_t onRead;
+  cis_write_callback_t onWrite;
+  cis_exec_callback_t onExec;
+  cis_observe_callback_t onObserve;
+  cis_set_params_callback_t onSetParams;
+  cis_event_callback_t onEvent;
+  cis_discover_callback_t onDiscover;
+  cis_write_raw_callback_t onWriteRaw;
+} cis_callback_t;
+
+enum
+{
+  CIS_EVENT_BASE = 0,
+  CIS_EVENT_BOOTSTRAP_START,
+  CIS_EVENT_BOOTSTRAP_SUCCESS,
+  CIS_EVENT_BOOTSTRAP_FAILED,
+  CIS_EVENT_CONNECT_SUCCESS,
+  CIS_EVENT_CONNECT_FAILED,
+  CIS_EVENT_REG_SUCCESS,
+  CIS_EVENT_REG_FAILED,
+  CIS_EVENT_REG_TIMEOUT,
+  CIS_EVENT_LIFETIME_TIMEOUT,
+  CIS_EVENT_STATUS_HALT,
+  CIS_EVENT_UPDATE_SUCCESS,
+  CIS_EVENT_UPDATE_FAILED,
+  CIS_EVENT_UPDATE_TIMEOUT,
+  CIS_EVENT_UPDATE_NEED,
+  CIS_EVENT_UNREG_DONE,
+  CIS_EVENT_RESPONSE_FAILED,
+  CIS_EVENT_RESPONSE_SUCCESS,
+  CIS_EVENT_NOTIFY_FAILED,
+  CIS_EVENT_NOTIFY_SUCCESS,
+  CIS_EVENT_FIRMWARE_DOWNLOADING,
+  CIS_EVENT_FIRMWARE_DOWNLOAD_FAILED,
+  CIS_EVENT_FIRMWARE_DOWNLOADED,
+  CIS_EVENT_FIRMWARE_UPDATING,
+  CIS_EVENT_FIRMWARE_TRIGGER,
+  CIS_EVENT_SOTA_DOWNLOADING,
+  CIS_EVENT_SOTA_DOWNLOAED,
+  CIS_EVENT_SOTA_FLASHERASE,
+  CIS_EVENT_SOTA_UPDATING,
+  CIS_EVENT_START_NB_GPS_THREAD,
+};
+
+/* Completion codes handed to cis_response()/cis_notify() are CoAP codes
+ * ((class << 5) | detail), CONTINUE only queues the value.
+ */
+
+enum
+{
+  CIS_RESPONSE_CONTINUE       = 0x00,
+  CIS_RESPONSE_WRITE          = 0x44,
+  CIS_RESPONSE_EXECUTE        = 0x44,
+  CIS_RESPONSE_OBSERVE_PARAMS = 0x44,
+  CIS_RESPONSE_READ           = 0x45,
+  CIS_RESPONSE_OBSERVE        = 0x45,
+  CIS_RESPONSE_DISCOVER       = 0x45,
+  CIS_RESPONSE_BAD_REQUEST    = 0x80,
+  CIS_RESPONSE_NOT_FOUND      = 0x84,
+};
+
+enum
+{
+  CIS_NOTIFY_CONTINUE = 0x00,
+  CIS_NOTIFY_CONTENT  = 0x45,
+};
+
+enum
+{
+  PUMP_RET_CUSTOM = 0,
+  PUMP_RET_NOSLEEP,
+};
+
+enum
+{
+  PUMP_STATE_INITIAL = 0,
+  PUMP_STATE_BOOTSTRAPPING,
+  PUMP_STATE_CONNECTING,
+  PUMP_STATE_REGISTER_REQUIRED,
+  PUMP_STATE_REGISTERING,
+  PUMP_STATE_READY,
+  PUMP_STATE_DISCONNECTED,
+  PUMP_STATE_UNREGISTER,
+  PUMP_STATE_HALT,
+};
+
+typedef enum
+{
+  cis_iotpf_mode_at = 0,
+  cis_iotpf_mode_api,
+} cis_iotpf_mode_t;
+
+typedef enum
+{
+  cis_iotpf_operator_ctcc = 0,
+  cis_iotpf_operator_cmcc,
+} cis_iotpf_operator_t;
+
+typedef struct
+{
+  cis_iotpf_mode_t iotpf_mode;
+  cis_iotpf_operator_t iotpf_operator;
+} cis_iotpf_configs;
+
+typedef enum
+{
+  sota_erase_success = 0,
+  sota_erase_fail,
+} cis_sota_result_t;
+
+#define STR_EVENT_CODE(e)   cis_event_str(e)
+
+/* Core */
+
+cis_ret_t cis_init(void **context, void *config, uint16_t size);
+cis_ret_t cis_init_with_vendor(void **context, void *config, uint16_t size,
+                               int vendor);
+cis_ret_t cis_deinit(void **context);
+cis_ret_t cis_register(void *context, cis_time_t lifetime,
+                       const cis_callback_t *cb);
+cis_ret_t cis_unregister(void *context);
+cis_ret_t cis_update_reg(void *context, cis_time_t lifetime,
+                         bool withObjects);
+cis_ret_t cis_addobject(void *context, cis_oid_t objectid,
+                        const cis_inst_bitmap_t *bitmap,
+                        const cis_res_count_t *resource);
+cis_ret_t cis_delobject(void *context, cis_oid_t objectid);
+st_object_t *cis_findObject(void *context, cis_oid_t objectid);
+uint32_t cis_pump(void *context, time_t *sleep);
+void cis_pump_initialize(void);
+void cisapi_wakeup_pump(void);
+void core_updatePumpState(void *context, int state);
+cis_ret_t cis_response(void *context, const cis_uri_t *uri,
+                       const cis_data_t *value, cis_mid_t mid,
+                       cis_coapret_t result);
+cis_ret_t cis_notify(void *context, const cis_uri_t *uri,
+                     const cis_data_t *value, cis_mid_t mid,
+                     cis_coapret_t result, bool needAck);
+cis_ret_t cis_notify_raw(void *context, const uint8_t *data,
+                         uint32_t length);
+
+/* Raw uplink as NON when needAck is false. Libraries that have it define
+ * CIS_HAVE_NOTIFY_RAW_ACK, with the others every raw uplink is CON.
+ */
+
+#define CIS_HAVE_NOTIFY_RAW_ACK 1
+cis_ret_t cis_notify_raw_ack(void *context, const uint8_t *data,
+                             uint32_t length, bool needAck);
+
+/* Received packets the cmcc adapter pooled go back through
+ * cisapi_cmcc_packet_release() instead of cis_free()
+ */
+
+#define CIS_HAVE_PACKET_RELEASE 1
+
+/* Downloaded firmware goes to the adapter buffer by buffer, with its
+ * offset in the stream: cisapi_cmcc_fw_write() or cisapi_ctcc_fw_write().
+ * Libraries that program the slot themselves do not define it.
+ */
+
+#define CIS_HAVE_FW_WRITE 1
+
+/* The DTLS session of the last handshake as opaque bytes, and one to
+ * offer on the next, so a session outlives a restart and the handshake
+ * after it is the abbreviated one. Get returns the length, 0 without a
+ * session, CIS_RET_ERROR when it does not fit. Only DTLS builds of the
+ * library have them and define CIS_HAVE_DTLS_SESSION; the host core is
+ * one with CIS_HOST_DTLS.
+ */
+
+#ifdef CIS_HOST_DTLS
+#define CIS_HAVE_DTLS_SESSION 1
+#endif
+
+#ifdef CIS_HAVE_DTLS_SESSION
+int cis_dtls_session_get(void *context, uint8_t *buf, uint32_t size);
+cis_ret_t cis_dtls_session_set(void *context, const uint8_t *buf,
+                               uint32_t len);
+bool cis_dtls_session_resumed(void *context);
+#endif
+
+/* RFC 9146 connection ID of len bytes asked for on the next handshake, 0
+ * for none. Libraries that have it define CIS_HAVE_DTLS_CID; the host
+ * core does not, OpenSSL has no connection IDs.
+ */
+
+#ifdef CIS_HAVE_DTLS_CID
+cis_ret_t cis_dtls_set_cid(void *context, uint8_t len);
+#endif
+
+cis_ret_t cis_uri_update(cis_uri_t *uri);
+const char *cis_event_str(cis_evt_t eid);
+
+/* Firmware update hooks, only reachable with CIS_ENABLE_UPDATE */
+
+void cis_notify_503(int code);
+void cis_notify_sota_result(void *context, cis_sota_result_t result);
+void cis_set_sota_info(const char *version, uint16_t size);
+void cis_check_fota_update(void);
+bool cis_get_fota_update_state(void);
+pthread_mutex_t *get_nb_gps_mutex(void);
+void start_nb_gps_thread(void);
+
+/* Data helpers */
+
+void cis_data_encode_bool(bool value, cis_data_t *dataP);
+void cis_data_encode_int(int64_t value, cis_data_t *dataP);
+void cis_data_encode_float(double value, cis_data_t *dataP);
+void cis_data_encode_string(const char *string, cis_data_t *dataP);
+int cis_data_decode_bool(const cis_data_t *dataP, bool *valueP);
+int cis_data_decode_int(const cis_data_t *dataP, int64_t *valueP);
+int cis_data_decode_float(const cis_data_t *dataP, double *valueP);
+
+/* Platform */
+
+void *cis_malloc(size_t size);
+void cis_free(void *ptr);
+void *cis_memset(void *ptr, int value, size_t size);
+void *cis_memcpy(void *dst, const void *src, size_t size);
+uint32_t cissys_rand(void);
+uint32_t cissys_gettime(void);
+void cissys_sleepms(uint32_t ms);
+void cissys_assert(bool cond);
+void cissys_recover_psm(void);
+
+/* Modem */
+
+int ciscom_initialize(cis_iotpf_configs *configs);
+void ciscom_destory(void);
+void ciscom_setRadioPower(bool on);
+int ciscom_getRegisteredStaus(void);
+bool ciscom_isRegistered(int status);
+int ciscom_getATHandle(void);
+
+/* Power saving instead of ciscom_setRadioPower(false), in libraries that
+ * define CIS_HAVE_POWER_SAVING. ciscom_setPowerSaving() requests PSM
+ * (AT+CPSMS) and, unless edrx is NULL, eDRX (AT+CEDRXS) with the timers
+ * coded as 27.007 bit strings; ciscom_releaseAssist() tells the network
+ * no more data follows (AT+CNMPSD) so it releases RRC at once. Both
+ * return 0 on OK.
+ */
+
+#define CIS_HAVE_POWER_SAVING 1
+int ciscom_setPowerSaving(const char *tau, const char *active,
+                          const char *edrx);
+int ciscom_releaseAssist(void);
+int cisat_initialize(void);
+void cisat_readloop(int fd);
+int cisapi_initialize(int iotpf_mode);
+
+#endif /* _CIS_API_H_ */
@@ -0,0 +1,159 @@
+/****************************************************************************
+ * external/services/iotpf/host/include/cis_internals.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _CIS_INTERNALS_H_
+#define _CIS_INTERNALS_H_
+
+#include <netinet/in.h>
+
+#include "cis_api.h"
+#include "coap.h"
+
+#ifdef CIS_HOST_DTLS
+#  include "dtls.h"
+#endif
+
+/* Layout of the host core's context. The adapters only reach into
+ * pNetContext (socket and received packet list), the rest is private to
+ * host/cis_core.c.
+ */
+
+#define CIS_HOST_PENDING_MAX     8    /* server requests awaiting an answer */
+#define CIS_HOST_OBSERVE_MAX     8
+#define CIS_HOST_TX_MAX          8    /* our CON messages awaiting an ACK */
+#define CIS_HOST_CACHE_MAX       4    /* answers kept for duplicate requests */
+#define CIS_HOST_BODY_MAX        1024
+
+struct st_net_packet
+{
+  struct st_net_packet *next;
+  uint8_t *buffer;
+  uint32_t length;
+};
+
+typedef struct st_cisnet_context
+{
+  int sock;
+  struct st_net_packet *g_packetlist;
+} *cisnet_t;
+
+typedef struct st_host_body
+{
+  uint8_t format;                  /* COAP_FORMAT_* */
+  uint16_t count;                  /* records or links so far */
+  uint16_t len;
+  char data[CIS_HOST_BODY_MAX];
+} st_host_body_t;
+
+typedef struct st_host_request
+{
+  cis_mid_t mid;                   /* 0: slot free */
+  uint16_t coapMid;
+  uint8_t type;
+  uint8_t tkl;
+  uint8_t token[8];
+  bool acked;                      /* empty ACK already sent */
+  bool observe;
+  uint32_t time;                   /* cissys_gettime() on arrival */
+  cis_uri_t uri;
+  st_host_body_t body;
+} st_host_request_t;
+
+typedef struct st_host_observe
+{
+  cis_mid_t mid;                   /* 0: slot free */
+  uint8_t tkl;
+  uint8_t token[8];
+  uint32_t seq;
+  bool raw;                        /* /19/0/0, fed by cis_notify_raw() */
+  cis_uri_t uri;
+  st_host_body_t body;
+} st_host_observe_t;
+
+typedef struct st_host_tx
+{
+  uint8_t kind;                    /* 0: slot free */
+  cis_mid_t mid;                   /* observation a notify belongs to */
+  uint16_t coapMid;
+  uint8_t retries;
+  uint32_t timeout;
+  uint32_t deadline;
+  uint32_t sent;
+  uint16_t len;
+  uint8_t buf[COAP_HDR_MAX + CIS_HOST_BODY_MAX];
+} st_host_tx_t;
+
+typedef struct st_host_cache
+{
+  uint16_t coapMid;
+  uint16_t len;
+  uint8_t buf[COAP_HDR_MAX + CIS_HOST_BODY_MAX];
+} st_host_cache_t;
+
+typedef struct st_context
+{
+  cisnet_t pNetContext;
+  struct st_cisnet_context net;
+  pthread_mutex_t lock;
+  struct sockaddr_in server;
+  bool vendor;                     /* ctcc: /19 raw data objects */
+  bool queue;                      /* config binding UQ: LwM2M queue mode */
+  bool registered;
+  int state;
+  cis_callback_t callback;
+  cis_time_t lifetime;
+  uint32_t regTime;
+  bool updateNeedSent;
+  uint32_t radioEpoch;             /* modem power cycle we dropped in */
+  char endpoint[48];
+  char location[32];
+  uint16_t nextCoapMid;
+  uint32_t nextToken;
+  cis_mid_t nextMid;
+  st_object_t *objectList;
+  st_host_request_t request[CIS_HOST_PENDING_MAX];
+  st_host_observe_t observe[CIS_HOST_OBSERVE_MAX];
+  st_host_tx_t tx[CIS_HOST_TX_MAX];
+  st_host_cache_t cache[CIS_HOST_CACHE_MAX];
+  uint8_t cacheNext;
+#ifdef CIS_HOST_DTLS
+  SSL *ssl;                        /* NULL: no DTLS session open */
+  bool secure;                     /* handshake done */
+  uint32_t handshakeStart;
+  SSL_SESSION *session;            /* offered on the next handshake */
+#endif
+} st_context_t;
+
+#endif /* _CIS_INTERNALS_H_ */
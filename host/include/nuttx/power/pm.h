@@ -0,0 +1,66 @@
+/****************************************************************************
+ * external/services/iotpf/host/include/nuttx/power/pm.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef __HOST_NUTTX_POWER_PM_H
+#define __HOST_NUTTX_POWER_PM_H
+
+#define PM_IDLE_DOMAIN  0
+
+enum pm_state_e
+{
+  PM_NORMAL = 0,
+  PM_IDLE,
+  PM_STANDBY,
+  PM_SLEEP,
+  PM_COUNT,
+};
+
+struct pm_callback_s
+{
+  int (*prepare)(struct pm_callback_s *cb, int domain,
+                 enum pm_state_e pmstate);
+  void (*notify)(struct pm_callback_s *cb, int domain,
+                 enum pm_state_e pmstate);
+};
+
+/* The host governor moves the domain to the deepest state no vote rules
+ * out as soon as the votes change, and tells the registered callback.
+ */
+
+int pm_register(struct pm_callback_s *callbacks);
+void pm_stay(int domain, enum pm_state_e state);
+void pm_relax(int domain, enum pm_state_e state);
+
+#endif /* __HOST_NUTTX_POWER_PM_H */
@@ -0,0 +1,285 @@
+/****************************************************************************
+ * external/services/iotpf/host/iotpf_dlogdump.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../iotpf_dlog.h"
+
+/* Usage: iotpf_dlogdump file.dlog
+ *
+ * Decodes the file sink of the deferred logger (see prv_file_record() in
+ * iotpf_dlog.c) into the lines the console drain would have printed, with
+ * the record time in front. Formats come from the file, so only the
+ * integer conversions DLOGx() allows are accepted.
+ */
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#define DUMP_FMTS         65536
+#define DUMP_LINE         256
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static char *g_fmts[DUMP_FMTS];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static int prv_get(FILE *f, uint8_t *buf, size_t len)
+{
+  return fread(buf, 1, len, f) == len ? 0 : -1;
+}
+
+static uint32_t prv_le16(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t prv_le32(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Accepts flags, width and precision with d i u x X o c, and %% */
+
+static int prv_fmt_ok(const char *fmt)
+{
+  while ((fmt = strchr(fmt, '%')) != NULL)
+    {
+      fmt++;
+      if (*fmt == '%')
+        {
+          fmt++;
+          continue;
+        }
+
+      fmt += strspn(fmt, "-+ #0");
+      fmt += strspn(fmt, "0123456789");
+      if (*fmt == '.')
+        {
+          fmt++;
+          fmt += strspn(fmt, "0123456789");
+        }
+
+      if (*fmt == '\0' || strchr("diuxXoc", *fmt) == NULL)
+        {
+          return 0;
+        }
+    }
+
+  return 1;
+}
+
+/* Same output as iotpf_dlog_format(), which needs the target runtime */
+
+static void prv_format(const iotpf_dlog_rec_t *rec, char *line, int size)
+{
+  const uint32_t *a = rec->u.args;
+  int n;
+  uint32_t i;
+
+  if (rec->hex)
+    {
+      n = snprintf(line, size, rec->fmt, rec->total);
+    }
+  else
+    {
+      n = snprintf(line, size, rec->fmt, a[0], a[1], a[2], a[3], a[4], a[5]);
+    }
+
+  for (i = 0; rec->hex && i < rec->count && n < size - 3; i++)
+    {
+      n += sprintf(line + n, "%02X", rec->u.bytes[i]);
+    }
+
+  if (rec->hex && rec->total > rec->count && n < size)
+    {
+      snprintf(line + n, size - n, "..(+%u)", rec->total - rec->count);
+    }
+}
+
+static void prv_record(const uint8_t *hdr, const uint8_t *body)
+{
+  static const char levels[] = "?EWID";
+  iotpf_dlog_rec_t rec;
+  char line[DUMP_LINE];
+  uint32_t id = prv_le16(hdr + 3);
+  uint32_t i;
+
+  memset(&rec, 0, sizeof(rec));
+  rec.level = hdr[0];
+  rec.hex = hdr[1];
+  rec.count = hdr[2];
+  rec.time = prv_le32(hdr + 5);
+  rec.fmt = g_fmts[id];
+  if (rec.hex)
+    {
+      rec.total = prv_le32(body);
+      memcpy(rec.u.bytes, body + 4, rec.count);
+    }
+  else
+    {
+      for (i = 0; i < rec.count; i++)
+        {
+          rec.u.args[i] = prv_le32(body + 4 * i);
+        }
+    }
+
+  if (rec.fmt == NULL || !prv_fmt_ok(rec.fmt))
+    {
+      snprintf(line, sizeof(line), "<format %u %s>", id,
+               rec.fmt ? "rejected" : "undefined");
+    }
+  else
+    {
+      prv_format(&rec, line, sizeof(line));
+    }
+
+  printf("%10u %c %s\n", rec.time,
+         levels[rec.level < sizeof(levels) - 1 ? rec.level : 0], line);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+  uint8_t buf[16 + IOTPF_DLOG_HEX_MAX];
+  FILE *f;
+  int c;
+
+  if (argc != 2 || (f = fopen(argv[1], "rb")) == NULL)
+    {
+      fprintf(stderr, "usage: %s file.dlog\n", argv[0]);
+      return 1;
+    }
+
+  while ((c = fgetc(f)) != EOF)
+    {
+      switch (c)
+        {
+          case 'I':
+            /* Header, once per daemon start: ids begin again */
+
+            if (prv_get(f, buf, 4) < 0 || memcmp(buf, "DLG\1", 4) != 0)
+              {
+                fprintf(stderr, "bad header\n");
+                return 1;
+              }
+            break;
+
+          case 'S':
+            {
+              uint32_t id;
+              uint32_t len;
+
+              if (prv_get(f, buf, 4) < 0)
+                {
+                  goto truncated;
+                }
+
+              id = prv_le16(buf);
+              len = prv_le16(buf + 2);
+              free(g_fmts[id]);
+              g_fmts[id] = calloc(1, len + 1);
+              if (g_fmts[id] == NULL || prv_get(f, (uint8_t *)g_fmts[id], len) < 0)
+                {
+                  goto truncated;
+                }
+            }
+            break;
+
+          case 'R':
+            {
+              uint32_t size;
+
+              if (prv_get(f, buf, 9) < 0)
+                {
+                  goto truncated;
+                }
+
+              if (buf[1])
+                {
+                  size = 4 + (buf[2] < IOTPF_DLOG_HEX_MAX ?
+                              buf[2] : IOTPF_DLOG_HEX_MAX);
+                }
+              else
+                {
+                  size = 4 * (buf[2] < IOTPF_DLOG_ARGS ?
+                              buf[2] : IOTPF_DLOG_ARGS);
+                }
+
+              buf[2] = buf[1] ? size - 4 : size / 4;
+              if (prv_get(f, buf + 9, size) < 0)
+                {
+                  goto truncated;
+                }
+
+              prv_record(buf, buf + 9);
+            }
+            break;
+
+          case 'D':
+            if (prv_get(f, buf, 4) < 0)
+              {
+                goto truncated;
+              }
+
+            printf("%10s - %u records dropped\n", "", prv_le32(buf));
+            break;
+
+          default:
+            fprintf(stderr, "bad entry 0x%02x at %ld\n", c, ftell(f) - 1);
+            return 1;
+        }
+    }
+
+  fclose(f);
+  return 0;
+
+truncated:
+  fprintf(stderr, "truncated at %ld\n", ftell(f));
+  fclose(f);
+  return 1;
+}
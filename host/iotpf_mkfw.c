@@ -0,0 +1,142 @@
+/****************************************************************************
+ * external/services/iotpf/host/iotpf_mkfw.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fwgen.h"
+
+/* Usage: iotpf_mkfw image out
+ *        iotpf_mkfw -d running image out
+ *
+ * Packs image behind its iotpf_fw manifest, or with -d writes the
+ * iotpf_delta patch that turns the running image into it. Either goes to
+ * the client with iotpf_server -f out.
+ */
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static uint8_t *prv_load(const char *path, uint32_t *len)
+{
+  uint8_t *data = NULL;
+  long size;
+  FILE *f;
+
+  f = fopen(path, "rb");
+  if (f == NULL)
+    {
+      perror(path);
+      return NULL;
+    }
+
+  if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) >= 0 &&
+      fseek(f, 0, SEEK_SET) == 0)
+    {
+      data = malloc(size + 1);
+      if (data != NULL && fread(data, 1, size, f) != (size_t)size)
+        {
+          free(data);
+          data = NULL;
+        }
+      *len = size;
+    }
+
+  fclose(f);
+  if (data == NULL)
+    {
+      fprintf(stderr, "%s: read failed\n", path);
+    }
+
+  return data;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+  uint8_t *src = NULL;
+  uint8_t *dst;
+  uint8_t *out;
+  uint32_t src_len = 0;
+  uint32_t dst_len;
+  uint32_t out_len;
+  FILE *f;
+
+  if (argc == 5 && strcmp(argv[1], "-d") == 0)
+    {
+      src = prv_load(argv[2], &src_len);
+      if (src == NULL)
+        {
+          return 1;
+        }
+      argv += 2;
+    }
+  else if (argc != 3)
+    {
+      fprintf(stderr, "usage: %s [-d running] image out\n", argv[0]);
+      return 1;
+    }
+
+  dst = prv_load(argv[1], &dst_len);
+  if (dst == NULL)
+    {
+      return 1;
+    }
+
+  out = src != NULL ? fwgen_delta(src, src_len, dst, dst_len, &out_len) :
+                      fwgen_package(dst, dst_len, &out_len);
+  if (out == NULL)
+    {
+      fprintf(stderr, "out of memory\n");
+      return 1;
+    }
+
+  f = fopen(argv[2], "wb");
+  if (f == NULL || fwrite(out, 1, out_len, f) != out_len || fclose(f) != 0)
+    {
+      perror(argv[2]);
+      return 1;
+    }
+
+  printf("%s: %s of %u bytes for a %u byte image\n", argv[2],
+         src != NULL ? "patch" : "package", out_len, dst_len);
+  return 0;
+}
@@ -0,0 +1,1524 @@
+/****************************************************************************
+ * external/services/iotpf/host/iotpf_server.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "coap.h"
+#include "impair.h"
+#ifdef CIS_HOST_DTLS
+#  include "dtls.h"
+#endif
+#include "iotpf_block.h"
+#include "iotpf_comp.h"
+#include "iotpf_rec.h"
+
+/* Stand-in LwM2M server for the host build. It accepts registrations,
+ * observes every registered instance plus the ctcc raw uplink /19/0/0,
+ * prints what arrives and, with -x, keeps poking the client with
+ * Discover/Read/Write/Execute and raw downlinks. With -i every datagram
+ * goes through the impairment profile, see impair.h, and the server exits
+ * with a per-scenario report once the profile has played. -z decodes raw
+ * uplinks of a client built with SERVICES_IOTPF_COMPRESS, -b reassembles
+ * those of one built with SERVICES_IOTPF_BLOCKWISE and sends it its raw
+ * downlinks as block frames, -r prints raw uplinks that are iotpf_rec
+ * records field by field. -f writes a firmware package or patch made
+ * with iotpf_mkfw to /5/0/0 of every client once, in Block1 blocks, and
+ * says how long that took and how many blocks and bytes it cost.
+ * -d, in a DTLS=y build, takes DTLS with the PSK of dtls.h only and keeps
+ * the sessions for abbreviated handshakes; impairment then applies to the
+ * records, so -i reports counts of those and not of CoAP messages.
+ *
+ * Requests to a client that registered in queue mode are held while it
+ * sleeps and all sent when it is next heard from; it is taken to listen
+ * for -q milliseconds after that. How long requests took to be answered,
+ * held or not, is summed up per client on SIGINT or SIGTERM.
+ *
+ *   iotpf_server [-p port] [-x seconds] [-e /oid/iid/rid]
+ *                [-i profile] [-s seed] [-z] [-b] [-r] [-q ms] [-f file]
+ *                [-d]
+ */
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#define SERVER_CLIENT_MAX       8
+#define SERVER_OBJECT_MAX       16
+#define SERVER_PENDING_MAX      32
+#define SERVER_BUF_MAX          1280
+#define SERVER_BLOCK_MAX        4096
+#define SERVER_BLOCK_SZX        0
+#define SERVER_FW_SZX           5     /* 512 byte firmware blocks */
+#define SERVER_FW_MAX           (4 * 1024 * 1024)
+#define SERVER_PEER_MAX         16
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct client_s
+{
+  bool used;
+  struct sockaddr_in addr;
+  char ep[64];
+  int id;
+  int lifetime;
+  int nobj;
+  char obj[SERVER_OBJECT_MAX][16];   /* "/oid/iid" */
+  bool raw;                          /* /19/1 present */
+  int step;
+  char rid[16];                      /* last resource seen in a read */
+  long long value;
+  iotpf_comp_t comp;                 /* -z: raw uplink stream */
+  int raw_mid;                       /* -z: last raw uplink decoded */
+  uint8_t blk[SERVER_BLOCK_MAX];     /* -b: block2 uplink so far */
+  int blk_len;
+  uint32_t blk_num;                  /* -b: next block2 expected */
+  int blk_mid;                       /* -b: last block2 frame taken */
+  bool queue;                        /* registered with Q or b=UQ */
+  uint32_t awake_until;              /* queue mode: listening till then */
+  uint32_t answered;                 /* requests answered */
+  uint32_t answer_total_ms;          /* request() to the answer */
+  uint32_t answer_max_ms;
+  uint32_t held;                     /* requests held while it slept */
+  uint32_t timeouts;                 /* requests never answered */
+  uint32_t fw_next;                  /* -f: firmware block to write next */
+  bool fw_done;
+  uint32_t fw_start;
+  uint32_t fw_sent;                  /* -f: blocks sent, resends too */
+  uint32_t fw_bytes;                 /* -f: and their CoAP bytes */
+};
+
+struct pending_s
+{
+  bool used;
+  bool held;                         /* not sent yet, client asleep */
+  int client;                        /* client_s id */
+  uint32_t created;
+  struct sockaddr_in addr;
+  uint16_t mid;
+  uint32_t deadline;
+  uint32_t timeout;
+  int retries;
+  char what[48];
+  int len;
+  uint8_t buf[SERVER_BUF_MAX];
+};
+
+#ifdef CIS_HOST_DTLS
+struct peer_s
+{
+  bool used;
+  struct sockaddr_in addr;
+  SSL *ssl;
+  bool secure;                       /* handshake done */
+  uint32_t start;                    /* its ClientHello came in */
+  uint32_t seen;
+};
+#endif
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static int g_sock;
+static struct client_s g_clients[SERVER_CLIENT_MAX];
+static struct pending_s g_pending[SERVER_PENDING_MAX];
+static uint16_t g_mid;
+static uint32_t g_token;
+static int g_next_id = 1;
+static const char *g_exec;
+static bool g_unzip;
+static bool g_unblock;
+static bool g_records;
+static uint32_t g_awake_ms = 1000;
+static uint8_t *g_fw;
+static int g_fw_len;
+static volatile sig_atomic_t g_quit;
+#ifdef CIS_HOST_DTLS
+static SSL_CTX *g_dtls;                /* -d */
+static struct peer_s g_peers[SERVER_PEER_MAX];
+static uint32_t g_handshakes[2];       /* full, abbreviated */
+static uint32_t g_handshake_ms[2];
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static uint32_t now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void say(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void say(const char *fmt, ...)
+{
+  va_list ap;
+
+  printf("%10u ", now_ms());
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  putchar('\n');
+  fflush(stdout);
+}
+
+static void send_raw(const struct sockaddr_in *addr, const uint8_t *buf,
+                     int len)
+{
+  if (len > 0 && impair_active())
+    {
+      impair_downlink(addr, buf, len, now_ms());
+    }
+  else if (len > 0)
+    {
+      sendto(g_sock, buf, len, 0, (const struct sockaddr *)addr,
+             sizeof(*addr));
+    }
+}
+
+#ifdef CIS_HOST_DTLS
+static struct peer_s *peer_by_addr(const struct sockaddr_in *addr)
+{
+  int i;
+
+  for (i = 0; i < SERVER_PEER_MAX; i++)
+    {
+      if (g_peers[i].used &&
+          g_peers[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+          g_peers[i].addr.sin_port == addr->sin_port)
+        {
+          return &g_peers[i];
+        }
+    }
+
+  return NULL;
+}
+
+static void peer_drop(struct peer_s *p)
+{
+  SSL_free(p->ssl);
+  memset(p, 0, sizeof(*p));
+}
+
+/* A free slot, else the one heard from least recently */
+
+static struct peer_s *peer_new(const struct sockaddr_in *addr)
+{
+  struct peer_s *p = peer_by_addr(addr);
+  int i;
+
+  if (p == NULL)
+    {
+      p = &g_peers[0];
+      for (i = 1; i < SERVER_PEER_MAX && p->used; i++)
+        {
+          if (!g_peers[i].used || (int32_t)(g_peers[i].seen - p->seen) < 0)
+            {
+              p = &g_peers[i];
+            }
+        }
+    }
+
+  if (p->used)
+    {
+      peer_drop(p);
+    }
+
+  p->ssl = dtls_new(g_dtls, true);
+  if (p->ssl == NULL)
+    {
+      return NULL;
+    }
+
+  p->used = true;
+  p->addr = *addr;
+  p->start = now_ms();
+  return p;
+}
+
+static void peer_flush(struct peer_s *p)
+{
+  uint8_t buf[DTLS_MTU + 256];
+  int n;
+
+  while ((n = dtls_output(p->ssl, buf, sizeof(buf))) > 0)
+    {
+      send_raw(&p->addr, buf, n);
+    }
+}
+
+/* Flights of unfinished handshakes nobody answered */
+
+static void peer_poll(void)
+{
+  int i;
+
+  for (i = 0; i < SERVER_PEER_MAX; i++)
+    {
+      struct peer_s *p = &g_peers[i];
+
+      if (p->used && !p->secure && dtls_timeout(p->ssl) == 0)
+        {
+          DTLSv1_handle_timeout(p->ssl);
+          peer_flush(p);
+        }
+    }
+}
+#endif
+
+static void send_to(const struct sockaddr_in *addr, const uint8_t *buf,
+                    int len)
+{
+#ifdef CIS_HOST_DTLS
+  if (g_dtls != NULL)
+    {
+      struct peer_s *p = peer_by_addr(addr);
+
+      if (len > 0 && p != NULL && p->secure &&
+          SSL_write(p->ssl, buf, len) == len)
+        {
+          peer_flush(p);
+        }
+      return;
+    }
+#endif
+
+  send_raw(addr, buf, len);
+}
+
+static struct client_s *client_by_addr(const struct sockaddr_in *addr)
+{
+  int i;
+
+  for (i = 0; i < SERVER_CLIENT_MAX; i++)
+    {
+      if (g_clients[i].used &&
+          g_clients[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+          g_clients[i].addr.sin_port == addr->sin_port)
+        {
+          return &g_clients[i];
+        }
+    }
+
+  return NULL;
+}
+
+static struct client_s *client_by_id(int id)
+{
+  int i;
+
+  for (i = 0; i < SERVER_CLIENT_MAX; i++)
+    {
+      if (g_clients[i].used && g_clients[i].id == id)
+        {
+          return &g_clients[i];
+        }
+    }
+
+  return NULL;
+}
+
+static void reply(const struct sockaddr_in *addr, const coap_msg_t *req,
+                  uint8_t code, const char *location)
+{
+  uint8_t buf[COAP_HDR_MAX];
+  coap_writer_t w;
+
+  coap_begin(&w, buf, sizeof(buf),
+             req->type == COAP_TYPE_CON ? COAP_TYPE_ACK : COAP_TYPE_NON,
+             code, req->type == COAP_TYPE_CON ? req->mid : g_mid++,
+             req->token, req->tkl);
+  if (location != NULL)
+    {
+      coap_option_path(&w, COAP_OPT_LOCATION_PATH, location);
+    }
+  send_to(addr, buf, coap_end(&w));
+}
+
+/* -f: what the firmware cost on the wire is counted here */
+
+static void send_pending(struct client_s *c, const struct pending_s *p)
+{
+  if (c != NULL && strcmp(p->what, "firmware block") == 0)
+    {
+      c->fw_sent++;
+      c->fw_bytes += p->len;
+    }
+
+  send_to(&p->addr, p->buf, p->len);
+}
+
+static bool asleep(const struct client_s *c, uint32_t now)
+{
+  return c->queue && (int32_t)(now - c->awake_until) >= 0;
+}
+
+/* Heard from a client: a queue mode one listens now, send what it missed */
+
+static void wake(struct client_s *c)
+{
+  uint32_t now = now_ms();
+  int sent = 0;
+  int i;
+
+  if (!c->queue)
+    {
+      return;
+    }
+
+  c->awake_until = now + g_awake_ms;
+  for (i = 0; i < SERVER_PENDING_MAX; i++)
+    {
+      struct pending_s *p = &g_pending[i];
+
+      if (p->used && p->held && p->client == c->id)
+        {
+          p->held = false;
+          p->addr = c->addr;
+          p->deadline = now + p->timeout;
+          send_pending(c, p);
+          sent++;
+        }
+    }
+
+  if (sent > 0)
+    {
+      say("%s: awake, %d held requests sent", c->ep, sent);
+    }
+}
+
+/* Sends a CON request to a client and keeps it for retransmission, or
+ * holds it until a queue mode client wakes up
+ */
+
+static void request(struct client_s *c, uint8_t code, const char *path,
+                    int observe, int accept, int format, int block1,
+                    const void *payload, int len, const char *what)
+{
+  struct pending_s *p = NULL;
+  coap_writer_t w;
+  uint32_t token = g_token++;
+  int i;
+
+  for (i = 0; i < SERVER_PENDING_MAX && p == NULL; i++)
+    {
+      if (!g_pending[i].used)
+        {
+          p = &g_pending[i];
+        }
+    }
+
+  if (p == NULL)
+    {
+      say("%s: too many requests in flight, %s skipped", c->ep, what);
+      return;
+    }
+
+  coap_begin(&w, p->buf, sizeof(p->buf), COAP_TYPE_CON, code, g_mid++,
+             (uint8_t *)&token, sizeof(token));
+  if (observe >= 0)
+    {
+      coap_option_u(&w, COAP_OPT_OBSERVE, observe);
+    }
+  coap_option_path(&w, COAP_OPT_URI_PATH, path);
+  if (format >= 0)
+    {
+      coap_option_u(&w, COAP_OPT_CONTENT_FORMAT, format);
+    }
+  if (accept >= 0)
+    {
+      coap_option_u(&w, COAP_OPT_ACCEPT, accept);
+    }
+  if (block1 >= 0)
+    {
+      coap_option_u(&w, COAP_OPT_BLOCK1, block1);
+    }
+  if (len > 0)
+    {
+      coap_payload(&w, payload, len);
+    }
+
+  p->len = coap_end(&w);
+  if (p->len < 0)
+    {
+      say("%s: %s does not fit", c->ep, what);
+      return;
+    }
+
+  p->used = true;
+  p->client = c->id;
+  p->created = now_ms();
+  p->addr = c->addr;
+  p->mid = (p->buf[2] << 8) | p->buf[3];
+  p->timeout = COAP_ACK_TIMEOUT_MS;
+  p->deadline = p->created + p->timeout;
+  p->retries = 0;
+  snprintf(p->what, sizeof(p->what), "%s", what);
+  p->held = asleep(c, p->created);
+  if (p->held)
+    {
+      c->held++;
+      return;
+    }
+
+  send_pending(c, p);
+}
+
+static void parse_links(struct client_s *c, const char *links, int len)
+{
+  const char *p = links;
+  const char *end = links + len;
+
+  c->nobj = 0;
+  c->raw = false;
+  while (p < end && (p = memchr(p, '<', end - p)) != NULL)
+    {
+      const char *q = memchr(p, '>', end - p);
+      int n;
+
+      if (q == NULL)
+        {
+          break;
+        }
+
+      n = q - p - 1;
+      if (n > 1 && n < 16 && c->nobj < SERVER_OBJECT_MAX)
+        {
+          char path[16];
+
+          memcpy(path, p + 1, n);
+          path[n] = '\0';
+          if (strcmp(path, "/19/1") == 0)
+            {
+              c->raw = true;
+            }
+          else if (strchr(path + 1, '/') != NULL)
+            {
+              strcpy(c->obj[c->nobj++], path);
+            }
+        }
+
+      p = q + 1;
+    }
+}
+
+static void observe_all(struct client_s *c)
+{
+  char what[48];
+  int i;
+
+  for (i = 0; i < c->nobj; i++)
+    {
+      const char *path = strcmp(c->obj[i], "/19/0") == 0 ? "/19/0/0" :
+                                                          c->obj[i];
+
+      snprintf(what, sizeof(what), "observe %s", path);
+      request(c, COAP_GET, path, 0, -1, -1, -1, NULL, 0, what);
+    }
+}
+
+/* -f: block num of the firmware, the next one goes once it is taken.
+ * A client that drops off mid-way carries on from there when it is back.
+ */
+
+static void write_firmware(struct client_s *c, uint32_t num)
+{
+  uint32_t off = num << (SERVER_FW_SZX + 4);
+  int n;
+
+  if (num == 0)
+    {
+      c->fw_start = now_ms();
+      c->fw_sent = 0;
+      c->fw_bytes = 0;
+    }
+
+  c->fw_next = num;
+
+  n = g_fw_len - off < (16 << SERVER_FW_SZX) ?
+      g_fw_len - off : (16 << SERVER_FW_SZX);
+  request(c, COAP_PUT, "/5/0/0", -1, -1, COAP_FORMAT_OPAQUE,
+          (num << 4) | (off + n < g_fw_len ? 0x08 : 0) | SERVER_FW_SZX,
+          g_fw + off, n, "firmware block");
+}
+
+static int load_firmware(const char *path)
+{
+  FILE *f = fopen(path, "rb");
+
+  if (f == NULL)
+    {
+      perror(path);
+      return -1;
+    }
+
+  g_fw = malloc(SERVER_FW_MAX);
+  g_fw_len = g_fw ? fread(g_fw, 1, SERVER_FW_MAX, f) : 0;
+  fclose(f);
+  if (g_fw_len <= 0 || g_fw_len == SERVER_FW_MAX)
+    {
+      fprintf(stderr, "%s: empty or larger than %d bytes\n", path,
+              SERVER_FW_MAX - 1);
+      return -1;
+    }
+
+  return 0;
+}
+
+static void handle_register(const struct sockaddr_in *addr,
+                            const coap_msg_t *msg)
+{
+  struct client_s *c = client_by_addr(addr);
+  const coap_option_t *opt = NULL;
+  char location[16];
+  char ep[64] = "";
+  bool queue = false;
+  int i;
+
+  while ((opt = coap_find(msg, COAP_OPT_URI_QUERY, opt)) != NULL)
+    {
+      if (opt->len > 3 && memcmp(opt->val, "ep=", 3) == 0)
+        {
+          snprintf(ep, sizeof(ep), "%.*s", opt->len - 3,
+                   (const char *)opt->val + 3);
+        }
+      else if ((opt->len == 1 && opt->val[0] == 'Q') ||
+               (opt->len == 4 && memcmp(opt->val, "b=UQ", 4) == 0))
+        {
+          queue = true;
+        }
+    }
+
+  /* Registering again, from wherever the client is now */
+
+  for (i = 0; c == NULL && ep[0] != '\0' && i < SERVER_CLIENT_MAX; i++)
+    {
+      if (g_clients[i].used && strcmp(g_clients[i].ep, ep) == 0)
+        {
+          c = &g_clients[i];
+        }
+    }
+
+  for (i = 0; c == NULL && i < SERVER_CLIENT_MAX; i++)
+    {
+      if (!g_clients[i].used)
+        {
+          c = &g_clients[i];
+          memset(c, 0, sizeof(*c));
+          c->id = g_next_id++;
+          c->raw_mid = -1;
+          c->blk_mid = -1;
+        }
+    }
+
+  if (c == NULL)
+    {
+      reply(addr, msg, COAP_500_INTERNAL, NULL);
+      return;
+    }
+
+  c->used = true;
+  c->addr = *addr;
+  c->lifetime = 86400;
+  c->queue = queue;
+  snprintf(c->ep, sizeof(c->ep), "%s", ep);
+  while ((opt = coap_find(msg, COAP_OPT_URI_QUERY, opt)) != NULL)
+    {
+      if (opt->len > 3 && memcmp(opt->val, "lt=", 3) == 0)
+        {
+          c->lifetime = atoi((const char *)opt->val + 3);
+        }
+    }
+
+  parse_links(c, (const char *)msg->payload, msg->payload_len);
+  snprintf(location, sizeof(location), "rd/%d", c->id);
+  reply(addr, msg, COAP_201_CREATED, location);
+  say("%s: registered as /%s, lt=%d%s, %.*s", c->ep, location, c->lifetime,
+      c->queue ? " queue mode" : "", msg->payload_len,
+      (const char *)msg->payload);
+  wake(c);
+  observe_all(c);
+  if (g_fw != NULL && !c->fw_done)
+    {
+      write_firmware(c, c->fw_next);
+    }
+}
+
+/* "report/1 seq=3 lat=31.239933 ..."; -1 when buf is no record */
+
+static int format_record(const uint8_t *buf, int len, char *out, int size)
+{
+  iotpf_rec_reader_t r;
+  iotpf_rec_value_t v;
+  int ret = 0;
+  int n;
+
+  if (iotpf_rec_open(&r, buf, len) < 0)
+    {
+      return -1;
+    }
+
+  n = snprintf(out, size, "%s/%u", r.schema->name, r.version);
+  while (n < size && (ret = iotpf_rec_next(&r, &v)) > 0)
+    {
+      uint8_t scale = v.field != NULL ? v.field->scale : 0;
+      uint64_t mag = v.type == IOTPF_REC_SINT && v.s < 0 ? -v.s :
+                     v.type == IOTPF_REC_SINT ? v.s : v.u;
+      uint64_t div = 1;
+      uint8_t i;
+
+      for (i = 0; i < scale; i++)
+        {
+          div *= 10;
+        }
+
+      if (v.field != NULL)
+        {
+          n += snprintf(out + n, size - n, " %s=", v.field->name);
+        }
+      else
+        {
+          n += snprintf(out + n, size - n, " #%u=", v.tag);
+        }
+
+      if (n >= size)
+        {
+          break;
+        }
+      else if (v.type == IOTPF_REC_BYTES)
+        {
+          for (i = 0; i < v.u && n + 2 < size; i++, n += 2)
+            {
+              sprintf(out + n, "%02X", v.data[i]);
+            }
+        }
+      else if (scale > 0)
+        {
+          n += snprintf(out + n, size - n, "%s%llu.%0*llu",
+                        v.type == IOTPF_REC_SINT && v.s < 0 ? "-" : "",
+                        (unsigned long long)(mag / div), scale,
+                        (unsigned long long)(mag % div));
+        }
+      else
+        {
+          n += snprintf(out + n, size - n, "%s%llu",
+                        v.type == IOTPF_REC_SINT && v.s < 0 ? "-" : "",
+                        (unsigned long long)mag);
+        }
+    }
+
+  return ret < 0 ? -1 : 0;
+}
+
+static void print_payload(const char *who, const char *what,
+                          const coap_msg_t *msg)
+{
+  const coap_option_t *opt = coap_find(msg, COAP_OPT_CONTENT_FORMAT, NULL);
+  char hex[2 * 64 + 1];
+  char rec[256];
+  int i;
+
+  if (opt != NULL && coap_option_uint(opt) == COAP_FORMAT_OPAQUE &&
+      g_records && format_record(msg->payload, msg->payload_len, rec,
+                                 sizeof(rec)) == 0)
+    {
+      say("%s: %s %d.%02d record %d bytes %s", who, what, msg->code >> 5,
+          msg->code & 31, msg->payload_len, rec);
+    }
+  else if (opt != NULL && coap_option_uint(opt) == COAP_FORMAT_OPAQUE)
+    {
+      for (i = 0; i < msg->payload_len && i < 64; i++)
+        {
+          sprintf(hex + 2 * i, "%02X", msg->payload[i]);
+        }
+      hex[2 * i] = '\0';
+      say("%s: %s %d.%02d raw %d bytes %s%s", who, what, msg->code >> 5,
+          msg->code & 31, msg->payload_len, hex,
+          msg->payload_len > 64 ? ".." : "");
+    }
+  else
+    {
+      say("%s: %s %d.%02d %.*s", who, what, msg->code >> 5, msg->code & 31,
+          msg->payload_len, (const char *)msg->payload);
+    }
+}
+
+/* Remembers an integer resource from a read so the next write has
+ * something sensible to change.
+ */
+
+static void learn(struct client_s *c, const coap_msg_t *msg)
+{
+  const char *p = (const char *)msg->payload;
+  const char *end = p + msg->payload_len;
+
+  while (p < end && (p = memmem(p, end - p, "\"n\":\"", 5)) != NULL)
+    {
+      const char *name = p + 5;
+      const char *q = memchr(name, '"', end - name);
+
+      if (q == NULL)
+        {
+          return;
+        }
+
+      if (q + 5 < end && memcmp(q, "\",\"v\":", 6) == 0 &&
+          memchr(q + 6, '.', strcspn(q + 6, ",}")) == NULL &&
+          q - name < (int)sizeof(c->rid))
+        {
+          memcpy(c->rid, name, q - name);
+          c->rid[q - name] = '\0';
+          c->value = atoll(q + 6);
+          return;
+        }
+
+      p = q;
+    }
+}
+
+static void handle_response(const struct sockaddr_in *addr,
+                            const coap_msg_t *msg)
+{
+  struct client_s *c = client_by_addr(addr);
+  const char *who = c ? c->ep : "?";
+  int i;
+
+  for (i = 0; i < SERVER_PENDING_MAX; i++)
+    {
+      struct pending_s *p = &g_pending[i];
+
+      if (p->used && !p->held && p->mid == msg->mid &&
+          p->addr.sin_port == addr->sin_port)
+        {
+          uint32_t ms = now_ms() - p->created;
+
+          p->used = false;
+          if (c != NULL && msg->type != COAP_TYPE_RST)
+            {
+              c->answered++;
+              c->answer_total_ms += ms;
+              if (ms > c->answer_max_ms)
+                {
+                  c->answer_max_ms = ms;
+                }
+              if (ms > g_awake_ms && c->queue)
+                {
+                  say("%s: %s answered %u ms after it was queued", who,
+                      p->what, ms);
+                }
+            }
+
+          if (msg->type == COAP_TYPE_RST)
+            {
+              say("%s: %s reset", who, p->what);
+            }
+          else if (msg->code == COAP_EMPTY)
+            {
+              /* Separate response follows, match it by token */
+
+              say("%s: %s acked", who, p->what);
+            }
+          else if (c != NULL && strcmp(p->what, "firmware block") == 0)
+            {
+              const coap_option_t *opt = coap_find(msg, COAP_OPT_BLOCK1,
+                                                   NULL);
+
+              if (msg->code == COAP_231_CONTINUE && opt != NULL)
+                {
+                  /* Or an answer to a block resent after a re-register */
+
+                  if ((coap_option_uint(opt) >> 4) == c->fw_next)
+                    {
+                      write_firmware(c, c->fw_next + 1);
+                    }
+                }
+              else if (!c->fw_done)
+                {
+                  c->fw_done = true;
+                  say("%s: firmware of %d bytes %s in %u ms, %u blocks "
+                      "sent for %u, %u bytes", who, g_fw_len,
+                      msg->code == COAP_204_CHANGED ? "taken" : "refused",
+                      now_ms() - c->fw_start, c->fw_sent, c->fw_next + 1,
+                      c->fw_bytes);
+                }
+            }
+          else
+            {
+              if (c != NULL && strncmp(p->what, "read", 4) == 0)
+                {
+                  learn(c, msg);
+                }
+              print_payload(who, p->what, msg);
+            }
+          return;
+        }
+    }
+}
+
+/* Takes the block framing off a raw uplink: strips the escape byte of a
+ * plain one, and collects block2 frames until the last, which is then
+ * replaced by the whole payload. False while more blocks are due, and for
+ * a frame seen before: a retransmission, or a block resent after its ACK
+ * was lost.
+ */
+
+static bool unblock(struct client_s *c, coap_msg_t *msg)
+{
+  const coap_option_t *opt = coap_find(msg, COAP_OPT_CONTENT_FORMAT, NULL);
+  uint32_t value;
+  uint32_t num;
+  int len;
+
+  if (!g_unblock || c == NULL || opt == NULL ||
+      coap_option_uint(opt) != COAP_FORMAT_OPAQUE ||
+      msg->payload_len == 0 || !IOTPF_BLOCK_RESERVED(msg->payload[0]))
+    {
+      return true;
+    }
+
+  if (msg->payload[0] == IOTPF_BLOCK_TAG_ESC)
+    {
+      msg->payload++;
+      msg->payload_len--;
+      return true;
+    }
+
+  if (msg->payload[0] != IOTPF_BLOCK_TAG_BLOCK2 ||
+      msg->payload_len < IOTPF_BLOCK_HDR_LEN)
+    {
+      say("%s: bad block frame of %d bytes", c->ep, msg->payload_len);
+      return false;
+    }
+
+  if (msg->mid == c->blk_mid)
+    {
+      return false;
+    }
+
+  c->blk_mid = msg->mid;
+  value = (msg->payload[1] << 16) | (msg->payload[2] << 8) | msg->payload[3];
+  num = value >> 4;
+  len = msg->payload_len - IOTPF_BLOCK_HDR_LEN;
+  if (num == 0)
+    {
+      c->blk_len = 0;
+      c->blk_num = 0;
+    }
+
+  if (num + 1 == c->blk_num)
+    {
+      return false;
+    }
+
+  if (num != c->blk_num || c->blk_len + len > SERVER_BLOCK_MAX)
+    {
+      say("%s: block2 %u out of sequence, expect %u", c->ep, num,
+          c->blk_num);
+      c->blk_num = 0;
+      return false;
+    }
+
+  memcpy(c->blk + c->blk_len, msg->payload + IOTPF_BLOCK_HDR_LEN, len);
+  c->blk_len += len;
+  c->blk_num++;
+  if (value & 0x08)
+    {
+      say("%s: block2 %u, %d bytes", c->ep, num, len);
+      return false;
+    }
+
+  say("%s: block2 done, %d bytes in %u blocks", c->ep, c->blk_len,
+      c->blk_num);
+  c->blk_num = 0;
+  msg->payload = c->blk;
+  msg->payload_len = c->blk_len;
+  return true;
+}
+
+/* -b: a raw downlink as block1 frames of IOTPF_BLOCK_SIZE(SERVER_BLOCK_SZX)
+ * bytes, all sent at once
+ */
+
+static void request_blocks(struct client_s *c, const uint8_t *data, int len)
+{
+  uint8_t frame[IOTPF_BLOCK_HDR_LEN + IOTPF_BLOCK_SIZE(SERVER_BLOCK_SZX)];
+  uint32_t value;
+  uint32_t num;
+  int off;
+  int n;
+
+  for (num = 0, off = 0; off < len; num++, off += n)
+    {
+      n = len - off < IOTPF_BLOCK_SIZE(SERVER_BLOCK_SZX) ?
+          len - off : IOTPF_BLOCK_SIZE(SERVER_BLOCK_SZX);
+      value = (num << 4) | (off + n < len ? 0x08 : 0) | SERVER_BLOCK_SZX;
+      frame[0] = IOTPF_BLOCK_TAG_BLOCK1;
+      frame[1] = (value >> 16) & 0xff;
+      frame[2] = (value >> 8) & 0xff;
+      frame[3] = value & 0xff;
+      memcpy(frame + IOTPF_BLOCK_HDR_LEN, data + off, n);
+      request(c, COAP_POST, "/19/1/0", -1, -1, COAP_FORMAT_OPAQUE, -1,
+              frame, IOTPF_BLOCK_HDR_LEN + n, "raw block1");
+    }
+}
+
+/* Replaces a compressed raw uplink by what it decodes to. Retransmitted
+ * and duplicated frames are decoded once only, the delta codec refers to
+ * the frame before.
+ */
+
+static void unzip(struct client_s *c, coap_msg_t *msg, uint8_t *buf,
+                  int size)
+{
+  static const char *codec[] =
+  {
+    "plain", "lz", "delta", "?"
+  };
+
+  const coap_option_t *opt = coap_find(msg, COAP_OPT_CONTENT_FORMAT, NULL);
+  int n;
+
+  if (!g_unzip || c == NULL || opt == NULL ||
+      coap_option_uint(opt) != COAP_FORMAT_OPAQUE ||
+      msg->payload_len == 0 || msg->mid == c->raw_mid)
+    {
+      return;
+    }
+
+  c->raw_mid = msg->mid;
+  n = iotpf_comp_decode(&c->comp, msg->payload, msg->payload_len, buf,
+                        size);
+  if (n < 0)
+    {
+      say("%s: %s frame %u of %d bytes does not decode", c->ep,
+          codec[msg->payload[0] >> 6], msg->payload[0] & IOTPF_COMP_SEQ_MASK,
+          msg->payload_len);
+      return;
+    }
+
+  say("%s: %s frame %u, %d -> %d bytes", c->ep, codec[msg->payload[0] >> 6],
+      msg->payload[0] & IOTPF_COMP_SEQ_MASK, msg->payload_len, n);
+  msg->payload = buf;
+  msg->payload_len = n;
+}
+
+static void handle_message(const struct sockaddr_in *addr,
+                           const uint8_t *buf, int len)
+{
+  struct client_s *c;
+  coap_msg_t msg;
+  char path[32];
+  uint8_t raw[SERVER_BUF_MAX];
+
+  if (coap_parse(&msg, buf, len) < 0)
+    {
+      say("dropped %d byte datagram", len);
+      return;
+    }
+
+  if ((c = client_by_addr(addr)) != NULL)
+    {
+      wake(c);
+    }
+
+  if (msg.type == COAP_TYPE_ACK || msg.type == COAP_TYPE_RST)
+    {
+      handle_response(addr, &msg);
+      return;
+    }
+
+  if (msg.code >= 1 && msg.code < 32)
+    {
+      coap_path(&msg, COAP_OPT_URI_PATH, path, sizeof(path));
+      if (msg.code == COAP_POST && strcmp(path, "/rd") == 0)
+        {
+          handle_register(addr, &msg);
+        }
+      else if (strncmp(path, "/rd/", 4) == 0 &&
+               (c = client_by_id(atoi(path + 4))) != NULL)
+        {
+          if (msg.code == COAP_DELETE)
+            {
+              say("%s: deregistered", c->ep);
+              c->used = false;
+              reply(addr, &msg, COAP_202_DELETED, NULL);
+            }
+          else
+            {
+              const coap_option_t *opt = coap_find(&msg, COAP_OPT_URI_QUERY,
+                                                   NULL);
+
+              c->addr = *addr;
+              if (msg.payload_len > 0)
+                {
+                  parse_links(c, (const char *)msg.payload, msg.payload_len);
+                }
+              say("%s: update%s%.*s", c->ep, opt ? " " : "",
+                  opt ? opt->len : 0, opt ? (const char *)opt->val : "");
+              reply(addr, &msg, COAP_204_CHANGED, NULL);
+            }
+        }
+      else
+        {
+          reply(addr, &msg, COAP_404_NOT_FOUND, NULL);
+        }
+      return;
+    }
+
+  /* Notifications and separate responses */
+
+  c = client_by_addr(addr);
+  if (coap_find(&msg, COAP_OPT_OBSERVE, NULL) == NULL)
+    {
+      print_payload(c ? c->ep : "?", "response", &msg);
+    }
+  else if (unblock(c, &msg))
+    {
+      unzip(c, &msg, raw, sizeof(raw));
+      print_payload(c ? c->ep : "?", "notify", &msg);
+    }
+
+  if (c != NULL && coap_find(&msg, COAP_OPT_OBSERVE, NULL) == NULL)
+    {
+      learn(c, &msg);
+    }
+
+  if (msg.type == COAP_TYPE_CON)
+    {
+      uint8_t ack[4];
+      coap_writer_t w;
+
+      coap_begin(&w, ack, sizeof(ack), COAP_TYPE_ACK, COAP_EMPTY, msg.mid,
+                 NULL, 0);
+      send_to(addr, ack, coap_end(&w));
+    }
+}
+
+/* One step of the -x exercise for every registered client */
+
+static void exercise(void)
+{
+  int i;
+
+  for (i = 0; i < SERVER_CLIENT_MAX; i++)
+    {
+      struct client_s *c = &g_clients[i];
+      const char *obj;
+      char path[32];
+      char body[96];
+
+      if (!c->used || c->nobj == 0)
+        {
+          continue;
+        }
+
+      obj = c->obj[c->step / 5 % c->nobj];
+      if (strcmp(obj, "/19/0") == 0)
+        {
+          c->step += 5 - c->step % 5;
+          continue;
+        }
+
+      switch (c->step++ % 5)
+        {
+          case 0:
+            snprintf(path, sizeof(path), "%s", obj);
+            *strrchr(path, '/') = '\0';
+            request(c, COAP_GET, path, -1, COAP_FORMAT_LINK, -1, -1, NULL, 0,
+                    "discover");
+            break;
+          case 1:
+            request(c, COAP_GET, obj, -1, -1, -1, -1, NULL, 0, "read");
+            break;
+          case 2:
+            if (c->rid[0] != '\0')
+              {
+                snprintf(body, sizeof(body), "%lld", c->value + 1);
+                request(c, COAP_PUT, c->rid, -1, -1, COAP_FORMAT_TEXT, -1,
+                        body, strlen(body), "write text");
+              }
+            break;
+          case 3:
+            if (c->rid[0] != '\0')
+              {
+                snprintf(body, sizeof(body), "[{\"n\":\"%s\",\"v\":%lld}]",
+                         c->rid, c->value + 2);
+                request(c, COAP_PUT, obj, -1, -1, COAP_FORMAT_SENML_JSON,
+                        -1, body, strlen(body), "write senml");
+              }
+            break;
+          case 4:
+            if (g_exec != NULL)
+              {
+                request(c, COAP_POST, g_exec, -1, -1, -1, -1, NULL, 0,
+                        "execute");
+              }
+            if (c->raw && g_unblock)
+              {
+                uint8_t raw[40];
+                int n;
+
+                for (n = 0; n < (int)sizeof(raw); n++)
+                  {
+                    raw[n] = 0xb0 + n;
+                  }
+
+                request_blocks(c, raw, sizeof(raw));
+              }
+            else if (c->raw)
+              {
+                static const uint8_t raw[] =
+                {
+                  0x02, 0x00, 0x01, 0x00, 0x04, 0xde, 0xad, 0xbe, 0xef
+                };
+
+                request(c, COAP_POST, "/19/1/0", -1, -1, COAP_FORMAT_OPAQUE,
+                        -1, raw, sizeof(raw), "raw downlink");
+              }
+            break;
+        }
+    }
+}
+
+/* With -d the records of a datagram: a ClientHello, handshake record of
+ * epoch 0, starts a new session even where there is one, the client
+ * restarted. Records of an address without a session are dropped.
+ */
+
+static void handle_datagram(const struct sockaddr_in *addr,
+                            const uint8_t *buf, int len)
+{
+#ifdef CIS_HOST_DTLS
+  uint8_t plain[SERVER_BUF_MAX];
+  struct peer_s *p;
+  uint32_t ms;
+  int n;
+
+  if (g_dtls == NULL)
+    {
+      handle_message(addr, buf, len);
+      return;
+    }
+
+  p = peer_by_addr(addr);
+  if (len > 13 && buf[0] == 22 && buf[3] == 0 && buf[4] == 0 &&
+      buf[13] == 1 && (p == NULL || p->secure))
+    {
+      p = peer_new(addr);
+    }
+
+  if (p == NULL)
+    {
+      return;
+    }
+
+  p->seen = now_ms();
+  dtls_input(p->ssl, buf, len);
+  if (!p->secure)
+    {
+      n = SSL_do_handshake(p->ssl);
+      peer_flush(p);
+      if (n != 1)
+        {
+          if (SSL_get_error(p->ssl, n) != SSL_ERROR_WANT_READ)
+            {
+              say("%s:%d: dtls handshake failed", inet_ntoa(addr->sin_addr),
+                  ntohs(addr->sin_port));
+              peer_drop(p);
+            }
+          return;
+        }
+
+      n = SSL_session_reused(p->ssl);
+      ms = p->seen - p->start;
+      g_handshakes[n]++;
+      g_handshake_ms[n] += ms;
+      p->secure = true;
+      say("%s:%d: %s handshake, %u ms", inet_ntoa(addr->sin_addr),
+          ntohs(addr->sin_port), n ? "abbreviated" : "full", ms);
+    }
+
+  while ((n = SSL_read(p->ssl, plain, sizeof(plain))) > 0)
+    {
+      handle_message(addr, plain, n);
+    }
+
+  peer_flush(p);
+#else
+  handle_message(addr, buf, len);
+#endif
+}
+
+static void retransmit(void)
+{
+  uint32_t now = now_ms();
+  int i;
+
+  for (i = 0; i < SERVER_PENDING_MAX; i++)
+    {
+      struct pending_s *p = &g_pending[i];
+      struct client_s *c;
+
+      if (!p->used || p->held || (int32_t)(now - p->deadline) < 0)
+        {
+          continue;
+        }
+
+      /* A queue mode client that went back to sleep gets it next time */
+
+      c = client_by_id(p->client);
+      if (c != NULL && asleep(c, now))
+        {
+          p->held = true;
+          p->retries = 0;
+          p->timeout = COAP_ACK_TIMEOUT_MS;
+          continue;
+        }
+
+      if (p->retries == COAP_MAX_RETRANSMIT)
+        {
+          say("%s timed out", p->what);
+          p->used = false;
+          if (c != NULL)
+            {
+              c->timeouts++;
+            }
+          continue;
+        }
+
+      p->retries++;
+      p->timeout *= 2;
+      p->deadline = now + p->timeout;
+      send_pending(c, p);
+    }
+}
+
+static void quit(int signo)
+{
+  g_quit = 1;
+}
+
+static void summary(void)
+{
+  int i;
+
+#ifdef CIS_HOST_DTLS
+  if (g_dtls != NULL)
+    {
+      say("dtls: %u full handshakes avg %u ms, %u abbreviated avg %u ms",
+          g_handshakes[0],
+          g_handshakes[0] ? g_handshake_ms[0] / g_handshakes[0] : 0,
+          g_handshakes[1],
+          g_handshakes[1] ? g_handshake_ms[1] / g_handshakes[1] : 0);
+    }
+#endif
+
+  for (i = 0; i < SERVER_CLIENT_MAX; i++)
+    {
+      struct client_s *c = &g_clients[i];
+
+      if (!c->used)
+        {
+          continue;
+        }
+
+      say("%s: %s%u requests answered, avg %u ms max %u ms, %u held, "
+          "%u timed out", c->ep, c->queue ? "queue mode, " : "",
+          c->answered, c->answered ? c->answer_total_ms / c->answered : 0,
+          c->answer_max_ms, c->held, c->timeouts);
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+  struct sockaddr_in addr;
+  uint32_t next_exercise;
+  const char *profile = NULL;
+  uint32_t seed = 1;
+  int period = 0;
+  int port = 5683;
+  int wait = 100;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "p:x:e:i:s:zbrq:f:d")) != -1)
+    {
+      switch (opt)
+        {
+          case 'p':
+            port = atoi(optarg);
+            break;
+          case 'x':
+            period = atoi(optarg) * 1000;
+            break;
+          case 'e':
+            g_exec = optarg;
+            break;
+          case 'i':
+            profile = optarg;
+            break;
+          case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+          case 'z':
+            g_unzip = true;
+            break;
+          case 'b':
+            g_unblock = true;
+            break;
+          case 'r':
+            g_records = true;
+            break;
+          case 'q':
+            g_awake_ms = atoi(optarg);
+            break;
+          case 'f':
+            if (load_firmware(optarg) < 0)
+              {
+                return 1;
+              }
+            break;
+          case 'd':
+#ifdef CIS_HOST_DTLS
+            g_dtls = dtls_context(true);
+            if (g_dtls == NULL)
+              {
+                fprintf(stderr, "no DTLS context\n");
+                return 1;
+              }
+            break;
+#else
+            fprintf(stderr, "-d needs a DTLS=y build\n");
+            return 1;
+#endif
+          default:
+            fprintf(stderr,
+                    "usage: %s [-p port] [-x seconds] [-e /oid/iid/rid] "
+                    "[-i profile] [-s seed] [-z] [-b] [-r] [-q ms] "
+                    "[-f file] [-d]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+  g_sock = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(g_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+      perror("bind");
+      return 1;
+    }
+
+  srandom(getpid());
+  g_mid = random();
+  g_token = random();
+  say("listening on 127.0.0.1:%d", port);
+  if (profile != NULL &&
+      impair_load(profile, seed, g_sock, handle_datagram, now_ms()) < 0)
+    {
+      return 1;
+    }
+
+  next_exercise = now_ms() + period;
+  signal(SIGINT, quit);
+  signal(SIGTERM, quit);
+
+  while (!g_quit)
+    {
+      uint8_t buf[SERVER_BUF_MAX];
+      struct timeval tv = { 0, wait * 1000 };
+      socklen_t alen = sizeof(addr);
+      fd_set rfds;
+      int n;
+
+      FD_ZERO(&rfds);
+      FD_SET(g_sock, &rfds);
+      if (select(g_sock + 1, &rfds, NULL, NULL, &tv) > 0)
+        {
+          n = recvfrom(g_sock, buf, sizeof(buf), 0,
+                       (struct sockaddr *)&addr, &alen);
+          if (n > 0 && impair_active())
+            {
+              impair_uplink(&addr, buf, n, now_ms());
+            }
+          else if (n > 0)
+            {
+              handle_datagram(&addr, buf, n);
+            }
+        }
+
+      if (profile != NULL && (wait = impair_poll(now_ms())) < 0)
+        {
+          impair_report(now_ms());
+          return 0;
+        }
+
+      retransmit();
+#ifdef CIS_HOST_DTLS
+      peer_poll();
+#endif
+      if (period > 0 && (int32_t)(now_ms() - next_exercise) >= 0)
+        {
+          next_exercise += period;
+          exercise();
+        }
+    }
+
+  summary();
+  return 0;
+}
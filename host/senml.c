@@ -0,0 +1,451 @@
+/****************************************************************************
+ * external/services/iotpf/host/senml.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "senml.h"
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const char g_b64[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void senml_put(senml_writer_t *w, const char *fmt, ...)
+  __attribute__((format(printf, 2, 3)));
+
+static void senml_put(senml_writer_t *w, const char *fmt, ...)
+{
+  va_list ap;
+  int n;
+
+  if (w->len < 0)
+    {
+      return;
+    }
+
+  va_start(ap, fmt);
+  n = vsnprintf(w->buf + w->len, w->size - w->len, fmt, ap);
+  va_end(ap);
+  w->len = n < 0 || n >= w->size - w->len ? -1 : w->len + n;
+}
+
+static void senml_putc(senml_writer_t *w, char c)
+{
+  if (w->len < 0 || w->len + 1 >= w->size)
+    {
+      w->len = -1;
+      return;
+    }
+
+  w->buf[w->len++] = c;
+  w->buf[w->len] = '\0';
+}
+
+static void senml_string(senml_writer_t *w, const uint8_t *s, uint32_t len)
+{
+  uint32_t i;
+
+  senml_putc(w, '"');
+  for (i = 0; i < len; i++)
+    {
+      if (s[i] == '"' || s[i] == '\\')
+        {
+          senml_putc(w, '\\');
+          senml_putc(w, s[i]);
+        }
+      else if (s[i] < 0x20)
+        {
+          senml_put(w, "\\u%04x", s[i]);
+        }
+      else
+        {
+          senml_putc(w, s[i]);
+        }
+    }
+
+  senml_putc(w, '"');
+}
+
+static void senml_base64(senml_writer_t *w, const uint8_t *s, uint32_t len)
+{
+  uint32_t i;
+  uint32_t v;
+
+  senml_putc(w, '"');
+  for (i = 0; i < len; i += 3)
+    {
+      v = s[i] << 16;
+      v |= i + 1 < len ? s[i + 1] << 8 : 0;
+      v |= i + 2 < len ? s[i + 2] : 0;
+      senml_putc(w, g_b64[(v >> 18) & 0x3f]);
+      senml_putc(w, g_b64[(v >> 12) & 0x3f]);
+      senml_putc(w, i + 1 < len ? g_b64[(v >> 6) & 0x3f] : '=');
+      senml_putc(w, i + 2 < len ? g_b64[v & 0x3f] : '=');
+    }
+
+  senml_putc(w, '"');
+}
+
+/* Decodes in place, the output never overtakes the input */
+
+static int senml_unbase64(char *s)
+{
+  uint8_t *out = (uint8_t *)s;
+  const char *p;
+  uint32_t v = 0;
+  int bits = 0;
+  int len = 0;
+
+  for (; *s != '\0' && *s != '='; s++)
+    {
+      p = strchr(g_b64, *s);
+      if (p == NULL)
+        {
+          return -1;
+        }
+
+      v = (v << 6) | (p - g_b64);
+      bits += 6;
+      if (bits >= 8)
+        {
+          bits -= 8;
+          out[len++] = (v >> bits) & 0xff;
+        }
+    }
+
+  return len;
+}
+
+static char *senml_ws(char *p, char *end)
+{
+  while (p < end && isspace((unsigned char)*p))
+    {
+      p++;
+    }
+
+  return p;
+}
+
+/* Unescapes in place, returns the character after the closing quote */
+
+static char *senml_str(char *p, char *end, char **out)
+{
+  char *dst;
+
+  if (p >= end || *p != '"')
+    {
+      return NULL;
+    }
+
+  *out = dst = ++p;
+  while (p < end && *p != '"')
+    {
+      if (*p == '\\' && p + 1 < end)
+        {
+          p++;
+          if (*p == 'u' && p + 4 < end)
+            {
+              char hex[5];
+
+              memcpy(hex, p + 1, 4);
+              hex[4] = '\0';
+              *dst++ = (char)strtoul(hex, NULL, 16);
+              p += 5;
+              continue;
+            }
+
+          *dst++ = *p == 'n' ? '\n' : *p;
+          p++;
+          continue;
+        }
+
+      *dst++ = *p++;
+    }
+
+  if (p >= end)
+    {
+      return NULL;
+    }
+
+  *dst = '\0';
+  return p + 1;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void senml_begin(senml_writer_t *w, char *buf, int size)
+{
+  w->buf = buf;
+  w->size = size;
+  w->len = 0;
+  w->count = 0;
+  senml_putc(w, '[');
+}
+
+int senml_add(senml_writer_t *w, const cis_uri_t *uri,
+              const cis_data_t *value)
+{
+  char num[40];
+
+  if (w->count++ > 0)
+    {
+      senml_putc(w, ',');
+    }
+
+  senml_put(w, "{\"n\":\"/%u/%u/%u\",", uri->objectId, uri->instanceId,
+            uri->resourceId);
+  switch (value->type)
+    {
+      case cis_data_type_integer:
+        senml_put(w, "\"v\":%lld", (long long)value->value.asInteger);
+        break;
+      case cis_data_type_float:
+        snprintf(num, sizeof(num), "%.17g", value->value.asFloat);
+        if (strpbrk(num, ".eEn") == NULL)
+          {
+            strcat(num, ".0");
+          }
+        senml_put(w, "\"v\":%s", num);
+        break;
+      case cis_data_type_bool:
+        senml_put(w, "\"vb\":%s", value->value.asBoolean ? "true" : "false");
+        break;
+      case cis_data_type_opaque:
+        senml_put(w, "\"vd\":");
+        senml_base64(w, value->asBuffer.buffer, value->asBuffer.length);
+        break;
+      default:
+        senml_put(w, "\"vs\":");
+        senml_string(w, value->asBuffer.buffer, value->asBuffer.length);
+        break;
+    }
+
+  senml_putc(w, '}');
+  return w->len < 0 ? -1 : 0;
+}
+
+int senml_end(senml_writer_t *w)
+{
+  senml_putc(w, ']');
+  return w->len;
+}
+
+int senml_parse(char *json, int len, senml_record_t cb, void *priv)
+{
+  char *p = json;
+  char *end = json + len;
+  int count = 0;
+
+  p = senml_ws(p, end);
+  if (p >= end || *p++ != '[')
+    {
+      return -1;
+    }
+
+  for (; ; )
+    {
+      cis_data_t value;
+      char *name = NULL;
+      char *key;
+
+      p = senml_ws(p, end);
+      if (p < end && *p == ']')
+        {
+          return count;
+        }
+
+      if (p >= end || *p++ != '{')
+        {
+          return -1;
+        }
+
+      memset(&value, 0, sizeof(value));
+      for (; ; )
+        {
+          p = senml_str(senml_ws(p, end), end, &key);
+          p = p ? senml_ws(p, end) : NULL;
+          if (p == NULL || *p++ != ':')
+            {
+              return -1;
+            }
+
+          p = senml_ws(p, end);
+          if (strcmp(key, "n") == 0 || strcmp(key, "vs") == 0 ||
+              strcmp(key, "vd") == 0)
+            {
+              char *s;
+
+              p = senml_str(p, end, &s);
+              if (p == NULL)
+                {
+                  return -1;
+                }
+
+              if (key[0] == 'n')
+                {
+                  name = s;
+                }
+              else
+                {
+                  int n = key[1] == 'd' ? senml_unbase64(s) : (int)strlen(s);
+
+                  if (n < 0)
+                    {
+                      return -1;
+                    }
+
+                  value.type = key[1] == 'd' ? cis_data_type_opaque :
+                                               cis_data_type_string;
+                  value.asBuffer.buffer = (uint8_t *)s;
+                  value.asBuffer.length = n;
+                }
+            }
+          else if (strcmp(key, "vb") == 0)
+            {
+              value.type = cis_data_type_bool;
+              value.value.asBoolean = p < end && *p == 't';
+              while (p < end && isalpha((unsigned char)*p))
+                {
+                  p++;
+                }
+            }
+          else if (strcmp(key, "v") == 0)
+            {
+              char *num = p;
+
+              while (p < end && strchr("+-0123456789.eE", *p) != NULL)
+                {
+                  p++;
+                }
+
+              if (memchr(num, '.', p - num) || memchr(num, 'e', p - num) ||
+                  memchr(num, 'E', p - num))
+                {
+                  value.type = cis_data_type_float;
+                  value.value.asFloat = strtod(num, NULL);
+                }
+              else
+                {
+                  value.type = cis_data_type_integer;
+                  value.value.asInteger = strtoll(num, NULL, 10);
+                }
+            }
+          else
+            {
+              return -1;
+            }
+
+          p = senml_ws(p, end);
+          if (p < end && *p == ',')
+            {
+              p++;
+              continue;
+            }
+
+          if (p >= end || *p++ != '}')
+            {
+              return -1;
+            }
+
+          break;
+        }
+
+      if (name == NULL || cb(priv, name, &value) < 0)
+        {
+          return -1;
+        }
+
+      count++;
+      p = senml_ws(p, end);
+      if (p < end && *p == ',')
+        {
+          p++;
+        }
+    }
+}
+
+/* "/3311/0/5850" -> uri with the flags of the parts present */
+
+int senml_uri(const char *path, cis_uri_t *uri)
+{
+  unsigned long v[3];
+  char *end;
+  int n = 0;
+
+  memset(uri, 0, sizeof(*uri));
+  while (*path == '/' && n < 3)
+    {
+      v[n] = strtoul(path + 1, &end, 10);
+      if (end == path + 1 || v[n] > 0xffff)
+        {
+          return -1;
+        }
+
+      path = end;
+      n++;
+    }
+
+  if (n == 0 || *path != '\0')
+    {
+      return -1;
+    }
+
+  uri->objectId = v[0];
+  uri->flag = CIS_URI_FLAG_OBJECT_ID;
+  if (n > 1)
+    {
+      uri->instanceId = v[1];
+      uri->flag |= CIS_URI_FLAG_INSTANCE_ID;
+    }
+  if (n > 2)
+    {
+      uri->resourceId = v[2];
+      uri->flag |= CIS_URI_FLAG_RESOURCE_ID;
+    }
+
+  return 0;
+}
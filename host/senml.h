@@ -0,0 +1,66 @@
+/****************************************************************************
+ * external/services/iotpf/host/senml.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _HOST_SENML_H_
+#define _HOST_SENML_H_
+
+#include "cis_api.h"
+
+/* SenML JSON (RFC 8428, LwM2M 1.1 content format 110) for the values the
+ * host core and the stand-in server exchange. Every record carries its
+ * full path in "n"; integers and floats are told apart by the decimal
+ * point, opaque values travel base64 encoded in "vd".
+ */
+
+typedef struct senml_writer_s
+{
+  char *buf;
+  int size;
+  int len;
+  int count;
+} senml_writer_t;
+
+typedef int (*senml_record_t)(void *priv, const char *name,
+                              const cis_data_t *value);
+
+void senml_begin(senml_writer_t *w, char *buf, int size);
+int senml_add(senml_writer_t *w, const cis_uri_t *uri,
+              const cis_data_t *value);
+int senml_end(senml_writer_t *w);
+int senml_parse(char *json, int len, senml_record_t cb, void *priv);
+
+int senml_uri(const char *path, cis_uri_t *uri);
+
+#endif /* _HOST_SENML_H_ */
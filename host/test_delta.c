@@ -0,0 +1,287 @@
+/****************************************************************************
+ * external/services/iotpf/host/test_delta.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/* Round trips through iotpf_delta: patches made by fwgen against a file
+ * standing in for the running slot, applied in uneven pieces, restarted,
+ * fed a wrong source and a malformed argument, and a full package taking
+ * the pass-through path.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "cis_api.h"
+#include "iotpf_delta.h"
+#include "fwgen.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#define TEST_SRC_SIZE           65536
+#define TEST_DST_MAX            (TEST_SRC_SIZE + 4096)
+#define TEST_PIECE              61
+
+#define TEST_CHECK(cond) \
+  do \
+    { \
+      if (!(cond)) \
+        { \
+          printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+          g_test_failed++; \
+        } \
+    } \
+  while (0)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static int g_test_failed;
+static uint8_t g_test_src[TEST_SRC_SIZE];
+static uint8_t g_test_dst[TEST_DST_MAX];
+static uint32_t g_test_dst_len;
+static uint32_t g_test_seed = 1;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void test_random(uint8_t *buf, uint32_t len)
+{
+  while (len-- > 0)
+    {
+      g_test_seed = g_test_seed * 1103515245 + 12345;
+      *buf++ = g_test_seed >> 16;
+    }
+}
+
+static void test_append(const uint8_t *data, uint32_t len)
+{
+  memcpy(g_test_dst + g_test_dst_len, data, len);
+  g_test_dst_len += len;
+}
+
+/* A new release: kept, inserted, deleted, zeroed, moved and patched */
+
+static void test_make_images(void)
+{
+  uint8_t fresh[300];
+
+  test_random(g_test_src, TEST_SRC_SIZE);
+  test_random(fresh, sizeof(fresh));
+
+  test_append(g_test_src, 10000);
+  test_append(fresh, sizeof(fresh));
+  test_append(g_test_src + 10500, 30000 - 10500);
+  memset(g_test_dst + g_test_dst_len, 0, 2000);
+  g_test_dst_len += 2000;
+  test_append(g_test_src + 40000, TEST_SRC_SIZE - 40000);
+  test_append(g_test_src + 30000, 10000);
+  g_test_dst[5000] ^= 0x55;
+  g_test_dst[g_test_dst_len - 7] ^= 0xaa;
+}
+
+static void test_write_file(const char *path, const uint8_t *data,
+                            uint32_t len)
+{
+  int fd;
+
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0)
+    {
+      TEST_CHECK(write(fd, data, len) == (int)len);
+      close(fd);
+    }
+}
+
+/* Running image in place, empty inactive slot, nothing saved */
+
+static void test_reset(void)
+{
+  test_write_file(CONFIG_SERVICES_IOTPF_FW_RUN_PATH, g_test_src,
+                  TEST_SRC_SIZE);
+  test_write_file(CONFIG_SERVICES_IOTPF_FW_SLOT_PATH, NULL, 0);
+  unlink(CONFIG_SERVICES_IOTPF_FW_STATE_PATH);
+  unlink(CONFIG_SERVICES_IOTPF_FW_STATE_PATH ".delta");
+}
+
+static bool test_slot_matches(void)
+{
+  static uint8_t slot[TEST_DST_MAX + 1];
+  int fd;
+  int ret;
+
+  fd = open(CONFIG_SERVICES_IOTPF_FW_SLOT_PATH, O_RDONLY);
+  if (fd < 0)
+    {
+      return false;
+    }
+
+  ret = read(fd, slot, sizeof(slot));
+  close(fd);
+  return ret == (int)g_test_dst_len &&
+         memcmp(slot, g_test_dst, g_test_dst_len) == 0;
+}
+
+static int test_feed(const uint8_t *data, uint32_t from, uint32_t to)
+{
+  uint32_t n;
+
+  while (from < to)
+    {
+      n = to - from < TEST_PIECE ? to - from : TEST_PIECE;
+      if (iotpf_delta_write(from, data + from, n) != CIS_RET_OK)
+        {
+          return CIS_RET_ERROR;
+        }
+      from += n;
+    }
+
+  return CIS_RET_OK;
+}
+
+static void test_patch(const uint8_t *patch, uint32_t len)
+{
+  test_reset();
+  TEST_CHECK(iotpf_delta_begin() == 0);
+  TEST_CHECK(test_feed(patch, 0, len) == CIS_RET_OK);
+  TEST_CHECK(iotpf_delta_finish() == CIS_RET_OK);
+  TEST_CHECK(test_slot_matches());
+}
+
+/* Sent again from 0 halfway through; a repeated piece is skipped and a
+ * gap refused
+ */
+
+static void test_restart(const uint8_t *patch, uint32_t len)
+{
+  test_reset();
+  TEST_CHECK(iotpf_delta_begin() == 0);
+  TEST_CHECK(test_feed(patch, 0, len / 2) == CIS_RET_OK);
+  TEST_CHECK(iotpf_delta_write(len / 2 - 10, patch + len / 2 - 10, 20) ==
+             CIS_RET_OK);
+  TEST_CHECK(test_feed(patch, 0, len) == CIS_RET_OK);
+  TEST_CHECK(iotpf_delta_finish() == CIS_RET_OK);
+  TEST_CHECK(test_slot_matches());
+
+  test_reset();
+  TEST_CHECK(iotpf_delta_begin() == 0);
+  TEST_CHECK(test_feed(patch, 0, len / 2) == CIS_RET_OK);
+  TEST_CHECK(iotpf_delta_write(len / 2 + 1, patch + len / 2 + 1, 5) ==
+             CIS_RET_ERROR);
+  iotpf_delta_abort();
+}
+
+static void test_reject(const uint8_t *patch, uint32_t len)
+{
+  static const uint8_t wide[] =
+  {
+    0x00, 0xff, 0xff, 0xff, 0xff, 0x1f, 0x01
+  };
+
+  uint8_t bad[76 + sizeof(wide)];
+
+  /* Made for another running image */
+
+  test_reset();
+  g_test_src[TEST_SRC_SIZE - 1] ^= 0x01;
+  test_write_file(CONFIG_SERVICES_IOTPF_FW_RUN_PATH, g_test_src,
+                  TEST_SRC_SIZE);
+  g_test_src[TEST_SRC_SIZE - 1] ^= 0x01;
+  TEST_CHECK(iotpf_delta_begin() == 0);
+  test_feed(patch, 0, len);
+  TEST_CHECK(iotpf_delta_finish() == CIS_RET_ERROR);
+
+  /* Cut short */
+
+  test_reset();
+  TEST_CHECK(iotpf_delta_begin() == 0);
+  TEST_CHECK(test_feed(patch, 0, len - 1) == CIS_RET_OK);
+  TEST_CHECK(iotpf_delta_finish() == CIS_RET_ERROR);
+
+  /* A COPY seek of five varint bytes carrying 33 bits */
+
+  test_reset();
+  memcpy(bad, patch, 76);
+  memcpy(bad + 76, wide, sizeof(wide));
+  TEST_CHECK(iotpf_delta_begin() == 0);
+  TEST_CHECK(iotpf_delta_write(0, bad, sizeof(bad)) == CIS_RET_ERROR);
+  iotpf_delta_abort();
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+  uint8_t *patch;
+  uint8_t *package;
+  uint32_t patch_len;
+  uint32_t package_len;
+
+  test_make_images();
+  patch = fwgen_delta(g_test_src, TEST_SRC_SIZE, g_test_dst, g_test_dst_len,
+                      &patch_len);
+  package = fwgen_package(g_test_dst, g_test_dst_len, &package_len);
+  if (patch == NULL || package == NULL)
+    {
+      printf("test_delta: out of memory\n");
+      return EXIT_FAILURE;
+    }
+
+  printf("test_delta: %u byte patch for a %u byte image\n", patch_len,
+         g_test_dst_len);
+  TEST_CHECK(patch_len < g_test_dst_len / 16);
+
+  test_patch(patch, patch_len);
+  test_patch(package, package_len);
+  test_restart(patch, patch_len);
+  test_reject(patch, patch_len);
+
+  free(patch);
+  free(package);
+  unlink(CONFIG_SERVICES_IOTPF_FW_RUN_PATH);
+  unlink(CONFIG_SERVICES_IOTPF_FW_SLOT_PATH);
+  unlink(CONFIG_SERVICES_IOTPF_FW_STATE_PATH);
+  printf("test_delta: %s\n", g_test_failed ? "FAILED" : "ok");
+  return g_test_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
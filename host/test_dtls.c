@@ -0,0 +1,221 @@
+/****************************************************************************
+ * external/services/iotpf/host/test_dtls.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/* Checks of the DTLS session file against a fake library: what one run
+ * saves is offered by the next, once, and a session that cannot be saved
+ * or is refused leaves no file behind.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cis_api.h"
+#include "iotpf_dtls.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#define TEST_CHECK(cond) \
+  do \
+    { \
+      if (!(cond)) \
+        { \
+          printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+          g_test_failed++; \
+        } \
+    } \
+  while (0)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static int g_test_failed;
+static int g_test_context;
+
+/* The fake library: the session it would export, what it was given */
+
+static char g_lib_session[64];
+static int g_lib_get;               /* > 0: length to export */
+static bool g_lib_resumed;
+static bool g_lib_refuse;
+static char g_lib_offered[64];
+static int g_lib_sets;
+static int g_lib_cid = -1;
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int cis_dtls_session_get(void *context, uint8_t *buf, uint32_t size)
+{
+  if (g_lib_get > 0)
+    {
+      memcpy(buf, g_lib_session, g_lib_get);
+    }
+
+  return g_lib_get;
+}
+
+cis_ret_t cis_dtls_session_set(void *context, const uint8_t *buf,
+                               uint32_t len)
+{
+  g_lib_sets++;
+  if (g_lib_refuse || len >= sizeof(g_lib_offered))
+    {
+      return CIS_RET_ERROR;
+    }
+
+  memcpy(g_lib_offered, buf, len);
+  g_lib_offered[len] = '\0';
+  return CIS_RET_OK;
+}
+
+bool cis_dtls_session_resumed(void *context)
+{
+  return g_lib_resumed;
+}
+
+cis_ret_t cis_dtls_set_cid(void *context, uint8_t len)
+{
+  g_lib_cid = len;
+  return CIS_RET_OK;
+}
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static bool test_saved(void)
+{
+  return access(CONFIG_SERVICES_IOTPF_DTLS_SESSION_PATH, F_OK) == 0;
+}
+
+/* A run from boot: one register, answered */
+
+static void test_run(iotpf_dtls_t *dtls)
+{
+  iotpf_dtls_init(dtls, 0);
+  g_lib_sets = 0;
+  g_lib_offered[0] = '\0';
+  iotpf_dtls_register(dtls, &g_test_context);
+  iotpf_dtls_registered(dtls, &g_test_context);
+}
+
+static void test_resume(void)
+{
+  struct stat st;
+  iotpf_dtls_t dtls;
+
+  unlink(CONFIG_SERVICES_IOTPF_DTLS_SESSION_PATH);
+  strcpy(g_lib_session, "first session");
+  g_lib_get = strlen(g_lib_session);
+  test_run(&dtls);
+  TEST_CHECK(g_lib_sets == 0);
+  TEST_CHECK(g_lib_cid == 4);
+  TEST_CHECK(test_saved());
+  TEST_CHECK(stat(CONFIG_SERVICES_IOTPF_DTLS_SESSION_PATH, &st) == 0 &&
+             (st.st_mode & 0077) == 0);
+
+  /* The next boot offers it, later registers of that run do not */
+
+  strcpy(g_lib_session, "second session");
+  g_lib_get = strlen(g_lib_session);
+  g_lib_resumed = true;
+  test_run(&dtls);
+  TEST_CHECK(g_lib_sets == 1);
+  TEST_CHECK(strcmp(g_lib_offered, "first session") == 0);
+
+  iotpf_dtls_register(&dtls, &g_test_context);
+  iotpf_dtls_registered(&dtls, &g_test_context);
+  TEST_CHECK(g_lib_sets == 1);
+
+  test_run(&dtls);
+  TEST_CHECK(strcmp(g_lib_offered, "second session") == 0);
+  g_lib_resumed = false;
+}
+
+static void test_forget(void)
+{
+  iotpf_dtls_t dtls;
+
+  /* No session to export: nothing stale left for the next boot */
+
+  strcpy(g_lib_session, "a session");
+  g_lib_get = strlen(g_lib_session);
+  test_run(&dtls);
+  g_lib_get = 0;
+  test_run(&dtls);
+  TEST_CHECK(!test_saved());
+
+  /* Too large for the adapter's buffer */
+
+  g_lib_get = strlen(g_lib_session);
+  test_run(&dtls);
+  g_lib_get = CIS_RET_ERROR;
+  test_run(&dtls);
+  TEST_CHECK(!test_saved());
+
+  /* Refused by the library */
+
+  g_lib_get = strlen(g_lib_session);
+  test_run(&dtls);
+  g_lib_refuse = true;
+  g_lib_get = 0;
+  test_run(&dtls);
+  TEST_CHECK(g_lib_sets == 1);
+  TEST_CHECK(!test_saved());
+  g_lib_refuse = false;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+  test_resume();
+  test_forget();
+
+  unlink(CONFIG_SERVICES_IOTPF_DTLS_SESSION_PATH);
+  printf("test_dtls: %s\n", g_test_failed ? "FAILED" : "ok");
+  return g_test_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,335 @@
+/****************************************************************************
+ * external/services/iotpf/host/test_fw.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+/* Checks of the firmware sink: the FIPS 180-2 SHA-256 vectors, then
+ * packages written through iotpf_fw against a plain file standing in for
+ * the slot, interrupted, resumed, restarted and corrupted.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "cis_api.h"
+#include "iotpf_sha256.h"
+#include "iotpf_fw.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#define TEST_IMAGE_SIZE         (10 * CONFIG_SERVICES_IOTPF_FW_ERASE_SIZE + 77)
+#define TEST_PACKAGE_SIZE       (IOTPF_FW_MANIFEST_SIZE + TEST_IMAGE_SIZE)
+
+#define TEST_CHECK(cond) \
+  do \
+    { \
+      if (!(cond)) \
+        { \
+          printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+          g_test_failed++; \
+        } \
+    } \
+  while (0)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static int g_test_failed;
+static uint8_t g_test_package[TEST_PACKAGE_SIZE];
+static uint8_t *g_test_image = g_test_package + IOTPF_FW_MANIFEST_SIZE;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void test_hex(const char *hex, uint8_t *out)
+{
+  int i;
+
+  for (i = 0; i < IOTPF_SHA256_DIGEST_LEN; i++)
+    {
+      sscanf(hex + 2 * i, "%2hhx", &out[i]);
+    }
+}
+
+/* msg is hashed in pieces of step bytes, to cross block boundaries */
+
+static bool test_sha_vector(const char *msg, uint32_t repeat, uint32_t step,
+                            const char *hex)
+{
+  uint8_t expected[IOTPF_SHA256_DIGEST_LEN];
+  uint8_t digest[IOTPF_SHA256_DIGEST_LEN];
+  iotpf_sha256_t sha;
+  uint32_t len = strlen(msg);
+  uint32_t off;
+  uint32_t n;
+
+  iotpf_sha256_init(&sha);
+  while (repeat-- > 0)
+    {
+      for (off = 0; off < len; off += n)
+        {
+          n = len - off < step ? len - off : step;
+          iotpf_sha256_update(&sha, (const uint8_t *)msg + off, n);
+        }
+    }
+
+  iotpf_sha256_final(&sha, digest);
+  test_hex(hex, expected);
+  return memcmp(digest, expected, sizeof(digest)) == 0;
+}
+
+static void test_sha256(void)
+{
+  static const char two_block[] =
+    "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  static char thousand[1001];
+
+  memset(thousand, 'a', sizeof(thousand) - 1);
+
+  TEST_CHECK(test_sha_vector("abc", 1, 3,
+    "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+  TEST_CHECK(test_sha_vector(two_block, 1, 56,
+    "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"));
+  TEST_CHECK(test_sha_vector(two_block, 1, 5,
+    "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"));
+  TEST_CHECK(test_sha_vector(thousand, 1000, 333,
+    "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"));
+  TEST_CHECK(test_sha_vector("", 1, 1,
+    "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"));
+}
+
+/* A manifest in front of pseudo random bytes, like the packaging does */
+
+static void test_make_package(void)
+{
+  iotpf_sha256_t sha;
+  uint32_t seed = 1;
+  uint32_t i;
+
+  for (i = 0; i < TEST_IMAGE_SIZE; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      g_test_image[i] = seed >> 16;
+    }
+
+  memcpy(g_test_package, IOTPF_FW_MANIFEST_MAGIC, 4);
+  g_test_package[4] = TEST_IMAGE_SIZE & 0xff;
+  g_test_package[5] = (TEST_IMAGE_SIZE >> 8) & 0xff;
+  g_test_package[6] = (TEST_IMAGE_SIZE >> 16) & 0xff;
+  g_test_package[7] = (TEST_IMAGE_SIZE >> 24) & 0xff;
+  iotpf_sha256_init(&sha);
+  iotpf_sha256_update(&sha, g_test_image, TEST_IMAGE_SIZE);
+  iotpf_sha256_final(&sha, g_test_package + 8);
+}
+
+/* Fresh, empty slot and no saved state */
+
+static void test_reset_slot(void)
+{
+  int fd;
+
+  unlink(CONFIG_SERVICES_IOTPF_FW_STATE_PATH);
+  fd = open(CONFIG_SERVICES_IOTPF_FW_SLOT_PATH,
+            O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0)
+    {
+      close(fd);
+    }
+}
+
+static bool test_slot_matches(void)
+{
+  static uint8_t slot[TEST_IMAGE_SIZE + 1];
+  int fd;
+  int ret;
+
+  fd = open(CONFIG_SERVICES_IOTPF_FW_SLOT_PATH, O_RDONLY);
+  if (fd < 0)
+    {
+      return false;
+    }
+
+  ret = read(fd, slot, sizeof(slot));
+  close(fd);
+  return ret == TEST_IMAGE_SIZE &&
+         memcmp(slot, g_test_image, TEST_IMAGE_SIZE) == 0;
+}
+
+/* Feeds package bytes [from, to) in uneven buffers, as blocks arrive */
+
+static int test_feed(uint32_t from, uint32_t to)
+{
+  uint32_t n;
+
+  while (from < to)
+    {
+      n = to - from < 93 ? to - from : 93;
+      if (iotpf_fw_write(from, g_test_package + from, n) != CIS_RET_OK)
+        {
+          return CIS_RET_ERROR;
+        }
+      from += n;
+    }
+
+  return CIS_RET_OK;
+}
+
+static void test_fw_straight(void)
+{
+  test_reset_slot();
+  TEST_CHECK(iotpf_fw_begin(true) == 0);
+  TEST_CHECK(test_feed(0, TEST_PACKAGE_SIZE) == CIS_RET_OK);
+  TEST_CHECK(iotpf_fw_finish(NULL) == CIS_RET_OK);
+  TEST_CHECK(test_slot_matches());
+  TEST_CHECK(iotpf_fw_saved_bytes() == 0);
+}
+
+/* Interrupted mid chunk: the resume point is the last programmed chunk,
+ * the bytes staged after it arrive again and the image still verifies.
+ */
+
+static void test_fw_resume(void)
+{
+  uint32_t cut = TEST_PACKAGE_SIZE / 2 + 10;
+  int resume;
+
+  test_reset_slot();
+  TEST_CHECK(iotpf_fw_begin(true) == 0);
+  TEST_CHECK(test_feed(0, cut) == CIS_RET_OK);
+  iotpf_fw_abort(true);
+
+  resume = iotpf_fw_saved_bytes();
+  TEST_CHECK(resume > IOTPF_FW_MANIFEST_SIZE && resume <= cut);
+  TEST_CHECK((resume - IOTPF_FW_MANIFEST_SIZE) %
+             CONFIG_SERVICES_IOTPF_FW_ERASE_SIZE == 0);
+  TEST_CHECK(iotpf_fw_begin(true) == resume);
+
+  /* A repeated buffer is skipped, a hole is refused */
+
+  TEST_CHECK(iotpf_fw_write(resume - 5, g_test_package + resume - 5, 5) ==
+             CIS_RET_OK);
+  TEST_CHECK(iotpf_fw_write(resume + 1, g_test_package + resume + 1, 5) ==
+             CIS_RET_ERROR);
+  TEST_CHECK(test_feed(resume, TEST_PACKAGE_SIZE) == CIS_RET_OK);
+  TEST_CHECK(iotpf_fw_finish(NULL) == CIS_RET_OK);
+  TEST_CHECK(test_slot_matches());
+}
+
+/* The server sends from 0 although state was saved: start over */
+
+static void test_fw_restart(void)
+{
+  test_reset_slot();
+  TEST_CHECK(iotpf_fw_begin(true) == 0);
+  TEST_CHECK(test_feed(0, TEST_PACKAGE_SIZE / 3) == CIS_RET_OK);
+  iotpf_fw_abort(true);
+
+  TEST_CHECK(iotpf_fw_begin(true) > 0);
+  TEST_CHECK(test_feed(0, TEST_PACKAGE_SIZE) == CIS_RET_OK);
+  TEST_CHECK(iotpf_fw_finish(NULL) == CIS_RET_OK);
+  TEST_CHECK(test_slot_matches());
+}
+
+/* abort(false) forgets, a damaged or short image fails the digest */
+
+static void test_fw_reject(void)
+{
+  test_reset_slot();
+  TEST_CHECK(iotpf_fw_begin(true) == 0);
+  TEST_CHECK(test_feed(0, TEST_PACKAGE_SIZE / 2) == CIS_RET_OK);
+  iotpf_fw_abort(false);
+  TEST_CHECK(iotpf_fw_saved_bytes() == 0);
+
+  g_test_image[TEST_IMAGE_SIZE / 2] ^= 0x01;
+  TEST_CHECK(iotpf_fw_begin(true) == 0);
+  TEST_CHECK(test_feed(0, TEST_PACKAGE_SIZE) == CIS_RET_OK);
+  TEST_CHECK(iotpf_fw_finish(NULL) == CIS_RET_ERROR);
+  g_test_image[TEST_IMAGE_SIZE / 2] ^= 0x01;
+
+  TEST_CHECK(iotpf_fw_begin(true) == 0);
+  TEST_CHECK(test_feed(0, TEST_PACKAGE_SIZE - 1) == CIS_RET_OK);
+  TEST_CHECK(iotpf_fw_finish(NULL) == CIS_RET_ERROR);
+
+  /* Past the size in the manifest, and no manifest at all */
+
+  TEST_CHECK(iotpf_fw_begin(true) == 0);
+  TEST_CHECK(test_feed(0, TEST_PACKAGE_SIZE) == CIS_RET_OK);
+  TEST_CHECK(iotpf_fw_write(TEST_PACKAGE_SIZE, g_test_image, 1) ==
+             CIS_RET_ERROR);
+  iotpf_fw_abort(false);
+
+  TEST_CHECK(iotpf_fw_begin(true) == 0);
+  TEST_CHECK(iotpf_fw_write(0, g_test_image, 64) == CIS_RET_ERROR);
+  iotpf_fw_abort(false);
+
+  /* A bare image is only as good as the digest the caller brings */
+
+  TEST_CHECK(iotpf_fw_begin(false) == 0);
+  TEST_CHECK(iotpf_fw_write(0, g_test_image, TEST_IMAGE_SIZE) ==
+             CIS_RET_OK);
+  TEST_CHECK(iotpf_fw_finish(NULL) == CIS_RET_ERROR);
+
+  TEST_CHECK(iotpf_fw_begin(false) == 0);
+  TEST_CHECK(iotpf_fw_write(0, g_test_image, TEST_IMAGE_SIZE) ==
+             CIS_RET_OK);
+  TEST_CHECK(iotpf_fw_finish(g_test_package + 8) == CIS_RET_OK);
+  TEST_CHECK(test_slot_matches());
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+  test_sha256();
+  test_make_package();
+  test_fw_straight();
+  test_fw_resume();
+  test_fw_restart();
+  test_fw_reject();
+
+  unlink(CONFIG_SERVICES_IOTPF_FW_SLOT_PATH);
+  unlink(CONFIG_SERVICES_IOTPF_FW_STATE_PATH);
+  printf("test_fw: %s\n", g_test_failed ? "FAILED" : "ok");
+  return g_test_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
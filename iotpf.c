@@ -52,6 +52,13 @@
 
 #include "cis_api.h"
 #include "cis_log.h"
+#include "iotpf_stats.h"
+#include "iotpf_dlog.h"
+#include "iotpf_pm.h"
+#include "iotpf_bench.h"
+#ifdef CIS_AT_BINARY
+#include "iotpf_atbin.h"
+#endif
 
 /****************************************************************************
  * Pre-processor definitions
@@ -79,6 +86,11 @@ static void usage(void)
   LOGI("iotpf: start gps thread, do not start update");
   LOGI("iotpf 0: start gps thread, do not start update");
   LOGI("iotpf 1: start update, do not start gps thread");
+  LOGI("iotpf stats: print the counters of the running iotpf");
+  LOGI("iotpf stats -r: print them, then reset the latency histograms");
+#ifdef CIS_BENCH
+  iotpf_bench_usage();
+#endif
   LOGI("iotpf other: error, return");
 }
 
@@ -102,6 +114,13 @@ static int iotpf_daemon(int argc, char *argv[])
   //iotpf_mode=1, start update process, dont start gps thread
   if(argc >= 2)
     {
+#ifdef CIS_BENCH
+      if (strcmp(argv[1], "bench") == 0)
+        {
+          iotpf_mode = IOTPF_MODE_BENCH;
+        }
+      else
+#endif
       if(atoi(argv[1]) == 0 || atoi(argv[1]) == 1)
         {
           iotpf_mode = atoi(argv[1]);
@@ -113,12 +132,27 @@ static int iotpf_daemon(int argc, char *argv[])
         }
     }
 
+#ifdef CIS_DLOG
+  iotpf_dlog_start();
+#endif
+
+  /* From here on the service only keeps the SoC up while it has work */
+
+  iotpf_pm_initialize();
+  iotpf_pm_stay(IOTPF_PM_START);
   ret = ciscom_initialize(&iotpf_configs);
+  iotpf_pm_relax(IOTPF_PM_START);
   if (ret < 0)
     {
       LOGE("ciscom_initialize error");
+#ifdef CIS_DLOG
+      iotpf_dlog_stop();
+#endif
       return -1;
     }
+#ifdef CIS_STATS
+  iotpf_stats_serve();
+#endif
 #ifdef CIS_TWO_MCU
   ret = cisat_initialize();
   if (ret < 0)
@@ -126,6 +160,14 @@ static int iotpf_daemon(int argc, char *argv[])
       LOGE("cisat_initialize error");
       goto error;
     }
+#ifdef CIS_AT_BINARY
+  ret = iotpf_atbin_start(ret);
+  if (ret < 0)
+    {
+      LOGE("iotpf_atbin_start error");
+      goto error;
+    }
+#endif
   cisat_readloop(ret);
 #else
   ret = cisapi_initialize(iotpf_mode);
@@ -134,10 +176,16 @@ static int iotpf_daemon(int argc, char *argv[])
       LOGE("cisapi_initialize error");
       goto error;
     }
+#endif
+#ifdef CIS_DLOG
+  iotpf_dlog_stop();
 #endif
   return 0;
 error:
   ciscom_destory();
+#ifdef CIS_DLOG
+  iotpf_dlog_stop();
+#endif
   return -1;
 }
 
@@ -148,7 +196,31 @@ int iotpf_main(int argc, char *argv[])
 #endif
 {
   int ret;
-  pm_stay(PM_IDLE_DOMAIN, PM_STANDBY);
+
+  if (argc >= 2 && strcmp(argv[1], "stats") == 0)
+    {
+#ifdef CIS_STATS
+      return iotpf_stats_print(argc >= 3 && strcmp(argv[2], "-r") == 0);
+#else
+      printf("iotpf: statistics are not enabled\n");
+      return -1;
+#endif
+    }
+
+#ifdef CIS_BENCH
+  /* Parsed here, the daemon only gets "bench": task arguments are few */
+
+  if (argc >= 2 && strcmp(argv[1], "bench") == 0)
+    {
+      if (iotpf_bench_parse(argc - 1, argv + 1) != CIS_RET_OK)
+        {
+          iotpf_bench_usage();
+          return -1;
+        }
+      argv[2] = NULL;
+    }
+#endif
+
   ret = task_create(argv[0],
           CONFIG_SERVICES_IOTPF_PRIORITY,
           CONFIG_SERVICES_IOTPF_STACKSIZE,
@@ -0,0 +1,783 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_atbin.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+#include "cis_api.h"
+#include "cis_log.h"
+#include "iotpf_atbin.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SERVICES_IOTPF_AT_BINARY_DEPTH
+#define CONFIG_SERVICES_IOTPF_AT_BINARY_DEPTH   4
+#endif
+
+#define IOTPF_ATBIN_MAX         CONFIG_SERVICES_IOTPF_AT_BINARY_MAX
+#define IOTPF_ATBIN_DEPTH       CONFIG_SERVICES_IOTPF_AT_BINARY_DEPTH
+
+/* Reply lines from the parser may carry MAX bytes of payload as hex */
+
+#define IOTPF_ATBIN_LINE_MAX    (2 * IOTPF_ATBIN_MAX)
+
+/* Shorter quoted hex strings in replies are left as text */
+
+#define IOTPF_ATBIN_HEX_MIN     8
+
+/* A command the parser never answers must not stall the queue forever */
+
+#define IOTPF_ATBIN_TIMEOUT_MS  30000
+
+#define IOTPF_ATBIN_CMD         "AT+IOTPFBIN"
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+typedef struct iotpf_atbin_cmd_s
+{
+  uint8_t tag;
+  uint16_t text_len;
+  uint16_t blob_len;
+  uint16_t blob_at;
+  uint8_t data[IOTPF_ATBIN_MAX];    /* text, then blob */
+} iotpf_atbin_cmd_t;
+
+typedef struct iotpf_atbin_s
+{
+  int uart;                         /* host MCU */
+  int pty;                          /* master; the AT parser has the slave */
+  bool binary;
+  uint8_t rx[IOTPF_ATBIN_MAX + IOTPF_ATBIN_OVERHEAD];
+  uint32_t rx_len;
+  char line[IOTPF_ATBIN_LINE_MAX];  /* reply line from the parser */
+  uint32_t line_len;
+  uint8_t blob[IOTPF_ATBIN_MAX];
+  uint8_t out[IOTPF_ATBIN_MAX + IOTPF_ATBIN_OVERHEAD];
+  char cmd[IOTPF_ATBIN_LINE_MAX + 2];  /* command line for the parser */
+  iotpf_atbin_cmd_t queue[IOTPF_ATBIN_DEPTH];
+  uint8_t head;
+  uint8_t count;
+  bool busy;                        /* queue[head] is with the parser */
+  uint32_t busy_since;
+  uint32_t crc_errors;
+} iotpf_atbin_t;
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const uint16_t g_crc_nibble[16] =
+{
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+  0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+};
+
+static const char g_hex[] = "0123456789abcdef";
+
+/* Unsolicited result codes the parser may emit between a command and its
+ * reply. The same prefix answering its own query, AT+CEREG? for +CEREG,
+ * is a reply.
+ */
+
+static const char *const g_urcs[] =
+{
+  "+MIPLREAD", "+MIPLWRITE", "+MIPLEXECUTE", "+MIPLOBSERVE",
+  "+MIPLDISCOVER", "+MIPLPARAMETER", "+MIPLEVENT", "+CEREG", "+CGREG",
+  "+CSCON", "+CTZE", "+CTZV", "+CGEV", "+NPSMR",
+};
+
+static iotpf_atbin_t g_atbin;
+static pthread_t g_atbin_tid;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static int prv_hexval(char c)
+{
+  if (c >= '0' && c <= '9')
+    {
+      return c - '0';
+    }
+  if (c >= 'a' && c <= 'f')
+    {
+      return c - 'a' + 10;
+    }
+  if (c >= 'A' && c <= 'F')
+    {
+      return c - 'A' + 10;
+    }
+  return -1;
+}
+
+static int prv_write(int fd, const void *buf, uint32_t len)
+{
+  const uint8_t *p = (const uint8_t *)buf;
+
+  while (len > 0)
+    {
+      ssize_t n = write(fd, p, len);
+
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            {
+              continue;
+            }
+          return CIS_RET_ERROR;
+        }
+      p += n;
+      len -= n;
+    }
+
+  return CIS_RET_OK;
+}
+
+/* A reply of ours or of the parser, to the host MCU */
+
+static void prv_reply(iotpf_atbin_t *g, uint8_t tag, const char *text,
+                      uint16_t text_len, const uint8_t *blob,
+                      uint16_t blob_len, uint16_t blob_at)
+{
+  int len;
+
+  if (!g->binary)
+    {
+      prv_write(g->uart, "\r\n", 2);
+      prv_write(g->uart, text, text_len);
+      prv_write(g->uart, "\r\n", 2);
+      return;
+    }
+
+  len = iotpf_atbin_encode(tag, text, text_len, blob, blob_len, blob_at,
+                           g->out, sizeof(g->out));
+  if (len > 0)
+    {
+      prv_write(g->uart, g->out, len);
+    }
+}
+
+static void prv_replyText(iotpf_atbin_t *g, uint8_t tag, const char *text)
+{
+  prv_reply(g, tag, text, strlen(text), NULL, 0, 0);
+}
+
+/* AT+IOTPFBIN is answered here, the parser never sees it */
+
+static bool prv_local(iotpf_atbin_t *g, uint8_t tag, const char *text,
+                      uint16_t len)
+{
+  uint16_t n = sizeof(IOTPF_ATBIN_CMD) - 1;
+
+  while (len > 0 && (text[len - 1] == '\r' || text[len - 1] == '\n'))
+    {
+      len--;
+    }
+  if (len != n + 1 && len != n + 2)
+    {
+      return false;
+    }
+  if (strncasecmp(text, IOTPF_ATBIN_CMD, n) != 0)
+    {
+      return false;
+    }
+
+  if (len == n + 1 && text[n] == '?')
+    {
+      prv_replyText(g, tag, g->binary ? "+IOTPFBIN: 1" : "+IOTPFBIN: 0");
+      prv_replyText(g, tag, "OK");
+    }
+  else if (len == n + 2 && text[n] == '=' && text[n + 1] == '1')
+    {
+      prv_replyText(g, tag, "OK");
+      g->binary = true;
+      LOGI("atbin: binary mode");
+    }
+  else if (len == n + 2 && text[n] == '=' && text[n + 1] == '0')
+    {
+      prv_replyText(g, tag, "OK");
+      g->binary = false;
+      LOGI("atbin: text mode, %u crc errors", g->crc_errors);
+    }
+  else
+    {
+      prv_replyText(g, tag, "ERROR");
+    }
+
+  return true;
+}
+
+/* Hand queued commands to the parser, one at a time */
+
+static void prv_dispatch(iotpf_atbin_t *g)
+{
+  while (!g->busy && g->count > 0)
+    {
+      iotpf_atbin_cmd_t *cmd = &g->queue[g->head];
+      const uint8_t *blob = cmd->data + cmd->text_len;
+      uint16_t i;
+      uint32_t n;
+
+      if (cmd->blob_len == 0 &&
+          prv_local(g, cmd->tag, (const char *)cmd->data, cmd->text_len))
+        {
+          g->head = (g->head + 1) % IOTPF_ATBIN_DEPTH;
+          g->count--;
+          continue;
+        }
+
+      /* One write, so the parser wakes up once per command */
+
+      memcpy(g->cmd, cmd->data, cmd->blob_at);
+      n = cmd->blob_at;
+      for (i = 0; i < cmd->blob_len; i++)
+        {
+          g->cmd[n++] = g_hex[blob[i] >> 4];
+          g->cmd[n++] = g_hex[blob[i] & 0x0f];
+        }
+      memcpy(g->cmd + n, cmd->data + cmd->blob_at,
+             cmd->text_len - cmd->blob_at);
+      n += cmd->text_len - cmd->blob_at;
+      g->cmd[n++] = '\r';
+      g->cmd[n++] = '\n';
+      prv_write(g->pty, g->cmd, n);
+      g->busy = true;
+      g->busy_since = cissys_gettime();
+    }
+}
+
+static void prv_done(iotpf_atbin_t *g)
+{
+  g->busy = false;
+  g->head = (g->head + 1) % IOTPF_ATBIN_DEPTH;
+  g->count--;
+  prv_dispatch(g);
+}
+
+static void prv_enqueue(iotpf_atbin_t *g, const iotpf_atbin_frame_t *frame)
+{
+  iotpf_atbin_cmd_t *cmd;
+
+  if (g->count == IOTPF_ATBIN_DEPTH)
+    {
+      prv_replyText(g, frame->tag, "+IOTPFBIN ERROR: busy");
+      return;
+    }
+
+  cmd = &g->queue[(g->head + g->count) % IOTPF_ATBIN_DEPTH];
+  cmd->tag = frame->tag;
+  cmd->text_len = frame->text_len;
+  cmd->blob_len = frame->blob_len;
+  cmd->blob_at = frame->blob_at;
+  memcpy(cmd->data, frame->text, frame->text_len);
+  memcpy(cmd->data + frame->text_len, frame->blob, frame->blob_len);
+  g->count++;
+  prv_dispatch(g);
+}
+
+static void prv_fromHostBinary(iotpf_atbin_t *g)
+{
+  iotpf_atbin_frame_t frame;
+  uint32_t pos = 0;
+
+  while (pos < g->rx_len)
+    {
+      int ret = iotpf_atbin_decode(&frame, g->rx + pos, g->rx_len - pos);
+
+      if (ret == 0)
+        {
+          break;
+        }
+      if (ret < 0)
+        {
+          /* Noise or a damaged frame: hunt for the next sync byte. A
+           * frame whose header held up is answered under its own tag so
+           * the host can resend that command at once.
+           */
+
+          uint8_t *sync = memchr(g->rx + pos + 1, IOTPF_ATBIN_SYNC,
+                                 g->rx_len - pos - 1);
+
+          if (g->rx[pos] == IOTPF_ATBIN_SYNC)
+            {
+              g->crc_errors++;
+              prv_replyText(g, frame.tag, "+IOTPFBIN ERROR: frame");
+            }
+          pos = sync ? sync - g->rx : g->rx_len;
+          continue;
+        }
+
+      prv_enqueue(g, &frame);
+      pos += ret;
+    }
+
+  memmove(g->rx, g->rx + pos, g->rx_len - pos);
+  g->rx_len -= pos;
+}
+
+/* Text mode is a pass-through that only looks for AT+IOTPFBIN */
+
+static void prv_fromHostText(iotpf_atbin_t *g)
+{
+  uint32_t start = 0;
+  uint32_t i;
+
+  for (i = 0; i < g->rx_len && !g->binary; i++)
+    {
+      uint8_t c = g->rx[i];
+
+      if (c != '\r' && c != '\n' && c != 0x1a)
+        {
+          continue;
+        }
+      if (!prv_local(g, 0, (const char *)g->rx + start, i + 1 - start))
+        {
+          prv_write(g->pty, g->rx + start, i + 1 - start);
+        }
+      start = i + 1;
+    }
+
+  if (start == 0 && g->rx_len == sizeof(g->rx))
+    {
+      prv_write(g->pty, g->rx, g->rx_len);
+      start = g->rx_len;
+    }
+
+  memmove(g->rx, g->rx + start, g->rx_len - start);
+  g->rx_len -= start;
+  if (g->binary)
+    {
+      prv_fromHostBinary(g);
+    }
+}
+
+/* Lift the first quoted hex string of a reply line out into g->blob */
+
+static uint16_t prv_extractHex(iotpf_atbin_t *g, uint16_t *blob_at)
+{
+  char *p = g->line;
+  char *end = g->line + g->line_len;
+
+  while ((p = memchr(p, '"', end - p)) != NULL)
+    {
+      char *q = ++p;
+      uint16_t n;
+      uint16_t i;
+
+      while (q < end && prv_hexval(*q) >= 0)
+        {
+          q++;
+        }
+      if (q == end)
+        {
+          break;
+        }
+      n = q - p;
+      if (*q != '"' || n < IOTPF_ATBIN_HEX_MIN || (n & 1) ||
+          g->line_len - n + n / 2 > IOTPF_ATBIN_MAX)
+        {
+          p = q + 1;
+          continue;
+        }
+
+      for (i = 0; i < n / 2; i++)
+        {
+          g->blob[i] = (prv_hexval(p[2 * i]) << 4) | prv_hexval(p[2 * i + 1]);
+        }
+      memmove(p, q, end - q);
+      g->line_len -= n;
+      *blob_at = p - g->line;
+      return n / 2;
+    }
+
+  return 0;
+}
+
+static bool prv_unsolicited(iotpf_atbin_t *g)
+{
+  const iotpf_atbin_cmd_t *cmd = &g->queue[g->head];
+  uint8_t i;
+
+  for (i = 0; i < sizeof(g_urcs) / sizeof(g_urcs[0]); i++)
+    {
+      uint16_t n = strlen(g_urcs[i]);
+
+      if (g->line_len < n || memcmp(g->line, g_urcs[i], n) != 0 ||
+          (g->line_len > n && g->line[n] != ':'))
+        {
+          continue;
+        }
+
+      return !g->busy || cmd->text_len < n + 2 ||
+             strncasecmp((const char *)cmd->data + 2, g_urcs[i], n) != 0;
+    }
+
+  return false;
+}
+
+static void prv_fromParserLine(iotpf_atbin_t *g)
+{
+  bool urc = prv_unsolicited(g);
+  uint8_t tag = g->busy && !urc ? g->queue[g->head].tag : 0;
+  bool final = iotpf_atbin_final(g->line, g->line_len);
+  uint16_t blob_at = 0;
+  uint16_t blob_len = prv_extractHex(g, &blob_at);
+  uint32_t pos = 0;
+
+  /* Text too long for one frame goes out in pieces under the same tag */
+
+  if (blob_len == 0)
+    {
+      while (g->line_len - pos > IOTPF_ATBIN_MAX)
+        {
+          prv_reply(g, tag, g->line + pos, IOTPF_ATBIN_MAX, NULL, 0, 0);
+          pos += IOTPF_ATBIN_MAX;
+        }
+    }
+  prv_reply(g, tag, g->line + pos, g->line_len - pos, g->blob, blob_len,
+            blob_at);
+
+  if (final && g->busy && !urc)
+    {
+      prv_done(g);
+    }
+}
+
+static void prv_fromParser(iotpf_atbin_t *g, const uint8_t *buf, int len)
+{
+  int i;
+
+  if (!g->binary)
+    {
+      prv_write(g->uart, buf, len);
+      return;
+    }
+
+  for (i = 0; i < len; i++)
+    {
+      if (buf[i] == '\n' || g->line_len == sizeof(g->line))
+        {
+          if (g->line_len > 0 && g->line[g->line_len - 1] == '\r')
+            {
+              g->line_len--;
+            }
+          if (g->line_len > 0)
+            {
+              prv_fromParserLine(g);
+            }
+          g->line_len = 0;
+          if (buf[i] == '\n')
+            {
+              continue;
+            }
+        }
+      g->line[g->line_len++] = buf[i];
+    }
+}
+
+static void *prv_atbin_thread(void *arg)
+{
+  iotpf_atbin_t *g = (iotpf_atbin_t *)arg;
+  uint8_t buf[128];
+
+  pthread_setname_np(pthread_self(), "iotpf_atbin");
+  for (; ; )
+    {
+      struct timeval tv;
+      fd_set readfds;
+      int maxfd = g->uart > g->pty ? g->uart : g->pty;
+      int ret;
+
+      FD_ZERO(&readfds);
+      FD_SET(g->uart, &readfds);
+      FD_SET(g->pty, &readfds);
+      if (g->busy)
+        {
+          uint32_t elapsed = cissys_gettime() - g->busy_since;
+          uint32_t left = elapsed < IOTPF_ATBIN_TIMEOUT_MS ?
+                          IOTPF_ATBIN_TIMEOUT_MS - elapsed : 0;
+
+          tv.tv_sec = left / 1000;
+          tv.tv_usec = (left % 1000) * 1000;
+        }
+
+      ret = select(maxfd + 1, &readfds, NULL, NULL, g->busy ? &tv : NULL);
+      if (ret < 0)
+        {
+          if (errno == EINTR)
+            {
+              continue;
+            }
+          LOGE("atbin: select: %d", errno);
+          break;
+        }
+
+      if (FD_ISSET(g->uart, &readfds))
+        {
+          ret = read(g->uart, g->rx + g->rx_len, sizeof(g->rx) - g->rx_len);
+          if (ret > 0)
+            {
+              g->rx_len += ret;
+              if (g->binary)
+                {
+                  prv_fromHostBinary(g);
+                }
+              else
+                {
+                  prv_fromHostText(g);
+                }
+            }
+        }
+
+      if (FD_ISSET(g->pty, &readfds))
+        {
+          ret = read(g->pty, buf, sizeof(buf));
+          if (ret > 0)
+            {
+              prv_fromParser(g, buf, ret);
+            }
+        }
+
+      if (g->busy &&
+          cissys_gettime() - g->busy_since >= IOTPF_ATBIN_TIMEOUT_MS)
+        {
+          LOGE("atbin: no reply to tag %u", g->queue[g->head].tag);
+          prv_replyText(g, g->queue[g->head].tag, "+IOTPFBIN ERROR: timeout");
+          prv_done(g);
+        }
+    }
+
+  return NULL;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* CRC-16/CCITT-FALSE (poly 0x1021), start with 0xffff */
+
+uint16_t iotpf_atbin_crc(uint16_t crc, const uint8_t *data, uint32_t len)
+{
+  while (len-- > 0)
+    {
+      crc = (crc << 4) ^ g_crc_nibble[(crc >> 12) ^ (*data >> 4)];
+      crc = (crc << 4) ^ g_crc_nibble[(crc >> 12) ^ (*data & 0x0f)];
+      data++;
+    }
+
+  return crc;
+}
+
+/* Returns the frame length, or -1 when it does not fit in size */
+
+int iotpf_atbin_encode(uint8_t tag, const char *text, uint16_t text_len,
+                       const uint8_t *blob, uint16_t blob_len,
+                       uint16_t blob_at, uint8_t *out, uint32_t size)
+{
+  uint32_t len = IOTPF_ATBIN_OVERHEAD + text_len + blob_len;
+  uint16_t crc;
+
+  if (len > size || text_len + blob_len > IOTPF_ATBIN_MAX ||
+      blob_at > text_len)
+    {
+      return -1;
+    }
+
+  out[0] = IOTPF_ATBIN_SYNC;
+  out[1] = tag;
+  out[2] = text_len >> 8;
+  out[3] = text_len & 0xff;
+  out[4] = blob_len >> 8;
+  out[5] = blob_len & 0xff;
+  out[6] = blob_at >> 8;
+  out[7] = blob_at & 0xff;
+  memcpy(out + IOTPF_ATBIN_HDR_LEN, text, text_len);
+  memcpy(out + IOTPF_ATBIN_HDR_LEN + text_len, blob, blob_len);
+  crc = iotpf_atbin_crc(0xffff, out + 1, len - IOTPF_ATBIN_CRC_LEN - 1);
+  out[len - 2] = crc >> 8;
+  out[len - 1] = crc & 0xff;
+  return len;
+}
+
+/* Returns the bytes one whole frame at buf takes, 0 when more are needed
+ * and -1 when buf does not start a valid frame. On -1 frame->tag is the
+ * frame's tag if only the CRC failed, 0 otherwise.
+ */
+
+int iotpf_atbin_decode(iotpf_atbin_frame_t *frame, const uint8_t *buf,
+                       uint32_t len)
+{
+  uint32_t total;
+  uint16_t crc;
+
+  frame->tag = 0;
+  if (len < 1)
+    {
+      return 0;
+    }
+  if (buf[0] != IOTPF_ATBIN_SYNC)
+    {
+      return -1;
+    }
+  if (len < IOTPF_ATBIN_HDR_LEN)
+    {
+      return 0;
+    }
+
+  frame->text_len = (buf[2] << 8) | buf[3];
+  frame->blob_len = (buf[4] << 8) | buf[5];
+  frame->blob_at = (buf[6] << 8) | buf[7];
+  if (frame->text_len + frame->blob_len > IOTPF_ATBIN_MAX ||
+      frame->blob_at > frame->text_len)
+    {
+      return -1;
+    }
+
+  total = IOTPF_ATBIN_OVERHEAD + frame->text_len + frame->blob_len;
+  if (len < total)
+    {
+      return 0;
+    }
+
+  frame->tag = buf[1];
+  crc = iotpf_atbin_crc(0xffff, buf + 1, total - IOTPF_ATBIN_CRC_LEN - 1);
+  if (buf[total - 2] != (crc >> 8) || buf[total - 1] != (crc & 0xff))
+    {
+      return -1;
+    }
+
+  frame->text = buf + IOTPF_ATBIN_HDR_LEN;
+  frame->blob = frame->text + frame->text_len;
+  return total;
+}
+
+/* Final result codes end a command, anything else is an information or
+ * unsolicited line.
+ */
+
+bool iotpf_atbin_final(const char *text, uint16_t len)
+{
+  static const char *const finals[] =
+  {
+    "OK", "ERROR", "+CME ERROR", "+CMS ERROR", "+CIS ERROR",
+    "+IOTPFBIN ERROR",
+  };
+  uint8_t i;
+
+  for (i = 0; i < sizeof(finals) / sizeof(finals[0]); i++)
+    {
+      uint16_t n = strlen(finals[i]);
+
+      if (len >= n && memcmp(text, finals[i], n) == 0 &&
+          (len == n || text[n] == ':'))
+        {
+          return true;
+        }
+    }
+
+  return false;
+}
+
+/* Put the gateway between the host MCU's UART and the AT parser. Returns
+ * the descriptor the parser should read its commands from instead of the
+ * UART.
+ */
+
+int iotpf_atbin_start(int uart)
+{
+  iotpf_atbin_t *g = &g_atbin;
+  struct termios tio;
+  int master;
+  int slave;
+
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+    {
+      LOGE("atbin: no pty: %d", errno);
+      goto errout;
+    }
+
+  slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  if (slave < 0)
+    {
+      LOGE("atbin: open %s: %d", ptsname(master), errno);
+      goto errout;
+    }
+
+  /* The parser sees exactly the bytes we write, no echo or CR mapping */
+
+  if (tcgetattr(slave, &tio) == 0)
+    {
+      cfmakeraw(&tio);
+      tcsetattr(slave, TCSANOW, &tio);
+    }
+
+  memset(g, 0, sizeof(*g));
+  g->uart = uart;
+  g->pty = master;
+  if (pthread_create(&g_atbin_tid, NULL, prv_atbin_thread, g) != 0)
+    {
+      close(slave);
+      goto errout;
+    }
+
+  pthread_detach(g_atbin_tid);
+  return slave;
+
+errout:
+  if (master >= 0)
+    {
+      close(master);
+    }
+  return CIS_RET_ERROR;
+}
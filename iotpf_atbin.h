@@ -0,0 +1,94 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_atbin.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef _IOTPF_ATBIN_H_
+#define _IOTPF_ATBIN_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Binary data mode for the two-MCU AT link. The host MCU switches it on
+ * with AT+IOTPFBIN=1 and from then on sends every command as a frame:
+ *
+ *   0xa5, tag, text length, blob length, blob offset, text, blob, crc
+ *
+ * with big endian 16 bit lengths and a CRC-16/CCITT over everything after
+ * the sync byte. The blob is raw payload; on its way to the AT parser it
+ * is hex encoded and inserted into the text at the blob offset, so
+ *
+ *   AT+MIPLNOTIFY=0,1,3311,0,5701,1,4,"",0,0  offset 35, blob 4 bytes
+ *
+ * reaches the parser as ...,4,"deadbeef",0,0. Replies come back the same
+ * way, a quoted hex string in a reply line arriving as a blob.
+ *
+ * Commands may be sent without waiting for the previous reply. They are
+ * queued, handed to the AT parser one at a time, and every reply line is
+ * framed with the tag of the command it answers. Unsolicited result codes
+ * (+MIPLREAD, +CEREG and the like) and lines while no command is
+ * outstanding carry tag 0. A command is done once a frame with OK, ERROR,
+ * +CME ERROR, +CIS ERROR or +IOTPFBIN ERROR carries its tag; a frame that
+ * arrives damaged is answered with +IOTPFBIN ERROR: frame under its tag
+ * when its header is intact, tag 0 otherwise.
+ * AT+IOTPFBIN=0 in a frame returns to plain text.
+ */
+
+#define IOTPF_ATBIN_SYNC          0xa5
+#define IOTPF_ATBIN_HDR_LEN       8
+#define IOTPF_ATBIN_CRC_LEN       2
+#define IOTPF_ATBIN_OVERHEAD      (IOTPF_ATBIN_HDR_LEN + IOTPF_ATBIN_CRC_LEN)
+
+#ifndef CONFIG_SERVICES_IOTPF_AT_BINARY_MAX
+#define CONFIG_SERVICES_IOTPF_AT_BINARY_MAX     512
+#endif
+
+typedef struct iotpf_atbin_frame_s
+{
+  uint8_t tag;
+  uint16_t text_len;
+  uint16_t blob_len;
+  uint16_t blob_at;        /* offset into text the blob belongs at */
+  const uint8_t *text;     /* point into the decoded buffer */
+  const uint8_t *blob;
+} iotpf_atbin_frame_t;
+
+uint16_t iotpf_atbin_crc(uint16_t crc, const uint8_t *data, uint32_t len);
+int iotpf_atbin_encode(uint8_t tag, const char *text, uint16_t text_len,
+                       const uint8_t *blob, uint16_t blob_len,
+                       uint16_t blob_at, uint8_t *out, uint32_t size);
+int iotpf_atbin_decode(iotpf_atbin_frame_t *frame, const uint8_t *buf,
+                       uint32_t len);
+bool iotpf_atbin_final(const char *text, uint16_t len);
+int iotpf_atbin_start(int uart);
+
+#endif /* _IOTPF_ATBIN_H_ */
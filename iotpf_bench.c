@@ -0,0 +1,455 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_bench.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "cis_api.h"
+#include "cis_log.h"
+#include "iotpf_bench.h"
+#include "iotpf_rel.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#define IOTPF_BENCH_SIZE_MAX      1024
+
+/* ACK latencies kept for the percentiles; past this, reservoir sampling */
+
+#define IOTPF_BENCH_SAMPLES       1024
+
+/* Uplinks waiting for their ACK that can be timed */
+
+#define IOTPF_BENCH_INFLIGHT      64
+
+#define IOTPF_BENCH_PROGRESS_MS   10000
+#define IOTPF_BENCH_DRAIN_MS      10000
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+typedef struct iotpf_bench_s
+{
+  iotpf_bench_config_t cfg;
+  pthread_mutex_t lock;
+  bool active;
+  uint32_t queued;
+  uint32_t sent;
+  uint32_t nons;            /* of them sent NON, nothing to wait for */
+  uint32_t failed;          /* refused by cis_notify_raw() */
+  uint32_t acked;
+  uint32_t ack_failed;      /* CIS_EVENT_NOTIFY_FAILED */
+  uint32_t untimed;         /* acks with no send time left to match */
+  uint32_t rounds;          /* notification rounds queued */
+  uint32_t late;            /* ticks the generator could not keep */
+  uint32_t depth_max;       /* uplinks queued but not yet handed over */
+  uint32_t inflight[IOTPF_BENCH_INFLIGHT];
+  uint8_t head;
+  uint8_t count;
+  uint16_t samples[IOTPF_BENCH_SAMPLES];
+  uint32_t nsamples;        /* latencies seen, kept or not */
+  int heap_start;
+  int heap_max;
+} iotpf_bench_t;
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static iotpf_bench_t g_bench =
+{
+  .cfg = { 64, 10, 1, 0, 60, 0, 0 },
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static int prv_heap_used(void)
+{
+  struct mallinfo info = mallinfo();
+
+  return info.uordblks;
+}
+
+static int prv_cmp(const void *a, const void *b)
+{
+  return *(const uint16_t *)a - *(const uint16_t *)b;
+}
+
+static uint16_t prv_percentile(const uint16_t *sorted, uint32_t n,
+                               uint32_t pct)
+{
+  return n ? sorted[(n - 1) * pct / 100] : 0;
+}
+
+static void prv_report(uint32_t elapsed)
+{
+  iotpf_bench_t *b = &g_bench;
+  uint64_t rate10 = elapsed ? (uint64_t)b->sent * 10000 / elapsed : 0;
+  uint32_t answered;
+  uint32_t n;
+
+  pthread_mutex_lock(&b->lock);
+  answered = b->acked + b->ack_failed + b->nons;
+  n = b->nsamples < IOTPF_BENCH_SAMPLES ? b->nsamples : IOTPF_BENCH_SAMPLES;
+  qsort(b->samples, n, sizeof(b->samples[0]), prv_cmp);
+
+  printf("bench: %u B at %u/s, burst %u, observe %u, con every %u, "
+         "alarm every %u, %u.%03u s\n", b->cfg.size, b->cfg.rate,
+         b->cfg.burst, b->cfg.observe, b->cfg.con, b->cfg.alarm,
+         elapsed / 1000, elapsed % 1000);
+  printf("uplinks         queued %u sent %u (non %u) failed %u, %u.%u msg/s\n",
+         b->queued, b->sent, b->nons, b->failed, (uint32_t)(rate10 / 10),
+         (uint32_t)(rate10 % 10));
+  printf("acks            %u failed %u unacked %u untimed %u\n", b->acked,
+         b->ack_failed, b->sent > answered ? b->sent - answered : 0,
+         b->untimed);
+  printf("ack latency     p50 %u p90 %u p99 %u max %u ms, %u samples\n",
+         prv_percentile(b->samples, n, 50), prv_percentile(b->samples, n, 90),
+         prv_percentile(b->samples, n, 99), prv_percentile(b->samples, n, 100),
+         b->nsamples);
+  printf("notifications   %u rounds\n", b->rounds);
+  printf("queue           high-water %u, late ticks %u\n", b->depth_max,
+         b->late);
+  printf("heap            %d B at start, high-water +%d B\n", b->heap_start,
+         b->heap_max - b->heap_start);
+  fflush(stdout);
+  pthread_mutex_unlock(&b->lock);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void iotpf_bench_usage(void)
+{
+  LOGI("iotpf bench [-s size] [-r rate] [-b burst] [-o rounds] [-d seconds]");
+  LOGI("            [-c con] [-a alarm]");
+  LOGI("  uplink size bytes payloads at rate per second, burst at a time,");
+  LOGI("  rounds object notification rounds per burst, for seconds;");
+  LOGI("  CON every con uplinks (1 all, 0 none), every alarm-th one CON");
+}
+
+/* argv[0] is "bench" */
+
+int iotpf_bench_parse(int argc, char *argv[])
+{
+  iotpf_bench_config_t *cfg = &g_bench.cfg;
+  int i;
+
+  cfg->con = iotpf_rel_every();
+  for (i = 1; i + 1 < argc; i += 2)
+    {
+      uint32_t value = strtoul(argv[i + 1], NULL, 0);
+
+      if (strcmp(argv[i], "-s") == 0)
+        {
+          cfg->size = value;
+        }
+      else if (strcmp(argv[i], "-r") == 0)
+        {
+          cfg->rate = value;
+        }
+      else if (strcmp(argv[i], "-b") == 0)
+        {
+          cfg->burst = value;
+        }
+      else if (strcmp(argv[i], "-o") == 0)
+        {
+          cfg->observe = value;
+        }
+      else if (strcmp(argv[i], "-d") == 0)
+        {
+          cfg->duration = value;
+        }
+      else if (strcmp(argv[i], "-c") == 0)
+        {
+          cfg->con = value;
+        }
+      else if (strcmp(argv[i], "-a") == 0)
+        {
+          cfg->alarm = value;
+        }
+      else
+        {
+          return CIS_RET_ERROR;
+        }
+    }
+
+  if (i != argc || cfg->size < 1 || cfg->size > IOTPF_BENCH_SIZE_MAX ||
+      cfg->rate < 1 || cfg->burst < 1 || cfg->burst > cfg->rate ||
+      cfg->duration < 1 || cfg->con > UINT16_MAX)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  iotpf_rel_set_every(cfg->con);
+  return CIS_RET_OK;
+}
+
+/* Runs on the user send thread in place of the periodic report */
+
+void iotpf_bench_run(iotpf_bench_send_t send, void *priv)
+{
+  iotpf_bench_t *b = &g_bench;
+  uint32_t period = 1000000ull * b->cfg.burst / b->cfg.rate;   /* us */
+  uint64_t next = 0;                                            /* us */
+  uint64_t at;
+  uint32_t start;
+  uint32_t progress;
+  uint32_t seq = 0;
+  uint32_t now;
+  uint8_t *data;
+  uint32_t i;
+
+  data = malloc(b->cfg.size);
+  if (data == NULL)
+    {
+      return;
+    }
+  for (i = 0; i < b->cfg.size; i++)
+    {
+      data[i] = i;
+    }
+
+  pthread_mutex_lock(&b->lock);
+  b->heap_start = prv_heap_used();
+  b->heap_max = b->heap_start;
+  b->active = true;
+  pthread_mutex_unlock(&b->lock);
+
+  LOGI("bench: %u B at %u/s, burst %u, observe %u, con every %u, "
+       "alarm every %u, for %u s", b->cfg.size, b->cfg.rate, b->cfg.burst,
+       b->cfg.observe, b->cfg.con, b->cfg.alarm, b->cfg.duration);
+
+  start = cissys_gettime();
+  progress = start + IOTPF_BENCH_PROGRESS_MS;
+  while ((now = cissys_gettime()) - start < b->cfg.duration * 1000)
+    {
+      int heap;
+
+      /* The schedule runs in microseconds since start: rates above one
+       * burst per millisecond still get a period
+       */
+
+      at = (uint64_t)(now - start) * 1000;
+      if (next > at)
+        {
+          usleep(next - at);
+          continue;
+        }
+
+      /* Sequence number and send time up front, for the server side */
+
+      for (i = 0; i < b->cfg.burst; i++, seq++)
+        {
+          uint32_t stamp = cissys_gettime();
+
+          memcpy(data, &seq, b->cfg.size < 4 ? b->cfg.size : 4);
+          if (b->cfg.size >= 8)
+            {
+              memcpy(data + 4, &stamp, 4);
+            }
+          pthread_mutex_lock(&b->lock);
+          b->queued++;
+          if (b->queued - b->sent - b->failed > b->depth_max)
+            {
+              b->depth_max = b->queued - b->sent - b->failed;
+            }
+          pthread_mutex_unlock(&b->lock);
+          send(priv, data, b->cfg.size,
+               b->cfg.alarm > 0 && seq % b->cfg.alarm == b->cfg.alarm - 1);
+        }
+      for (i = 0; i < b->cfg.observe; i++)
+        {
+          b->rounds++;
+          send(priv, NULL, 0, false);
+        }
+
+      heap = prv_heap_used();
+      pthread_mutex_lock(&b->lock);
+      if (heap > b->heap_max)
+        {
+          b->heap_max = heap;
+        }
+      pthread_mutex_unlock(&b->lock);
+
+      /* Behind by a whole tick, beyond the clock's millisecond: count it
+       * and do not try to catch up
+       */
+
+      next += period;
+      now = cissys_gettime();
+      at = (uint64_t)(now - start) * 1000;
+      if (at >= next + period + 1000)
+        {
+          b->late++;
+          next = at;
+        }
+
+      if ((int32_t)(now - progress) >= 0)
+        {
+          progress += IOTPF_BENCH_PROGRESS_MS;
+          LOGI("bench: %u s, sent %u acked %u failed %u",
+               (now - start) / 1000, b->sent, b->acked,
+               b->failed + b->ack_failed);
+        }
+    }
+
+  /* Give the last uplinks a chance to be ACKed */
+
+  now = cissys_gettime();
+  while (cissys_gettime() - now < IOTPF_BENCH_DRAIN_MS &&
+         b->acked + b->ack_failed + b->failed + b->nons < b->queued)
+    {
+      usleep(100 * 1000);
+    }
+
+  prv_report(now - start);
+  pthread_mutex_lock(&b->lock);
+  b->active = false;
+  pthread_mutex_unlock(&b->lock);
+  free(data);
+}
+
+/* Around cis_notify_raw() of one uplink. The send time is taken before
+ * the call, the ACK can be handled before the call returns. NON uplinks
+ * get no ACK and are not timed.
+ */
+
+void iotpf_bench_sending(bool con)
+{
+  iotpf_bench_t *b = &g_bench;
+
+  pthread_mutex_lock(&b->lock);
+  if (b->active && con && b->count < IOTPF_BENCH_INFLIGHT)
+    {
+      b->inflight[(b->head + b->count++) % IOTPF_BENCH_INFLIGHT] =
+        cissys_gettime();
+    }
+  pthread_mutex_unlock(&b->lock);
+}
+
+void iotpf_bench_sent(bool ok, bool con)
+{
+  iotpf_bench_t *b = &g_bench;
+
+  pthread_mutex_lock(&b->lock);
+  if (!b->active)
+    {
+      pthread_mutex_unlock(&b->lock);
+      return;
+    }
+
+  if (ok)
+    {
+      b->sent++;
+      b->nons += !con;
+    }
+  else
+    {
+      /* Nothing went out, so nothing will be ACKed: forget its time */
+
+      b->failed++;
+      if (con && b->count > 0)
+        {
+          b->count--;
+        }
+    }
+  pthread_mutex_unlock(&b->lock);
+}
+
+/* Raw uplink ACKs carry no message id of their own, so they are matched
+ * to the sends in order.
+ */
+
+void iotpf_bench_acked(bool ok)
+{
+  iotpf_bench_t *b = &g_bench;
+  uint32_t latency;
+  uint32_t slot;
+
+  pthread_mutex_lock(&b->lock);
+  if (!b->active)
+    {
+      pthread_mutex_unlock(&b->lock);
+      return;
+    }
+
+  if (ok)
+    {
+      b->acked++;
+    }
+  else
+    {
+      b->ack_failed++;
+    }
+
+  if (b->count == 0)
+    {
+      b->untimed++;
+      pthread_mutex_unlock(&b->lock);
+      return;
+    }
+
+  latency = cissys_gettime() - b->inflight[b->head];
+  b->head = (b->head + 1) % IOTPF_BENCH_INFLIGHT;
+  b->count--;
+  if (ok)
+    {
+      slot = b->nsamples < IOTPF_BENCH_SAMPLES ? b->nsamples :
+             (uint32_t)rand() % (b->nsamples + 1);
+      if (slot < IOTPF_BENCH_SAMPLES)
+        {
+          b->samples[slot] = latency < UINT16_MAX ? latency : UINT16_MAX;
+        }
+      b->nsamples++;
+    }
+  pthread_mutex_unlock(&b->lock);
+}
@@ -0,0 +1,83 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_bench.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef _IOTPF_BENCH_H_
+#define _IOTPF_BENCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* `iotpf bench` replaces the fixed report of the user send thread with a
+ * load generator: payloads of a given size at a given rate, in bursts,
+ * optionally followed by object notification rounds, for a while. Raw
+ * uplinks go through the normal queue and pump; at the end the achieved
+ * rate, the ACK latency percentiles, the drops and the heap high-water
+ * are printed. Latency assumes one ACK per uplink, so keep -s within one
+ * block when SERVICES_IOTPF_BLOCKWISE is on. Uplinks are telemetry for
+ * the CON/NON policy of iotpf_rel.h, every -a th one an alarm; only the
+ * CON ones are timed.
+ */
+
+#define IOTPF_MODE_BENCH          2
+
+typedef struct iotpf_bench_config_s
+{
+  uint32_t size;       /* -s payload bytes */
+  uint32_t rate;       /* -r uplinks per second */
+  uint32_t burst;      /* -b uplinks sent back to back per tick */
+  uint32_t observe;    /* -o object notification rounds per tick */
+  uint32_t duration;   /* -d seconds */
+  uint32_t con;        /* -c CON every that many telemetry uplinks */
+  uint32_t alarm;      /* -a every that many uplinks is an alarm, 0 none */
+} iotpf_bench_config_t;
+
+/* Queues one uplink; data NULL queues a notification round instead */
+
+typedef void (*iotpf_bench_send_t)(void *priv, const void *data,
+                                   uint32_t len, bool alarm);
+
+#ifdef CIS_BENCH
+int iotpf_bench_parse(int argc, char *argv[]);
+void iotpf_bench_usage(void);
+void iotpf_bench_run(iotpf_bench_send_t send, void *priv);
+void iotpf_bench_sending(bool con);
+void iotpf_bench_sent(bool ok, bool con);
+void iotpf_bench_acked(bool ok);
+#else
+#  define iotpf_bench_sending(con)  ((void)0)
+#  define iotpf_bench_sent(ok, con) ((void)0)
+#  define iotpf_bench_acked(ok)     ((void)0)
+#endif
+
+#endif /* _IOTPF_BENCH_H_ */
@@ -0,0 +1,212 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_block.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cis_api.h"
+#include "cis_log.h"
+#include "iotpf_block.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SERVICES_IOTPF_BLOCK_SZX
+#define CONFIG_SERVICES_IOTPF_BLOCK_SZX    3
+#endif
+
+#define IOTPF_BLOCK_RETRY                  3
+#define IOTPF_BLOCK_RETRY_MS               2000
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Only the user send thread sends, one block at a time */
+
+static uint8_t g_block_frame[IOTPF_BLOCK_HDR_LEN +
+                             IOTPF_BLOCK_SIZE(CONFIG_SERVICES_IOTPF_BLOCK_SZX)];
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+uint32_t iotpf_block_encode(uint32_t num, bool more, uint8_t szx)
+{
+  return (num << 4) | (more ? 0x08 : 0) | (szx & 0x07);
+}
+
+void iotpf_block_decode(uint32_t value, uint32_t *num, bool *more,
+                        uint8_t *szx)
+{
+  *num = value >> 4;
+  *more = (value & 0x08) != 0;
+  *szx = value & 0x07;
+}
+
+/* Pull the payload block by block from read() so the caller never has to
+ * hold more than one block, and hand each framed block to send(). The next
+ * block only goes once send() saw this one acknowledged; a block that was
+ * not is sent again after IOTPF_BLOCK_RETRY_MS, doubled on every retry.
+ */
+
+int iotpf_block_send(uint8_t szx, uint32_t total, iotpf_block_read_t read,
+                     iotpf_block_send_t send, void *priv)
+{
+  uint32_t size;
+  uint32_t offset = 0;
+  uint32_t num = 0;
+  uint32_t start;
+  uint32_t value;
+  uint32_t retries;
+  uint32_t len;
+  int ret;
+
+  if (szx > CONFIG_SERVICES_IOTPF_BLOCK_SZX)
+    {
+      szx = CONFIG_SERVICES_IOTPF_BLOCK_SZX;
+    }
+  size = IOTPF_BLOCK_SIZE(szx);
+
+  do
+    {
+      len = total - offset < size ? total - offset : size;
+      ret = read(priv, offset, g_block_frame + IOTPF_BLOCK_HDR_LEN, len);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      value = iotpf_block_encode(num, offset + len < total, szx);
+      g_block_frame[0] = IOTPF_BLOCK_TAG_BLOCK2;
+      g_block_frame[1] = (value >> 16) & 0xff;
+      g_block_frame[2] = (value >> 8) & 0xff;
+      g_block_frame[3] = value & 0xff;
+
+      for (retries = 0; ; retries++)
+        {
+          start = cissys_gettime();
+          ret = send(priv, g_block_frame, IOTPF_BLOCK_HDR_LEN + len);
+          if (ret == CIS_RET_OK || retries == IOTPF_BLOCK_RETRY)
+            {
+              break;
+            }
+
+          LOGW("block2 %u not acknowledged, retry in %u ms",
+               num, IOTPF_BLOCK_RETRY_MS << retries);
+          usleep((IOTPF_BLOCK_RETRY_MS << retries) * 1000);
+        }
+
+      if (ret != CIS_RET_OK)
+        {
+          LOGE("block2 %u: given up after %u retries", num, retries);
+          return ret;
+        }
+
+      LOGI("block2 %u: %u bytes acknowledged in %u ms, %u retries",
+           num, len, cissys_gettime() - start, retries);
+
+      offset += len;
+      num++;
+    }
+  while (offset < total);
+
+  return CIS_RET_OK;
+}
+
+/* Hands each block in sequence to write() as it arrives, nothing is
+ * buffered here. Returns 1 once the last block was written and 0 while
+ * more are expected. Otherwise returns the completion code to answer the
+ * frame with, and the transfer restarts: IOTPF_BLOCK_INCOMPLETE for a
+ * block out of sequence, IOTPF_BLOCK_TOO_LARGE when write() refused the
+ * block.
+ */
+
+int iotpf_block_receive(iotpf_block_t *blk, const uint8_t *frame,
+                        uint32_t len, iotpf_block_write_t write, void *priv)
+{
+  uint32_t value;
+  uint32_t num;
+  bool more;
+  uint8_t szx;
+
+  if (len < IOTPF_BLOCK_HDR_LEN)
+    {
+      return IOTPF_BLOCK_BAD_FRAME;
+    }
+
+  value = (frame[1] << 16) | (frame[2] << 8) | frame[3];
+  iotpf_block_decode(value, &num, &more, &szx);
+
+  if (num == 0)
+    {
+      blk->num = 0;
+      blk->offset = 0;
+      blk->start = cissys_gettime();
+    }
+
+  if (num != blk->num || szx > IOTPF_BLOCK_SZX_MAX)
+    {
+      LOGE("block1 %u out of sequence, expect %u", num, blk->num);
+      blk->num = 0;
+      blk->offset = 0;
+      return IOTPF_BLOCK_INCOMPLETE;
+    }
+
+  if (write(priv, blk->offset, frame + IOTPF_BLOCK_HDR_LEN,
+            len - IOTPF_BLOCK_HDR_LEN, more) < 0)
+    {
+      LOGE("block1 %u: refused at %u bytes", num, blk->offset);
+      blk->num = 0;
+      blk->offset = 0;
+      return IOTPF_BLOCK_TOO_LARGE;
+    }
+
+  blk->offset += len - IOTPF_BLOCK_HDR_LEN;
+  blk->num++;
+  if (more)
+    {
+      return 0;
+    }
+
+  LOGI("block1 done: %u bytes in %u blocks, %u ms",
+       blk->offset, blk->num, cissys_gettime() - blk->start);
+  blk->num = 0;
+  return 1;
+}
@@ -0,0 +1,99 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_block.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _IOTPF_BLOCK_H_
+#define _IOTPF_BLOCK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Block-wise transfer of raw payloads larger than one datagram, with the
+ * NUM/M/SZX block numbering of RFC 7959 carried inside the raw payload:
+ * iotpf_lib has no Block1/Block2 options for raw data, so this is not
+ * RFC 7959 on the wire and the platform side has to speak it. Every frame
+ * starts with a tag byte and the 3 byte block value, then up to
+ * IOTPF_BLOCK_SIZE(szx) bytes of payload.
+ *
+ * Raw payloads starting with a reserved byte (0xb0..0xb3) are framed: a
+ * block frame, or a plain payload behind IOTPF_BLOCK_TAG_ESC. Senders put
+ * the escape byte in front of a plain payload that starts with a reserved
+ * byte itself, so no plain payload is ever taken for a block frame.
+ */
+
+#define IOTPF_BLOCK_TAG_ESC        0xb0 /* plain payload follows */
+#define IOTPF_BLOCK_TAG_BLOCK1     0xb1 /* server to device */
+#define IOTPF_BLOCK_TAG_BLOCK2     0xb2 /* device to server */
+#define IOTPF_BLOCK_RESERVED(b)    (((b) & 0xfc) == 0xb0)
+#define IOTPF_BLOCK_HDR_LEN        4
+#define IOTPF_BLOCK_SZX_MAX        6
+#define IOTPF_BLOCK_SIZE(szx)      (1 << ((szx) + 4))
+
+/* Completion codes a refused block1 frame is answered with */
+
+#define IOTPF_BLOCK_BAD_FRAME      0x80 /* 4.00 Bad Request */
+#define IOTPF_BLOCK_INCOMPLETE     0x88 /* 4.08 Request Entity Incomplete */
+#define IOTPF_BLOCK_TOO_LARGE      0x8d /* 4.13 Request Entity Too Large */
+
+typedef int (*iotpf_block_read_t)(void *priv, uint32_t offset,
+                                  uint8_t *buf, uint32_t len);
+/* Takes each received block as it arrives; more is false for the last.
+ * A block at offset 0 starts the payload over.
+ */
+
+typedef int (*iotpf_block_write_t)(void *priv, uint32_t offset,
+                                   const uint8_t *buf, uint32_t len,
+                                   bool more);
+
+/* Sends one frame and returns CIS_RET_OK once the server acknowledged it */
+
+typedef int (*iotpf_block_send_t)(void *priv, const uint8_t *frame,
+                                  uint32_t len);
+
+typedef struct iotpf_block_s
+{
+  uint32_t num;      /* next block expected */
+  uint32_t offset;   /* bytes written so far */
+  uint32_t start;    /* cissys_gettime() of block 0 */
+} iotpf_block_t;
+
+uint32_t iotpf_block_encode(uint32_t num, bool more, uint8_t szx);
+void iotpf_block_decode(uint32_t value, uint32_t *num, bool *more,
+                        uint8_t *szx);
+int iotpf_block_send(uint8_t szx, uint32_t total, iotpf_block_read_t read,
+                     iotpf_block_send_t send, void *priv);
+int iotpf_block_receive(iotpf_block_t *blk, const uint8_t *frame,
+                        uint32_t len, iotpf_block_write_t write, void *priv);
+
+#endif /* _IOTPF_BLOCK_H_ */
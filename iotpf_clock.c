@@ -0,0 +1,269 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_clock.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "cis_log.h"
+#include "iotpf_clock.h"
+#include "iotpf_stats.h"
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* UTC at mono is utc; it runs 1 - drift_ppb / 10^9 times as fast as the
+ * monotonic clock, minus slew_ms still to be taken out
+ */
+
+typedef struct clock_base_s
+{
+  uint64_t mono;
+  uint64_t utc;             /* 0 before the first reference */
+  int32_t drift_ppb;
+  int32_t slew_ms;
+} clock_base_t;
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Readers copy g_clock_base while g_clock_seq is even and unchanged */
+
+static clock_base_t g_clock_base;
+static uint32_t g_clock_seq;
+
+/* Writer side, under g_clock_mutex */
+
+static pthread_mutex_t g_clock_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t g_clock_source;
+static uint64_t g_clock_ref_mono;
+static int32_t g_clock_error;
+static bool g_clock_freq;           /* drift_ppb has been measured */
+static uint8_t g_anchor_source;     /* the reference drift is measured from */
+static uint64_t g_anchor_mono;
+static uint64_t g_anchor_utc;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void prv_load(clock_base_t *base)
+{
+  uint32_t seq;
+
+  do
+    {
+      seq = __atomic_load_n(&g_clock_seq, __ATOMIC_ACQUIRE);
+      *base = *(volatile clock_base_t *)&g_clock_base;
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    }
+  while ((seq & 1) != 0 ||
+         __atomic_load_n(&g_clock_seq, __ATOMIC_RELAXED) != seq);
+}
+
+static void prv_store(const clock_base_t *base)
+{
+  __atomic_store_n(&g_clock_seq, g_clock_seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  *(volatile clock_base_t *)&g_clock_base = *base;
+  __atomic_store_n(&g_clock_seq, g_clock_seq + 1, __ATOMIC_RELEASE);
+}
+
+static uint64_t prv_utc_at(const clock_base_t *base, uint64_t mono)
+{
+  int64_t d = (int64_t)(mono - base->mono);
+  int64_t utc;
+
+  if (base->utc == 0)
+    {
+      return 0;
+    }
+
+  utc = base->utc + d - d * base->drift_ppb / 1000000000;
+  if (base->slew_ms > 0 && d > 0)
+    {
+      int64_t slew = d / 2000;
+
+      utc -= slew < base->slew_ms ? slew : base->slew_ms;
+    }
+
+  return utc;
+}
+
+static int32_t prv_clamp(int64_t v, int32_t max)
+{
+  return v > max ? max : v < -max ? -max : v;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+uint64_t iotpf_clock_mono_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint64_t iotpf_clock_utc_ms(void)
+{
+  return iotpf_clock_utc_at(iotpf_clock_mono_ms());
+}
+
+uint64_t iotpf_clock_utc_at(uint64_t mono_ms)
+{
+  clock_base_t base;
+
+  prv_load(&base);
+  return prv_utc_at(&base, mono_ms);
+}
+
+void iotpf_clock_reference(iotpf_clock_source_t source, uint64_t utc_ms,
+                           uint64_t mono_ms)
+{
+  clock_base_t base;
+  int64_t err = 0;
+
+  pthread_mutex_lock(&g_clock_mutex);
+  if (source < g_clock_source && g_clock_base.utc != 0 &&
+      mono_ms - g_clock_ref_mono <
+      (uint64_t)CONFIG_SERVICES_IOTPF_CLOCK_HOLDOVER * 1000)
+    {
+      pthread_mutex_unlock(&g_clock_mutex);
+      return;
+    }
+
+  base = g_clock_base;
+  IOTPF_STAT_INC(clock_refs);
+  if (base.utc != 0)
+    {
+      err = (int64_t)(utc_ms - prv_utc_at(&base, mono_ms));
+    }
+
+  if (base.utc == 0 || err > IOTPF_CLOCK_STEP_MS ||
+      err < -IOTPF_CLOCK_STEP_MS)
+    {
+      if (base.utc != 0)
+        {
+          LOGW("clock: stepped by %lld ms", (long long)err);
+          IOTPF_STAT_INC(clock_steps);
+        }
+
+      base.mono = mono_ms;
+      base.utc = utc_ms;
+      base.slew_ms = 0;
+      g_anchor_source = source;
+      g_anchor_mono = mono_ms;
+      g_anchor_utc = utc_ms;
+    }
+  else if (source == IOTPF_CLOCK_NET && err > -1000 && err < 1000)
+    {
+      /* Within the whole second network time is given in */
+    }
+  else
+    {
+      uint64_t now = prv_utc_at(&base, mono_ms);
+      int64_t span = (int64_t)(mono_ms - g_anchor_mono);
+
+      /* The rate comes from two raw references, whatever the phase
+       * corrections in between did
+       */
+
+      if (source != g_anchor_source)
+        {
+          g_anchor_source = source;
+          g_anchor_mono = mono_ms;
+          g_anchor_utc = utc_ms;
+        }
+      else if (span >= CONFIG_SERVICES_IOTPF_CLOCK_SPAN * 1000)
+        {
+          int32_t ppb;
+
+          ppb = prv_clamp((span - (int64_t)(utc_ms - g_anchor_utc)) *
+                          1000000000 / span, IOTPF_CLOCK_DRIFT_MAX);
+          base.drift_ppb = g_clock_freq ? (base.drift_ppb + ppb) / 2 : ppb;
+          g_clock_freq = true;
+          g_anchor_mono = mono_ms;
+          g_anchor_utc = utc_ms;
+        }
+
+      base.mono = mono_ms;
+      base.utc = err >= 0 ? utc_ms : now;
+      base.slew_ms = err >= 0 ? 0 : -err;
+    }
+
+  prv_store(&base);
+  g_clock_source = source;
+  g_clock_ref_mono = mono_ms;
+  g_clock_error = prv_clamp(err, INT32_MAX);
+  pthread_mutex_unlock(&g_clock_mutex);
+}
+
+void iotpf_clock_status(iotpf_clock_status_t *status)
+{
+  uint64_t mono = iotpf_clock_mono_ms();
+
+  pthread_mutex_lock(&g_clock_mutex);
+  status->source = g_clock_source;
+  status->drift_ppb = g_clock_base.drift_ppb;
+  status->last_error_ms = g_clock_error;
+  status->age_s = g_clock_source == IOTPF_CLOCK_NONE ? 0 :
+                  (mono - g_clock_ref_mono) / 1000;
+  pthread_mutex_unlock(&g_clock_mutex);
+}
+
+/* Days since 1970-01-01 of a proleptic Gregorian date, no tables and no
+ * libc: March based years put the leap day last
+ */
+
+uint64_t iotpf_clock_civil_ms(int year, int month, int day, int hour,
+                              int min, int sec, int ms)
+{
+  int y = year - (month <= 2);
+  int era = y / 400;
+  int yoe = y - era * 400;
+  int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  int64_t days = (int64_t)era * 146097 + doe - 719468;
+
+  return (((days * 24 + hour) * 60 + min) * 60 + sec) * 1000 + ms;
+}
@@ -0,0 +1,110 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_clock.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _IOTPF_CLOCK_H_
+#define _IOTPF_CLOCK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* UTC in milliseconds, disciplined from GPS fixes and network time over
+ * CLOCK_MONOTONIC. Every reference corrects the phase; references at
+ * least CONFIG_SERVICES_IOTPF_CLOCK_SPAN seconds apart from the same
+ * source also estimate how fast the monotonic clock runs against UTC, so
+ * the time keeps while there are no fixes. Corrections under
+ * IOTPF_CLOCK_STEP_MS never make the clock go back: forward ones apply at
+ * once, backward ones are slewed out by running 0.05% slow. Bigger ones
+ * step.
+ *
+ * Network time is only taken while GPS has not been seen for
+ * CONFIG_SERVICES_IOTPF_CLOCK_HOLDOVER seconds. Readers never block and
+ * do no calendar arithmetic.
+ */
+
+#ifndef CONFIG_SERVICES_IOTPF_CLOCK_SPAN
+#define CONFIG_SERVICES_IOTPF_CLOCK_SPAN          60
+#endif
+
+#ifndef CONFIG_SERVICES_IOTPF_CLOCK_HOLDOVER
+#define CONFIG_SERVICES_IOTPF_CLOCK_HOLDOVER      3600
+#endif
+
+#define IOTPF_CLOCK_STEP_MS       2000
+#define IOTPF_CLOCK_DRIFT_MAX     500000    /* ppb */
+
+/* In order of trust */
+
+typedef enum
+{
+  IOTPF_CLOCK_NONE = 0,
+  IOTPF_CLOCK_NET,          /* +CTZE, whole seconds */
+  IOTPF_CLOCK_GPS,
+} iotpf_clock_source_t;
+
+typedef struct iotpf_clock_status_s
+{
+  uint8_t source;           /* of the last reference taken */
+  int32_t drift_ppb;        /* monotonic clock fast against UTC when > 0 */
+  int32_t last_error_ms;    /* of the last reference, before correcting */
+  uint32_t age_s;           /* since the last reference */
+} iotpf_clock_status_t;
+
+uint64_t iotpf_clock_mono_ms(void);
+
+/* 0 until the first reference */
+
+uint64_t iotpf_clock_utc_ms(void);
+
+/* UTC of an earlier (or later) iotpf_clock_mono_ms() reading */
+
+uint64_t iotpf_clock_utc_at(uint64_t mono_ms);
+
+/* utc_ms was true at mono_ms; the caller samples mono_ms as close to the
+ * event as it can
+ */
+
+void iotpf_clock_reference(iotpf_clock_source_t source, uint64_t utc_ms,
+                           uint64_t mono_ms);
+
+void iotpf_clock_status(iotpf_clock_status_t *status);
+
+/* Calendar UTC to ms since 1970, for the references: year is 4 digits,
+ * month 1-12
+ */
+
+uint64_t iotpf_clock_civil_ms(int year, int month, int day, int hour,
+                              int min, int sec, int ms);
+
+#endif /* _IOTPF_CLOCK_H_ */
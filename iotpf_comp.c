@@ -0,0 +1,405 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_comp.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "iotpf_comp.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SERVICES_IOTPF_COMPRESS_KEY
+#define CONFIG_SERVICES_IOTPF_COMPRESS_KEY        8
+#endif
+
+#define IOTPF_COMP_HASH_BITS      8
+#define IOTPF_COMP_WINDOW         4096
+#define IOTPF_COMP_MATCH_MIN      3
+#define IOTPF_COMP_MATCH_MAX      18
+#define IOTPF_COMP_RUN_MAX        128
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static inline uint32_t prv_hash(const uint8_t *p)
+{
+  uint32_t v = p[0] | p[1] << 8 | p[2] << 16;
+
+  return (v * 2654435761u) >> (32 - IOTPF_COMP_HASH_BITS);
+}
+
+static void prv_remember(iotpf_comp_t *comp, const uint8_t *data,
+                         uint32_t len)
+{
+  if (len > 0 && len <= CONFIG_SERVICES_IOTPF_COMPRESS_MAX)
+    {
+      memcpy(comp->prev, data, len);
+      comp->prev_len = len;
+    }
+  else
+    {
+      comp->prev_len = 0;
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int iotpf_comp_lz(const uint8_t *in, uint32_t len, uint8_t *out,
+                  uint32_t size)
+{
+  uint16_t head[1 << IOTPF_COMP_HASH_BITS];  /* last position + 1 */
+  uint32_t flag = 0;
+  uint32_t bit = 8;
+  uint32_t o = 0;
+  uint32_t i = 0;
+
+  if (len > UINT16_MAX)
+    {
+      return -1;
+    }
+
+  memset(head, 0, sizeof(head));
+  while (i < len)
+    {
+      uint32_t best = 0;
+      uint32_t dist = 0;
+
+      if (bit == 8)
+        {
+          if (o >= size)
+            {
+              return -1;
+            }
+          flag = o++;
+          out[flag] = 0;
+          bit = 0;
+        }
+
+      if (i + IOTPF_COMP_MATCH_MIN <= len)
+        {
+          uint32_t h = prv_hash(in + i);
+          uint32_t cand = head[h];
+
+          head[h] = i + 1;
+          if (cand != 0 && i - (cand - 1) <= IOTPF_COMP_WINDOW)
+            {
+              const uint8_t *p = in + cand - 1;
+              uint32_t max = len - i;
+
+              if (max > IOTPF_COMP_MATCH_MAX)
+                {
+                  max = IOTPF_COMP_MATCH_MAX;
+                }
+              while (best < max && p[best] == in[i + best])
+                {
+                  best++;
+                }
+              dist = i - (cand - 1);
+            }
+        }
+
+      if (best >= IOTPF_COMP_MATCH_MIN)
+        {
+          uint32_t k;
+
+          if (o + 2 > size)
+            {
+              return -1;
+            }
+          out[flag] |= 1 << bit;
+          out[o++] = (dist - 1) & 0xff;
+          out[o++] = ((dist - 1) >> 4 & 0xf0) | (best - IOTPF_COMP_MATCH_MIN);
+          for (k = 1; k < best && i + k + IOTPF_COMP_MATCH_MIN <= len; k++)
+            {
+              head[prv_hash(in + i + k)] = i + k + 1;
+            }
+          i += best;
+        }
+      else
+        {
+          if (o >= size)
+            {
+              return -1;
+            }
+          out[o++] = in[i++];
+        }
+
+      bit++;
+    }
+
+  return o;
+}
+
+int iotpf_comp_unlz(const uint8_t *in, uint32_t len, uint8_t *out,
+                    uint32_t size)
+{
+  uint32_t i = 0;
+  uint32_t o = 0;
+
+  while (i < len)
+    {
+      uint8_t flags = in[i++];
+      uint32_t bit;
+
+      for (bit = 0; bit < 8 && i < len; bit++)
+        {
+          if (flags & (1 << bit))
+            {
+              uint32_t dist;
+              uint32_t n;
+
+              if (i + 2 > len)
+                {
+                  return -1;
+                }
+              dist = (in[i] | (in[i + 1] & 0xf0) << 4) + 1;
+              n = (in[i + 1] & 0x0f) + IOTPF_COMP_MATCH_MIN;
+              i += 2;
+              if (dist > o || o + n > size)
+                {
+                  return -1;
+                }
+              while (n-- > 0)
+                {
+                  out[o] = out[o - dist];
+                  o++;
+                }
+            }
+          else
+            {
+              if (o >= size)
+                {
+                  return -1;
+                }
+              out[o++] = in[i++];
+            }
+        }
+    }
+
+  return o;
+}
+
+int iotpf_comp_delta(const uint8_t *in, const uint8_t *ref, uint32_t len,
+                     uint8_t *out, uint32_t size)
+{
+  uint32_t i = 0;
+  uint32_t o = 0;
+
+  while (i < len)
+    {
+      uint32_t start = i;
+      uint32_t n = 0;
+
+      while (i + n < len && n < IOTPF_COMP_RUN_MAX && in[i + n] == ref[i + n])
+        {
+          n++;
+        }
+
+      /* A lone equal byte is cheaper as a literal, unless it is the last */
+
+      if (n >= 2 || (n == 1 && i + 1 == len))
+        {
+          if (o >= size)
+            {
+              return -1;
+            }
+          out[o++] = 0x80 | (n - 1);
+          i += n;
+          continue;
+        }
+
+      n = 0;
+      while (i < len && n < IOTPF_COMP_RUN_MAX &&
+             !(i + 1 < len && in[i] == ref[i] && in[i + 1] == ref[i + 1]))
+        {
+          i++;
+          n++;
+        }
+
+      if (o + 1 + n > size)
+        {
+          return -1;
+        }
+      out[o++] = n - 1;
+      while (start < i)
+        {
+          out[o++] = in[start] ^ ref[start];
+          start++;
+        }
+    }
+
+  return o;
+}
+
+int iotpf_comp_undelta(const uint8_t *in, uint32_t len, const uint8_t *ref,
+                       uint8_t *out, uint32_t size)
+{
+  uint32_t i = 0;
+  uint32_t o = 0;
+
+  while (i < len)
+    {
+      uint32_t n = (in[i] & 0x7f) + 1;
+
+      if (o + n > size)
+        {
+          return -1;
+        }
+
+      if (in[i++] & 0x80)
+        {
+          memcpy(out + o, ref + o, n);
+          o += n;
+          continue;
+        }
+
+      if (i + n > len)
+        {
+          return -1;
+        }
+      while (n-- > 0)
+        {
+          out[o] = ref[o] ^ in[i++];
+          o++;
+        }
+    }
+
+  return o;
+}
+
+void iotpf_comp_init(iotpf_comp_t *comp)
+{
+  comp->seq = 0;
+  comp->deltas = 0;
+  comp->prev_len = 0;
+}
+
+int iotpf_comp_encode(iotpf_comp_t *comp, const uint8_t *in, uint32_t len,
+                      uint8_t *out)
+{
+  uint8_t delta[CONFIG_SERVICES_IOTPF_COMPRESS_MAX];
+  uint8_t codec = IOTPF_COMP_RAW;
+  int best = len;
+  int n;
+
+  /* Each candidate has to beat the best so far by at least a byte */
+
+  if (len > 1 && len == comp->prev_len &&
+      comp->deltas + 1 < CONFIG_SERVICES_IOTPF_COMPRESS_KEY)
+    {
+      n = iotpf_comp_delta(in, comp->prev, len, delta, best - 1);
+      if (n >= 0)
+        {
+          codec = IOTPF_COMP_DELTA;
+          best = n;
+        }
+    }
+
+  n = best > 1 ? iotpf_comp_lz(in, len, out + 1, best - 1) : -1;
+  if (n >= 0)
+    {
+      codec = IOTPF_COMP_LZ;
+      best = n;
+    }
+  else if (codec == IOTPF_COMP_DELTA)
+    {
+      memcpy(out + 1, delta, best);
+    }
+  else
+    {
+      memcpy(out + 1, in, len);
+    }
+
+  out[0] = codec | (comp->seq++ & IOTPF_COMP_SEQ_MASK);
+  comp->deltas = codec == IOTPF_COMP_DELTA ? comp->deltas + 1 : 0;
+  prv_remember(comp, in, len);
+  return best + 1;
+}
+
+int iotpf_comp_decode(iotpf_comp_t *comp, const uint8_t *in, uint32_t len,
+                      uint8_t *out, uint32_t size)
+{
+  uint8_t seq;
+  int n = -1;
+
+  if (len < 1)
+    {
+      return -1;
+    }
+
+  seq = in[0] & IOTPF_COMP_SEQ_MASK;
+  switch (in[0] & IOTPF_COMP_CODEC_MASK)
+    {
+      case IOTPF_COMP_RAW:
+        if (len - 1 <= size)
+          {
+            memcpy(out, in + 1, len - 1);
+            n = len - 1;
+          }
+        break;
+      case IOTPF_COMP_LZ:
+        n = iotpf_comp_unlz(in + 1, len - 1, out, size);
+        break;
+      case IOTPF_COMP_DELTA:
+        if (comp->prev_len > 0 && comp->prev_len <= size &&
+            ((comp->seq + 1) & IOTPF_COMP_SEQ_MASK) == seq)
+          {
+            n = iotpf_comp_undelta(in + 1, len - 1, comp->prev, out,
+                                   comp->prev_len);
+            if (n != comp->prev_len)
+              {
+                n = -1;
+              }
+          }
+        break;
+    }
+
+  comp->seq = seq;
+  if (n < 0)
+    {
+      comp->prev_len = 0;
+      return -1;
+    }
+
+  prv_remember(comp, out, n);
+  return n;
+}
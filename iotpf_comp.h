@@ -0,0 +1,111 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_comp.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _IOTPF_COMP_H_
+#define _IOTPF_COMP_H_
+
+#include <stdint.h>
+
+/* Compression of raw uplink frames. Every frame gets one header byte:
+ *
+ *   bits 7-6  codec: 0 verbatim, 1 LZ, 2 XOR delta
+ *   bits 3-0  frame sequence, modulo 16
+ *
+ * LZ is LZSS over the frame itself: a flag byte announces eight items,
+ * LSB first, 0 a literal byte and 1 a match of two bytes, the low eight
+ * bits of distance - 1, then its high four bits over length - 3. That is
+ * a 4 KB window and 3 to 18 byte matches; the encoder needs 512 bytes of
+ * hash table and nothing else. Delta XORs the frame with the previous
+ * one of the same length and run-length codes the result: a token with
+ * bit 7 set is a run of (token & 0x7f) + 1 zeros, otherwise token + 1
+ * literal bytes follow. A delta frame refers to sequence - 1, so the
+ * receiver can tell when it lost the reference; at least every
+ * CONFIG_SERVICES_IOTPF_COMPRESS_KEY frames one goes without delta.
+ * Whichever codec comes out shortest is sent, verbatim when none of them
+ * shrinks the frame.
+ */
+
+#ifndef CONFIG_SERVICES_IOTPF_COMPRESS_MAX
+#define CONFIG_SERVICES_IOTPF_COMPRESS_MAX        256
+#endif
+
+#define IOTPF_COMP_RAW            0x00
+#define IOTPF_COMP_LZ             0x40
+#define IOTPF_COMP_DELTA          0x80
+#define IOTPF_COMP_CODEC_MASK     0xc0
+#define IOTPF_COMP_SEQ_MASK       0x0f
+
+/* Worst case output, a verbatim frame behind its header */
+
+#define IOTPF_COMP_BOUND(len)     ((len) + 1)
+
+/* One stream, the same on the sending and the receiving side */
+
+typedef struct iotpf_comp_s
+{
+  uint8_t seq;              /* of the next frame / the last one decoded */
+  uint8_t deltas;           /* delta frames since the last key frame */
+  uint16_t prev_len;        /* 0 when there is nothing to refer to */
+  uint8_t prev[CONFIG_SERVICES_IOTPF_COMPRESS_MAX];
+} iotpf_comp_t;
+
+void iotpf_comp_init(iotpf_comp_t *comp);
+
+/* out has room for IOTPF_COMP_BOUND(len); returns the frame length */
+
+int iotpf_comp_encode(iotpf_comp_t *comp, const uint8_t *in, uint32_t len,
+                      uint8_t *out);
+
+/* Returns the payload length, -1 for a broken frame or a delta whose
+ * reference was lost
+ */
+
+int iotpf_comp_decode(iotpf_comp_t *comp, const uint8_t *in, uint32_t len,
+                      uint8_t *out, uint32_t size);
+
+/* The codecs alone, without header or stream state; -1 when the result
+ * would not fit in size
+ */
+
+int iotpf_comp_lz(const uint8_t *in, uint32_t len, uint8_t *out,
+                  uint32_t size);
+int iotpf_comp_unlz(const uint8_t *in, uint32_t len, uint8_t *out,
+                    uint32_t size);
+int iotpf_comp_delta(const uint8_t *in, const uint8_t *ref, uint32_t len,
+                     uint8_t *out, uint32_t size);
+int iotpf_comp_undelta(const uint8_t *in, uint32_t len, const uint8_t *ref,
+                       uint8_t *out, uint32_t size);
+
+#endif /* _IOTPF_COMP_H_ */
@@ -0,0 +1,302 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_conn.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cis_api.h"
+#include "cis_log.h"
+#include "iotpf_conn.h"
+#include "iotpf_stats.h"
+#include "iotpf_pm.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SERVICES_IOTPF_BACKOFF_BASE_MS
+#define CONFIG_SERVICES_IOTPF_BACKOFF_BASE_MS     2000
+#endif
+
+#ifndef CONFIG_SERVICES_IOTPF_BACKOFF_MAX_MS
+#define CONFIG_SERVICES_IOTPF_BACKOFF_MAX_MS      600000
+#endif
+
+#ifndef CONFIG_SERVICES_IOTPF_RETRIES_PER_HOUR
+#define CONFIG_SERVICES_IOTPF_RETRIES_PER_HOUR    12
+#endif
+
+#ifndef CONFIG_SERVICES_IOTPF_REG_GUARD_MS
+#define CONFIG_SERVICES_IOTPF_REG_GUARD_MS        120000
+#endif
+
+#define IOTPF_CONN_HOUR_MS                        (60 * 60 * 1000)
+#define IOTPF_CONN_FOREVER                        UINT32_MAX
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void iotpf_conn_roll_window(iotpf_conn_t *conn, uint32_t now)
+{
+  if (now - conn->hour_start >= IOTPF_CONN_HOUR_MS)
+    {
+      conn->hour_start = now;
+      conn->hour_retries = 0;
+    }
+}
+
+/* Keeps the SoC up while a register or update waits for its answer */
+
+static void iotpf_conn_pm_sync(iotpf_conn_t *conn)
+{
+  bool busy = conn->state == IOTPF_CONN_REGISTERING ||
+              conn->state == IOTPF_CONN_UPDATING;
+
+  if (busy && !conn->pm_held)
+    {
+      iotpf_pm_stay(IOTPF_PM_EXCHANGE);
+    }
+  else if (!busy && conn->pm_held)
+    {
+      iotpf_pm_relax(IOTPF_PM_EXCHANGE);
+    }
+
+  conn->pm_held = busy;
+}
+
+static bool iotpf_conn_next(iotpf_conn_t *conn)
+{
+  uint32_t now = cissys_gettime();
+
+  switch (conn->state)
+    {
+      case IOTPF_CONN_UPDATING:
+        if ((int32_t)(now - conn->deadline) >= 0)
+          {
+            LOGE("conn: no answer to update, giving up on attempt");
+            iotpf_conn_backoff(conn);
+          }
+        return false;
+      case IOTPF_CONN_REGISTERING:
+        if ((int32_t)(now - conn->deadline) >= 0)
+          {
+            LOGE("conn: no answer to register, giving up on attempt");
+            iotpf_conn_backoff(conn);
+          }
+        return false;
+      case IOTPF_CONN_BACKOFF:
+        if ((int32_t)(now - conn->deadline) < 0)
+          {
+            return false;
+          }
+        iotpf_conn_roll_window(conn, now);
+        conn->hour_retries++;
+        break;
+      case IOTPF_CONN_ATTACHING:
+        break;
+      default:
+        return false;
+    }
+
+  conn->state = IOTPF_CONN_REGISTERING;
+  conn->op_start = now;
+  conn->deadline = now + CONFIG_SERVICES_IOTPF_REG_GUARD_MS;
+  return true;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void iotpf_conn_init(iotpf_conn_t *conn)
+{
+  if (conn->pm_held)
+    {
+      iotpf_pm_relax(IOTPF_PM_EXCHANGE);
+    }
+
+  memset(conn, 0, sizeof(iotpf_conn_t));
+  conn->state = IOTPF_CONN_ATTACHING;
+  conn->deadline = cissys_gettime();
+  conn->hour_start = conn->deadline;
+  conn->op_start = conn->deadline;
+}
+
+/* Exponential backoff with full jitter: the delay is drawn uniformly from
+ * [0, min(max, base * 2^attempt)], so devices that lost the network at the
+ * same moment spread their retries instead of coming back in lockstep.
+ */
+
+void iotpf_conn_backoff(iotpf_conn_t *conn)
+{
+  uint32_t now = cissys_gettime();
+  uint32_t ceiling = CONFIG_SERVICES_IOTPF_BACKOFF_MAX_MS;
+  uint32_t delay;
+
+  if (conn->attempt < 31 &&
+      (CONFIG_SERVICES_IOTPF_BACKOFF_MAX_MS >> conn->attempt) >
+      CONFIG_SERVICES_IOTPF_BACKOFF_BASE_MS)
+    {
+      ceiling = CONFIG_SERVICES_IOTPF_BACKOFF_BASE_MS << conn->attempt;
+    }
+  delay = cissys_rand() % (ceiling + 1);
+
+  iotpf_conn_roll_window(conn, now);
+  if (conn->hour_retries >= CONFIG_SERVICES_IOTPF_RETRIES_PER_HOUR)
+    {
+      /* Retry budget spent, sit out the rest of the window */
+
+      delay += conn->hour_start + IOTPF_CONN_HOUR_MS - now;
+    }
+
+  conn->attempt++;
+  conn->state = IOTPF_CONN_BACKOFF;
+  conn->deadline = now + delay;
+  iotpf_conn_pm_sync(conn);
+  LOGI("conn: attempt %u failed, retry in %u ms", conn->attempt, delay);
+}
+
+void iotpf_conn_event(iotpf_conn_t *conn, cis_evt_t eid)
+{
+  uint32_t now = cissys_gettime();
+
+  switch (eid)
+    {
+      case CIS_EVENT_REG_SUCCESS:
+      case CIS_EVENT_UPDATE_SUCCESS:
+        if (conn->attempt > 0)
+          {
+            conn->reconnects++;
+            IOTPF_STAT_INC(reconnects);
+          }
+        if (eid == CIS_EVENT_REG_SUCCESS &&
+            conn->state == IOTPF_CONN_REGISTERING)
+          {
+            /* Not one the core redid on its own, unclocked */
+
+            IOTPF_HIST_ADD(reg_ms, now - conn->op_start);
+          }
+        conn->attempt = 0;
+        conn->state = IOTPF_CONN_REGISTERED;
+        break;
+      case CIS_EVENT_UPDATE_NEED:
+        if (conn->state == IOTPF_CONN_REGISTERED)
+          {
+            conn->state = IOTPF_CONN_UPDATING;
+            conn->deadline = now + CONFIG_SERVICES_IOTPF_REG_GUARD_MS;
+          }
+        break;
+      case CIS_EVENT_CONNECT_FAILED:
+      case CIS_EVENT_REG_FAILED:
+      case CIS_EVENT_REG_TIMEOUT:
+      case CIS_EVENT_UPDATE_FAILED:
+      case CIS_EVENT_UPDATE_TIMEOUT:
+        if (conn->state != IOTPF_CONN_BACKOFF)
+          {
+            iotpf_conn_backoff(conn);
+          }
+        break;
+      case CIS_EVENT_UNREG_DONE:
+        if (conn->state != IOTPF_CONN_BACKOFF)
+          {
+            conn->state = IOTPF_CONN_DETACHED;
+          }
+        break;
+      default:
+        break;
+    }
+
+  iotpf_conn_pm_sync(conn);
+}
+
+/* Returns true exactly once per attempt, when the caller should issue
+ * cis_register(). A register or update the library never answers is
+ * treated as failed after CONFIG_SERVICES_IOTPF_REG_GUARD_MS.
+ */
+
+bool iotpf_conn_due(iotpf_conn_t *conn)
+{
+  bool due = iotpf_conn_next(conn);
+
+  iotpf_conn_pm_sync(conn);
+  return due;
+}
+
+/* Milliseconds the owner may sleep before iotpf_conn_due() needs a look */
+
+uint32_t iotpf_conn_timeout(const iotpf_conn_t *conn)
+{
+  uint32_t now = cissys_gettime();
+
+  switch (conn->state)
+    {
+      case IOTPF_CONN_ATTACHING:
+        return 0;
+      case IOTPF_CONN_REGISTERING:
+      case IOTPF_CONN_UPDATING:
+      case IOTPF_CONN_BACKOFF:
+        if ((int32_t)(conn->deadline - now) <= 0)
+          {
+            return 0;
+          }
+        return conn->deadline - now;
+      default:
+        return IOTPF_CONN_FOREVER;
+    }
+}
+
+const char *iotpf_conn_state_str(iotpf_conn_state_t state)
+{
+  switch (state)
+    {
+      case IOTPF_CONN_DETACHED:
+        return "detached";
+      case IOTPF_CONN_ATTACHING:
+        return "attaching";
+      case IOTPF_CONN_REGISTERING:
+        return "registering";
+      case IOTPF_CONN_REGISTERED:
+        return "registered";
+      case IOTPF_CONN_UPDATING:
+        return "updating";
+      case IOTPF_CONN_BACKOFF:
+        return "backing-off";
+      default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,77 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_conn.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef _IOTPF_CONN_H_
+#define _IOTPF_CONN_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cis_api.h"
+
+/* Registration state shared by the ctcc and cmcc adapters. Nothing in here
+ * blocks: the owner polls iotpf_conn_due() from its loop and sleeps at most
+ * iotpf_conn_timeout() milliseconds.
+ */
+
+typedef enum
+{
+  IOTPF_CONN_DETACHED = 0,
+  IOTPF_CONN_ATTACHING,
+  IOTPF_CONN_REGISTERING,
+  IOTPF_CONN_REGISTERED,
+  IOTPF_CONN_UPDATING,
+  IOTPF_CONN_BACKOFF,
+} iotpf_conn_state_t;
+
+typedef struct iotpf_conn_s
+{
+  iotpf_conn_state_t state;
+  uint32_t attempt;         /* failed attempts since the last success */
+  uint32_t deadline;        /* cissys_gettime() of the next attempt */
+  uint32_t hour_start;      /* start of the current retry budget window */
+  uint16_t hour_retries;    /* retries spent in that window */
+  uint32_t reconnects;      /* registrations that followed a failure */
+  uint32_t op_start;        /* cissys_gettime() of the pending register */
+  bool pm_held;             /* IOTPF_PM_EXCHANGE vote while in flight */
+} iotpf_conn_t;
+
+void iotpf_conn_init(iotpf_conn_t *conn);
+void iotpf_conn_event(iotpf_conn_t *conn, cis_evt_t eid);
+void iotpf_conn_backoff(iotpf_conn_t *conn);
+bool iotpf_conn_due(iotpf_conn_t *conn);
+uint32_t iotpf_conn_timeout(const iotpf_conn_t *conn);
+const char *iotpf_conn_state_str(iotpf_conn_state_t state);
+
+#endif /* _IOTPF_CONN_H_ */
@@ -0,0 +1,608 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_delta.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "cis_api.h"
+#include "cis_log.h"
+#include "iotpf_fw.h"
+#include "iotpf_delta.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SERVICES_IOTPF_FW_RUN_PATH
+#define CONFIG_SERVICES_IOTPF_FW_RUN_PATH      "/dev/ota0"
+#endif
+
+#ifndef CONFIG_SERVICES_IOTPF_FW_STATE_PATH
+#define CONFIG_SERVICES_IOTPF_FW_STATE_PATH    "/data/iotpf_fw.state"
+#endif
+
+/* Present while a patch is being applied, so a restart knows the saved
+ * iotpf_fw offset is output, not download, progress.
+ */
+
+#define IOTPF_DELTA_MARK_PATH   CONFIG_SERVICES_IOTPF_FW_STATE_PATH ".delta"
+
+#define IOTPF_DELTA_MAGIC       "IPD1"
+#define IOTPF_DELTA_HDR_SIZE    (4 + 4 + 4 + 2 * IOTPF_SHA256_DIGEST_LEN)
+#define IOTPF_DELTA_BUF_SIZE    256
+
+#define IOTPF_DELTA_OP_COPY     0x00
+#define IOTPF_DELTA_OP_INSERT   0x01
+#define IOTPF_DELTA_OP_FILL     0x02
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+typedef enum
+{
+  IOTPF_DELTA_HEADER = 0,
+  IOTPF_DELTA_PASS,       /* not a patch, a full image */
+  IOTPF_DELTA_OP,
+  IOTPF_DELTA_ARG,
+  IOTPF_DELTA_INSERT,
+  IOTPF_DELTA_FILL,
+  IOTPF_DELTA_DONE,
+  IOTPF_DELTA_ERROR,
+} iotpf_delta_state_t;
+
+typedef struct iotpf_delta_s
+{
+  iotpf_delta_state_t state;
+  uint8_t hdr[IOTPF_DELTA_HDR_SIZE];
+  uint32_t hdr_fill;
+  uint32_t src_size;
+  uint32_t dst_size;
+  int src_fd;
+  uint32_t src_pos;
+  iotpf_sha256_t src_sha;
+  uint32_t src_hashed;    /* running image bytes in src_sha */
+  uint32_t out_pos;
+  uint8_t op;
+  uint8_t nargs;
+  uint8_t argi;
+  uint8_t shift;
+  uint32_t var;
+  uint32_t args[2];
+  uint32_t remain;        /* INSERT bytes still to come */
+  uint32_t patch_bytes;
+  uint32_t start;
+} iotpf_delta_t;
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static iotpf_delta_t g_delta =
+{
+  .src_fd = -1,
+};
+
+static uint8_t g_delta_buf[IOTPF_DELTA_BUF_SIZE];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static uint32_t prv_le32(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int prv_open_source(void)
+{
+  g_delta.src_fd = open(CONFIG_SERVICES_IOTPF_FW_RUN_PATH, O_RDONLY);
+  if (g_delta.src_fd < 0)
+    {
+      LOGE("delta: open %s failed", CONFIG_SERVICES_IOTPF_FW_RUN_PATH);
+      return CIS_RET_ERROR;
+    }
+
+  iotpf_sha256_init(&g_delta.src_sha);
+  g_delta.src_hashed = 0;
+  return CIS_RET_OK;
+}
+
+/* The patch only makes sense against the image it was made from. Hashing
+ * all of that image up front would hold the caller for as long as it
+ * takes to read the slot, so it is hashed in step with the output instead
+ * and checked once the patch is through: up to then only the inactive
+ * slot has been written, and a wrong source fails the target hash too.
+ */
+
+static int prv_hash_source(uint32_t upto)
+{
+  uint32_t n;
+  int ret;
+
+  while (g_delta.src_hashed < upto)
+    {
+      n = upto - g_delta.src_hashed;
+      n = n < sizeof(g_delta_buf) ? n : sizeof(g_delta_buf);
+      ret = pread(g_delta.src_fd, g_delta_buf, n, g_delta.src_hashed);
+      if (ret <= 0)
+        {
+          LOGE("delta: running image shorter than %u", g_delta.src_size);
+          return CIS_RET_ERROR;
+        }
+
+      iotpf_sha256_update(&g_delta.src_sha, g_delta_buf, ret);
+      g_delta.src_hashed += ret;
+    }
+
+  return CIS_RET_OK;
+}
+
+static int prv_check_source(void)
+{
+  uint8_t digest[IOTPF_SHA256_DIGEST_LEN];
+
+  if (prv_hash_source(g_delta.src_size) != CIS_RET_OK)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  iotpf_sha256_final(&g_delta.src_sha, digest);
+  if (memcmp(digest, g_delta.hdr + 12, sizeof(digest)) != 0)
+    {
+      LOGE("delta: patch is not for the running image");
+      return CIS_RET_ERROR;
+    }
+
+  return CIS_RET_OK;
+}
+
+static int prv_header(void)
+{
+  int fd;
+
+  g_delta.src_size = prv_le32(g_delta.hdr + 4);
+  g_delta.dst_size = prv_le32(g_delta.hdr + 8);
+  if (prv_open_source() != CIS_RET_OK)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  fd = open(IOTPF_DELTA_MARK_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0)
+    {
+      close(fd);
+    }
+
+  /* Output offsets from an earlier attempt are no use to a new stream */
+
+  iotpf_fw_abort(false);
+  if (iotpf_fw_begin(false) < 0)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  LOGI("delta: %u -> %u bytes", g_delta.src_size, g_delta.dst_size);
+  return CIS_RET_OK;
+}
+
+static void prv_next(void)
+{
+  g_delta.state = g_delta.out_pos == g_delta.dst_size ?
+                  IOTPF_DELTA_DONE : IOTPF_DELTA_OP;
+}
+
+static int prv_copy(int32_t seek, uint32_t len)
+{
+  uint32_t n;
+  int ret;
+
+  g_delta.src_pos += seek;
+  if (g_delta.src_pos > g_delta.src_size ||
+      len > g_delta.src_size - g_delta.src_pos)
+    {
+      LOGE("delta: copy outside the running image");
+      return CIS_RET_ERROR;
+    }
+
+  while (len > 0)
+    {
+      n = len < sizeof(g_delta_buf) ? len : sizeof(g_delta_buf);
+      ret = pread(g_delta.src_fd, g_delta_buf, n, g_delta.src_pos);
+      if (ret != (int)n ||
+          iotpf_fw_write(g_delta.out_pos, g_delta_buf, n) != CIS_RET_OK)
+        {
+          return CIS_RET_ERROR;
+        }
+
+      g_delta.src_pos += n;
+      g_delta.out_pos += n;
+      len -= n;
+    }
+
+  return CIS_RET_OK;
+}
+
+static int prv_fill(uint8_t value, uint32_t len)
+{
+  uint32_t n;
+
+  memset(g_delta_buf, value, sizeof(g_delta_buf));
+  while (len > 0)
+    {
+      n = len < sizeof(g_delta_buf) ? len : sizeof(g_delta_buf);
+      if (iotpf_fw_write(g_delta.out_pos, g_delta_buf, n) != CIS_RET_OK)
+        {
+          return CIS_RET_ERROR;
+        }
+
+      g_delta.out_pos += n;
+      len -= n;
+    }
+
+  return CIS_RET_OK;
+}
+
+/* The transfer started over: whatever the earlier stream produced goes */
+
+static void prv_restart(void)
+{
+  uint32_t start = g_delta.start;
+
+  if (g_delta.src_fd >= 0)
+    {
+      close(g_delta.src_fd);
+    }
+
+  iotpf_fw_abort(false);
+  unlink(IOTPF_DELTA_MARK_PATH);
+  memset(&g_delta, 0, sizeof(g_delta));
+  g_delta.src_fd = -1;
+  g_delta.start = start;
+}
+
+/* All arguments of the current operation are in */
+
+static int prv_run(void)
+{
+  uint32_t len = g_delta.args[g_delta.nargs - 1];
+
+  if (len > g_delta.dst_size - g_delta.out_pos)
+    {
+      LOGE("delta: operation past the target size");
+      return CIS_RET_ERROR;
+    }
+
+  switch (g_delta.op)
+    {
+      case IOTPF_DELTA_OP_COPY:
+        if (prv_copy((int32_t)(g_delta.args[0] >> 1) ^
+                     -(int32_t)(g_delta.args[0] & 1),
+                     len) != CIS_RET_OK)
+          {
+            return CIS_RET_ERROR;
+          }
+        prv_next();
+        break;
+      case IOTPF_DELTA_OP_INSERT:
+        g_delta.remain = len;
+        g_delta.state = IOTPF_DELTA_INSERT;
+        if (len == 0)
+          {
+            prv_next();
+          }
+        break;
+      default:
+        g_delta.remain = len;
+        g_delta.state = IOTPF_DELTA_FILL;
+        break;
+    }
+
+  return CIS_RET_OK;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int iotpf_delta_begin(void)
+{
+  iotpf_delta_abort();
+  memset(&g_delta, 0, sizeof(g_delta));
+  g_delta.src_fd = -1;
+  g_delta.start = cissys_gettime();
+
+  /* A full image that was cut short carries on where it stopped */
+
+  if (iotpf_delta_saved_bytes() > 0)
+    {
+      g_delta.state = IOTPF_DELTA_PASS;
+      return iotpf_fw_begin(true);
+    }
+
+  g_delta.state = IOTPF_DELTA_HEADER;
+  return 0;
+}
+
+/* offset is the stream offset of data, as for iotpf_fw_write() */
+
+int iotpf_delta_write(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+  uint32_t end = offset + len;
+  uint32_t n;
+
+  if (offset == 0 &&
+      (g_delta.state != IOTPF_DELTA_HEADER || g_delta.hdr_fill > 0))
+    {
+      LOGW("delta: transfer started over");
+      prv_restart();
+    }
+
+  /* A full image is iotpf_fw's to check, a patch has no resume point */
+
+  if (g_delta.state != IOTPF_DELTA_PASS)
+    {
+      if (offset > g_delta.patch_bytes)
+        {
+          LOGE("delta: %u bytes at %u, expected %u",
+               len, offset, g_delta.patch_bytes);
+          g_delta.state = IOTPF_DELTA_ERROR;
+          return CIS_RET_ERROR;
+        }
+
+      n = g_delta.patch_bytes - offset;
+      if (len <= n)
+        {
+          return CIS_RET_OK;
+        }
+
+      data += n;
+      len -= n;
+    }
+
+  g_delta.patch_bytes += len;
+  while (len > 0)
+    {
+      switch (g_delta.state)
+        {
+          case IOTPF_DELTA_HEADER:
+            n = IOTPF_DELTA_HDR_SIZE - g_delta.hdr_fill;
+            n = n < len ? n : len;
+            memcpy(g_delta.hdr + g_delta.hdr_fill, data, n);
+            g_delta.hdr_fill += n;
+            data += n;
+            len -= n;
+
+            if (g_delta.hdr_fill >= 4 &&
+                memcmp(g_delta.hdr, IOTPF_DELTA_MAGIC, 4) != 0)
+              {
+                g_delta.state = IOTPF_DELTA_PASS;
+                if (iotpf_fw_begin(true) < 0 ||
+                    iotpf_fw_write(0, g_delta.hdr,
+                                   g_delta.hdr_fill) != CIS_RET_OK)
+                  {
+                    g_delta.state = IOTPF_DELTA_ERROR;
+                  }
+              }
+            else if (g_delta.hdr_fill == IOTPF_DELTA_HDR_SIZE)
+              {
+                g_delta.state = IOTPF_DELTA_ERROR;
+                if (prv_header() == CIS_RET_OK)
+                  {
+                    prv_next();
+                  }
+              }
+            break;
+
+          case IOTPF_DELTA_PASS:
+            if (iotpf_fw_write(end - len, data, len) != CIS_RET_OK)
+              {
+                g_delta.state = IOTPF_DELTA_ERROR;
+              }
+            len = 0;
+            break;
+
+          case IOTPF_DELTA_OP:
+            g_delta.op = *data++;
+            len--;
+            if (g_delta.op > IOTPF_DELTA_OP_FILL)
+              {
+                LOGE("delta: bad operation %02x", g_delta.op);
+                g_delta.state = IOTPF_DELTA_ERROR;
+                break;
+              }
+            g_delta.nargs = g_delta.op == IOTPF_DELTA_OP_COPY ? 2 : 1;
+            g_delta.argi = 0;
+            g_delta.var = 0;
+            g_delta.shift = 0;
+            g_delta.state = IOTPF_DELTA_ARG;
+            break;
+
+          case IOTPF_DELTA_ARG:
+
+            /* The fifth byte has room for the top four bits only */
+
+            if (g_delta.shift == 28 && (*data & 0xf0) != 0)
+              {
+                LOGE("delta: argument wider than 32 bits");
+                g_delta.state = IOTPF_DELTA_ERROR;
+                break;
+              }
+            g_delta.var |= (uint32_t)(*data & 0x7f) << g_delta.shift;
+            g_delta.shift += 7;
+            len--;
+            if ((*data++ & 0x80) == 0)
+              {
+                g_delta.args[g_delta.argi++] = g_delta.var;
+                g_delta.var = 0;
+                g_delta.shift = 0;
+                if (g_delta.argi == g_delta.nargs &&
+                    prv_run() != CIS_RET_OK)
+                  {
+                    g_delta.state = IOTPF_DELTA_ERROR;
+                  }
+              }
+            break;
+
+          case IOTPF_DELTA_INSERT:
+            n = g_delta.remain < len ? g_delta.remain : len;
+            if (iotpf_fw_write(g_delta.out_pos, data, n) != CIS_RET_OK)
+              {
+                g_delta.state = IOTPF_DELTA_ERROR;
+                break;
+              }
+            data += n;
+            len -= n;
+            g_delta.out_pos += n;
+            g_delta.remain -= n;
+            if (g_delta.remain == 0)
+              {
+                prv_next();
+              }
+            break;
+
+          case IOTPF_DELTA_FILL:
+            len--;
+            if (prv_fill(*data++, g_delta.remain) != CIS_RET_OK)
+              {
+                g_delta.state = IOTPF_DELTA_ERROR;
+                break;
+              }
+            prv_next();
+            break;
+
+          case IOTPF_DELTA_DONE:
+            LOGE("delta: %u bytes after the end of the patch", len);
+            g_delta.state = IOTPF_DELTA_ERROR;
+            break;
+
+          default:
+            return CIS_RET_ERROR;
+        }
+    }
+
+  /* Keep the source hash level with the output */
+
+  if (g_delta.src_fd >= 0 && g_delta.dst_size > 0 &&
+      g_delta.state != IOTPF_DELTA_ERROR &&
+      prv_hash_source((uint64_t)g_delta.src_size * g_delta.out_pos /
+                      g_delta.dst_size) != CIS_RET_OK)
+    {
+      g_delta.state = IOTPF_DELTA_ERROR;
+    }
+
+  return g_delta.state == IOTPF_DELTA_ERROR ? CIS_RET_ERROR : CIS_RET_OK;
+}
+
+/* Checks the result against the target hash the patch carried and reports
+ * what the patch saved over shipping the full image.
+ */
+
+int iotpf_delta_finish(void)
+{
+  int ret;
+
+  if (g_delta.state == IOTPF_DELTA_PASS)
+    {
+      g_delta.state = IOTPF_DELTA_HEADER;
+      return iotpf_fw_finish(NULL);
+    }
+
+  if (g_delta.state != IOTPF_DELTA_DONE)
+    {
+      LOGE("delta: incomplete patch, %u of %u bytes",
+           g_delta.out_pos, g_delta.dst_size);
+      iotpf_delta_abort();
+      return CIS_RET_ERROR;
+    }
+
+  if (prv_check_source() != CIS_RET_OK)
+    {
+      iotpf_delta_abort();
+      return CIS_RET_ERROR;
+    }
+
+  ret = iotpf_fw_finish(g_delta.hdr + 12 + IOTPF_SHA256_DIGEST_LEN);
+  LOGI("delta: %u patch bytes for a %u byte image (%u%%), applied in %u ms",
+       g_delta.patch_bytes, g_delta.dst_size,
+       g_delta.dst_size ? (uint32_t)((uint64_t)g_delta.patch_bytes * 100 /
+                                     g_delta.dst_size) : 0,
+       cissys_gettime() - g_delta.start);
+
+  unlink(IOTPF_DELTA_MARK_PATH);
+  g_delta.state = IOTPF_DELTA_HEADER;
+  iotpf_delta_abort();
+  return ret;
+}
+
+void iotpf_delta_abort(void)
+{
+  if (g_delta.src_fd >= 0)
+    {
+      close(g_delta.src_fd);
+      g_delta.src_fd = -1;
+    }
+
+  /* Only a full image can pick up where it stopped */
+
+  if (g_delta.state == IOTPF_DELTA_PASS)
+    {
+      iotpf_fw_abort(true);
+    }
+  else if (g_delta.state != IOTPF_DELTA_HEADER)
+    {
+      iotpf_fw_abort(false);
+      unlink(IOTPF_DELTA_MARK_PATH);
+    }
+
+  g_delta.state = IOTPF_DELTA_HEADER;
+}
+
+uint32_t iotpf_delta_saved_bytes(void)
+{
+  if (access(IOTPF_DELTA_MARK_PATH, F_OK) == 0)
+    {
+      unlink(IOTPF_DELTA_MARK_PATH);
+      iotpf_fw_abort(false);
+      return 0;
+    }
+
+  return iotpf_fw_saved_bytes();
+}
@@ -0,0 +1,73 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_delta.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _IOTPF_DELTA_H_
+#define _IOTPF_DELTA_H_
+
+#include <stdint.h>
+
+/* Streaming patch applier in front of iotpf_fw. The download is either a
+ * full image, passed straight through to iotpf_fw_write(), or a patch
+ * against the running image:
+ *
+ *   "IPD1" | source size | target size | source sha256 | target sha256
+ *
+ * (sizes are little endian u32) followed by operations until target size
+ * bytes have been produced. Arguments are LEB128 varints:
+ *
+ *   0x00 COPY   zigzag(source seek), length  - bytes of the running image
+ *   0x01 INSERT length, <length bytes>       - literal new bytes
+ *   0x02 FILL   length, <byte>               - a run of one byte
+ *
+ * COPY reads continue from where the previous COPY stopped, so unchanged
+ * runs cost a few bytes. RAM use is one small copy buffer plus the
+ * iotpf_fw erase chunk, whatever the image size. The running image is
+ * hashed in step with the output and checked against the source hash
+ * once the patch is through, the result against the target hash.
+ *
+ * With CONFIG_SERVICES_IOTPF_FW_DELTA the iotpf_lib firmware hooks call
+ * iotpf_delta_write() and iotpf_delta_saved_bytes() instead of the
+ * iotpf_fw ones, with the same stream offsets. A full image is a package
+ * with an iotpf_fw manifest. A patch can not resume mid-stream, an
+ * interrupted one is fetched again from zero.
+ */
+
+int iotpf_delta_begin(void);
+int iotpf_delta_write(uint32_t offset, const uint8_t *data, uint32_t len);
+int iotpf_delta_finish(void);
+void iotpf_delta_abort(void);
+uint32_t iotpf_delta_saved_bytes(void);
+
+#endif /* _IOTPF_DELTA_H_ */
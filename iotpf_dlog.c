@@ -0,0 +1,558 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_dlog.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <nuttx/config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <unistd.h>
+
+#include "cis_api.h"
+#include "cis_log.h"
+#include "iotpf_dlog.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SERVICES_IOTPF_DLOG_SLOTS
+#define CONFIG_SERVICES_IOTPF_DLOG_SLOTS      128
+#endif
+
+#ifndef CONFIG_SERVICES_IOTPF_DLOG_PRIORITY
+#define CONFIG_SERVICES_IOTPF_DLOG_PRIORITY   50
+#endif
+
+#ifndef CONFIG_SERVICES_IOTPF_DLOG_FILE
+#define CONFIG_SERVICES_IOTPF_DLOG_FILE       ""
+#endif
+
+#define IOTPF_DLOG_MASK       (CONFIG_SERVICES_IOTPF_DLOG_SLOTS - 1)
+#define IOTPF_DLOG_LINE       160
+
+/* Formats seen by the file sink, each written once before its first use */
+
+#define IOTPF_DLOG_FMTS       64
+
+#if (CONFIG_SERVICES_IOTPF_DLOG_SLOTS & IOTPF_DLOG_MASK) != 0
+#  error CONFIG_SERVICES_IOTPF_DLOG_SLOTS must be a power of two
+#endif
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+#ifdef CIS_DLOG
+/* Bounded MPSC ring after D. Vyukov: a slot is free for the producer that
+ * claims position pos when its seq equals pos, and holds a record for the
+ * consumer when seq equals pos + 1. seq is stored minus the slot index so
+ * the zeroed ring is valid before iotpf_dlog_start().
+ */
+
+static iotpf_dlog_rec_t g_dlog_ring[CONFIG_SERVICES_IOTPF_DLOG_SLOTS];
+static uint32_t g_dlog_head;
+static uint32_t g_dlog_tail;
+static uint32_t g_dlog_dropped;
+
+/* The drain sleeps on g_dlog_sem while the ring is empty. It raises
+ * g_dlog_idle before its last look at the ring, and the producer that
+ * clears it posts, so a record is never left waiting for the next one.
+ */
+
+static sem_t g_dlog_sem;
+static bool g_dlog_idle;
+static bool g_dlog_stop;
+static bool g_dlog_running;
+static pthread_t g_dlog_tid;
+static int g_dlog_fd = -1;
+static const char *g_dlog_fmts[IOTPF_DLOG_FMTS];
+static uint32_t g_dlog_nfmts;
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void prv_emit(uint8_t level, const char *line)
+{
+  switch (level)
+    {
+      case IOTPF_DLOG_ERROR:
+        LOGE("%s", line);
+        break;
+      case IOTPF_DLOG_WARN:
+        LOGW("%s", line);
+        break;
+      case IOTPF_DLOG_INFO:
+        LOGI("%s", line);
+        break;
+      default:
+        LOGD("%s", line);
+        break;
+    }
+}
+
+#ifdef CIS_DLOG
+static uint8_t *prv_put16(uint8_t *p, uint32_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  return p + 2;
+}
+
+static uint8_t *prv_put32(uint8_t *p, uint32_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+  return p + 4;
+}
+
+/* Producers claim a slot with a CAS on the head and publish it through
+ * seq once filled; a full ring drops the record, the hot path never waits
+ * for the drain.
+ */
+
+static iotpf_dlog_rec_t *prv_claim(uint32_t *posp)
+{
+  iotpf_dlog_rec_t *rec;
+  uint32_t pos;
+  int32_t diff;
+
+  pos = __atomic_load_n(&g_dlog_head, __ATOMIC_RELAXED);
+  for (; ; )
+    {
+      rec = &g_dlog_ring[pos & IOTPF_DLOG_MASK];
+      diff = (int32_t)(__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) +
+                       (pos & IOTPF_DLOG_MASK) - pos);
+      if (diff == 0)
+        {
+          if (__atomic_compare_exchange_n(&g_dlog_head, &pos, pos + 1, true,
+                                          __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED))
+            {
+              *posp = pos;
+              return rec;
+            }
+        }
+      else if (diff < 0)
+        {
+          __atomic_fetch_add(&g_dlog_dropped, 1, __ATOMIC_RELAXED);
+          return NULL;
+        }
+      else
+        {
+          pos = __atomic_load_n(&g_dlog_head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void prv_publish(iotpf_dlog_rec_t *rec, uint32_t pos)
+{
+  __atomic_store_n(&rec->seq, pos + 1 - (pos & IOTPF_DLOG_MASK),
+                   __ATOMIC_RELEASE);
+
+  /* Orders the record before the look at g_dlog_idle, pairs with the
+   * fence in prv_drain_thread()
+   */
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&g_dlog_idle, __ATOMIC_RELAXED) &&
+      __atomic_exchange_n(&g_dlog_idle, false, __ATOMIC_RELAXED))
+    {
+      sem_post(&g_dlog_sem);
+    }
+}
+
+static bool prv_pending(void)
+{
+  uint32_t pos = g_dlog_tail;
+  uint32_t idx = pos & IOTPF_DLOG_MASK;
+
+  return __atomic_load_n(&g_dlog_ring[idx].seq, __ATOMIC_ACQUIRE) + idx ==
+         pos + 1;
+}
+
+/* File sink, little endian. After the "IDLG" v1 header:
+ *   'S' id:16 len:16 format     defines id, before its first record
+ *   'R' level:8 hex:8 count:8 id:16 time:32, then count args:32, or
+ *       total:32 and count bytes
+ *   'D' dropped:32              records lost since the last 'D'
+ */
+
+static uint32_t prv_file_fmt(const char *fmt)
+{
+  uint8_t hdr[5];
+  uint32_t len;
+  uint32_t id;
+
+  for (id = 0; id < g_dlog_nfmts; id++)
+    {
+      if (g_dlog_fmts[id] == fmt)
+        {
+          return id;
+        }
+    }
+
+  /* Table full: start over, the decoder takes the latest definition */
+
+  if (g_dlog_nfmts == IOTPF_DLOG_FMTS)
+    {
+      g_dlog_nfmts = 0;
+    }
+
+  id = g_dlog_nfmts++;
+  g_dlog_fmts[id] = fmt;
+  len = strlen(fmt);
+  hdr[0] = 'S';
+  prv_put16(prv_put16(hdr + 1, id), len);
+  write(g_dlog_fd, hdr, sizeof(hdr));
+  write(g_dlog_fd, fmt, len);
+  return id;
+}
+
+static void prv_file_record(const iotpf_dlog_rec_t *rec)
+{
+  uint8_t buf[10 + 4 + IOTPF_DLOG_HEX_MAX];
+  uint8_t *p = buf;
+  uint32_t i;
+
+  *p++ = 'R';
+  *p++ = rec->level;
+  *p++ = rec->hex;
+  *p++ = rec->count;
+  p = prv_put16(p, prv_file_fmt(rec->fmt));
+  p = prv_put32(p, rec->time);
+  if (rec->hex)
+    {
+      p = prv_put32(p, rec->total);
+      memcpy(p, rec->u.bytes, rec->count);
+      p += rec->count;
+    }
+  else
+    {
+      for (i = 0; i < rec->count; i++)
+        {
+          p = prv_put32(p, rec->u.args[i]);
+        }
+    }
+
+  write(g_dlog_fd, buf, p - buf);
+}
+
+static void prv_drain(void)
+{
+  static uint32_t reported;
+  iotpf_dlog_rec_t rec;
+  char line[IOTPF_DLOG_LINE];
+  uint32_t dropped;
+
+  while (iotpf_dlog_pop(&rec))
+    {
+      if (g_dlog_fd >= 0)
+        {
+          prv_file_record(&rec);
+        }
+      else
+        {
+          iotpf_dlog_format(&rec, line, sizeof(line));
+          prv_emit(rec.level, line);
+        }
+    }
+
+  dropped = iotpf_dlog_dropped();
+  if (dropped != reported)
+    {
+      if (g_dlog_fd >= 0)
+        {
+          uint8_t buf[5];
+
+          buf[0] = 'D';
+          prv_put32(buf + 1, dropped - reported);
+          write(g_dlog_fd, buf, sizeof(buf));
+        }
+      else
+        {
+          LOGW("dlog: %u records dropped", dropped - reported);
+        }
+
+      reported = dropped;
+    }
+}
+
+static void *prv_drain_thread(void *arg)
+{
+  pthread_setname_np(pthread_self(), "iotpf_dlog");
+  while (!__atomic_load_n(&g_dlog_stop, __ATOMIC_ACQUIRE))
+    {
+      prv_drain();
+      __atomic_store_n(&g_dlog_idle, true, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      if (prv_pending())
+        {
+          continue;
+        }
+
+      while (sem_wait(&g_dlog_sem) != 0 && errno == EINTR)
+        {
+        }
+    }
+
+  prv_drain();
+  return NULL;
+}
+#endif /* CIS_DLOG */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+#ifdef CIS_DLOG
+int iotpf_dlog_start(void)
+{
+  struct sched_param param;
+  pthread_attr_t attr;
+  int ret;
+
+  sem_init(&g_dlog_sem, 0, 0);
+#ifdef CONFIG_PRIORITY_INHERITANCE
+  sem_setprotocol(&g_dlog_sem, SEM_PRIO_NONE);
+#endif
+
+  if (CONFIG_SERVICES_IOTPF_DLOG_FILE[0] != '\0')
+    {
+      g_dlog_fd = open(CONFIG_SERVICES_IOTPF_DLOG_FILE,
+                       O_WRONLY | O_CREAT | O_APPEND, 0644);
+      if (g_dlog_fd < 0)
+        {
+          LOGE("dlog: cannot open %s, logging to the console",
+               CONFIG_SERVICES_IOTPF_DLOG_FILE);
+        }
+      else
+        {
+          static const uint8_t magic[5] = { 'I', 'D', 'L', 'G', 1 };
+
+          write(g_dlog_fd, magic, sizeof(magic));
+        }
+    }
+
+  pthread_attr_init(&attr);
+  param.sched_priority = CONFIG_SERVICES_IOTPF_DLOG_PRIORITY;
+  pthread_attr_setschedparam(&attr, &param);
+  ret = pthread_create(&g_dlog_tid, &attr, prv_drain_thread, NULL);
+  pthread_attr_destroy(&attr);
+  if (ret != 0)
+    {
+      /* An unprivileged host process may not pick a priority */
+
+      ret = pthread_create(&g_dlog_tid, NULL, prv_drain_thread, NULL);
+      if (ret != 0)
+        {
+          LOGE("dlog: cannot start the drain thread: %d", ret);
+          return CIS_RET_ERROR;
+        }
+    }
+
+  g_dlog_running = true;
+  return CIS_RET_OK;
+}
+
+void iotpf_dlog_stop(void)
+{
+  if (!g_dlog_running)
+    {
+      return;
+    }
+
+  __atomic_store_n(&g_dlog_stop, true, __ATOMIC_RELEASE);
+  sem_post(&g_dlog_sem);
+  pthread_join(g_dlog_tid, NULL);
+  g_dlog_running = false;
+  if (g_dlog_fd >= 0)
+    {
+      close(g_dlog_fd);
+      g_dlog_fd = -1;
+    }
+}
+
+void iotpf_dlog_write(uint8_t level, const char *fmt, const uint32_t *args,
+                      uint32_t count)
+{
+  iotpf_dlog_rec_t *rec;
+  uint32_t pos;
+
+  rec = prv_claim(&pos);
+  if (rec == NULL)
+    {
+      return;
+    }
+
+  if (count > IOTPF_DLOG_ARGS)
+    {
+      count = IOTPF_DLOG_ARGS;
+    }
+
+  rec->time = cissys_gettime();
+  rec->fmt = fmt;
+  rec->level = level;
+  rec->hex = false;
+  rec->count = count;
+  memcpy(rec->u.args, args, count * sizeof(uint32_t));
+  prv_publish(rec, pos);
+}
+
+bool iotpf_dlog_pop(iotpf_dlog_rec_t *rec)
+{
+  uint32_t pos = g_dlog_tail;
+  uint32_t idx = pos & IOTPF_DLOG_MASK;
+  iotpf_dlog_rec_t *slot = &g_dlog_ring[idx];
+
+  if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) + idx != pos + 1)
+    {
+      return false;
+    }
+
+  *rec = *slot;
+  g_dlog_tail = pos + 1;
+  __atomic_store_n(&slot->seq, pos + CONFIG_SERVICES_IOTPF_DLOG_SLOTS - idx,
+                   __ATOMIC_RELEASE);
+  return true;
+}
+
+uint32_t iotpf_dlog_dropped(void)
+{
+  return __atomic_load_n(&g_dlog_dropped, __ATOMIC_RELAXED);
+}
+#endif /* CIS_DLOG */
+
+void iotpf_dlog_hex(uint8_t level, const char *fmt, const void *buf,
+                    uint32_t len)
+{
+#ifdef CIS_DLOG
+  iotpf_dlog_rec_t *rec;
+  uint32_t pos;
+
+  rec = prv_claim(&pos);
+  if (rec == NULL)
+    {
+      return;
+    }
+
+  rec->time = cissys_gettime();
+  rec->fmt = fmt;
+  rec->level = level;
+  rec->hex = true;
+  rec->count = len < IOTPF_DLOG_HEX_MAX ? len : IOTPF_DLOG_HEX_MAX;
+  rec->total = len;
+  memcpy(rec->u.bytes, buf, rec->count);
+  prv_publish(rec, pos);
+#else
+  const uint8_t *data = (const uint8_t *)buf;
+  char *line;
+  int size;
+  int n;
+  uint32_t i;
+
+  size = IOTPF_DLOG_LINE + 2 * len;
+  line = (char *)malloc(size);
+  if (line == NULL)
+    {
+      return;
+    }
+
+  n = snprintf(line, size, fmt, len);
+  for (i = 0; i < len && n < size - 2; i++)
+    {
+      static const char digits[] = "0123456789ABCDEF";
+
+      line[n++] = digits[data[i] >> 4];
+      line[n++] = digits[data[i] & 0xf];
+    }
+
+  line[n] = '\0';
+  prv_emit(level, line);
+  free(line);
+#endif
+}
+
+int iotpf_dlog_format(const iotpf_dlog_rec_t *rec, char *line, int size)
+{
+  static const char digits[] = "0123456789ABCDEF";
+  const uint32_t *a = rec->u.args;
+  int n;
+  uint32_t i;
+
+  if (rec->hex)
+    {
+      n = snprintf(line, size, rec->fmt, rec->total);
+    }
+  else
+    {
+      /* Unused trailing arguments are ignored by the format */
+
+      n = snprintf(line, size, rec->fmt, a[0], a[1], a[2], a[3], a[4], a[5]);
+    }
+
+  if (n >= size)
+    {
+      return size - 1;
+    }
+
+  for (i = 0; rec->hex && i < rec->count && n < size - 2; i++)
+    {
+      line[n++] = digits[rec->u.bytes[i] >> 4];
+      line[n++] = digits[rec->u.bytes[i] & 0xf];
+    }
+
+  if (rec->hex && rec->total > rec->count)
+    {
+      n += snprintf(line + n, size - n, "..(+%u)", rec->total - rec->count);
+      if (n >= size)
+        {
+          n = size - 1;
+        }
+    }
+
+  line[n] = '\0';
+  return n;
+}
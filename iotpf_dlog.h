@@ -0,0 +1,166 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_dlog.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _IOTPF_DLOG_H_
+#define _IOTPF_DLOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cis_log.h"
+
+/* Deferred logging. DLOGx() stores the format pointer, a timestamp and up
+ * to IOTPF_DLOG_ARGS integer arguments in a lock-free RAM ring and
+ * returns; a low priority drain thread, woken by the first record after
+ * the ring ran empty, formats the records to the console, or appends
+ * them in binary to a file that host/iotpf_dlogdump decodes. DLOGx_HEX()
+ * records up to IOTPF_DLOG_HEX_MAX bytes of a buffer and its full length
+ * instead of hex printing it in place.
+ *
+ * Arguments are stored as uint32_t, so the format may only use %d, %i,
+ * %u, %x, %X, %o and %c without length modifiers; strings, pointers and
+ * floats must keep using LOGx(). Levels above
+ * CONFIG_SERVICES_IOTPF_DLOG_LEVEL compile to nothing. Without CIS_DLOG
+ * every DLOGx() is the plain LOGx().
+ */
+
+#ifndef CONFIG_SERVICES_IOTPF_DLOG_LEVEL
+#define CONFIG_SERVICES_IOTPF_DLOG_LEVEL    3
+#endif
+
+#define IOTPF_DLOG_ERROR        1
+#define IOTPF_DLOG_WARN         2
+#define IOTPF_DLOG_INFO         3
+#define IOTPF_DLOG_DEBUG        4
+
+#define IOTPF_DLOG_ARGS         6
+#define IOTPF_DLOG_HEX_MAX      (IOTPF_DLOG_ARGS * 4)
+
+typedef struct iotpf_dlog_rec_s
+{
+  uint32_t seq;             /* ring sequence, owned by the ring */
+  uint32_t time;            /* cissys_gettime() at the call */
+  const char *fmt;
+  uint8_t level;
+  uint8_t hex;              /* u.bytes holds a buffer, not arguments */
+  uint8_t count;            /* arguments or bytes stored */
+  uint32_t total;           /* hex: length of the whole buffer */
+  union
+  {
+    uint32_t args[IOTPF_DLOG_ARGS];
+    uint8_t bytes[IOTPF_DLOG_HEX_MAX];
+  } u;
+} iotpf_dlog_rec_t;
+
+#ifdef CIS_DLOG
+
+/* The leading 0 keeps the array valid for calls without arguments */
+
+#  define IOTPF_DLOG_ARGV(...)  ((const uint32_t[]){ 0, ##__VA_ARGS__ })
+#  define IOTPF_DLOG_(lvl, fmt, ...) \
+     iotpf_dlog_write(lvl, fmt, IOTPF_DLOG_ARGV(__VA_ARGS__) + 1, \
+                      sizeof(IOTPF_DLOG_ARGV(__VA_ARGS__)) / \
+                      sizeof(uint32_t) - 1)
+#  define IOTPF_DLOG_HEX_(lvl, fmt, buf, len) \
+     iotpf_dlog_hex(lvl, fmt, buf, len)
+#  define IOTPF_DLOG_OFF(...)   ((void)0)
+
+#  if CONFIG_SERVICES_IOTPF_DLOG_LEVEL >= IOTPF_DLOG_ERROR
+#    define DLOGE(fmt, ...)     IOTPF_DLOG_(IOTPF_DLOG_ERROR, fmt, ##__VA_ARGS__)
+#  else
+#    define DLOGE               IOTPF_DLOG_OFF
+#  endif
+#  if CONFIG_SERVICES_IOTPF_DLOG_LEVEL >= IOTPF_DLOG_WARN
+#    define DLOGW(fmt, ...)     IOTPF_DLOG_(IOTPF_DLOG_WARN, fmt, ##__VA_ARGS__)
+#  else
+#    define DLOGW               IOTPF_DLOG_OFF
+#  endif
+#  if CONFIG_SERVICES_IOTPF_DLOG_LEVEL >= IOTPF_DLOG_INFO
+#    define DLOGI(fmt, ...)     IOTPF_DLOG_(IOTPF_DLOG_INFO, fmt, ##__VA_ARGS__)
+#    define DLOGI_HEX(fmt, buf, len) \
+       IOTPF_DLOG_HEX_(IOTPF_DLOG_INFO, fmt, buf, len)
+#  else
+#    define DLOGI               IOTPF_DLOG_OFF
+#    define DLOGI_HEX           IOTPF_DLOG_OFF
+#  endif
+#  if CONFIG_SERVICES_IOTPF_DLOG_LEVEL >= IOTPF_DLOG_DEBUG
+#    define DLOGD(fmt, ...)     IOTPF_DLOG_(IOTPF_DLOG_DEBUG, fmt, ##__VA_ARGS__)
+#    define DLOGD_HEX(fmt, buf, len) \
+       IOTPF_DLOG_HEX_(IOTPF_DLOG_DEBUG, fmt, buf, len)
+#  else
+#    define DLOGD               IOTPF_DLOG_OFF
+#    define DLOGD_HEX           IOTPF_DLOG_OFF
+#  endif
+
+int iotpf_dlog_start(void);
+
+/* Drains what is left in the ring and stops the drain thread, for the
+ * daemon on its way out. Records written after it stay in the ring.
+ */
+
+void iotpf_dlog_stop(void);
+void iotpf_dlog_write(uint8_t level, const char *fmt, const uint32_t *args,
+                      uint32_t count);
+
+/* Consumer side, used by the drain thread */
+
+bool iotpf_dlog_pop(iotpf_dlog_rec_t *rec);
+uint32_t iotpf_dlog_dropped(void);
+
+#else
+
+#  define DLOGE                 LOGE
+#  define DLOGW                 LOGW
+#  define DLOGI                 LOGI
+#  define DLOGD                 LOGD
+#  define DLOGI_HEX(fmt, buf, len) \
+     iotpf_dlog_hex(IOTPF_DLOG_INFO, fmt, buf, len)
+#  define DLOGD_HEX(fmt, buf, len) \
+     iotpf_dlog_hex(IOTPF_DLOG_DEBUG, fmt, buf, len)
+
+#endif /* CIS_DLOG */
+
+/* fmt takes the full length as its only argument, the bytes follow it in
+ * hex. Without CIS_DLOG the line is formatted and logged right away.
+ */
+
+void iotpf_dlog_hex(uint8_t level, const char *fmt, const void *buf,
+                    uint32_t len);
+
+/* Formats one record into line, "fmt" output plus any hex bytes */
+
+int iotpf_dlog_format(const iotpf_dlog_rec_t *rec, char *line, int size);
+
+#endif /* _IOTPF_DLOG_H_ */
@@ -0,0 +1,219 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_dtls.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "cis_api.h"
+#include "cis_log.h"
+#include "iotpf_dtls.h"
+#include "iotpf_stats.h"
+
+#ifdef CIS_DTLS_SESSION
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SERVICES_IOTPF_DTLS_SESSION_PATH
+#define CONFIG_SERVICES_IOTPF_DTLS_SESSION_PATH  "/data/iotpf_dtls.session"
+#endif
+
+#ifndef CONFIG_SERVICES_IOTPF_DTLS_CID_LEN
+#define CONFIG_SERVICES_IOTPF_DTLS_CID_LEN       4
+#endif
+
+#define IOTPF_DTLS_SESSION_MAX                   1024
+#define IOTPF_DTLS_PATH_MAX                      64
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void prv_path(const iotpf_dtls_t *dtls, char *path)
+{
+  if (dtls->index == 0)
+    {
+      snprintf(path, IOTPF_DTLS_PATH_MAX, "%s",
+               CONFIG_SERVICES_IOTPF_DTLS_SESSION_PATH);
+    }
+  else
+    {
+      snprintf(path, IOTPF_DTLS_PATH_MAX, "%s.%u",
+               CONFIG_SERVICES_IOTPF_DTLS_SESSION_PATH, dtls->index);
+    }
+}
+
+static void prv_restore(const iotpf_dtls_t *dtls, void *context)
+{
+  uint8_t buf[IOTPF_DTLS_SESSION_MAX];
+  char path[IOTPF_DTLS_PATH_MAX];
+  int fd;
+  int n;
+
+  prv_path(dtls, path);
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    {
+      return;
+    }
+
+  n = read(fd, buf, sizeof(buf));
+  close(fd);
+  if (n <= 0 || n == sizeof(buf) ||
+      cis_dtls_session_set(context, buf, n) != CIS_RET_OK)
+    {
+      LOGE("dtls: session in %s unusable, removed", path);
+      unlink(path);
+      return;
+    }
+
+  LOGI("dtls: offering the session saved in %s", path);
+}
+
+/* The file holds the session keys, so it is only readable by us */
+
+static void prv_save(const iotpf_dtls_t *dtls, void *context)
+{
+  uint8_t buf[IOTPF_DTLS_SESSION_MAX];
+  char path[IOTPF_DTLS_PATH_MAX];
+  char tmp[IOTPF_DTLS_PATH_MAX + 4];
+  int len;
+  int fd;
+
+  prv_path(dtls, path);
+  len = cis_dtls_session_get(context, buf, sizeof(buf));
+  if (len <= 0)
+    {
+      if (len < 0)
+        {
+          LOGE("dtls: session larger than %d bytes", IOTPF_DTLS_SESSION_MAX);
+        }
+
+      unlink(path);
+      return;
+    }
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0)
+    {
+      LOGE("dtls: cannot write %s", tmp);
+      return;
+    }
+
+  if (write(fd, buf, len) != len)
+    {
+      LOGE("dtls: cannot write %s", tmp);
+      close(fd);
+      unlink(tmp);
+      return;
+    }
+
+  close(fd);
+  rename(tmp, path);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void iotpf_dtls_init(iotpf_dtls_t *dtls, uint8_t index)
+{
+  memset(dtls, 0, sizeof(iotpf_dtls_t));
+  dtls->index = index;
+}
+
+/* Right before cis_register(). The library keeps the session across the
+ * registers of one run itself, the file is only read for the first.
+ */
+
+void iotpf_dtls_register(iotpf_dtls_t *dtls, void *context)
+{
+  if (!dtls->restored)
+    {
+      dtls->restored = true;
+#ifdef CIS_HAVE_DTLS_CID
+      if (cis_dtls_set_cid(context, CONFIG_SERVICES_IOTPF_DTLS_CID_LEN) !=
+          CIS_RET_OK)
+        {
+          LOGE("dtls: no %u byte connection ID",
+               CONFIG_SERVICES_IOTPF_DTLS_CID_LEN);
+        }
+#endif
+      prv_restore(dtls, context);
+    }
+
+  dtls->clocked = true;
+  dtls->start = cissys_gettime();
+}
+
+/* On CIS_EVENT_REG_SUCCESS. Registers the core redid on its own are not
+ * clocked, their session is saved all the same.
+ */
+
+void iotpf_dtls_registered(iotpf_dtls_t *dtls, void *context)
+{
+  bool resumed = cis_dtls_session_resumed(context);
+  uint32_t ms;
+
+  if (dtls->clocked)
+    {
+      dtls->clocked = false;
+      ms = cissys_gettime() - dtls->start;
+      if (resumed)
+        {
+          IOTPF_STAT_INC(dtls_resumed);
+          IOTPF_STAT_ADD(dtls_resumed_ms, ms);
+        }
+      else
+        {
+          IOTPF_STAT_INC(dtls_full);
+          IOTPF_STAT_ADD(dtls_full_ms, ms);
+        }
+
+      LOGI("dtls: registered in %u ms, %s handshake", ms,
+           resumed ? "abbreviated" : "full");
+    }
+
+  prv_save(dtls, context);
+}
+
+#endif /* CIS_DTLS_SESSION */
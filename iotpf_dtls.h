@@ -0,0 +1,73 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_dtls.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _IOTPF_DTLS_H_
+#define _IOTPF_DTLS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cis_api.h"
+
+/* DTLS sessions that outlive a restart. The session of every successful
+ * register is saved to a file, and after a restart handed back to
+ * iotpf_lib ahead of the first register, so the handshake is the
+ * abbreviated one: one round trip instead of two, and no key exchange.
+ * The record layer is the library's, which has to define
+ * CIS_HAVE_DTLS_SESSION; with any other SERVICES_IOTPF_DTLS_SESSION has
+ * no effect. One that also defines CIS_HAVE_DTLS_CID is asked for an
+ * RFC 9146 connection ID, so that a new NAT binding keeps the session.
+ */
+
+#if defined(CIS_DTLS_SESSION) && !defined(CIS_HAVE_DTLS_SESSION)
+#  undef CIS_DTLS_SESSION
+#endif
+
+#ifdef CIS_DTLS_SESSION
+
+typedef struct iotpf_dtls_s
+{
+  uint8_t index;           /* cmcc context, suffix of the session file */
+  bool restored;           /* saved session handed to the library */
+  bool clocked;            /* a register of ours waits for its answer */
+  uint32_t start;          /* cissys_gettime() when it was sent */
+} iotpf_dtls_t;
+
+void iotpf_dtls_init(iotpf_dtls_t *dtls, uint8_t index);
+void iotpf_dtls_register(iotpf_dtls_t *dtls, void *context);
+void iotpf_dtls_registered(iotpf_dtls_t *dtls, void *context);
+
+#endif /* CIS_DTLS_SESSION */
+#endif /* _IOTPF_DTLS_H_ */
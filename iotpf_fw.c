@@ -0,0 +1,508 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_fw.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <nuttx/mtd/mtd.h>
+
+#include "cis_api.h"
+#include "cis_log.h"
+#include "iotpf_fw.h"
+#include "iotpf_pm.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SERVICES_IOTPF_FW_SLOT_PATH
+#define CONFIG_SERVICES_IOTPF_FW_SLOT_PATH     "/dev/ota1"
+#endif
+
+#ifndef CONFIG_SERVICES_IOTPF_FW_STATE_PATH
+#define CONFIG_SERVICES_IOTPF_FW_STATE_PATH    "/data/iotpf_fw.state"
+#endif
+
+#ifndef CONFIG_SERVICES_IOTPF_FW_ERASE_SIZE
+#define CONFIG_SERVICES_IOTPF_FW_ERASE_SIZE    4096
+#endif
+
+#define IOTPF_FW_STATE_MAGIC                   0x49465732 /* "IFW2" */
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+typedef struct iotpf_fw_state_s
+{
+  uint32_t magic;
+  uint32_t skip;        /* manifest bytes in front of the image */
+  uint32_t offset;      /* image bytes programmed and hashed so far */
+  uint32_t size;        /* image size the manifest announced */
+  uint8_t digest[IOTPF_SHA256_DIGEST_LEN]; /* and its sha256 */
+  iotpf_sha256_t sha;   /* hash of exactly those bytes */
+} iotpf_fw_state_t;
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static int g_fw_fd = -1;
+static iotpf_fw_state_t g_fw_state;
+static uint8_t g_fw_chunk[CONFIG_SERVICES_IOTPF_FW_ERASE_SIZE];
+static uint32_t g_fw_fill;
+static uint8_t g_fw_hdr[IOTPF_FW_MANIFEST_SIZE];
+static bool g_fw_manifest;
+static uint32_t g_fw_resumed;
+static uint32_t g_fw_start;
+
+static pthread_t g_fw_erase_tid;
+static volatile bool g_fw_erasing;
+static iotpf_fw_done_t g_fw_erase_done;
+static void *g_fw_erase_arg;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static bool iotpf_fw_load_state(void)
+{
+  int fd;
+  int ret;
+
+  fd = open(CONFIG_SERVICES_IOTPF_FW_STATE_PATH, O_RDONLY);
+  if (fd < 0)
+    {
+      return false;
+    }
+
+  ret = read(fd, &g_fw_state, sizeof(g_fw_state));
+  close(fd);
+
+  return ret == sizeof(g_fw_state) && g_fw_state.magic == IOTPF_FW_STATE_MAGIC;
+}
+
+static int iotpf_fw_save_state(void)
+{
+  int fd;
+  int ret;
+
+  fd = open(CONFIG_SERVICES_IOTPF_FW_STATE_PATH ".tmp",
+            O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  ret = write(fd, &g_fw_state, sizeof(g_fw_state));
+  close(fd);
+  if (ret != sizeof(g_fw_state))
+    {
+      return CIS_RET_ERROR;
+    }
+
+  /* The rename is what commits the new offset */
+
+  return rename(CONFIG_SERVICES_IOTPF_FW_STATE_PATH ".tmp",
+                CONFIG_SERVICES_IOTPF_FW_STATE_PATH) == 0 ?
+         CIS_RET_OK : CIS_RET_ERROR;
+}
+
+/* Forgets the saved progress, the next byte is the start of the stream */
+
+static void iotpf_fw_restart(void)
+{
+  unlink(CONFIG_SERVICES_IOTPF_FW_STATE_PATH);
+  g_fw_state.magic = IOTPF_FW_STATE_MAGIC;
+  g_fw_state.skip = 0;
+  g_fw_state.offset = 0;
+  g_fw_state.size = 0;
+  iotpf_sha256_init(&g_fw_state.sha);
+  g_fw_fill = 0;
+}
+
+/* Stream offset the next buffer has to start at */
+
+static uint32_t iotpf_fw_pos(void)
+{
+  return g_fw_state.skip + g_fw_state.offset + g_fw_fill;
+}
+
+static int iotpf_fw_parse_manifest(void)
+{
+  const uint8_t *p = g_fw_hdr + 4;
+
+  if (memcmp(g_fw_hdr, IOTPF_FW_MANIFEST_MAGIC, 4) != 0)
+    {
+      LOGE("fw: not a firmware package");
+      return CIS_RET_ERROR;
+    }
+
+  g_fw_state.size = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  memcpy(g_fw_state.digest, p + 4, IOTPF_SHA256_DIGEST_LEN);
+  LOGI("fw: package of %u bytes", g_fw_state.size);
+  return CIS_RET_OK;
+}
+
+static int iotpf_fw_flush(void)
+{
+  uint32_t done = 0;
+  int ret;
+
+  if (lseek(g_fw_fd, g_fw_state.offset, SEEK_SET) < 0)
+    {
+      LOGE("fw: seek to %u failed: %d", g_fw_state.offset, errno);
+      return CIS_RET_ERROR;
+    }
+
+  iotpf_pm_stay(IOTPF_PM_FLASH);
+  while (done < g_fw_fill)
+    {
+      ret = write(g_fw_fd, g_fw_chunk + done, g_fw_fill - done);
+      if (ret <= 0)
+        {
+          LOGE("fw: program at %u failed: %d", g_fw_state.offset + done, errno);
+          iotpf_pm_relax(IOTPF_PM_FLASH);
+          return CIS_RET_ERROR;
+        }
+      done += ret;
+    }
+  iotpf_pm_relax(IOTPF_PM_FLASH);
+
+  iotpf_sha256_update(&g_fw_state.sha, g_fw_chunk, g_fw_fill);
+  g_fw_state.offset += g_fw_fill;
+  g_fw_fill = 0;
+
+  return iotpf_fw_save_state();
+}
+
+/* Runs on its own thread so the pump keeps servicing CoAP while the flash
+ * is busy; the owner only learns the outcome through the done callback.
+ */
+
+static void *iotpf_fw_erase_worker(void *arg)
+{
+  uint32_t start = cissys_gettime();
+  int ret = CIS_RET_ERROR;
+  int fd;
+
+  iotpf_pm_stay(IOTPF_PM_FLASH);
+  fd = open(CONFIG_SERVICES_IOTPF_FW_SLOT_PATH, O_RDWR);
+  if (fd >= 0)
+    {
+      if (ioctl(fd, MTDIOC_BULKERASE, 0) >= 0)
+        {
+          ret = CIS_RET_OK;
+        }
+
+      close(fd);
+    }
+  iotpf_pm_relax(IOTPF_PM_FLASH);
+
+  /* Whatever was saved for resume went with the erased slot */
+
+  if (ret == CIS_RET_OK)
+    {
+      unlink(CONFIG_SERVICES_IOTPF_FW_STATE_PATH);
+    }
+
+  LOGI("fw: erase %s %s in %u ms", CONFIG_SERVICES_IOTPF_FW_SLOT_PATH,
+       ret == CIS_RET_OK ? "done" : "failed", cissys_gettime() - start);
+
+  g_fw_erasing = false;
+  g_fw_erase_done(ret, g_fw_erase_arg);
+  return NULL;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* manifest: the stream starts with the package manifest. Returns the
+ * stream offset the download has to continue from.
+ */
+
+int iotpf_fw_begin(bool manifest)
+{
+  if (g_fw_fd >= 0)
+    {
+      return iotpf_fw_pos();
+    }
+
+  if (g_fw_erasing)
+    {
+      LOGE("fw: slot is being erased");
+      return CIS_RET_ERROR;
+    }
+
+  g_fw_fd = open(CONFIG_SERVICES_IOTPF_FW_SLOT_PATH, O_WRONLY);
+  if (g_fw_fd < 0)
+    {
+      LOGE("fw: open %s failed: %d", CONFIG_SERVICES_IOTPF_FW_SLOT_PATH, errno);
+      return CIS_RET_ERROR;
+    }
+
+  /* Progress saved for the other kind of stream is no use to this one */
+
+  g_fw_manifest = manifest;
+  if (!iotpf_fw_load_state() || (g_fw_state.skip != 0) != manifest)
+    {
+      iotpf_fw_restart();
+    }
+
+  g_fw_fill = 0;
+  g_fw_resumed = g_fw_state.offset;
+  g_fw_start = cissys_gettime();
+  LOGI("fw: download %s at %u", g_fw_resumed ? "resumed" : "started",
+       iotpf_fw_pos());
+  return iotpf_fw_pos();
+}
+
+/* offset is where data sits in the stream. A buffer the sink already has
+ * is skipped, one at 0 starts the download over and one past the end of
+ * what arrived so far fails it.
+ */
+
+int iotpf_fw_write(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+  uint32_t pos;
+  uint32_t room;
+
+  if (g_fw_fd < 0)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  pos = iotpf_fw_pos();
+  if (offset == 0 && pos > 0)
+    {
+      LOGW("fw: transfer started over, %u bytes dropped", pos);
+      iotpf_fw_restart();
+      pos = 0;
+    }
+
+  if (offset > pos)
+    {
+      LOGE("fw: %u bytes at %u, expected %u", len, offset, pos);
+      return CIS_RET_ERROR;
+    }
+
+  if (len <= pos - offset)
+    {
+      return CIS_RET_OK;
+    }
+
+  data += pos - offset;
+  len -= pos - offset;
+
+  while (len > 0)
+    {
+      if (g_fw_manifest && g_fw_state.skip < IOTPF_FW_MANIFEST_SIZE)
+        {
+          room = IOTPF_FW_MANIFEST_SIZE - g_fw_state.skip;
+          room = room < len ? room : len;
+          memcpy(g_fw_hdr + g_fw_state.skip, data, room);
+          g_fw_state.skip += room;
+          data += room;
+          len -= room;
+
+          if (g_fw_state.skip == IOTPF_FW_MANIFEST_SIZE &&
+              iotpf_fw_parse_manifest() != CIS_RET_OK)
+            {
+              return CIS_RET_ERROR;
+            }
+          continue;
+        }
+
+      room = sizeof(g_fw_chunk) - g_fw_fill;
+      if (room > len)
+        {
+          room = len;
+        }
+
+      if (g_fw_manifest &&
+          room > g_fw_state.size - g_fw_state.offset - g_fw_fill)
+        {
+          LOGE("fw: image larger than the %u bytes of its manifest",
+               g_fw_state.size);
+          return CIS_RET_ERROR;
+        }
+
+      memcpy(g_fw_chunk + g_fw_fill, data, room);
+      g_fw_fill += room;
+      data += room;
+      len -= room;
+
+      if (g_fw_fill == sizeof(g_fw_chunk) && iotpf_fw_flush() != CIS_RET_OK)
+        {
+          return CIS_RET_ERROR;
+        }
+    }
+
+  return CIS_RET_OK;
+}
+
+/* Programs the tail and checks the image against expected, or against
+ * the manifest when that is NULL; an image with neither fails. The resume
+ * state is dropped either way: a finished image is either good or has to
+ * be fetched again from zero.
+ */
+
+int iotpf_fw_finish(const uint8_t *expected)
+{
+  uint8_t digest[IOTPF_SHA256_DIGEST_LEN];
+  char hex[2 * IOTPF_SHA256_DIGEST_LEN + 1];
+  int ret = CIS_RET_OK;
+  int i;
+
+  if (g_fw_fd < 0)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  if (g_fw_fill > 0 && iotpf_fw_flush() != CIS_RET_OK)
+    {
+      ret = CIS_RET_ERROR;
+    }
+
+  if (expected == NULL && g_fw_manifest)
+    {
+      expected = g_fw_state.digest;
+      if (g_fw_state.skip < IOTPF_FW_MANIFEST_SIZE ||
+          g_fw_state.offset != g_fw_state.size)
+        {
+          LOGE("fw: image cut short, %u of %u bytes",
+               g_fw_state.offset, g_fw_state.size);
+          ret = CIS_RET_ERROR;
+        }
+    }
+
+  iotpf_sha256_final(&g_fw_state.sha, digest);
+  for (i = 0; i < IOTPF_SHA256_DIGEST_LEN; i++)
+    {
+      snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+    }
+
+  if (expected == NULL)
+    {
+      LOGE("fw: no sha256 to check the image against");
+      ret = CIS_RET_ERROR;
+    }
+  else if (memcmp(expected, digest, sizeof(digest)) != 0)
+    {
+      LOGE("fw: sha256 mismatch, got %s", hex);
+      ret = CIS_RET_ERROR;
+    }
+
+  LOGI("fw: %u bytes (%u this session) in %u ms, sha256 %s",
+       g_fw_state.offset, g_fw_state.offset - g_fw_resumed,
+       cissys_gettime() - g_fw_start, hex);
+
+  iotpf_fw_abort(false);
+  return ret;
+}
+
+/* keep: leave the resume state behind so the next iotpf_fw_begin()
+ * continues from the last programmed chunk.
+ */
+
+void iotpf_fw_abort(bool keep)
+{
+  if (g_fw_fd >= 0)
+    {
+      close(g_fw_fd);
+      g_fw_fd = -1;
+    }
+
+  g_fw_fill = 0;
+  if (!keep)
+    {
+      unlink(CONFIG_SERVICES_IOTPF_FW_STATE_PATH);
+      g_fw_state.skip = 0;
+      g_fw_state.offset = 0;
+    }
+}
+
+uint32_t iotpf_fw_saved_bytes(void)
+{
+  if (g_fw_fd < 0 && !iotpf_fw_load_state())
+    {
+      return 0;
+    }
+
+  return g_fw_state.skip + g_fw_state.offset;
+}
+
+/* done is called from the worker thread, it must only hand the result
+ * over (e.g. through the pump's wakeup pipe) and return.
+ */
+
+int iotpf_fw_erase_async(iotpf_fw_done_t done, void *arg)
+{
+  pthread_attr_t attr;
+  int ret;
+
+  if (g_fw_erasing || g_fw_fd >= 0)
+    {
+      LOGE("fw: erase refused, slot busy");
+      return CIS_RET_ERROR;
+    }
+
+  g_fw_erasing = true;
+  g_fw_erase_done = done;
+  g_fw_erase_arg = arg;
+  g_fw_state.skip = 0;
+  g_fw_state.offset = 0;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  ret = pthread_create(&g_fw_erase_tid, &attr, iotpf_fw_erase_worker, NULL);
+  pthread_attr_destroy(&attr);
+  if (ret != 0)
+    {
+      LOGE("fw: erase worker: %s", strerror(ret));
+      g_fw_erasing = false;
+      return CIS_RET_ERROR;
+    }
+
+  return CIS_RET_OK;
+}
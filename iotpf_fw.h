@@ -0,0 +1,83 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_fw.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _IOTPF_FW_H_
+#define _IOTPF_FW_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "iotpf_sha256.h"
+
+/* Streaming sink for a firmware image going to the inactive flash slot.
+ * Bytes are staged into erase block sized chunks, each full chunk is
+ * programmed and hashed, and the offset plus running SHA-256 are saved so
+ * an interrupted download resumes from the last committed chunk.
+ *
+ * A firmware package is the image behind a manifest carrying what it has
+ * to hash to:
+ *
+ *   "IFWM" | image size (little endian u32) | image sha256
+ *
+ * iotpf_fw_begin(true) expects that manifest at the start of the stream,
+ * iotpf_fw_begin(false) takes a bare image whose digest the caller hands
+ * to iotpf_fw_finish() (the delta applier, which has it from the patch).
+ *
+ * An iotpf_lib that defines CIS_HAVE_FW_WRITE hands every downloaded
+ * buffer with its stream offset to the adapter, cisapi_cmcc_fw_write()
+ * or cisapi_ctcc_fw_write(), which feeds it to iotpf_fw_write(); where to
+ * resume comes from iotpf_fw_saved_bytes(). A buffer at offset 0 means
+ * the transfer started over and drops whatever was saved, a gap fails the
+ * download instead of programming a hole. With any other library the
+ * adapters leave downloads to it and only erase the slot through here.
+ */
+
+/* Erasing the slot takes seconds; iotpf_fw_erase_async() does it on a
+ * worker thread and reports CIS_RET_OK/CIS_RET_ERROR through done.
+ */
+
+#define IOTPF_FW_MANIFEST_MAGIC    "IFWM"
+#define IOTPF_FW_MANIFEST_SIZE     (4 + 4 + IOTPF_SHA256_DIGEST_LEN)
+
+typedef void (*iotpf_fw_done_t)(int result, void *arg);
+
+int iotpf_fw_begin(bool manifest);
+int iotpf_fw_write(uint32_t offset, const uint8_t *data, uint32_t len);
+int iotpf_fw_finish(const uint8_t *expected);
+void iotpf_fw_abort(bool keep);
+uint32_t iotpf_fw_saved_bytes(void);
+int iotpf_fw_erase_async(iotpf_fw_done_t done, void *arg);
+
+#endif /* _IOTPF_FW_H_ */
@@ -0,0 +1,138 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_hist.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "iotpf_hist.h"
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static unsigned iotpf_hist_index(uint32_t value)
+{
+  unsigned msb;
+  unsigned index;
+
+  if (value < 2 * IOTPF_HIST_SUB)
+    {
+      return value;
+    }
+
+  msb = 31 - __builtin_clz(value);
+  index = (msb - IOTPF_HIST_SUB_BITS + 1) * IOTPF_HIST_SUB +
+          ((value >> (msb - IOTPF_HIST_SUB_BITS)) & (IOTPF_HIST_SUB - 1));
+  return index < IOTPF_HIST_BUCKETS ? index : IOTPF_HIST_BUCKETS - 1;
+}
+
+/* Largest value that falls in bucket index */
+
+static uint32_t iotpf_hist_upper(unsigned index)
+{
+  unsigned shift;
+
+  if (index < 2 * IOTPF_HIST_SUB)
+    {
+      return index;
+    }
+
+  shift = index / IOTPF_HIST_SUB - 1;
+  return ((IOTPF_HIST_SUB + index % IOTPF_HIST_SUB + 1) << shift) - 1;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void iotpf_hist_add(iotpf_hist_t *h, uint32_t value)
+{
+  uint32_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+  __atomic_fetch_add(&h->bucket[iotpf_hist_index(value)], 1,
+                     __ATOMIC_RELAXED);
+  while (value > max &&
+         !__atomic_compare_exchange_n(&h->max, &max, value, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+uint32_t iotpf_hist_count(const iotpf_hist_t *h)
+{
+  uint32_t count = 0;
+  unsigned i;
+
+  for (i = 0; i < IOTPF_HIST_BUCKETS; i++)
+    {
+      count += h->bucket[i];
+    }
+
+  return count;
+}
+
+/* Upper bound of the bucket holding the sample of that rank, so never
+ * below the true percentile, and never above max
+ */
+
+uint32_t iotpf_hist_percentile(const iotpf_hist_t *h, uint32_t permille)
+{
+  uint32_t rank = ((uint64_t)iotpf_hist_count(h) * permille + 999) / 1000;
+  uint32_t seen = 0;
+  unsigned i;
+
+  for (i = 0; i < IOTPF_HIST_BUCKETS; i++)
+    {
+      seen += h->bucket[i];
+      if (seen >= rank && seen > 0)
+        {
+          uint32_t upper = iotpf_hist_upper(i);
+
+          return upper < h->max ? upper : h->max;
+        }
+    }
+
+  return 0;
+}
+
+uint32_t iotpf_hist_now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,76 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_hist.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _IOTPF_HIST_H_
+#define _IOTPF_HIST_H_
+
+#include <stdint.h>
+
+/* Latency histograms of constant size. Each power of two is split in
+ * IOTPF_HIST_SUB linear buckets, so a bucket is never wider than a
+ * quarter of its lower bound, and values below 2 * IOTPF_HIST_SUB get
+ * a bucket of their own. 80 buckets reach 2^21 units, 35 minutes in
+ * ms and 2 s in us; longer spans land in the last one and in max.
+ * Samples are added with relaxed atomics from any thread, and the
+ * whole thing is plain uint32_t words so that it can live in, and be
+ * copied and cleared with, iotpf_stats_t.
+ */
+
+#define IOTPF_HIST_SUB_BITS       2
+#define IOTPF_HIST_SUB            (1 << IOTPF_HIST_SUB_BITS)
+#define IOTPF_HIST_BUCKETS        80
+
+typedef struct iotpf_hist_s
+{
+  uint32_t max;                         /* longest sample, exact */
+  uint32_t bucket[IOTPF_HIST_BUCKETS];
+} iotpf_hist_t;
+
+/* Lock free, for the hot paths */
+
+void iotpf_hist_add(iotpf_hist_t *h, uint32_t value);
+
+/* Readers, on a copy */
+
+uint32_t iotpf_hist_count(const iotpf_hist_t *h);
+uint32_t iotpf_hist_percentile(const iotpf_hist_t *h, uint32_t permille);
+
+/* CLOCK_MONOTONIC in microseconds, for spans too short for
+ * cissys_gettime(). Wraps every 71 minutes, differences stay right.
+ */
+
+uint32_t iotpf_hist_now_us(void);
+
+#endif /* _IOTPF_HIST_H_ */
@@ -0,0 +1,203 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_pm.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <nuttx/power/pm.h>
+
+#include "cis_api.h"
+#include "cis_log.h"
+#include "iotpf_pm.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+/* What a vote keeps the idle domain from going below */
+
+#define IOTPF_PM_HOLD_STATE     PM_STANDBY
+
+/****************************************************************************
+ * Private Function Prototypes
+ ****************************************************************************/
+
+static void iotpf_pm_notify(FAR struct pm_callback_s *cb, int domain,
+                            enum pm_state_e pmstate);
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static pthread_mutex_t g_pm_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint16_t g_pm_votes[IOTPF_PM_NREASONS];
+static uint32_t g_pm_held;
+static uint32_t g_pm_hold_since[IOTPF_PM_NREASONS];
+static uint32_t g_pm_hold_ms[IOTPF_PM_NREASONS];
+
+static enum pm_state_e g_pm_state = PM_NORMAL;
+static uint32_t g_pm_state_since;
+static uint32_t g_pm_state_ms[PM_COUNT];
+
+static struct pm_callback_s g_pm_cb =
+{
+  .notify = iotpf_pm_notify,
+};
+
+static const char *g_pm_reasons[IOTPF_PM_NREASONS] =
+{
+  "start",
+  "pump",
+  "exchange",
+  "uplink",
+  "gps",
+  "flash",
+  "listen",
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void iotpf_pm_notify(FAR struct pm_callback_s *cb, int domain,
+                            enum pm_state_e pmstate)
+{
+  uint32_t now;
+
+  if (domain != PM_IDLE_DOMAIN || pmstate >= PM_COUNT)
+    {
+      return;
+    }
+
+  /* Called from the PM core, possibly with interrupts off: no locks, the
+   * readers only ever see a slightly stale total.
+   */
+
+  now = cissys_gettime();
+  g_pm_state_ms[g_pm_state] += now - g_pm_state_since;
+  g_pm_state_since = now;
+  g_pm_state = pmstate;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void iotpf_pm_initialize(void)
+{
+  uint32_t now = cissys_gettime();
+  int i;
+
+  g_pm_state_since = now;
+  for (i = 0; i < IOTPF_PM_NREASONS; i++)
+    {
+      g_pm_hold_since[i] = now;
+    }
+
+  if (pm_register(&g_pm_cb) < 0)
+    {
+      LOGW("pm: no state callbacks, only hold time is accounted");
+    }
+}
+
+void iotpf_pm_stay(iotpf_pm_reason_t reason)
+{
+  pthread_mutex_lock(&g_pm_mutex);
+  if (g_pm_votes[reason]++ == 0)
+    {
+      g_pm_hold_since[reason] = cissys_gettime();
+      if (g_pm_held++ == 0)
+        {
+          pm_stay(PM_IDLE_DOMAIN, IOTPF_PM_HOLD_STATE);
+        }
+    }
+  pthread_mutex_unlock(&g_pm_mutex);
+}
+
+void iotpf_pm_relax(iotpf_pm_reason_t reason)
+{
+  pthread_mutex_lock(&g_pm_mutex);
+  if (g_pm_votes[reason] == 0)
+    {
+      LOGE("pm: %s relaxed without a vote", g_pm_reasons[reason]);
+    }
+  else if (--g_pm_votes[reason] == 0)
+    {
+      g_pm_hold_ms[reason] += cissys_gettime() - g_pm_hold_since[reason];
+      if (--g_pm_held == 0)
+        {
+          pm_relax(PM_IDLE_DOMAIN, IOTPF_PM_HOLD_STATE);
+        }
+    }
+  pthread_mutex_unlock(&g_pm_mutex);
+}
+
+void iotpf_pm_residency(uint32_t state_ms[PM_COUNT],
+                        uint32_t hold_ms[IOTPF_PM_NREASONS])
+{
+  uint32_t now;
+  int i;
+
+  pthread_mutex_lock(&g_pm_mutex);
+  now = cissys_gettime();
+  if (state_ms != NULL)
+    {
+      memcpy(state_ms, g_pm_state_ms, sizeof(g_pm_state_ms));
+      state_ms[g_pm_state] += now - g_pm_state_since;
+    }
+
+  if (hold_ms != NULL)
+    {
+      for (i = 0; i < IOTPF_PM_NREASONS; i++)
+        {
+          hold_ms[i] = g_pm_hold_ms[i];
+          if (g_pm_votes[i] > 0)
+            {
+              hold_ms[i] += now - g_pm_hold_since[i];
+            }
+        }
+    }
+  pthread_mutex_unlock(&g_pm_mutex);
+}
+
+const char *iotpf_pm_reason_str(iotpf_pm_reason_t reason)
+{
+  return reason < IOTPF_PM_NREASONS ? g_pm_reasons[reason] : "?";
+}
@@ -0,0 +1,74 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_pm.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _IOTPF_PM_H_
+#define _IOTPF_PM_H_
+
+#include <stdint.h>
+
+#include <nuttx/power/pm.h>
+
+/* Reference counted PM votes. Each piece of real work takes a vote for its
+ * reason while it runs; the first vote pins the idle domain at
+ * PM_STANDBY and the last one lets it go, so the SoC may sleep whenever
+ * the reactor waits for its next deadline. Time is accounted per reason
+ * held and per PM state the domain reports, for `iotpf stats`.
+ */
+
+typedef enum
+{
+  IOTPF_PM_START = 0,       /* bring-up until the first registration */
+  IOTPF_PM_PUMP,            /* pump loop busy */
+  IOTPF_PM_EXCHANGE,        /* register or update in flight */
+  IOTPF_PM_UPLINK,          /* raw uplink handed to the core */
+  IOTPF_PM_GPS,             /* GPS capture */
+  IOTPF_PM_FLASH,           /* firmware slot program or erase */
+  IOTPF_PM_LISTEN,          /* queue mode listening window open */
+  IOTPF_PM_NREASONS
+} iotpf_pm_reason_t;
+
+void iotpf_pm_initialize(void);
+void iotpf_pm_stay(iotpf_pm_reason_t reason);
+void iotpf_pm_relax(iotpf_pm_reason_t reason);
+
+/* Milliseconds spent so far in each PM state and with each reason held;
+ * either array may be NULL.
+ */
+
+void iotpf_pm_residency(uint32_t state_ms[PM_COUNT],
+                        uint32_t hold_ms[IOTPF_PM_NREASONS]);
+const char *iotpf_pm_reason_str(iotpf_pm_reason_t reason);
+
+#endif /* _IOTPF_PM_H_ */
@@ -0,0 +1,189 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_psm.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cis_api.h"
+#include "cis_log.h"
+#include "iotpf_psm.h"
+#include "iotpf_stats.h"
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+typedef struct psm_unit_s
+{
+  uint8_t code;
+  uint32_t seconds;
+} psm_unit_t;
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Finest first, so the first unit that fits wastes the least */
+
+static const psm_unit_t g_timer3[] =
+{
+  { 3, 2 }, { 4, 30 }, { 5, 60 }, { 0, 600 }, { 1, 3600 }, { 2, 36000 },
+  { 6, 1152000 },
+};
+
+static const psm_unit_t g_timer2[] =
+{
+  { 0, 2 }, { 1, 60 }, { 2, 360 },
+};
+
+/* NB-S1 eDRX cycles in ms, by code; 0 where NB-S1 has none */
+
+static const uint32_t g_edrx_ms[16] =
+{
+  0, 0, 20480, 40960, 0, 81920, 0, 0, 0, 163840, 327680, 655360, 1310720,
+  2621440, 5242880, 10485760,
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void prv_bits(uint32_t value, int n, char *bits)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    {
+      bits[i] = value & (1 << (n - 1 - i)) ? '1' : '0';
+    }
+  bits[n] = '\0';
+}
+
+static int64_t prv_timer(const psm_unit_t *units, int nunits,
+                         uint32_t seconds, char bits[9])
+{
+  int i;
+
+  for (i = 0; i < nunits; i++)
+    {
+      uint32_t value = (seconds + units[i].seconds - 1) / units[i].seconds;
+
+      if (value <= 31)
+        {
+          prv_bits(units[i].code << 5 | value, 8, bits);
+          return (int64_t)value * units[i].seconds;
+        }
+    }
+
+  return -1;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int64_t iotpf_psm_tau(uint32_t seconds, char bits[9])
+{
+  return prv_timer(g_timer3, sizeof(g_timer3) / sizeof(g_timer3[0]),
+                   seconds, bits);
+}
+
+int64_t iotpf_psm_active(uint32_t seconds, char bits[9])
+{
+  return prv_timer(g_timer2, sizeof(g_timer2) / sizeof(g_timer2[0]),
+                   seconds, bits);
+}
+
+int64_t iotpf_psm_edrx(uint32_t ms, char bits[5])
+{
+  int i;
+
+  for (i = 0; i < 16; i++)
+    {
+      if (g_edrx_ms[i] >= ms && g_edrx_ms[i] != 0)
+        {
+          prv_bits(i, 4, bits);
+          return g_edrx_ms[i];
+        }
+    }
+
+  return -1;
+}
+
+int iotpf_psm_enable(void)
+{
+#ifdef CIS_HAVE_POWER_SAVING
+  char tau[9];
+  char active[9];
+  char edrx[5];
+  int64_t tau_s = iotpf_psm_tau(CONFIG_SERVICES_IOTPF_PSM_TAU, tau);
+  int64_t active_s = iotpf_psm_active(CONFIG_SERVICES_IOTPF_PSM_ACTIVE,
+                                      active);
+  int64_t edrx_ms = CONFIG_SERVICES_IOTPF_PSM_EDRX == 0 ? 0 :
+                    iotpf_psm_edrx(CONFIG_SERVICES_IOTPF_PSM_EDRX, edrx);
+
+  if (tau_s < 0 || active_s < 0 || edrx_ms < 0)
+    {
+      LOGE("psm: timers out of range");
+      return CIS_RET_ERROR;
+    }
+
+  if (ciscom_setPowerSaving(tau, active, edrx_ms > 0 ? edrx : NULL) < 0)
+    {
+      LOGW("psm: modem refused tau %s active %s", tau, active);
+      return CIS_RET_ERROR;
+    }
+
+  LOGI("psm: tau %lld s (%s), active %lld s (%s), edrx %lld ms",
+       (long long)tau_s, tau, (long long)active_s, active,
+       (long long)edrx_ms);
+  return CIS_RET_OK;
+#else
+  LOGW("psm: iotpf_lib has no power saving, power cycling instead");
+  return CIS_RET_ERROR;
+#endif
+}
+
+void iotpf_psm_release(void)
+{
+#ifdef CIS_HAVE_POWER_SAVING
+  if (ciscom_releaseAssist() == 0)
+    {
+      IOTPF_STAT_INC(psm_releases);
+    }
+#endif
+}
@@ -0,0 +1,79 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_psm.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _IOTPF_PSM_H_
+#define _IOTPF_PSM_H_
+
+#include <stdint.h>
+
+/* Power saving between report cycles instead of powering the radio off.
+ * The timers are coded the way AT+CPSMS and AT+CEDRXS take them (27.007,
+ * 24.008): the periodic TAU as GPRS Timer 3, the active time as GPRS
+ * Timer 2, both "uuuvvvvv" bit strings, and the NB-S1 eDRX cycle as four
+ * bits. Each coder rounds up to the next value the format can carry and
+ * returns it, or -1 when it can not.
+ */
+
+#ifndef CONFIG_SERVICES_IOTPF_PSM_TAU
+#define CONFIG_SERVICES_IOTPF_PSM_TAU             86400
+#endif
+
+#ifndef CONFIG_SERVICES_IOTPF_PSM_ACTIVE
+#define CONFIG_SERVICES_IOTPF_PSM_ACTIVE          10
+#endif
+
+#ifndef CONFIG_SERVICES_IOTPF_PSM_EDRX
+#define CONFIG_SERVICES_IOTPF_PSM_EDRX            0
+#endif
+
+#ifndef CONFIG_SERVICES_IOTPF_PSM_LINGER
+#define CONFIG_SERVICES_IOTPF_PSM_LINGER          5
+#endif
+
+int64_t iotpf_psm_tau(uint32_t seconds, char bits[9]);
+int64_t iotpf_psm_active(uint32_t seconds, char bits[9]);
+int64_t iotpf_psm_edrx(uint32_t ms, char bits[5]);
+
+/* Asks the modem for the configured timers; CIS_RET_ERROR when the
+ * iotpf_lib can not or the modem refused, the caller power cycles then
+ */
+
+int iotpf_psm_enable(void);
+
+/* Nothing more to send or receive this cycle, drop RRC now */
+
+void iotpf_psm_release(void);
+
+#endif /* _IOTPF_PSM_H_ */
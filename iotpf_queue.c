@@ -0,0 +1,176 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_queue.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cis_log.h"
+#include "iotpf_queue.h"
+#include "iotpf_stats.h"
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void prv_sample(iotpf_queue_t *q, uint32_t ms)
+{
+  int32_t err;
+
+  if (q->srtt == 0)
+    {
+      q->srtt = ms << 3;
+      q->rttvar = ms << 1;
+    }
+  else
+    {
+      err = (int32_t)ms - (q->srtt >> 3);
+      q->srtt += err;
+      q->rttvar += (err < 0 ? -err : err) - (q->rttvar >> 2);
+    }
+
+  q->window = (q->srtt >> 3) + q->rttvar;
+}
+
+static void prv_clamp(iotpf_queue_t *q)
+{
+  if (q->window < CONFIG_SERVICES_IOTPF_QUEUE_WINDOW_MIN)
+    {
+      q->window = CONFIG_SERVICES_IOTPF_QUEUE_WINDOW_MIN;
+    }
+  else if (q->window > CONFIG_SERVICES_IOTPF_QUEUE_WINDOW_MAX)
+    {
+      q->window = CONFIG_SERVICES_IOTPF_QUEUE_WINDOW_MAX;
+    }
+}
+
+static void prv_close(iotpf_queue_t *q, uint32_t now)
+{
+  uint32_t listened = now - q->opened;
+
+  q->open = false;
+  if (q->arrivals > 0)
+    {
+      prv_sample(q, q->last);
+    }
+  else
+    {
+      q->window -= q->window >> 3;
+    }
+
+  prv_clamp(q);
+
+  IOTPF_STAT_INC(queue_windows);
+  IOTPF_STAT_ADD(queue_listen_ms, listened);
+  IOTPF_STAT_SET(queue_window_ms, q->window);
+  LOGD("queue: listened %u ms, %u requests, next window %u ms",
+       listened, q->arrivals, q->window);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void iotpf_queue_init(iotpf_queue_t *q)
+{
+  memset(q, 0, sizeof(*q));
+  q->window = CONFIG_SERVICES_IOTPF_QUEUE_WINDOW_MAX;
+  IOTPF_STAT_SET(queue_window_ms, q->window);
+}
+
+void iotpf_queue_uplink(iotpf_queue_t *q, uint32_t now)
+{
+  q->uplink = now;
+  if (!q->open)
+    {
+      q->open = true;
+      q->opened = now;
+      q->deadline = now + q->window;
+      q->arrivals = 0;
+      q->last = 0;
+    }
+  else if ((int32_t)(now + q->window - q->deadline) > 0)
+    {
+      q->deadline = now + q->window;
+    }
+}
+
+void iotpf_queue_downlink(iotpf_queue_t *q, uint32_t now)
+{
+  uint32_t offset = now - q->uplink;
+
+  if (!q->open)
+    {
+      /* Missed by the last window, or sent while we were not asleep at
+       * all. Only the former says the window was too short.
+       */
+
+      IOTPF_STAT_INC(queue_late);
+      if (q->uplink != 0 && offset < CONFIG_SERVICES_IOTPF_QUEUE_WINDOW_MAX)
+        {
+          prv_sample(q, offset);
+          prv_clamp(q);
+        }
+      return;
+    }
+
+  /* The burst may go on, give it at least the shortest window */
+
+  q->arrivals++;
+  q->last = offset;
+  IOTPF_STAT_INC(queue_downlinks);
+  IOTPF_STAT_ADD(queue_offset_ms, offset);
+  if ((int32_t)(now + CONFIG_SERVICES_IOTPF_QUEUE_WINDOW_MIN -
+                q->deadline) > 0)
+    {
+      q->deadline = now + CONFIG_SERVICES_IOTPF_QUEUE_WINDOW_MIN;
+    }
+}
+
+uint32_t iotpf_queue_poll(iotpf_queue_t *q, uint32_t now)
+{
+  if (!q->open)
+    {
+      return 0;
+    }
+
+  if ((int32_t)(q->deadline - now) > 0)
+    {
+      return q->deadline - now;
+    }
+
+  prv_close(q, now);
+  return 0;
+}
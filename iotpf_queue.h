@@ -0,0 +1,94 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_queue.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef _IOTPF_QUEUE_H_
+#define _IOTPF_QUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* LwM2M queue mode listening window. A server that knows the client
+ * sleeps holds its requests and sends them in one burst as soon as the
+ * client is heard from, so the client only has to listen for a short
+ * while after each uplink. The window is sized like an RFC 6298
+ * retransmission timeout from when the bursts were seen to end, and
+ * shrinks while nothing arrives. Not locked, the owner serializes.
+ */
+
+#ifndef CONFIG_SERVICES_IOTPF_QUEUE_WINDOW_MIN
+#define CONFIG_SERVICES_IOTPF_QUEUE_WINDOW_MIN    1000
+#endif
+
+#ifndef CONFIG_SERVICES_IOTPF_QUEUE_WINDOW_MAX
+#define CONFIG_SERVICES_IOTPF_QUEUE_WINDOW_MAX    10000
+#endif
+
+/* Binding byte of the iotpf_lib config: link type UDP, binding UQ or U */
+
+#ifdef CIS_QUEUE_MODE
+#  define IOTPF_QUEUE_BINDING                     0x12
+#else
+#  define IOTPF_QUEUE_BINDING                     0x11
+#endif
+
+typedef struct iotpf_queue_s
+{
+  uint32_t window;          /* ms the next window stays open */
+  int32_t srtt;             /* end of the burst after the uplink, ms << 3 */
+  int32_t rttvar;           /* its mean deviation, ms << 2 */
+  uint32_t opened;          /* cissys_gettime() the window opened */
+  uint32_t deadline;        /* and closes */
+  uint32_t uplink;          /* cissys_gettime() of the latest uplink */
+  uint32_t last;            /* ms after it of the latest arrival */
+  uint16_t arrivals;        /* in this window */
+  bool open;
+} iotpf_queue_t;
+
+void iotpf_queue_init(iotpf_queue_t *q);
+
+/* An uplink went out, the server sends what it held now */
+
+void iotpf_queue_uplink(iotpf_queue_t *q, uint32_t now);
+
+/* A request of the server arrived */
+
+void iotpf_queue_downlink(iotpf_queue_t *q, uint32_t now);
+
+/* Milliseconds the window stays open; 0 once it is closed, the first
+ * call that returns 0 closes it and adapts the next one
+ */
+
+uint32_t iotpf_queue_poll(iotpf_queue_t *q, uint32_t now);
+
+#endif /* _IOTPF_QUEUE_H_ */
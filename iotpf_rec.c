@@ -0,0 +1,295 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_rec.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "iotpf_rec.h"
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const iotpf_rec_field_t g_heartbeat_fields[] =
+{
+  { IOTPF_REC_HEARTBEAT_SEQ,  IOTPF_REC_UINT, 0, "seq" },
+  { IOTPF_REC_HEARTBEAT_UP,   IOTPF_REC_UINT, 0, "up" },
+  { IOTPF_REC_HEARTBEAT_TIME, IOTPF_REC_UINT, 0, "time" },
+};
+
+static const iotpf_rec_field_t g_report_fields[] =
+{
+  { IOTPF_REC_REPORT_SEQ,    IOTPF_REC_UINT, 0, "seq" },
+  { IOTPF_REC_REPORT_UP,     IOTPF_REC_UINT, 0, "up" },
+  { IOTPF_REC_REPORT_FIX_MS, IOTPF_REC_UINT, 0, "fix_ms" },
+  { IOTPF_REC_REPORT_LAT,    IOTPF_REC_SINT, 6, "lat" },
+  { IOTPF_REC_REPORT_LON,    IOTPF_REC_SINT, 6, "lon" },
+  { IOTPF_REC_REPORT_TIME,   IOTPF_REC_UINT, 0, "time" },
+};
+
+/* Indexed by schema id */
+
+static const iotpf_rec_schema_t g_schemas[] =
+{
+  { 0 },
+  {
+    IOTPF_REC_HEARTBEAT, 2,
+    sizeof(g_heartbeat_fields) / sizeof(g_heartbeat_fields[0]),
+    "heartbeat", g_heartbeat_fields
+  },
+  {
+    IOTPF_REC_REPORT, 2,
+    sizeof(g_report_fields) / sizeof(g_report_fields[0]),
+    "report", g_report_fields
+  },
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static const iotpf_rec_field_t *prv_field(const iotpf_rec_schema_t *schema,
+                                          uint32_t tag)
+{
+  int i;
+
+  for (i = 0; i < schema->nfields; i++)
+    {
+      if (schema->fields[i].tag == tag)
+        {
+          return &schema->fields[i];
+        }
+    }
+
+  return NULL;
+}
+
+static void prv_put(iotpf_rec_t *rec, uint64_t value)
+{
+  do
+    {
+      if (rec->len >= rec->size)
+        {
+          rec->error = true;
+          return;
+        }
+      rec->buf[rec->len++] = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+      value >>= 7;
+    }
+  while (value != 0);
+}
+
+static bool prv_key(iotpf_rec_t *rec, uint8_t tag, uint8_t type)
+{
+  const iotpf_rec_field_t *field;
+
+  if (rec->schema == NULL)
+    {
+      rec->error = true;
+      return false;
+    }
+
+  field = prv_field(rec->schema, tag);
+  if (field == NULL || field->type != type)
+    {
+      rec->error = true;
+      return false;
+    }
+
+  prv_put(rec, (uint32_t)tag << 3 | type);
+  return true;
+}
+
+static int prv_get(iotpf_rec_reader_t *reader, uint64_t *value)
+{
+  uint64_t v = 0;
+  int shift = 0;
+
+  while (reader->p < reader->end && shift < 64)
+    {
+      uint8_t b = *reader->p++;
+
+      v |= (uint64_t)(b & 0x7f) << shift;
+      if ((b & 0x80) == 0)
+        {
+          *value = v;
+          return 0;
+        }
+      shift += 7;
+    }
+
+  return -1;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+const iotpf_rec_schema_t *iotpf_rec_schema(uint8_t id)
+{
+  if (id == 0 || id >= sizeof(g_schemas) / sizeof(g_schemas[0]))
+    {
+      return NULL;
+    }
+
+  return &g_schemas[id];
+}
+
+void iotpf_rec_begin(iotpf_rec_t *rec, uint8_t id, uint8_t *buf,
+                     uint32_t size)
+{
+  rec->buf = buf;
+  rec->size = size;
+  rec->len = 0;
+  rec->error = false;
+  rec->schema = iotpf_rec_schema(id);
+  if (rec->schema == NULL || size < 1)
+    {
+      rec->error = true;
+      return;
+    }
+
+  buf[rec->len++] = id << 4 | rec->schema->version;
+}
+
+void iotpf_rec_uint(iotpf_rec_t *rec, uint8_t tag, uint64_t value)
+{
+  if (prv_key(rec, tag, IOTPF_REC_UINT))
+    {
+      prv_put(rec, value);
+    }
+}
+
+void iotpf_rec_sint(iotpf_rec_t *rec, uint8_t tag, int64_t value)
+{
+  if (prv_key(rec, tag, IOTPF_REC_SINT))
+    {
+      prv_put(rec, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+    }
+}
+
+void iotpf_rec_bytes(iotpf_rec_t *rec, uint8_t tag, const void *data,
+                     uint32_t len)
+{
+  if (!prv_key(rec, tag, IOTPF_REC_BYTES))
+    {
+      return;
+    }
+
+  prv_put(rec, len);
+  if (rec->error || rec->size - rec->len < len)
+    {
+      rec->error = true;
+      return;
+    }
+
+  memcpy(rec->buf + rec->len, data, len);
+  rec->len += len;
+}
+
+int iotpf_rec_end(iotpf_rec_t *rec)
+{
+  return rec->error ? -1 : rec->len;
+}
+
+int iotpf_rec_open(iotpf_rec_reader_t *reader, const uint8_t *buf,
+                   uint32_t len)
+{
+  if (len < 1 || (reader->schema = iotpf_rec_schema(buf[0] >> 4)) == NULL)
+    {
+      return -1;
+    }
+
+  reader->version = buf[0] & 0x0f;
+  reader->p = buf + 1;
+  reader->end = buf + len;
+  return 0;
+}
+
+int iotpf_rec_next(iotpf_rec_reader_t *reader, iotpf_rec_value_t *value)
+{
+  uint64_t key;
+
+  if (reader->p == reader->end)
+    {
+      return 0;
+    }
+
+  if (prv_get(reader, &key) < 0 || (key >> 3) > UINT32_MAX)
+    {
+      return -1;
+    }
+
+  value->tag = key >> 3;
+  value->type = key & 7;
+  value->field = prv_field(reader->schema, value->tag);
+  value->data = NULL;
+  switch (value->type)
+    {
+      case IOTPF_REC_UINT:
+      case IOTPF_REC_SINT:
+        if (prv_get(reader, &value->u) < 0)
+          {
+            return -1;
+          }
+        value->s = (int64_t)(value->u >> 1) ^ -(int64_t)(value->u & 1);
+        break;
+
+      case IOTPF_REC_BYTES:
+        if (prv_get(reader, &value->u) < 0 ||
+            value->u > (uint64_t)(reader->end - reader->p))
+          {
+            return -1;
+          }
+        value->data = reader->p;
+        reader->p += value->u;
+        break;
+
+      default:
+        return -1;
+    }
+
+  /* A known tag has to come with the type the schema gives it */
+
+  if (value->field != NULL && value->field->type != value->type)
+    {
+      return -1;
+    }
+
+  return 1;
+}
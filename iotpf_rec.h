@@ -0,0 +1,148 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_rec.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _IOTPF_REC_H_
+#define _IOTPF_REC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Schema-driven binary records for raw uplinks:
+ *
+ *   schema byte | field | field | ...
+ *
+ * The schema byte is the schema id in bits 7-4 and its version in bits
+ * 3-0. A field is a LEB128 key, tag << 3 | wire type, and its value:
+ *
+ *   0 UINT   LEB128
+ *   1 SINT   LEB128 of the zigzag encoded value
+ *   2 BYTES  LEB128 length, then the bytes
+ *
+ * Decimals go as scaled integers, the schema says how many digits. Fields
+ * may be left out and readers skip tags they do not know, so a new version
+ * can add fields; reusing a tag for something else takes a new schema id.
+ * The schemas live in iotpf_rec.c and are shared with the host decoder.
+ */
+
+#define IOTPF_REC_UINT            0
+#define IOTPF_REC_SINT            1
+#define IOTPF_REC_BYTES           2
+
+/* Schemas and their tags */
+
+#define IOTPF_REC_HEARTBEAT       1
+#define IOTPF_REC_HEARTBEAT_SEQ   1   /* uint */
+#define IOTPF_REC_HEARTBEAT_UP    2   /* uint, seconds since boot */
+#define IOTPF_REC_HEARTBEAT_TIME  3   /* uint, UTC ms, v2 */
+
+#define IOTPF_REC_REPORT          2
+#define IOTPF_REC_REPORT_SEQ      1   /* uint */
+#define IOTPF_REC_REPORT_UP       2   /* uint, seconds since boot */
+#define IOTPF_REC_REPORT_FIX_MS   3   /* uint, UTC ms of the last GPS fix */
+#define IOTPF_REC_REPORT_LAT      4   /* sint, micro degrees, north > 0 */
+#define IOTPF_REC_REPORT_LON      5   /* sint, micro degrees, east > 0 */
+#define IOTPF_REC_REPORT_TIME     6   /* uint, UTC ms of the record, v2 */
+
+/* Longest record any schema produces, every field at its widest */
+
+#define IOTPF_REC_MAX             48
+
+typedef struct iotpf_rec_field_s
+{
+  uint8_t tag;
+  uint8_t type;
+  uint8_t scale;            /* decimal digits after the point */
+  const char *name;
+} iotpf_rec_field_t;
+
+typedef struct iotpf_rec_schema_s
+{
+  uint8_t id;
+  uint8_t version;
+  uint8_t nfields;
+  const char *name;
+  const iotpf_rec_field_t *fields;
+} iotpf_rec_schema_t;
+
+typedef struct iotpf_rec_s
+{
+  uint8_t *buf;
+  uint32_t size;
+  uint32_t len;
+  const iotpf_rec_schema_t *schema;
+  bool error;               /* overflow, or a field not in the schema */
+} iotpf_rec_t;
+
+typedef struct iotpf_rec_reader_s
+{
+  const uint8_t *p;
+  const uint8_t *end;
+  const iotpf_rec_schema_t *schema;
+  uint8_t version;
+} iotpf_rec_reader_t;
+
+typedef struct iotpf_rec_value_s
+{
+  uint32_t tag;
+  uint8_t type;
+  const iotpf_rec_field_t *field;   /* NULL for a tag the schema lacks */
+  uint64_t u;                       /* UINT, and BYTES length */
+  int64_t s;                        /* SINT */
+  const uint8_t *data;              /* BYTES */
+} iotpf_rec_value_t;
+
+const iotpf_rec_schema_t *iotpf_rec_schema(uint8_t id);
+
+/* Writing: begin, one call per field, end. A field that does not fit or
+ * does not match the schema makes iotpf_rec_end() fail.
+ */
+
+void iotpf_rec_begin(iotpf_rec_t *rec, uint8_t id, uint8_t *buf,
+                     uint32_t size);
+void iotpf_rec_uint(iotpf_rec_t *rec, uint8_t tag, uint64_t value);
+void iotpf_rec_sint(iotpf_rec_t *rec, uint8_t tag, int64_t value);
+void iotpf_rec_bytes(iotpf_rec_t *rec, uint8_t tag, const void *data,
+                     uint32_t len);
+int iotpf_rec_end(iotpf_rec_t *rec);
+
+/* Reading: open returns -1 for an unknown schema, next 1 per field, 0 at
+ * the end and -1 for a broken record.
+ */
+
+int iotpf_rec_open(iotpf_rec_reader_t *reader, const uint8_t *buf,
+                   uint32_t len);
+int iotpf_rec_next(iotpf_rec_reader_t *reader, iotpf_rec_value_t *value);
+
+#endif /* _IOTPF_REC_H_ */
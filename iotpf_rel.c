@@ -0,0 +1,107 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_rel.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <nuttx/config.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "iotpf_rel.h"
+#include "iotpf_stats.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SERVICES_IOTPF_CON_EVERY
+#define CONFIG_SERVICES_IOTPF_CON_EVERY           10
+#endif
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static uint16_t g_every = CONFIG_SERVICES_IOTPF_CON_EVERY;
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void iotpf_rel_init(iotpf_rel_t *rel, iotpf_rel_class_t cls)
+{
+  rel->cls = cls;
+  rel->nons = UINT16_MAX;
+}
+
+/* Decides one message of the stream; cls is the message's own class, the
+ * more reliable of it and the stream's wins. The first message of a
+ * stream goes CON so the server confirms the observation right away.
+ */
+
+bool iotpf_rel_confirm(iotpf_rel_t *rel, iotpf_rel_class_t cls)
+{
+  bool con;
+
+  if (cls < rel->cls)
+    {
+      cls = rel->cls;
+    }
+
+  con = cls == IOTPF_REL_ALARM || (g_every > 0 && rel->nons >= g_every - 1);
+  if (con)
+    {
+      rel->nons = 0;
+      IOTPF_STAT_INC(rel_con);
+    }
+  else
+    {
+      rel->nons++;
+      IOTPF_STAT_INC(rel_non);
+    }
+
+  return con;
+}
+
+/* 1 sends everything CON, 0 never promotes telemetry */
+
+void iotpf_rel_set_every(uint16_t every)
+{
+  g_every = every;
+}
+
+uint16_t iotpf_rel_every(void)
+{
+  return g_every;
+}
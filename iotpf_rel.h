@@ -0,0 +1,68 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_rel.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _IOTPF_REL_H_
+#define _IOTPF_REL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Reliability policy for uplinks and notifications. Telemetry that is
+ * stale by the next report goes NON, and every Nth of a stream is sent
+ * CON anyway so a dead link still shows up as failed notifications.
+ * Alarms always go CON. Each stream (an observation, the raw uplink
+ * queue) keeps its own count.
+ */
+
+typedef enum
+{
+  IOTPF_REL_TELEMETRY = 0,  /* NON, CON every iotpf_rel_every() */
+  IOTPF_REL_ALARM,          /* always CON */
+} iotpf_rel_class_t;
+
+typedef struct iotpf_rel_s
+{
+  uint8_t cls;              /* iotpf_rel_class_t of the stream */
+  uint16_t nons;            /* NONs since the last CON, MAX before one */
+} iotpf_rel_t;
+
+#define IOTPF_REL_INITIALIZER(cls) { (cls), UINT16_MAX }
+
+void iotpf_rel_init(iotpf_rel_t *rel, iotpf_rel_class_t cls);
+bool iotpf_rel_confirm(iotpf_rel_t *rel, iotpf_rel_class_t cls);
+void iotpf_rel_set_every(uint16_t every);
+uint16_t iotpf_rel_every(void);
+
+#endif /* _IOTPF_REL_H_ */
@@ -0,0 +1,200 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_sha256.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include "iotpf_sha256.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#define ROR(x, n)      (((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z)    (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z)   (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define EP0(x)         (ROR(x, 2) ^ ROR(x, 13) ^ ROR(x, 22))
+#define EP1(x)         (ROR(x, 6) ^ ROR(x, 11) ^ ROR(x, 25))
+#define SIG0(x)        (ROR(x, 7) ^ ROR(x, 18) ^ ((x) >> 3))
+#define SIG1(x)        (ROR(x, 17) ^ ROR(x, 19) ^ ((x) >> 10))
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const uint32_t g_sha256_k[64] =
+{
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void iotpf_sha256_transform(iotpf_sha256_t *ctx, const uint8_t *data)
+{
+  uint32_t a, b, c, d, e, f, g, h, t1, t2;
+  uint32_t m[64];
+  int i;
+
+  for (i = 0; i < 16; i++)
+    {
+      m[i] = ((uint32_t)data[i * 4] << 24) | ((uint32_t)data[i * 4 + 1] << 16) |
+             ((uint32_t)data[i * 4 + 2] << 8) | data[i * 4 + 3];
+    }
+  for (; i < 64; i++)
+    {
+      m[i] = SIG1(m[i - 2]) + m[i - 7] + SIG0(m[i - 15]) + m[i - 16];
+    }
+
+  a = ctx->state[0];
+  b = ctx->state[1];
+  c = ctx->state[2];
+  d = ctx->state[3];
+  e = ctx->state[4];
+  f = ctx->state[5];
+  g = ctx->state[6];
+  h = ctx->state[7];
+
+  for (i = 0; i < 64; i++)
+    {
+      t1 = h + EP1(e) + CH(e, f, g) + g_sha256_k[i] + m[i];
+      t2 = EP0(a) + MAJ(a, b, c);
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+
+  ctx->state[0] += a;
+  ctx->state[1] += b;
+  ctx->state[2] += c;
+  ctx->state[3] += d;
+  ctx->state[4] += e;
+  ctx->state[5] += f;
+  ctx->state[6] += g;
+  ctx->state[7] += h;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void iotpf_sha256_init(iotpf_sha256_t *ctx)
+{
+  ctx->state[0] = 0x6a09e667;
+  ctx->state[1] = 0xbb67ae85;
+  ctx->state[2] = 0x3c6ef372;
+  ctx->state[3] = 0xa54ff53a;
+  ctx->state[4] = 0x510e527f;
+  ctx->state[5] = 0x9b05688c;
+  ctx->state[6] = 0x1f83d9ab;
+  ctx->state[7] = 0x5be0cd19;
+  ctx->length = 0;
+}
+
+void iotpf_sha256_update(iotpf_sha256_t *ctx, const uint8_t *data,
+                         uint32_t len)
+{
+  uint32_t used = ctx->length % 64;
+  uint32_t fill;
+
+  ctx->length += len;
+
+  if (used > 0)
+    {
+      fill = 64 - used;
+      if (len < fill)
+        {
+          memcpy(ctx->block + used, data, len);
+          return;
+        }
+      memcpy(ctx->block + used, data, fill);
+      iotpf_sha256_transform(ctx, ctx->block);
+      data += fill;
+      len -= fill;
+    }
+
+  while (len >= 64)
+    {
+      iotpf_sha256_transform(ctx, data);
+      data += 64;
+      len -= 64;
+    }
+
+  memcpy(ctx->block, data, len);
+}
+
+void iotpf_sha256_final(iotpf_sha256_t *ctx,
+                        uint8_t digest[IOTPF_SHA256_DIGEST_LEN])
+{
+  uint64_t bits = ctx->length * 8;
+  uint32_t used = ctx->length % 64;
+  int i;
+
+  ctx->block[used++] = 0x80;
+  if (used > 56)
+    {
+      memset(ctx->block + used, 0, 64 - used);
+      iotpf_sha256_transform(ctx, ctx->block);
+      used = 0;
+    }
+  memset(ctx->block + used, 0, 56 - used);
+
+  for (i = 0; i < 8; i++)
+    {
+      ctx->block[63 - i] = (uint8_t)(bits >> (i * 8));
+    }
+  iotpf_sha256_transform(ctx, ctx->block);
+
+  for (i = 0; i < 32; i++)
+    {
+      digest[i] = (uint8_t)(ctx->state[i / 4] >> (24 - (i % 4) * 8));
+    }
+}
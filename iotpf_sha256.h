@@ -0,0 +1,58 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_sha256.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _IOTPF_SHA256_H_
+#define _IOTPF_SHA256_H_
+
+#include <stdint.h>
+
+#define IOTPF_SHA256_DIGEST_LEN    32
+
+/* Plain-old-data so a running hash can be saved and restored as bytes */
+
+typedef struct iotpf_sha256_s
+{
+  uint32_t state[8];
+  uint64_t length;
+  uint8_t block[64];
+} iotpf_sha256_t;
+
+void iotpf_sha256_init(iotpf_sha256_t *ctx);
+void iotpf_sha256_update(iotpf_sha256_t *ctx, const uint8_t *data,
+                         uint32_t len);
+void iotpf_sha256_final(iotpf_sha256_t *ctx,
+                        uint8_t digest[IOTPF_SHA256_DIGEST_LEN]);
+
+#endif /* _IOTPF_SHA256_H_ */
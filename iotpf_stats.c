@@ -0,0 +1,364 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_stats.c
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <nuttx/config.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "cis_api.h"
+#include "cis_log.h"
+#include "iotpf_stats.h"
+#include "iotpf_clock.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_SERVICES_IOTPF_STATS_PATH
+#define CONFIG_SERVICES_IOTPF_STATS_PATH          "/tmp/iotpf.stats"
+#endif
+
+#define IOTPF_STATS_TIMEOUT_MS                    1000
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+iotpf_stats_t g_iotpf_stats;
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static uint32_t g_stats_start;
+static pthread_t g_stats_tid;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void prv_print_hist(const char *name, const iotpf_hist_t *h,
+                           const char *unit)
+{
+  uint32_t count = iotpf_hist_count(h);
+
+  if (count > 0)
+    {
+      printf("%-15s %u, p50 %u p90 %u p99 %u max %u %s\n", name, count,
+             iotpf_hist_percentile(h, 500), iotpf_hist_percentile(h, 900),
+             iotpf_hist_percentile(h, 990), h->max, unit);
+    }
+}
+
+/* With reset, the histograms are cleared word by word as they are read:
+ * a sample added meanwhile lands in this period or in the next one, it
+ * is never lost.
+ */
+
+static void prv_snapshot(iotpf_stats_t *stats, bool reset)
+{
+  uint32_t *src = (uint32_t *)&g_iotpf_stats;
+  uint32_t *dst = (uint32_t *)stats;
+  iotpf_clock_status_t clock;
+  unsigned first = offsetof(iotpf_stats_t, reg_ms) / sizeof(uint32_t);
+  unsigned last = (offsetof(iotpf_stats_t, gps_ttff_ms) +
+                   sizeof(iotpf_hist_t)) / sizeof(uint32_t);
+  unsigned i;
+
+  for (i = 0; i < sizeof(*stats) / sizeof(uint32_t); i++)
+    {
+      if (reset && i >= first && i < last)
+        {
+          dst[i] = __atomic_exchange_n(&src[i], 0, __ATOMIC_RELAXED);
+        }
+      else
+        {
+          dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+        }
+    }
+
+  stats->version = IOTPF_STATS_VERSION;
+  stats->uptime_ms = cissys_gettime() - g_stats_start;
+  iotpf_pm_residency(stats->pm_state_ms, stats->pm_hold_ms);
+  iotpf_clock_status(&clock);
+  stats->clock_source = clock.source;
+  stats->clock_drift_ppb = clock.drift_ppb;
+  stats->clock_error_ms = clock.last_error_ms;
+  stats->clock_age_s = clock.age_s;
+}
+
+static int prv_bind(int sock, const char *path)
+{
+  struct sockaddr_un addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_LOCAL;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  unlink(addr.sun_path);
+  return bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+/* Answers every datagram with a snapshot, "r" also resets the
+ * histograms; blocked in recvfrom() otherwise
+ */
+
+static void *prv_stats_thread(void *arg)
+{
+  int sock = (int)(intptr_t)arg;
+
+  pthread_setname_np(pthread_self(), "iotpf_stats");
+  for (; ; )
+    {
+      struct sockaddr_un from;
+      socklen_t fromlen = sizeof(from);
+      static iotpf_stats_t stats;  /* too big for a small stack */
+      char req[8];
+      ssize_t len;
+
+      len = recvfrom(sock, req, sizeof(req), 0, (struct sockaddr *)&from,
+                     &fromlen);
+      if (len < 0)
+        {
+          if (errno == EINTR)
+            {
+              continue;
+            }
+          LOGE("stats: recvfrom: %d", errno);
+          break;
+        }
+
+      prv_snapshot(&stats, len > 0 && req[0] == 'r');
+      sendto(sock, &stats, sizeof(stats), 0, (struct sockaddr *)&from,
+             fromlen);
+    }
+
+  close(sock);
+  return NULL;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int iotpf_stats_serve(void)
+{
+  int sock;
+
+  g_stats_start = cissys_gettime();
+  sock = socket(AF_LOCAL, SOCK_DGRAM, 0);
+  if (sock < 0 || prv_bind(sock, CONFIG_SERVICES_IOTPF_STATS_PATH) < 0)
+    {
+      LOGE("stats: cannot serve on %s: %d", CONFIG_SERVICES_IOTPF_STATS_PATH,
+           errno);
+      if (sock >= 0)
+        {
+          close(sock);
+        }
+      return CIS_RET_ERROR;
+    }
+
+  if (pthread_create(&g_stats_tid, NULL, prv_stats_thread,
+                     (void *)(intptr_t)sock) != 0)
+    {
+      close(sock);
+      return CIS_RET_ERROR;
+    }
+
+  pthread_detach(g_stats_tid);
+  return CIS_RET_OK;
+}
+
+int iotpf_stats_query(iotpf_stats_t *stats, bool reset)
+{
+  struct sockaddr_un addr;
+  struct pollfd pfd;
+  char path[sizeof(addr.sun_path) - 1];
+  int ret = CIS_RET_ERROR;
+  int sock;
+
+  sock = socket(AF_LOCAL, SOCK_DGRAM, 0);
+  if (sock < 0)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  /* The reply needs an address to come back to */
+
+  snprintf(path, sizeof(path), "%s.%d", CONFIG_SERVICES_IOTPF_STATS_PATH,
+           (int)getpid());
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_LOCAL;
+  strncpy(addr.sun_path, CONFIG_SERVICES_IOTPF_STATS_PATH,
+          sizeof(addr.sun_path) - 1);
+  if (prv_bind(sock, path) < 0 ||
+      sendto(sock, reset ? "r" : "s", 1, 0, (struct sockaddr *)&addr,
+             sizeof(addr)) < 0)
+    {
+      goto out;
+    }
+
+  pfd.fd = sock;
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, IOTPF_STATS_TIMEOUT_MS) == 1 &&
+      recv(sock, stats, sizeof(*stats), 0) == sizeof(*stats) &&
+      stats->version == IOTPF_STATS_VERSION)
+    {
+      ret = CIS_RET_OK;
+    }
+
+out:
+  close(sock);
+  unlink(path);
+  return ret;
+}
+
+/* Runs as the "iotpf stats" command, not in the daemon: the report is its
+ * output and goes to the shell's stdout with printf, like the other
+ * command line messages in iotpf.c. LOGx() would send it to syslog and
+ * drop it below the configured log level.
+ */
+
+int iotpf_stats_print(bool reset)
+{
+  static iotpf_stats_t s;
+  int i;
+
+  if (iotpf_stats_query(&s, reset) != CIS_RET_OK)
+    {
+      printf("iotpf: no answer on %s, is the daemon running?\n",
+             CONFIG_SERVICES_IOTPF_STATS_PATH);
+      return -1;
+    }
+
+  printf("uptime          %u.%03u s\n", s.uptime_ms / 1000,
+         s.uptime_ms % 1000);
+  printf("uplinks         queued %u sent %u failed %u, %u bytes\n",
+         s.uplinks_queued, s.uplinks_sent, s.uplinks_failed, s.bytes_up);
+  if (s.comp_in > 0)
+    {
+      printf("compression     %u -> %u bytes, %u%%\n", s.comp_in,
+             s.comp_out, (uint32_t)((uint64_t)s.comp_out * 100 / s.comp_in));
+    }
+  printf("downlinks       %u, %u bytes\n", s.downlinks, s.bytes_down);
+  printf("received        %u datagrams, %u bytes", s.rx_datagrams,
+         s.rx_bytes);
+  if (s.net_pool_exhausted > 0)
+    {
+      printf(", pool exhausted %u times", s.net_pool_exhausted);
+    }
+
+  printf("\n");
+  printf("notifications   %u acked %u failed %u", s.notifies,
+         s.notify_acked, s.notify_failed);
+  if (s.notify_untimed > 0)
+    {
+      printf(", %u untimed", s.notify_untimed);
+    }
+
+  printf("\n");
+  printf("responses       failed %u\n", s.response_failed);
+  printf("reliability     con %u non %u\n", s.rel_con, s.rel_non);
+  printf("pump            loops %u wakeups %u\n", s.pump_loops, s.wakeups);
+  printf("reconnects      %u\n", s.reconnects);
+  if (s.dtls_full + s.dtls_resumed > 0)
+    {
+      printf("dtls            full %u avg %u ms, resumed %u avg %u ms\n",
+             s.dtls_full, s.dtls_full ? s.dtls_full_ms / s.dtls_full : 0,
+             s.dtls_resumed,
+             s.dtls_resumed ? s.dtls_resumed_ms / s.dtls_resumed : 0);
+    }
+
+  printf("gps             starts %u fixes %u", s.gps_starts, s.gps_fixes);
+  if (s.gps_ttff_count > 0)
+    {
+      printf(", ttff last %u ms avg %u ms", s.gps_ttff_last_ms,
+             s.gps_ttff_total_ms / s.gps_ttff_count);
+    }
+
+  printf("\n");
+
+  if (s.clock_source != IOTPF_CLOCK_NONE)
+    {
+      printf("clock           %s, %u s ago, error %d ms, drift %d ppb, "
+             "refs %u steps %u\n",
+             s.clock_source == IOTPF_CLOCK_GPS ? "gps" : "net", s.clock_age_s,
+             s.clock_error_ms, s.clock_drift_ppb, s.clock_refs,
+             s.clock_steps);
+    }
+
+  if (s.resume_count > 0)
+    {
+      printf("resume          last %u ms avg %u ms, %u cycles, "
+             "%u releases\n", s.resume_last_ms,
+             s.resume_total_ms / s.resume_count, s.resume_count,
+             s.psm_releases);
+    }
+
+  if (s.queue_windows > 0)
+    {
+      printf("queue           %u windows, %u ms listening, next %u ms, "
+             "%u requests avg +%u ms, %u late\n", s.queue_windows,
+             s.queue_listen_ms, s.queue_window_ms, s.queue_downlinks,
+             s.queue_downlinks ? s.queue_offset_ms / s.queue_downlinks : 0,
+             s.queue_late);
+    }
+
+  prv_print_hist("register", &s.reg_ms, "ms");
+  prv_print_hist("notify ack", &s.notify_ms, "ms");
+  prv_print_hist("request", &s.request_us, "us");
+  prv_print_hist("pump loop", &s.pump_us, "us");
+  prv_print_hist("gps ttff", &s.gps_ttff_ms, "ms");
+
+  printf("pm state        normal %u idle %u standby %u sleep %u ms\n",
+         s.pm_state_ms[PM_NORMAL], s.pm_state_ms[PM_IDLE],
+         s.pm_state_ms[PM_STANDBY], s.pm_state_ms[PM_SLEEP]);
+  printf("pm held by     ");
+  for (i = 0; i < IOTPF_PM_NREASONS; i++)
+    {
+      printf(" %s %u", iotpf_pm_reason_str(i), s.pm_hold_ms[i]);
+    }
+
+  printf(" ms\n");
+  return 0;
+}
@@ -0,0 +1,136 @@
+/****************************************************************************
+ * external/services/iotpf/iotpf_stats.h
+ *
+ *     Copyright (C) 2020 FishSemi Inc. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name NuttX nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef _IOTPF_STATS_H_
+#define _IOTPF_STATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "iotpf_hist.h"
+#include "iotpf_pm.h"
+
+/* Counters bumped on the hot paths with relaxed atomics and handed out
+ * whole to `iotpf stats` over a local datagram socket. Nothing is
+ * formatted or copied unless somebody asks. `iotpf stats -r` clears the
+ * latency histograms once they are copied, so that each reporting
+ * period gets its own percentiles.
+ */
+
+#define IOTPF_STATS_VERSION       11
+
+typedef struct iotpf_stats_s
+{
+  uint32_t version;
+  uint32_t uptime_ms;          /* filled in by the snapshot */
+  uint32_t uplinks_queued;     /* raw uplinks handed to the send thread */
+  uint32_t uplinks_sent;       /* accepted by cis_notify_raw() */
+  uint32_t uplinks_failed;
+  uint32_t bytes_up;           /* raw uplink payload, as sent */
+  uint32_t comp_in;            /* raw uplink bytes before compression */
+  uint32_t comp_out;           /* and after, with the header byte */
+  uint32_t downlinks;          /* raw downlinks delivered */
+  uint32_t bytes_down;         /* raw downlink payload */
+  uint32_t rx_datagrams;       /* cmcc: datagrams read for the pump */
+  uint32_t rx_bytes;
+  uint32_t net_pool_exhausted; /* cmcc: reads put off, packet pool empty */
+  uint32_t notifies;           /* object notifications issued */
+  uint32_t notify_acked;       /* CIS_EVENT_NOTIFY_SUCCESS */
+  uint32_t notify_failed;      /* CIS_EVENT_NOTIFY_FAILED */
+  uint32_t notify_untimed;     /* ctcc: confirmable uplinks left out of
+                                * notify_ms, the ack ring was full */
+  uint32_t response_failed;    /* CIS_EVENT_RESPONSE_FAILED */
+  uint32_t rel_con;            /* sent confirmable by iotpf_rel */
+  uint32_t rel_non;            /* sent non-confirmable by iotpf_rel */
+  uint32_t pump_loops;         /* cmcc: pump loop iterations */
+  uint32_t wakeups;            /* pump wakeups requested */
+  uint32_t reconnects;         /* registrations that followed a failure */
+  uint32_t dtls_full;          /* our registers after a full handshake */
+  uint32_t dtls_full_ms;       /* their cis_register() to REG_SUCCESS */
+  uint32_t dtls_resumed;       /* after an abbreviated one */
+  uint32_t dtls_resumed_ms;
+  uint32_t gps_starts;
+  uint32_t gps_fixes;
+  uint32_t gps_ttff_count;     /* starts that got a fix */
+  uint32_t gps_ttff_last_ms;   /* start_gps() to first fix */
+  uint32_t gps_ttff_total_ms;
+  uint32_t clock_refs;         /* references taken by iotpf_clock */
+  uint32_t clock_steps;        /* of them, corrections too big to slew */
+  uint32_t clock_source;       /* filled in by the snapshot */
+  int32_t clock_drift_ppb;     /* filled in by the snapshot */
+  int32_t clock_error_ms;      /* filled in by the snapshot */
+  uint32_t clock_age_s;        /* filled in by the snapshot */
+  uint32_t psm_releases;       /* RRC released by release assistance */
+  uint32_t resume_count;       /* report cycles back on the network */
+  uint32_t resume_last_ms;     /* connect_to_server() to the first uplink */
+  uint32_t resume_total_ms;
+  uint32_t queue_windows;      /* queue mode listening windows closed */
+  uint32_t queue_listen_ms;    /* time they were open */
+  uint32_t queue_window_ms;    /* length of the next one */
+  uint32_t queue_downlinks;    /* requests that came in a window */
+  uint32_t queue_offset_ms;    /* sum of their ms after the uplink */
+  uint32_t queue_late;         /* requests that came outside any */
+  iotpf_hist_t reg_ms;         /* cis_register() to CIS_EVENT_REG_SUCCESS */
+  iotpf_hist_t notify_ms;      /* confirmable notification to its ACK */
+  iotpf_hist_t request_us;     /* server request callback to cis_response() */
+  iotpf_hist_t pump_us;        /* cmcc: pump loop iteration, select() aside */
+  iotpf_hist_t gps_ttff_ms;    /* start_gps() to first fix */
+  uint32_t pm_state_ms[PM_COUNT];           /* filled in by the snapshot */
+  uint32_t pm_hold_ms[IOTPF_PM_NREASONS];   /* filled in by the snapshot */
+} iotpf_stats_t;
+
+#ifdef CIS_STATS
+extern iotpf_stats_t g_iotpf_stats;
+
+#  define IOTPF_STAT_ADD(f, n) \
+     __atomic_fetch_add(&g_iotpf_stats.f, (n), __ATOMIC_RELAXED)
+#  define IOTPF_STAT_SET(f, v) \
+     __atomic_store_n(&g_iotpf_stats.f, (v), __ATOMIC_RELAXED)
+#  define IOTPF_HIST_ADD(h, v) iotpf_hist_add(&g_iotpf_stats.h, (v))
+#  define IOTPF_HIST_NOW_US()  iotpf_hist_now_us()
+#else
+#  define IOTPF_STAT_ADD(f, n) ((void)(n))
+#  define IOTPF_STAT_SET(f, v) ((void)(v))
+#  define IOTPF_HIST_ADD(h, v) ((void)(v))
+#  define IOTPF_HIST_NOW_US()  0
+#endif
+
+#define IOTPF_STAT_INC(f)      IOTPF_STAT_ADD(f, 1)
+
+int iotpf_stats_serve(void);
+int iotpf_stats_query(iotpf_stats_t *stats, bool reset);
+int iotpf_stats_print(bool reset);
+
+#endif /* _IOTPF_STATS_H_ */
@@ -34,12 +34,16 @@
 
 #if CIS_ONE_MCU && CIS_OPERATOR_CTCC
 
+#include <nuttx/config.h>
+
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <signal.h>
 #include <sys/time.h>
 #include <sys/select.h>
 #include <string.h>
+#include <time.h>
 
 #include "at_api.h"
 #include "cis_log.h"
@@ -47,16 +51,307 @@
 #include "cis_if_api_ctcc.h"
 
 #include "iotpf_user.h"
+#include "iotpf_stats.h"
+#include "iotpf_dlog.h"
+#include "iotpf_pm.h"
+#include "iotpf_bench.h"
+#include "iotpf_rec.h"
+#include "iotpf_clock.h"
+#ifdef CIS_PSM
+#include "iotpf_psm.h"
+#endif
+#ifdef CIS_QUEUE_MODE
+#include "iotpf_queue.h"
+#endif
+#ifdef CIS_BLOCKWISE
+#include "iotpf_block.h"
+#endif
+#ifdef CIS_COMPRESS
+#include "iotpf_comp.h"
+#endif
 
 #define REPORT_INTERVAL 5  // 5 seconds one report
-#define GPS_BUF_SZ 256
+
+typedef struct user_gps_fix_s
+{
+  uint64_t time_ms;         /* UTC */
+  int32_t lat;              /* micro degrees, north > 0 */
+  int32_t lon;              /* micro degrees, east > 0 */
+  bool valid;
+} user_gps_fix_t;
 
 static pthread_mutex_t g_exit_mutex;
 static bool g_exit;
 
-static pthread_mutex_t g_gps_mutex;
-static pthread_cond_t g_gps_cond;
-static char g_gps_data[GPS_BUF_SZ];
+/* Raw uplinks are one stream for the CON/NON policy */
+
+static iotpf_rel_t g_raw_rel = IOTPF_REL_INITIALIZER(IOTPF_REL_TELEMETRY);
+
+#ifdef CIS_COMPRESS
+/* ...and one stream for compression, only touched by the send thread.
+ * A frame is encoded against g_raw_next, which becomes the stream state
+ * only once the uplink was taken: a frame that never left must not be the
+ * next delta's reference.
+ */
+
+static iotpf_comp_t g_raw_comp;
+static iotpf_comp_t g_raw_next;
+#endif
+
+/* The fix is written by the GPS callback and read by the report encoder
+ * on the user thread; both go through g_gps_mutex, which outlives any
+ * one capture.
+ */
+
+static pthread_mutex_t g_gps_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_gps_cond = PTHREAD_COND_INITIALIZER;
+static user_gps_fix_t g_gps_fix;
+static uint32_t g_report_seq;
+static uint32_t g_heartbeat_seq;
+#ifdef CIS_STATS
+static uint32_t g_gps_start;
+static bool g_gps_fixed;
+#endif
+
+/* Uplinks queued and not yet sent, or sent confirmable and not yet
+ * answered. With PSM the radio is released once this drains. The first
+ * uplink sent after connect_to_server() ends the resume measurement, and
+ * in queue mode every uplink opens the listening window.
+ */
+
+static pthread_mutex_t g_exchange_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_exchange_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t g_exchanges;
+#ifdef CIS_BLOCKWISE
+/* Confirmable raw uplinks sent and answered so far, and how the last one
+ * was: a block waits for its own answer before the next goes
+ */
+
+#define USER_BLOCK_ACK_MS         120000
+
+static uint32_t g_acks_sent;
+static uint32_t g_acks_done;
+static bool g_ack_ok;
+#endif
+#ifdef CIS_STATS
+static uint32_t g_resume_start;
+static bool g_resuming;
+#endif
+#ifdef CIS_STATS
+/* When the confirmable uplinks in flight were sent, oldest first: every
+ * raw notification is answered under the same observe mid, so their
+ * ACKs can only be matched in order. g_ack_count counts them all; once
+ * more are in flight than there are slots, sampling stops until they
+ * have all been answered, or later ACKs would pop the wrong send time.
+ */
+
+#define USER_ACK_SLOTS            8
+
+static uint32_t g_ack_sent[USER_ACK_SLOTS];
+static uint8_t g_ack_head;
+static uint32_t g_ack_count;
+static bool g_ack_untimed;
+#endif
+#ifdef CIS_PSM
+static bool g_psm;
+#endif
+#ifdef CIS_QUEUE_MODE
+static iotpf_queue_t g_queue;
+#endif
+
+#if defined(CIS_PSM) || defined(CIS_QUEUE_MODE) || defined(CIS_BLOCKWISE)
+/* With g_exchange_mutex held */
+
+static void user_exchange_wait(uint32_t timeout_ms)
+{
+  struct timespec abstime;
+
+  clock_gettime(CLOCK_REALTIME, &abstime);
+  abstime.tv_sec += timeout_ms / 1000;
+  abstime.tv_nsec += (timeout_ms % 1000) * 1000000;
+  if (abstime.tv_nsec >= 1000000000)
+    {
+      abstime.tv_sec++;
+      abstime.tv_nsec -= 1000000000;
+    }
+  pthread_cond_timedwait(&g_exchange_cond, &g_exchange_mutex, &abstime);
+}
+#endif
+
+#if defined(CIS_PSM) || defined(CIS_QUEUE_MODE)
+/* Waits up to timeout_ms for the exchanges to drain, true when they did.
+ * With g_exchange_mutex held.
+ */
+
+static bool user_exchange_drain(uint32_t timeout_ms)
+{
+  uint32_t start = cissys_gettime();
+  uint32_t spent;
+
+  while (g_exchanges > 0 &&
+         (spent = cissys_gettime() - start) < timeout_ms)
+    {
+      user_exchange_wait(timeout_ms - spent);
+    }
+
+  return g_exchanges == 0;
+}
+#endif
+
+static void user_exchange_begin(void)
+{
+  pthread_mutex_lock(&g_exchange_mutex);
+  g_exchanges++;
+  pthread_mutex_unlock(&g_exchange_mutex);
+}
+
+/* A confirmable uplink is about to go out, or did not after all */
+
+static void user_ack_sending(void)
+{
+  pthread_mutex_lock(&g_exchange_mutex);
+#ifdef CIS_BLOCKWISE
+  g_acks_sent++;
+#endif
+#ifdef CIS_STATS
+  if (g_ack_count >= USER_ACK_SLOTS)
+    {
+      g_ack_untimed = true;
+    }
+
+  if (g_ack_untimed)
+    {
+      IOTPF_STAT_INC(notify_untimed);
+    }
+  else
+    {
+      g_ack_sent[(g_ack_head + g_ack_count) % USER_ACK_SLOTS] =
+        cissys_gettime();
+    }
+
+  g_ack_count++;
+#endif
+  pthread_mutex_unlock(&g_exchange_mutex);
+}
+
+static void user_ack_unsent(void)
+{
+  pthread_mutex_lock(&g_exchange_mutex);
+#ifdef CIS_BLOCKWISE
+  g_acks_sent--;
+#endif
+#ifdef CIS_STATS
+  if (g_ack_count > 0 && --g_ack_count == 0)
+    {
+      g_ack_untimed = false;
+    }
+#endif
+  pthread_mutex_unlock(&g_exchange_mutex);
+}
+
+/* The oldest confirmable uplink was answered, or given up on */
+
+void cisapi_user_acked(bool ok)
+{
+  pthread_mutex_lock(&g_exchange_mutex);
+#ifdef CIS_BLOCKWISE
+  g_acks_done++;
+  g_ack_ok = ok;
+#endif
+#ifdef CIS_STATS
+  if (g_ack_count > 0)
+    {
+      if (ok && !g_ack_untimed)
+        {
+          IOTPF_HIST_ADD(notify_ms,
+                         cissys_gettime() - g_ack_sent[g_ack_head]);
+        }
+      g_ack_head = (g_ack_head + 1) % USER_ACK_SLOTS;
+      if (--g_ack_count == 0)
+        {
+          g_ack_untimed = false;
+        }
+    }
+#endif
+  pthread_mutex_unlock(&g_exchange_mutex);
+  cisapi_user_exchange_end();
+}
+
+void cisapi_user_exchange_end(void)
+{
+  pthread_mutex_lock(&g_exchange_mutex);
+  if (g_exchanges > 0)
+    {
+      g_exchanges--;
+    }
+  pthread_cond_broadcast(&g_exchange_cond);
+  pthread_mutex_unlock(&g_exchange_mutex);
+}
+
+static void user_uplinked(void)
+{
+  pthread_mutex_lock(&g_exchange_mutex);
+#ifdef CIS_STATS
+  if (g_resuming)
+    {
+      uint32_t ms = cissys_gettime() - g_resume_start;
+
+      g_resuming = false;
+      IOTPF_STAT_INC(resume_count);
+      IOTPF_STAT_SET(resume_last_ms, ms);
+      IOTPF_STAT_ADD(resume_total_ms, ms);
+    }
+#endif
+#ifdef CIS_QUEUE_MODE
+  iotpf_queue_uplink(&g_queue, cissys_gettime());
+#endif
+  pthread_mutex_unlock(&g_exchange_mutex);
+}
+
+/* Registered or updated: the server sends what it held, and its
+ * observes, right after
+ */
+
+void cisapi_user_registered(void)
+{
+#ifdef CIS_QUEUE_MODE
+  pthread_mutex_lock(&g_exchange_mutex);
+  iotpf_queue_uplink(&g_queue, cissys_gettime());
+  pthread_mutex_unlock(&g_exchange_mutex);
+#endif
+}
+
+/* A request of the server arrived */
+
+void cisapi_user_downlink(void)
+{
+#ifdef CIS_QUEUE_MODE
+  pthread_mutex_lock(&g_exchange_mutex);
+  iotpf_queue_downlink(&g_queue, cissys_gettime());
+  pthread_cond_broadcast(&g_exchange_cond);
+  pthread_mutex_unlock(&g_exchange_mutex);
+#endif
+}
+
+#ifdef CIS_QUEUE_MODE
+/* Instead of staying up for a fixed REPORT_INTERVAL: waits for the
+ * uplinks of this cycle to go out, then for the window they opened to
+ * close on what the server held
+ */
+
+static void user_listen(void)
+{
+  uint32_t left;
+
+  pthread_mutex_lock(&g_exchange_mutex);
+  user_exchange_drain(CONFIG_SERVICES_IOTPF_QUEUE_WINDOW_MAX);
+  while ((left = iotpf_queue_poll(&g_queue, cissys_gettime())) > 0)
+    {
+      user_exchange_wait(left);
+    }
+  pthread_mutex_unlock(&g_exchange_mutex);
+}
+#endif
 
 static void stop_user_thread(void)
 {
@@ -66,7 +361,8 @@ static void stop_user_thread(void)
 }
 
 static void send_data_to_server(user_thread_context_t *utc,
-                                void *data, uint32_t data_len)
+                                void *data, uint32_t data_len,
+                                iotpf_rel_class_t rel)
 {
   user_data_info_t udi;
 
@@ -76,20 +372,305 @@ static void send_data_to_server(user_thread_context_t *utc,
       return;
     }
   udi.data_len = data_len;
+  udi.rel = rel;
   memcpy(udi.data, data, data_len);
 
+  user_exchange_begin();
+  file_write(&utc->send_pipe_file, &udi, sizeof(user_data_info_t));
+  IOTPF_STAT_INC(uplinks_queued);
+}
+
+/* Records are encoded straight into the buffer that goes down the send
+ * pipe instead of being copied there by send_data_to_server()
+ */
+
+static void send_record_to_server(user_thread_context_t *utc,
+                                  int (*encode)(uint8_t *buf, uint32_t size),
+                                  iotpf_rel_class_t rel)
+{
+  user_data_info_t udi;
+  int len;
+
+  udi.data = (uint8_t *)malloc(IOTPF_REC_MAX);
+  if (udi.data == NULL)
+    {
+      return;
+    }
+
+  len = encode(udi.data, IOTPF_REC_MAX);
+  if (len < 0)
+    {
+      LOGE("user_thread: record does not encode");
+      free(udi.data);
+      return;
+    }
+  udi.data_len = len;
+  udi.rel = rel;
+
+  user_exchange_begin();
   file_write(&utc->send_pipe_file, &udi, sizeof(user_data_info_t));
+  IOTPF_STAT_INC(uplinks_queued);
 }
 
+static int user_report_encode(uint8_t *buf, uint32_t size)
+{
+  uint64_t now = iotpf_clock_utc_ms();
+  user_gps_fix_t fix;
+  iotpf_rec_t rec;
+
+  pthread_mutex_lock(&g_gps_mutex);
+  fix = g_gps_fix;
+  pthread_mutex_unlock(&g_gps_mutex);
+
+  iotpf_rec_begin(&rec, IOTPF_REC_REPORT, buf, size);
+  iotpf_rec_uint(&rec, IOTPF_REC_REPORT_SEQ, g_report_seq++);
+  iotpf_rec_uint(&rec, IOTPF_REC_REPORT_UP, cissys_gettime() / 1000);
+  if (now != 0)
+    {
+      iotpf_rec_uint(&rec, IOTPF_REC_REPORT_TIME, now);
+    }
+  if (fix.valid)
+    {
+      iotpf_rec_uint(&rec, IOTPF_REC_REPORT_FIX_MS, fix.time_ms);
+      iotpf_rec_sint(&rec, IOTPF_REC_REPORT_LAT, fix.lat);
+      iotpf_rec_sint(&rec, IOTPF_REC_REPORT_LON, fix.lon);
+    }
+
+  return iotpf_rec_end(&rec);
+}
+
+static int user_heartbeat_encode(uint8_t *buf, uint32_t size)
+{
+  uint64_t now = iotpf_clock_utc_ms();
+  iotpf_rec_t rec;
+
+  iotpf_rec_begin(&rec, IOTPF_REC_HEARTBEAT, buf, size);
+  iotpf_rec_uint(&rec, IOTPF_REC_HEARTBEAT_SEQ, g_heartbeat_seq++);
+  iotpf_rec_uint(&rec, IOTPF_REC_HEARTBEAT_UP, cissys_gettime() / 1000);
+  if (now != 0)
+    {
+      iotpf_rec_uint(&rec, IOTPF_REC_HEARTBEAT_TIME, now);
+    }
+  return iotpf_rec_end(&rec);
+}
+
+#ifdef CIS_BENCH
+/* A NULL payload asks the pump for one object notification round */
+
+static void user_bench_send(void *priv, const void *data, uint32_t data_len,
+                            bool alarm)
+{
+  user_thread_context_t *utc = (user_thread_context_t *)priv;
+  user_data_info_t udi;
+
+  if (data != NULL)
+    {
+      send_data_to_server(utc, (void *)data, data_len,
+                          alarm ? IOTPF_REL_ALARM : IOTPF_REL_TELEMETRY);
+      return;
+    }
+
+  udi.data = NULL;
+  udi.data_len = 0;
+  file_write(&utc->send_pipe_file, &udi, sizeof(user_data_info_t));
+}
+#endif
+
+#ifdef CIS_BLOCKWISE
+typedef struct user_block_xfer_s
+{
+  user_thread_context_t *utc;
+  user_data_info_t *udi;
+} user_block_xfer_t;
+
+static int user_block_read(void *priv, uint32_t offset,
+                           uint8_t *buf, uint32_t len)
+{
+  user_block_xfer_t *xfer = (user_block_xfer_t *)priv;
+
+  memcpy(buf, (uint8_t *)xfer->udi->data + offset, len);
+  return len;
+}
+
+static int user_block_send(void *priv, const uint8_t *frame, uint32_t len)
+{
+  user_block_xfer_t *xfer = (user_block_xfer_t *)priv;
+  uint32_t start = cissys_gettime();
+  uint32_t spent;
+  uint32_t ticket;
+  bool ok;
+  int ret;
+
+  /* Every block is confirmable and answered on its own */
+
+  user_exchange_begin();
+  user_ack_sending();
+  ret = cis_notify_raw(xfer->utc->context, frame, len);
+  if (ret != CIS_RET_OK)
+    {
+      user_ack_unsent();
+      cisapi_user_exchange_end();
+      return ret;
+    }
+
+  /* Have the pump schedule its retransmissions now rather than on its
+   * next wakeup. Nothing else goes out meanwhile, so the next answer is
+   * this block's.
+   */
+
+  cisapi_wakeup_pump();
+  IOTPF_STAT_INC(wakeups);
+
+  pthread_mutex_lock(&g_exchange_mutex);
+  ticket = g_acks_sent;
+  while ((int32_t)(g_acks_done - ticket) < 0 &&
+         (spent = cissys_gettime() - start) < USER_BLOCK_ACK_MS)
+    {
+      user_exchange_wait(USER_BLOCK_ACK_MS - spent);
+    }
+
+  ok = (int32_t)(g_acks_done - ticket) >= 0 && g_ack_ok;
+  pthread_mutex_unlock(&g_exchange_mutex);
+  return ok ? CIS_RET_OK : CIS_RET_ERROR;
+}
+
+/* A plain uplink starting with a reserved byte gets the escape byte, the
+ * server would otherwise take it for a block frame
+ */
+
+static int user_block_escape(user_data_info_t *udi)
+{
+  uint8_t *frame;
+
+  if (udi->data_len == 0 ||
+      !IOTPF_BLOCK_RESERVED(((uint8_t *)udi->data)[0]))
+    {
+      return CIS_RET_OK;
+    }
+
+  frame = (uint8_t *)malloc(udi->data_len + 1);
+  if (frame == NULL)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  frame[0] = IOTPF_BLOCK_TAG_ESC;
+  memcpy(frame + 1, udi->data, udi->data_len);
+  free(udi->data);
+  udi->data = frame;
+  udi->data_len++;
+  return CIS_RET_OK;
+}
+#endif
+
+#ifdef CIS_COMPRESS
+/* Swaps the payload for its compressed frame */
+
+static int user_compress(user_data_info_t *udi)
+{
+  uint8_t *frame = (uint8_t *)malloc(IOTPF_COMP_BOUND(udi->data_len));
+
+  if (frame == NULL)
+    {
+      return CIS_RET_ERROR;
+    }
+
+  IOTPF_STAT_ADD(comp_in, udi->data_len);
+  g_raw_next = g_raw_comp;
+  udi->data_len = iotpf_comp_encode(&g_raw_next, udi->data, udi->data_len,
+                                    frame);
+  IOTPF_STAT_ADD(comp_out, udi->data_len);
+  free(udi->data);
+  udi->data = frame;
+  return CIS_RET_OK;
+}
+#endif
+
 void cisapi_send_data_to_server(user_thread_context_t *utc)
 {
   user_data_info_t udi;
+  bool blockwise = false;
+  bool con = true;
+  int ret;
 
   read(utc->send_pipe_fd[0], &udi, sizeof(user_data_info_t));
+  if (udi.data == NULL)
+    {
+      return;
+    }
+  iotpf_pm_stay(IOTPF_PM_UPLINK);
+
+  DLOGI("user_thread: send data %u bytes", udi.data_len);
+#ifdef CIS_COMPRESS
+  if (user_compress(&udi) != CIS_RET_OK)
+    {
+      ret = CIS_RET_ERROR;
+    }
+  else
+#endif
+#ifdef CIS_BLOCKWISE
+  if (udi.data_len > IOTPF_BLOCK_SIZE(CONFIG_SERVICES_IOTPF_BLOCK_SZX))
+    {
+      user_block_xfer_t xfer;
+
+      xfer.utc = utc;
+      xfer.udi = &udi;
+      blockwise = true;
+      ret = iotpf_block_send(CONFIG_SERVICES_IOTPF_BLOCK_SZX, udi.data_len,
+                             user_block_read, user_block_send, &xfer);
+    }
+  else if (user_block_escape(&udi) != CIS_RET_OK)
+    {
+      ret = CIS_RET_ERROR;
+    }
+  else
+#endif
+    {
+#ifdef CIS_HAVE_NOTIFY_RAW_ACK
+      con = iotpf_rel_confirm(&g_raw_rel, udi.rel);
+#endif
+      iotpf_bench_sending(con);
+      if (con)
+        {
+          user_ack_sending();
+        }
+#ifdef CIS_HAVE_NOTIFY_RAW_ACK
+      ret = cis_notify_raw_ack(utc->context, udi.data, udi.data_len, con);
+#else
+      ret = cis_notify_raw(utc->context, udi.data, udi.data_len);
+#endif
+      if (con && ret != CIS_RET_OK)
+        {
+          user_ack_unsent();
+        }
+    }
+
+  iotpf_bench_sent(ret == CIS_RET_OK, con);
+  if (ret == CIS_RET_OK)
+    {
+#ifdef CIS_COMPRESS
+      g_raw_comp = g_raw_next;
+#endif
+      IOTPF_STAT_INC(uplinks_sent);
+      IOTPF_STAT_ADD(bytes_up, udi.data_len);
+      user_uplinked();
+    }
+  else
+    {
+      IOTPF_STAT_INC(uplinks_failed);
+    }
+
+  /* A confirmable uplink stays in flight until its answer; a blockwise
+   * one is then tracked per block
+   */
+
+  if (ret != CIS_RET_OK || !con || blockwise)
+    {
+      cisapi_user_exchange_end();
+    }
 
-  LOGI("user_thread: send data %d bytes", udi.data_len);
-  cis_notify_raw(utc->context, udi.data, udi.data_len);
   free(udi.data);
+  iotpf_pm_relax(IOTPF_PM_UPLINK);
 }
 
 void cisapi_recv_data_from_server(user_thread_context_t *utc,
@@ -97,6 +678,7 @@ void cisapi_recv_data_from_server(user_thread_context_t *utc,
 {
   user_data_info_t udi;
 
+  memset(&udi, 0, sizeof(udi));
   udi.data = (uint8_t*)malloc(data_len);
   if (udi.data == NULL)
     {
@@ -105,26 +687,56 @@ void cisapi_recv_data_from_server(user_thread_context_t *utc,
   udi.data_len = data_len;
   memcpy(udi.data, data, data_len);
   write(utc->recv_pipe_fd[1], &udi, sizeof(user_data_info_t));
+  IOTPF_STAT_INC(downlinks);
+  IOTPF_STAT_ADD(bytes_down, data_len);
+}
+
+#ifdef CIS_BLOCKWISE
+/* One block of a block-wise downlink, passed on as it arrives; only the
+ * last one counts as a downlink
+ */
+
+int cisapi_recv_block_from_server(user_thread_context_t *utc,
+                                  uint32_t offset, const void *data,
+                                  uint32_t data_len, bool more)
+{
+  user_data_info_t udi;
+
+  memset(&udi, 0, sizeof(udi));
+  udi.data = (uint8_t *)malloc(data_len);
+  if (udi.data == NULL)
+    {
+      return CIS_RET_ERROR;
+    }
+  udi.data_len = data_len;
+  udi.block = true;
+  udi.more = more;
+  udi.offset = offset;
+  memcpy(udi.data, data, data_len);
+  write(utc->recv_pipe_fd[1], &udi, sizeof(user_data_info_t));
+  if (!more)
+    {
+      IOTPF_STAT_INC(downlinks);
+    }
+  IOTPF_STAT_ADD(bytes_down, data_len);
+  return data_len;
 }
+#endif
 
 static void recv_data_from_server(user_thread_context_t *utc)
 {
   user_data_info_t udi;
-  char *buf = NULL;
-  int bufLen = 0;
-  int i;
 
   file_read(&utc->recv_pipe_file, &udi, sizeof(user_data_info_t));
-
-  buf = (char *)malloc(2 * udi.data_len + 1);
-  memset(buf, 0x0, 2 * udi.data_len + 1);
-  for (i = 0; i < udi.data_len; i++)
+  if (udi.block)
     {
-      bufLen += snprintf(buf + bufLen, 2 * udi.data_len + 1 - bufLen, "%02X", ((char *)(udi.data))[i]);
+      DLOGI("user_thread: recv block at %u, %u bytes, more %u",
+            udi.offset, udi.data_len, udi.more);
+    }
+  else
+    {
+      DLOGI_HEX("user_thread: recv data: %u,", udi.data, udi.data_len);
     }
-  LOGI("user_thread: recv data: %d,%s.", udi.data_len, buf);
-
-  free(buf);
   free(udi.data);
 }
 
@@ -136,16 +748,14 @@ static void heartbeat_callback(union sigval value)
 static void heartbeat_callback(FAR void *sival_ptr)
 #endif
 {
-  uint8_t data[6] = {0x05, 0x40, 0x41, 0x42, 0x43, 0x44};
-
 #ifdef CONFIG_CAN_PASS_STRUCTS
-  user_thread_context_t *utc = (user_thread_context_t *)value.sival_int;
+  user_thread_context_t *utc = (user_thread_context_t *)value.sival_ptr;
 #else
   user_thread_context_t *utc = (user_thread_context_t *)sival_ptr;
 #endif
 
-  LOGI("@@@@@@@@@@@ heartbeat callback utc: 0x%x and send heartbeat @@@@@@@@@@@", (unsigned int)utc);
-  send_data_to_server(utc, data, sizeof(data));
+  DLOGI("@@@@@@@@@@@ heartbeat callback utc: 0x%x and send heartbeat @@@@@@@@@@@", (unsigned int)(uintptr_t)utc);
+  send_record_to_server(utc, user_heartbeat_encode, IOTPF_REL_TELEMETRY);
 }
 
 static timer_t create_heartbeat_timer(user_thread_context_t *utc)
@@ -155,13 +765,13 @@ static timer_t create_heartbeat_timer(user_thread_context_t *utc)
   struct sigevent notify;
   struct itimerspec timer;
 
-  LOGI("@@@@@@@@@@@ Create heartbeat timer utc 0x%x @@@@@@@@@@@@", (unsigned int)utc);
+  LOGI("@@@@@@@@@@@ Create heartbeat timer utc %p @@@@@@@@@@@@", utc);
 
   file_detach(utc->send_pipe_fd[1], &utc->send_pipe_file);
 
   notify.sigev_notify            = SIGEV_THREAD;
   notify.sigev_signo             = HEARTBEAT_TIMER_SIGNAL;
-  notify.sigev_value.sival_int   = (int)utc;
+  notify.sigev_value.sival_ptr   = utc;
   notify.sigev_notify_function   = (void *)heartbeat_callback;
   notify.sigev_notify_attributes = NULL;
 
@@ -195,8 +805,46 @@ static void destroy_heartbeat_timer(timer_t timerid)
 
 static void disconnect_from_server(user_thread_context_t *utc)
 {
+#ifdef CIS_PSM
+  /* Registration and the session survive PSM; once the last answer is
+   * in there is no reason to keep RRC up for the network's inactivity
+   * timer
+   */
+
+  if (g_psm)
+    {
+      bool drained;
+
+      pthread_mutex_lock(&g_exchange_mutex);
+      drained = user_exchange_drain(CONFIG_SERVICES_IOTPF_PSM_LINGER * 1000);
+      pthread_mutex_unlock(&g_exchange_mutex);
+      if (!drained)
+        {
+          LOGW("psm: releasing with exchanges still in flight");
+        }
+      iotpf_psm_release();
+      LOGI("Released the radio!");
+      return;
+    }
+#endif
+
+  /* The core drops whatever is still in flight with the session */
+
+  pthread_mutex_lock(&g_exchange_mutex);
+  g_exchanges = 0;
+#ifdef CIS_BLOCKWISE
+  g_acks_done = g_acks_sent;
+  g_ack_ok = false;
+  pthread_cond_broadcast(&g_exchange_cond);
+#endif
+#ifdef CIS_STATS
+  g_ack_count = 0;
+  g_ack_untimed = false;
+#endif
+  pthread_mutex_unlock(&g_exchange_mutex);
   core_updatePumpState(utc->context, PUMP_STATE_DISCONNECTED);
   cisapi_wakeup_pump();
+  IOTPF_STAT_INC(wakeups);
   sleep(5);
   ciscom_setRadioPower(false);
   LOGI("Disconnect from server!");
@@ -204,24 +852,79 @@ static void disconnect_from_server(user_thread_context_t *utc)
 
 static void connect_to_server(user_thread_context_t *utc)
 {
+#ifdef CIS_STATS
+  pthread_mutex_lock(&g_exchange_mutex);
+  g_resume_start = cissys_gettime();
+  g_resuming = true;
+  pthread_mutex_unlock(&g_exchange_mutex);
+#endif
+#ifdef CIS_PSM
+  if (g_psm)
+    {
+      /* The next uplink wakes the modem out of PSM by itself */
+
+      LOGI("Resume to server !");
+      return;
+    }
+#endif
+
   ciscom_setRadioPower(true);
   while (!ciscom_isRegistered(ciscom_getRegisteredStaus())) {
       LOGI("############## CEREG not ready #################");
       sleep(1);
   }
   cisapi_wakeup_pump();
+  IOTPF_STAT_INC(wakeups);
   sleep(5);
   LOGI("Connect to server !");
 }
 
+/* NMEA ddmm.mmmm or dddmm.mmmm, and its hemisphere, to micro degrees */
+
+static int32_t nmea_udeg(const char *s, const char *hemi)
+{
+  uint32_t whole = 0;
+  uint32_t frac = 0;
+  int32_t udeg;
+  int digits = 0;
+
+  while (*s >= '0' && *s <= '9')
+    {
+      whole = whole * 10 + *s++ - '0';
+    }
+
+  if (*s == '.')
+    {
+      while (*++s >= '0' && *s <= '9')
+        {
+          if (digits < 5)
+            {
+              frac = frac * 10 + *s - '0';
+              digits++;
+            }
+        }
+    }
+
+  while (digits++ < 5)
+    {
+      frac *= 10;
+    }
+
+  /* frac is in 1e-5 minutes now, a sixth of that is a micro degree */
+
+  udeg = whole / 100 * 1000000 + (whole % 100 * 100000 + frac) / 6;
+  return *hemi == 'S' || *hemi == 'W' ? -udeg : udeg;
+}
+
 static void handle_gprmc(const char *s)
 {
+  uint64_t mono = iotpf_clock_mono_ms();
   int ret;
   char *p;
   char *ignore;
   bool ready = false;
   char *line = (char *)s;
-  char *p_longitude, *p_latitude, *p_time, *p_date;
+  char *p_longitude, *p_latitude, *p_time, *p_date, *p_ns, *p_ew;
 
   ret = at_tok_nextstr(&line, &p);
   if (ret < 0)
@@ -240,17 +943,16 @@ static void handle_gprmc(const char *s)
       return;
     }
 
-  if (*p == 'A' || *p == 'V') // If outside, just check p = 'A'
-    {
-      ready = true;
-    }
+  /* 'V' is a receiver still searching, with a stale or empty position */
+
+  ready = *p == 'A';
   ret = at_tok_nextstr(&line, &p_latitude);
   if (ret < 0)
     {
       return;
     }
 
-  ret = at_tok_nextstr(&line, &p);
+  ret = at_tok_nextstr(&line, &p_ns);
   if (ret < 0)
     {
       return;
@@ -262,7 +964,7 @@ static void handle_gprmc(const char *s)
       return;
     }
 
-  ret = at_tok_nextstr(&line, &ignore);
+  ret = at_tok_nextstr(&line, &p_ew);
   if (ret < 0)
     {
       return;
@@ -286,52 +988,113 @@ static void handle_gprmc(const char *s)
       return;
     }
 
-  if (ready)
+  if (ready && strlen(p_time) >= 6 && strlen(p_date) >= 6)
     {
-      struct tm t;
-      time_t seconds;
+      int sec, min, hour, day, mon, year;
       uint64_t mSeconds;
       char buf[4] = {0};
+      int scale = 100;
+      int ms = 0;
+      int i;
 
       strncpy(buf, p_time + 4, 2);
-      t.tm_sec = atoi(buf);
+      sec = atoi(buf);
       strncpy(buf, p_time + 2, 2);
-      t.tm_min = atoi(buf);
+      min = atoi(buf);
       strncpy(buf, p_time, 2);
-      t.tm_hour = atoi(buf);
+      hour = atoi(buf);
       strncpy(buf, p_date, 2);
-      t.tm_mday = atoi(buf);
+      day = atoi(buf);
       strncpy(buf, p_date + 2, 2);
-      t.tm_mon = atoi(buf);
-      t.tm_mon -= 1;
+      mon = atoi(buf);
       strncpy(buf, p_date + 4, 2);
-      t.tm_year = atoi(buf) + 100;
-      seconds = mktime(&t);
-      strncpy(buf, p_time + 7, 2);
-      mSeconds = (uint64_t)(seconds) * 1000 + atoi(buf);
+      year = atoi(buf) + 2000;
+
+      /* hhmmss.sss, receivers give anything from none to three decimals */
+
+      for (i = 7; p_time[6] == '.' && scale > 0 &&
+                  p_time[i] >= '0' && p_time[i] <= '9'; i++, scale /= 10)
+        {
+          ms += (p_time[i] - '0') * scale;
+        }
+
+      mSeconds = iotpf_clock_civil_ms(year, mon, day, hour, min, sec, ms);
+      iotpf_clock_reference(IOTPF_CLOCK_GPS, mSeconds, mono);
+
       pthread_mutex_lock(&g_gps_mutex);
-      sprintf(g_gps_data, "%s,%s,%s,%s,%013llu,%u",
-              p_time, p_latitude, p_longitude, p_date, mSeconds, seconds);
+#ifdef CIS_STATS
+      IOTPF_STAT_INC(gps_fixes);
+      if (!g_gps_fixed)
+        {
+          uint32_t ttff = cissys_gettime() - g_gps_start;
+
+          g_gps_fixed = true;
+          IOTPF_STAT_INC(gps_ttff_count);
+          IOTPF_STAT_SET(gps_ttff_last_ms, ttff);
+          IOTPF_STAT_ADD(gps_ttff_total_ms, ttff);
+          IOTPF_HIST_ADD(gps_ttff_ms, ttff);
+        }
+#endif
+      g_gps_fix.time_ms = mSeconds;
+      g_gps_fix.lat = nmea_udeg(p_latitude, p_ns);
+      g_gps_fix.lon = nmea_udeg(p_longitude, p_ew);
+      g_gps_fix.valid = true;
       pthread_cond_signal(&g_gps_cond);
       pthread_mutex_unlock(&g_gps_mutex);
     }
 }
 
+/* +CTZE: <tz>,<dst>,"yy/MM/dd,hh:mm:ss" with the time in UTC, sent on
+ * network time updates once the modem has AT+CTZR=2
+ */
+
+static void handle_ctze(const char *s)
+{
+  uint64_t mono = iotpf_clock_mono_ms();
+  char *line = (char *)s;
+  char *p;
+  int year, mon, day, hour, min, sec;
+
+  if (at_tok_start(&line) < 0 ||
+      at_tok_nextstr(&line, &p) < 0 ||       /* tz */
+      at_tok_nextstr(&line, &p) < 0 ||       /* dst */
+      at_tok_nextstr(&line, &p) < 0 ||
+      sscanf(p, "%d/%d/%d,%d:%d:%d", &year, &mon, &day, &hour, &min,
+             &sec) != 6)
+    {
+      return;
+    }
+
+  if (year < 100)
+    {
+      year += 2000;
+    }
+
+  iotpf_clock_reference(IOTPF_CLOCK_NET,
+                        iotpf_clock_civil_ms(year, mon, day, hour, min,
+                                             sec, 0), mono);
+}
+
 static void do_gps_capture(int fd)
 {
-  pthread_mutex_init(&g_gps_mutex, NULL);
-  pthread_cond_init(&g_gps_cond, NULL);
+  iotpf_pm_stay(IOTPF_PM_GPS);
+#ifdef CIS_STATS
+  g_gps_start = cissys_gettime();
+  g_gps_fixed = false;
+  IOTPF_STAT_INC(gps_starts);
+#endif
   start_gps(fd, false);
 
   // you can do your gps job here, for example caputure gps data for 10 minutes
   pthread_mutex_lock(&g_gps_mutex);
   pthread_cond_wait(&g_gps_cond, &g_gps_mutex);
-  LOGI("@@@@@@@@@@ gps data = %s @@@@@@@@@@@@@", g_gps_data);
+  LOGI("@@@@@@@@@@ gps fix = %llu ms, %ld %ld udeg @@@@@@@@@@@@@",
+       (unsigned long long)g_gps_fix.time_ms, (long)g_gps_fix.lat,
+       (long)g_gps_fix.lon);
   pthread_mutex_unlock(&g_gps_mutex);
 
   stop_gps(fd);
-  pthread_mutex_destroy(&g_gps_mutex);
-  pthread_cond_destroy(&g_gps_cond);
+  iotpf_pm_relax(IOTPF_PM_GPS);
 }
 
 void *cisapi_user_send_thread(void *obj)
@@ -348,8 +1111,6 @@ void *cisapi_user_send_thread(void *obj)
       LOGI("[%s]iotpf_mode is 1, means update process, so return user send thread", __func__);
       return NULL;
     }
-  uint8_t data[6] = {0x05, 0x31, 0x32, 0x33, 0x34, 0x35};
-
   pthread_mutex_init(&g_exit_mutex, NULL);
   pthread_setname_np(pthread_self(), "cisapi_user_send_thread");
   pthread_detach(pthread_self());
@@ -357,8 +1118,25 @@ void *cisapi_user_send_thread(void *obj)
   LOGI("entering into user send thread send_pipe = %d", utc->send_pipe_fd[1]);
   file_detach(utc->send_pipe_fd[1], &utc->send_pipe_file);
 
+#ifdef CIS_BENCH
+  if (utc->iotpf_mode == IOTPF_MODE_BENCH)
+    {
+      iotpf_bench_run(user_bench_send, utc);
+      return NULL;
+    }
+#endif
+
   at_fd = ciscom_getATHandle();
   register_indication(at_fd, "$GPRMC", handle_gprmc);
+  register_indication(at_fd, "+CTZE", handle_ctze);
+#ifdef CIS_PSM
+  g_psm = iotpf_psm_enable() == CIS_RET_OK;
+#endif
+#ifdef CIS_QUEUE_MODE
+  pthread_mutex_lock(&g_exchange_mutex);
+  iotpf_queue_init(&g_queue);
+  pthread_mutex_unlock(&g_exchange_mutex);
+#endif
 
   while (1)
     {
@@ -370,8 +1148,12 @@ void *cisapi_user_send_thread(void *obj)
         }
       pthread_mutex_unlock(&g_exit_mutex);
 
-      send_data_to_server(utc, data, sizeof(data));
+      send_record_to_server(utc, user_report_encode, IOTPF_REL_TELEMETRY);
+#ifdef CIS_QUEUE_MODE
+      user_listen();
+#else
       sleep(REPORT_INTERVAL);
+#endif
 #if CIS_ENABLE_UPDATE
       pthread_mutex_lock(get_nb_gps_mutex());
       LOGI("[%s]mutex_lock", __func__);
@@ -37,12 +37,18 @@
 
 #include <nuttx/fs/fs.h>
 
+#include "iotpf_rel.h"
+
 #if CIS_ONE_MCU && CIS_OPERATOR_CTCC
 
 typedef struct user_data_info_s
 {
   void *data;
   uint32_t data_len;
+  uint8_t rel;            /* iotpf_rel_class_t */
+  uint8_t block;          /* downlink: data is one block of a payload */
+  uint8_t more;           /* ...and not its last */
+  uint32_t offset;        /* ...at this offset into the payload */
 } user_data_info_t;
 
 typedef struct user_thread_context_s
@@ -58,8 +64,17 @@ typedef struct user_thread_context_s
 void cisapi_send_data_to_server(user_thread_context_t *utc);
 void cisapi_recv_data_from_server(user_thread_context_t *utc,
                                   const void *data, uint32_t data_len);
+#ifdef CIS_BLOCKWISE
+int cisapi_recv_block_from_server(user_thread_context_t *utc,
+                                  uint32_t offset, const void *data,
+                                  uint32_t data_len, bool more);
+#endif
 void *cisapi_user_send_thread(void *obj);
 void *cisapi_user_recv_thread(void *obj);
+void cisapi_user_exchange_end(void);
+void cisapi_user_acked(bool ok);
+void cisapi_user_downlink(void);
+void cisapi_user_registered(void);
 
 #endif
 
@@ -48,7 +48,8 @@ const object_callback_mapping g_object_callback_mapping [] = {
     light_control_observe,
     light_control_notify,
     light_control_clean,
-    light_control_make_sample_data
+    light_control_make_sample_data,
+    light_control_acked
   },
 };
 
@@ -37,6 +37,7 @@
 #include "cis_log.h"
 #include "cis_if_api_ctcc.h"
 #include "object_light_control.h"
+#include "iotpf_stats.h"
 
 static cis_list_t *light_control_inst;
 static st_observe_info *light_control_observe_list = NULL;
@@ -417,6 +418,8 @@ uint8_t light_control_observe(void *context, cis_uri_t *uri, bool flag, cis_mid_
       observe_new->mid = mid;
       memcpy(&(observe_new->uri), uri, sizeof(cis_uri_t));
       observe_new->next = NULL;
+      observe_new->notified = 0;
+      iotpf_rel_init(&observe_new->rel, IOTPF_REL_TELEMETRY);
       light_control_observe_list = (st_observe_info*)cis_list_add((cis_list_t*)light_control_observe_list, (cis_list_t*)observe_new);
 
       LOGD("light_control_observe set:%d/%d/%d",
@@ -468,6 +471,7 @@ void light_control_notify(void *context)
   cis_data_t cisData;
   cis_list_t *pInstNode;
   int nbRes = sizeof(g_resList) / sizeof(uint16_t);
+  bool needAck;
   int i;
 
   while (node != NULL)
@@ -487,6 +491,12 @@ void light_control_notify(void *context)
         node->uri.objectId,
         CIS_URI_IS_SET_INSTANCE(&node->uri) ? node->uri.instanceId : -1,
         CIS_URI_IS_SET_RESOURCE(&node->uri) ? node->uri.resourceId : -1);
+      IOTPF_STAT_INC(notifies);
+      needAck = iotpf_rel_confirm(&node->rel, IOTPF_REL_TELEMETRY);
+      if (needAck && node->notified == 0)
+        {
+          node->notified = cissys_gettime();
+        }
       if (!CIS_URI_IS_SET_INSTANCE(&uri) && !CIS_URI_IS_SET_RESOURCE(&uri))
         {
           while (pInstNode)
@@ -500,11 +510,11 @@ void light_control_notify(void *context)
                   cis_uri_update(&uri);
                   if (i < nbRes - 1)
                     {
-                      cis_notify(context, &uri, &cisData, node->mid, CIS_NOTIFY_CONTINUE, false);
+                      cis_notify(context, &uri, &cisData, node->mid, CIS_NOTIFY_CONTINUE, needAck);
                     }
                   else
                     {
-                      cis_notify(context, &uri, &cisData, node->mid, CIS_NOTIFY_CONTENT, false);
+                      cis_notify(context, &uri, &cisData, node->mid, CIS_NOTIFY_CONTENT, needAck);
                     }
                 }
               pInstNode = pInstNode->next;
@@ -526,11 +536,11 @@ void light_control_notify(void *context)
                       cis_uri_update(&uri);
                       if (i < nbRes - 1)
                         {
-                          cis_notify(context, &uri, &cisData, node->mid, CIS_NOTIFY_CONTINUE, false);
+                          cis_notify(context, &uri, &cisData, node->mid, CIS_NOTIFY_CONTINUE, needAck);
                         }
                       else
                         {
-                          cis_notify(context, &uri, &cisData, node->mid, CIS_NOTIFY_CONTENT, false);
+                          cis_notify(context, &uri, &cisData, node->mid, CIS_NOTIFY_CONTENT, needAck);
                         }
                       }
                   }
@@ -545,7 +555,7 @@ void light_control_notify(void *context)
                 {
                   light_control_get_value(context, &cisData, (light_control_data_t *)pInstNode,
                     uri.resourceId);
-                  cis_notify(context, &uri, &cisData, node->mid, CIS_NOTIFY_CONTENT, false);
+                  cis_notify(context, &uri, &cisData, node->mid, CIS_NOTIFY_CONTENT, needAck);
                 }
               pInstNode = pInstNode->next;
             }
@@ -554,6 +564,32 @@ void light_control_notify(void *context)
     }
 }
 
+/* One notification at a time per observe is timed, a newer one sent
+ * before the ACK is left out
+ */
+
+bool light_control_acked(void *context, cis_mid_t mid, bool ok)
+{
+  st_observe_info *node;
+
+  node = (st_observe_info *)CIS_LIST_FIND(light_control_observe_list, mid);
+  if (node == NULL)
+    {
+      return false;
+    }
+
+  if (node->notified != 0)
+    {
+      if (ok)
+        {
+          IOTPF_HIST_ADD(notify_ms, cissys_gettime() - node->notified);
+        }
+      node->notified = 0;
+    }
+
+  return true;
+}
+
 void light_control_clean(void *contextP)
 {
   light_control_data_t *deleteInst;
@@ -48,6 +48,7 @@ uint8_t light_control_read(void *context, cis_uri_t *uri, cis_mid_t mid);
 uint8_t light_control_observe(void *context, cis_uri_t *uri, bool flag, cis_mid_t mid);
 uint8_t light_control_write(void *context, cis_uri_t *uri, const cis_data_t *value, cis_attrcount_t attrcount, cis_mid_t mid);
 void light_control_notify(void *context);
+bool light_control_acked(void *context, cis_mid_t mid, bool ok);
 void light_control_clean(void *contextP);
 cis_ret_t light_control_make_sample_data(void *contextP);
 